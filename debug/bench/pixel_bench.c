@@ -0,0 +1,129 @@
+#include "../../include/pixel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Checks every pixel kernel the host CPU supports against the old per pixel decode
+ * and against each other on random tile rows, then times them on a scanline worth of
+ * tiles. Build it with 'make pixel_bench', it exits with 1 if any kernel disagrees */
+
+#define CHECK_ITERATIONS    100000
+#define MAX_ROWS            32              /* Decoded at once in a check */
+#define LINE_TILES          21              /* Tiles touched by a scanline with SCX scrolling */
+#define EXPAND_ITERATIONS   2000000
+#define DECODE_ITERATIONS   5000000
+
+static uint16_t decodeRowReference(uint8_t low, uint8_t high, bool flipped) {
+    /* How the PPU used to read a tile row, 1 pixel at a time straight from the bitplanes */
+    uint16_t row = 0;
+
+    for (int x = 0; x < 8; x++) {
+        uint8_t bit = flipped ? x : 7 - x;
+        uint8_t colorID = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+
+        row |= colorID << (x * 2);
+    }
+    return row;
+}
+
+static double getSeconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool checkKernels(const PixelKernels** kernels, int count) {
+    uint8_t tileData[MAX_ROWS * 2];
+    uint16_t expectedRows[MAX_ROWS], expectedFlippedRows[MAX_ROWS];
+    uint16_t rows[MAX_ROWS], flippedRows[MAX_ROWS];
+    uint32_t palettes[8][4];
+    uint8_t paletteIndices[MAX_ROWS];
+    uint32_t expectedPixels[MAX_ROWS * 8], pixels[MAX_ROWS * 8];
+
+    srand(1);
+
+    for (int i = 0; i < CHECK_ITERATIONS; i++) {
+        int rowCount = 1 + rand() % MAX_ROWS;
+
+        for (int j = 0; j < MAX_ROWS * 2; j++) tileData[j] = rand();
+        for (int j = 0; j < 8 * 4; j++) palettes[j / 4][j % 4] = ((uint32_t)rand() << 16) ^ rand();
+        for (int j = 0; j < MAX_ROWS; j++) paletteIndices[j] = rand() % 8;
+
+        for (int row = 0; row < rowCount; row++) {
+            expectedRows[row] = decodeRowReference(tileData[row * 2], tileData[(row * 2) + 1], false);
+            expectedFlippedRows[row] = decodeRowReference(tileData[row * 2], tileData[(row * 2) + 1], true);
+        }
+
+        /* The scalar expand is the reference for the others */
+        kernels[0]->expandTileRows(expectedRows, paletteIndices, (const uint32_t (*)[4])palettes,
+                                   expectedPixels, rowCount);
+
+        for (int k = 0; k < count; k++) {
+            kernels[k]->decodeTileRows(tileData, rows, flippedRows, rowCount);
+
+            if (memcmp(rows, expectedRows, rowCount * sizeof(uint16_t)) != 0 ||
+                    memcmp(flippedRows, expectedFlippedRows, rowCount * sizeof(uint16_t)) != 0) {
+                printf("Error : %s decodeTileRows doesnt match the reference (%d rows)\n",
+                       kernels[k]->name, rowCount);
+                return false;
+            }
+
+            kernels[k]->expandTileRows(rows, paletteIndices, (const uint32_t (*)[4])palettes,
+                                       pixels, rowCount);
+
+            if (memcmp(pixels, expectedPixels, rowCount * 8 * sizeof(uint32_t)) != 0) {
+                printf("Error : %s expandTileRows doesnt match scalar (%d rows)\n",
+                       kernels[k]->name, rowCount);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void benchKernel(const PixelKernels* kernels) {
+    uint8_t tileData[16] = { 0 };
+    uint16_t rows[LINE_TILES] = { 0 }, flippedRows[8];
+    uint32_t palettes[8][4] = { { 0 } };
+    uint8_t paletteIndices[LINE_TILES] = { 0 };
+    uint32_t line[LINE_TILES * 8];
+    volatile uint32_t sink = 0;
+
+    /* The input changes every iteration so the work cant be hoisted out of the loop */
+    double start = getSeconds();
+    for (int i = 0; i < EXPAND_ITERATIONS; i++) {
+        rows[i % LINE_TILES] ^= i;
+        kernels->expandTileRows(rows, paletteIndices, (const uint32_t (*)[4])palettes, line, LINE_TILES);
+        sink += line[i % (LINE_TILES * 8)];
+    }
+    double expandTime = (getSeconds() - start) / EXPAND_ITERATIONS;
+
+    start = getSeconds();
+    for (int i = 0; i < DECODE_ITERATIONS; i++) {
+        tileData[i & 15] ^= i;
+        kernels->decodeTileRows(tileData, rows, flippedRows, 8);
+        sink += rows[i & 7];
+    }
+    double decodeTime = (getSeconds() - start) / DECODE_ITERATIONS;
+
+    printf("%-8s expand %3d tile line : %7.1f ns, decode tile : %6.1f ns\n",
+           kernels->name, LINE_TILES, expandTime * 1e9, decodeTime * 1e9);
+}
+
+int main() {
+    const PixelKernels* kernels[PIXEL_KERNELS_MAX];
+    int count = getSupportedPixelKernels(kernels);
+
+    printf("Checking");
+    for (int k = 0; k < count; k++) printf(" %s", kernels[k]->name);
+    printf(" on %d random inputs\n", CHECK_ITERATIONS);
+
+    if (!checkKernels(kernels, count)) return 1;
+    printf("All kernels match\n");
+
+    for (int k = 0; k < count; k++) benchKernel(kernels[k]);
+    return 0;
+}
@@ -21,7 +21,7 @@ printString::
     inc hl              ; increment the pointer
     jp .loop            ; loop again
 
-.end
+.end:
     pop af
     ret
 ; ------------------------------------------------------ 
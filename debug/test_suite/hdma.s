@@ -0,0 +1,301 @@
+SECTION "Header", rom0[$100]
+    nop
+    jp main
+    ds $150 - @, 0
+
+INCLUDE "interface.inc"
+
+/* Checks general purpose and HBlank DMA on the CGB. The results are printed
+   over serial, so the emulator has to be built with DEBUG_PRINT_SERIAL_OUTPUT */
+
+DEF GDMA_CHUNKS     EQU 64
+DEF HBLANK_CHUNKS   EQU 8
+DEF STOP_CHUNKS     EQU 16
+DEF STOP_LINE       EQU 2               ; Lines the stopped DMA runs for
+
+main:
+    ld sp, $FFFE
+    call lcdOff
+
+    xor a, a
+    ldh [R_VBK], a                      ; Everything goes to VRAM bank 0
+
+    ld b, 0                             ; The stopped DMA has to leave the rest blank
+    ld de, $9C00
+    ld a, 255
+    call memfill
+
+    call testGDMA
+    call testHBlankDMA
+    call testStopHDMA
+    call testBadSource
+    call lcdOn
+
+    ld hl, sDone
+    call printStringNL
+    jp end
+
+end:
+    di
+    halt
+    jp end
+
+; =============================================================================
+testGDMA:
+    /* Copies everything in one go with the PPU off, HDMA5 reads $FF right after */
+    ld hl, gdmaData
+    ld de, $8000
+    ld a, GDMA_CHUNKS - 1               ; Bit 7 clear is a general purpose DMA
+    call startHDMA
+
+    ldh a, [R_HDMA5]
+    cp a, $FF
+    ld hl, sGDMAStatus
+    call report
+
+    ld hl, gdmaData
+    ld de, $8000
+    ld bc, GDMA_CHUNKS * 16
+    call memcmp
+    ld hl, sGDMACopy
+    call report
+    ret
+
+testHBlankDMA:
+    /* Started in VBlank, one chunk is copied in every HBlank from line 0 on.
+       Printing takes a few lines, so HDMA5 is read first and checked after */
+    call lcdOn
+    call pollVBlank
+
+    ld hl, hblankData
+    ld de, $9800
+    ld a, $80 | (HBLANK_CHUNKS - 1)
+    call startHDMA
+
+    ld b, 1
+    call waitLY
+    ldh a, [R_HDMA5]
+    ld c, a
+
+    ld b, 4
+    call waitLY
+    ldh a, [R_HDMA5]
+    ld d, a
+
+    ld b, HBLANK_CHUNKS
+    call waitLY
+    ldh a, [R_HDMA5]
+    ld e, a
+
+    call lcdOff
+
+    ld a, c
+    cp a, HBLANK_CHUNKS - 2             ; Chunks left - 1, line 0 copied 1
+    ld hl, sHBlankLine1
+    call report
+
+    ld a, d
+    cp a, HBLANK_CHUNKS - 5
+    ld hl, sHBlankLine4
+    call report
+
+    ld a, e
+    cp a, $FF                           ; Done after the last one
+    ld hl, sHBlankDone
+    call report
+
+    ld hl, hblankData
+    ld de, $9800
+    ld bc, HBLANK_CHUNKS * 16
+    call memcmp
+    ld hl, sHBlankCopy
+    call report
+    ret
+
+testStopHDMA:
+    /* Writing HDMA5 with bit 7 clear stops it, it then reads bit 7 set with
+       the chunks that were left and nothing else gets copied */
+    call lcdOn
+    call pollVBlank
+
+    ld hl, stopData
+    ld de, $9C00
+    ld a, $80 | (STOP_CHUNKS - 1)
+    call startHDMA
+
+    ld b, STOP_LINE
+    call waitLY
+    xor a, a
+    ldh [R_HDMA5], a
+    ldh a, [R_HDMA5]
+    ld c, a
+
+    ld b, STOP_LINE + 4
+    call waitLY
+    ldh a, [R_HDMA5]
+    ld d, a
+
+    call lcdOff
+
+    ld a, c
+    cp a, $80 | (STOP_CHUNKS - STOP_LINE - 1)
+    ld hl, sStopStatus
+    call report
+
+    ld a, d
+    cp a, c                             ; HBlanks after it dont change anything
+    ld hl, sStopStays
+    call report
+
+    ld hl, stopData
+    ld de, $9C00
+    ld bc, STOP_LINE * 16
+    call memcmp
+    ld hl, sStopCopy
+    call report
+
+    ld hl, $9C00 + (STOP_LINE * 16)
+    ld b, (STOP_CHUNKS - STOP_LINE) * 16
+    call isBlank
+    ld hl, sStopRest
+    call report
+    ret
+
+testBadSource:
+    /* The DMA cant read VRAM or E000-FFFF, a chunk from either comes out as $FF */
+    ld hl, $8000
+    ld de, $9000
+    xor a, a                            ; 1 chunk
+    call startHDMA
+    ld hl, $E000
+    ld de, $9010
+    xor a, a
+    call startHDMA
+
+    ld hl, $9000
+    ld b, 32
+.check:
+    ld a, [hl+]
+    inc a                               ; Only $FF becomes 0
+    jr nz, .done
+    dec b
+    jr nz, .check
+.done:
+    ld hl, sBadSource
+    call report
+    ret
+
+; =============================================================================
+startHDMA:
+    /* HL : Source
+       DE : Destination
+       A  : HDMA5 */
+    push af
+    ld a, h
+    ldh [R_HDMA1], a
+    ld a, l
+    ldh [R_HDMA2], a
+    ld a, d
+    ldh [R_HDMA3], a
+    ld a, e
+    ldh [R_HDMA4], a
+    pop af
+    ldh [R_HDMA5], a
+    ret
+
+waitLY:
+    /* Waits until LY is B */
+    ldh a, [R_LY]
+    cp a, b
+    jr nz, waitLY
+    ret
+
+lcdOff:
+    push hl
+    call pollVBlank
+    ld hl, R_LCDC
+    res 7, [hl]                         ; VRAM can only be checked with the PPU off
+    pop hl
+    ret
+
+lcdOn:
+    push hl
+    ld hl, R_LCDC
+    set 7, [hl]
+    pop hl
+    ret
+
+memcmp:
+    /* HL : First
+       DE : Second
+       BC : Size
+       Z is set if they are the same */
+.loop:
+    ld a, [de]
+    cp a, [hl]
+    ret nz
+    inc hl
+    inc de
+    dec bc
+    ld a, b
+    or a, c
+    jr nz, .loop
+    ret
+
+isBlank:
+    /* HL : Address
+       B  : Size
+       Z is set if its all 0 */
+    ld a, [hl+]
+    and a, a
+    ret nz
+    dec b
+    jr nz, isBlank
+    ret
+
+report:
+    /* Prints the name in HL and whether the check passed, Z is set if it did */
+    push af
+    call printString
+    pop af
+    ld hl, sPass
+    jr z, .print
+    ld hl, sFail
+.print:
+    call printStringNL
+    ret
+
+SECTION "ReadOnly", rom0
+
+sGDMAStatus:    db "GDMA HDMA5 : ", 0
+sGDMACopy:      db "GDMA copy : ", 0
+sHBlankLine1:   db "HBlank DMA line 1 : ", 0
+sHBlankLine4:   db "HBlank DMA line 4 : ", 0
+sHBlankDone:    db "HBlank DMA done : ", 0
+sHBlankCopy:    db "HBlank DMA copy : ", 0
+sStopStatus:    db "HBlank DMA stop HDMA5 : ", 0
+sStopStays:     db "HBlank DMA stays stopped : ", 0
+sStopCopy:      db "HBlank DMA stop copy : ", 0
+sStopRest:      db "HBlank DMA stop rest : ", 0
+sBadSource:     db "VRAM and echo sources : ", 0
+sPass:          db "ok", 0
+sFail:          db "FAIL", 0
+sDone:          db "Done", 0
+
+SECTION "HDMA Data", rom0, ALIGN[4]
+/* Sources are 16 byte aligned, every block is a whole number of chunks */
+
+gdmaData:
+    FOR I, GDMA_CHUNKS * 16
+        db (I * 37 + (I >> 4)) & $FF
+    ENDR
+
+hblankData:
+    FOR I, HBLANK_CHUNKS * 16
+        db (I * 7 + 3) & $FF
+    ENDR
+
+stopData:
+    FOR I, STOP_CHUNKS * 16
+        db $80 | (I & $7F)              ; Never 0, so a copied chunk shows up
+    ENDR
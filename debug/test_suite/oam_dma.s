@@ -0,0 +1,185 @@
+SECTION "Header", rom0[$100]
+    nop
+    jp main
+    ds $150 - @, 0
+
+INCLUDE "interface.inc"
+
+/* Starts OAM DMAs with a wait between them that grows by 1 step every time, so
+   they start in every mode and on every line, mode 2 included. All 40 sprites move
+   down 1 line per DMA so every copy shows up on screen. OAM is read back with the
+   PPU off after the first DMA and after the last one and compared with the buffer,
+   the results are printed over serial, so the emulator has to be built with
+   DEBUG_PRINT_SERIAL_OUTPUT */
+
+DEF SPRITE_COUNT    EQU 40
+DEF SPRITE_BUFFER   EQU $C000           ; DMA source, has to be 256 byte aligned
+DEF DMA_ROUTINE     EQU $FF80           ; The CPU can only run from HRAM during a DMA
+DEF OAM             EQU $FE00
+
+main:
+    ld sp, $FFFE
+    call pollVBlank
+    xor a, a
+    ldh [R_LCDC], a
+    ldh [R_VBK], a                      ; The tile goes to VRAM bank 0
+
+    call initPalettes
+    ld hl, R_BCPS                       ; The CGB palettes, the DMG ignores these
+    call loadColors
+    ld hl, R_OCPS
+    call loadColors
+
+    ld hl, $8010                        ; Tile 1 is solid
+    ld b, 16
+    ld a, $FF
+.tile:
+    ld [hl+], a
+    dec b
+    jr nz, .tile
+
+    ld hl, SPRITE_BUFFER
+    ld b, SPRITE_COUNT
+    ld c, 16                            ; Y of the first sprite, 3 lines between each
+.sprite:
+    ld a, c
+    ld [hl+], a
+    add a, 3
+    ld c, a
+    ld a, b                             ; X, none start left of the screen
+    add a, a
+    add a, a
+    add a, 4
+    ld [hl+], a
+    ld a, 1                             ; Tile
+    ld [hl+], a
+    xor a, a                            ; Attributes
+    ld [hl+], a
+    dec b
+    jr nz, .sprite
+
+    ld hl, dmaRoutine
+    ld de, DMA_ROUTINE
+    ld b, dmaRoutine.end - dmaRoutine
+.copy:
+    ld a, [hl+]
+    ld [de], a
+    inc de
+    dec b
+    jr nz, .copy
+
+    ld a, HIGH(SPRITE_BUFFER)           ; OAM can always be read with the PPU off
+    call DMA_ROUTINE
+    call checkOAM
+    ld hl, sLCDOff
+    call report
+
+    ld a, %10010011                     ; PPU, sprites and BG on, tiles at $8000
+    ldh [R_LCDC], a
+    ld e, 0
+
+loop:
+    ld hl, SPRITE_BUFFER
+    ld b, SPRITE_COUNT
+.move:
+    inc [hl]
+    inc hl
+    inc hl
+    inc hl
+    inc hl
+    dec b
+    jr nz, .move
+
+    ld a, HIGH(SPRITE_BUFFER)
+    call DMA_ROUTINE
+
+    inc e                               ; Waits 1 more step every time so the DMA drifts
+    jr z, .done                         ; 255 DMAs
+    ld d, e
+.wait:
+    dec d
+    jr nz, .wait
+    jr loop
+
+.done:
+    call pollVBlank
+    ld hl, R_LCDC
+    res 7, [hl]
+    call checkOAM
+    ld hl, sDrift
+    call report
+    ld hl, R_LCDC
+    set 7, [hl]
+
+    ld hl, sDone
+    call printStringNL
+    jp end
+
+end:
+    di
+    halt
+    jp end
+
+; =============================================================================
+checkOAM:
+    /* Z is set if OAM has the same sprites as the buffer */
+    ld hl, SPRITE_BUFFER
+    ld de, OAM
+    ld b, SPRITE_COUNT * 4
+.loop:
+    ld a, [de]
+    cp a, [hl]
+    ret nz
+    inc hl
+    inc de
+    dec b
+    jr nz, .loop
+    ret
+
+report:
+    /* Prints the name in HL and whether the check passed, Z is set if it did */
+    push af
+    call printString
+    pop af
+    ld hl, sPass
+    jr z, .print
+    ld hl, sFail
+.print:
+    call printStringNL
+    ret
+
+loadColors:
+    /* HL : Palette index register, palette 0 is set to the DMG shades */
+    ld a, $80                           ; Index 0, auto increment
+    ld [hl+], a
+    ld de, colors
+    ld b, colors.end - colors
+.loop:
+    ld a, [de]
+    ld [hl], a
+    inc de
+    dec b
+    jr nz, .loop
+    ret
+
+SECTION "ReadOnly", rom0
+
+sLCDOff:        db "OAM DMA with the PPU off : ", 0
+sDrift:         db "OAM DMA while drifting : ", 0
+sPass:          db "ok", 0
+sFail:          db "FAIL", 0
+sDone:          db "Done", 0
+
+colors:
+    dw $7FFF, $56B5, $294A, $0000
+.end:
+
+dmaRoutine:
+    /* A : Source / $100, copied to DMA_ROUTINE */
+    ldh [R_DMA], a
+    ld a, 40                            ; 160 M cycles
+.wait:
+    dec a
+    jr nz, .wait
+    ret
+.end:
@@ -0,0 +1,139 @@
+SECTION "Timer Interrupt", rom0[$50]
+    inc bc                              ; Leaves the flags alone
+    reti
+
+SECTION "Header", rom0[$100]
+    nop
+    jp main
+    ds $150 - @, 0
+
+INCLUDE "interface.inc"
+
+/* Stresses DIV, TAC and TIMA together. The timer keeps overflowing while DIV and
+   TIMA are read on every step, and every 256 steps DIV is reset, TAC moves to the
+   next frequency and TIMA is set close to overflowing, which is where the glitches
+   on DIV and TAC writes show up.
+
+   Every read goes into a checksum, which is checked with the number of timer
+   interrupts against the expected values. Both are printed over serial with the
+   results, so the emulator has to be built with DEBUG_PRINT_SERIAL_OUTPUT */
+
+DEF ROUNDS              EQU 64          ; Rounds of 256 steps, TAC changes every round
+DEF EXPECTED_CHECKSUM   EQU $78CD
+DEF EXPECTED_INTERRUPTS EQU $0615
+
+main:
+    ld sp, $FFFE
+
+    ld a, $F0
+    ldh [R_TMA], a
+    ld a, %101                          ; On, 262144 Hz
+    ldh [R_TAC], a
+    ld a, %100                          ; Only the timer interrupt
+    ldh [R_IE], a
+
+    ld bc, 0                            ; Timer interrupts
+    ld d, 0                             ; Rounds
+    ld e, 0                             ; Steps
+    ld hl, 0                            ; Checksum
+    ei
+
+step:
+    ldh a, [R_DIV]
+    add a, l
+    ld l, a
+    ldh a, [R_TIMA]
+    xor a, h
+    rlca
+    ld h, a
+
+    inc e
+    jr nz, step
+
+    inc d
+    ld a, d
+    and a, %11                          ; Next frequency
+    or a, %100
+    ldh [R_TAC], a
+    ldh [R_DIV], a                      ; Any write resets it
+    ld a, $FE
+    ldh [R_TIMA], a
+
+    ld a, d
+    cp a, ROUNDS
+    jr nz, step
+    di
+    xor a, a                            ; A pending timer interrupt would end the halt at the end
+    ldh [R_IE], a
+
+    push hl
+    ld hl, sChecksum
+    call printString
+    pop hl
+    ld a, h
+    call printHex
+    ld a, l
+    call printHex
+    ld a, h
+    cp a, HIGH(EXPECTED_CHECKSUM)
+    jr nz, .checksumDone
+    ld a, l
+    cp a, LOW(EXPECTED_CHECKSUM)
+.checksumDone:
+    call report
+
+    ld hl, sInterrupts
+    call printString
+    ld a, b
+    call printHex
+    ld a, c
+    call printHex
+    ld a, b
+    cp a, HIGH(EXPECTED_INTERRUPTS)
+    jr nz, .interruptsDone
+    ld a, c
+    cp a, LOW(EXPECTED_INTERRUPTS)
+.interruptsDone:
+    call report
+
+    ld hl, sDone
+    call printStringNL
+    jp end
+
+end:
+    di
+    halt
+    jp end
+
+; =============================================================================
+printHex:
+    /* A : Byte, printed as 2 hex digits */
+    push af
+    swap a
+    call .digit
+    pop af
+.digit:
+    and a, $0F
+    add a, "0"
+    cp a, "9" + 1
+    jr c, .print
+    add a, "A" - "9" - 1
+.print:
+    jp printChar
+
+report:
+    /* Ends the line with whether the check passed, Z is set if it did */
+    ld hl, sPass
+    jr z, .print
+    ld hl, sFail
+.print:
+    call printStringNL
+    ret
+
+SECTION "ReadOnly", rom0
+
+sChecksum:      db "DIV/TIMA checksum : ", 0
+sInterrupts:    db "Timer interrupts : ", 0
+sPass:          db " ok", 0
+sFail:          db " FAIL", 0
+sDone:          db "Done", 0
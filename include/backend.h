@@ -0,0 +1,62 @@
+#ifndef megagbc_backend_h
+#define megagbc_backend_h
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Forward Declare VM instead of including vm.h
+ * to avoid a circular include */
+
+struct VM;
+
+/* Everything the emulator needs from the host goes through a backend, so the core
+ * doesnt depend on SDL and can run without a window. A backend provides
+ *
+ * - A frame sink, which is handed every finished frame
+ * - An input source, which is polled for joypad state and quit/pause requests
+ * - A clock, which paces the emulation to the speed of the real hardware
+ * - Optionally a loop of its own, for backends that have to keep doing something on
+ *   the thread that runs them
+ *
+ * The backend is picked when starting the emulator, and any state it needs is kept
+ * in vm->backendData */
+
+typedef struct Backend {
+    const char* name;
+
+    /* Sets the backend up before the emulator runs, returns false if it couldnt be */
+    bool (*init)(struct VM* vm);
+    /* Frees whatever init allocated, this can be called even if init failed or
+     * wasnt called at all */
+    void (*free)(struct VM* vm);
+
+    /* Frame sink, vm->framebuffer holds the finished frame */
+    void (*presentFrame)(struct VM* vm);
+
+    /* Input source, called every few hundred instructions and while paused */
+    void (*pollInput)(struct VM* vm);
+
+    /* Clock, startClock is called right before the emulator starts running and
+     * waitForFrame at the end of every frame */
+    void (*startClock)(struct VM* vm);
+    void (*waitForFrame)(struct VM* vm);
+
+    /* Runs loop(data), which is where the emulator is run, on whichever thread the 
+     * backend wants it on and returns once it has returned. Returns false if it couldnt
+     * be run. NULL if the backend doesnt need one, loop is then run on the calling
+     * thread (see gbc_run_loop()) */
+    bool (*runLoop)(struct VM* vm, void (*loop)(void* data), void* data);
+} Backend;
+
+/* Opens a window, reads the keyboard and runs at the speed of the real hardware. The
+ * window is only drawn to and read from inside gbc_run_loop(), which has to be called
+ * from the thread that created the GBC, the emulator then runs on a thread of its own */
+extern const Backend sdlBackend;
+/* Creates no window, does no sleeping and never touches SDL, the emulator runs as fast
+ * as it can and the frames are only available in vm->framebuffer */
+extern const Backend nullBackend;
+
+/* Shared clock implementations for backends */
+void startClockRealtime(struct VM* vm);
+void waitForFrameRealtime(struct VM* vm);
+
+#endif
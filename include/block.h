@@ -0,0 +1,86 @@
+#ifndef megagbc_block_h
+#define megagbc_block_h
+#include <stdbool.h>
+#include <stdint.h>
+#include "../include/jit.h"
+
+/* Forward Declare VM instead of including vm.h
+ * to avoid a circular include */
+
+struct VM;
+
+/* Uncomment (or pass -DCPU_NO_BLOCK_CACHE) to decode every instruction from memory
+ * as it is run, instead of going through the block cache */
+// #define CPU_NO_BLOCK_CACHE
+
+#if defined(CPU_JIT) && defined(CPU_NO_BLOCK_CACHE)
+#error "CPU_JIT compiles the blocks of the block cache, it cant be used with CPU_NO_BLOCK_CACHE"
+#endif
+
+#define BLOCK_CACHE_SIZE 4096               /* Has to be a power of 2 */
+#define BLOCK_MAX_INSTRUCTIONS 32
+
+/* Block cache
+ *
+ * Instead of fetching every instruction byte by byte from the bus, code in ROM, WRAM
+ * and HRAM is decoded once into blocks, straight runs of instructions which end at an
+ * unconditional jump, call, return, HALT/STOP or the end of a memory page. The CPU then 
+ * walks the block and takes the opcode and operands of each instruction from it
+ *
+ * Blocks are looked up by the memory backing their first instruction, not the address,
+ * so every ROM bank gets its own blocks and nothing needs to be decoded again when 
+ * switching back to a bank. Bank switches only drop the block that is being walked
+ *
+ * ROM cant change, but RAM can. Once a block is decoded from a WRAM page its writes are
+ * sent to the slow handler like VRAM tile data, which throws away every block on the 
+ * page when the write lands on code. HRAM is always handled anyway
+ *
+ * The cycles are still taken at the same point of every instruction as before, 
+ * events can run in the middle of one and see the clock at that point */
+
+typedef struct {
+    uint8_t bytes[3];                       /* Opcode and the 2 bytes after it */
+    uint8_t length;
+    uint16_t address;
+} DecodedInstruction;
+
+typedef struct Block {
+    const uint8_t* memory;                  /* Memory behind the first instruction */
+    uint16_t start;                         /* Address of the first instruction */
+    uint8_t count;
+    uint32_t generation;                    /* Generation of the page when decoded */
+#ifdef CPU_JIT
+    void* code;                             /* Compiled code, NULL if not compiled yet */
+    uint8_t runs;                           /* Times it was interpreted, see jit.h */
+    bool uncompilable;                      /* Starts with an instruction that isnt compiled */
+#endif
+    DecodedInstruction instructions[BLOCK_MAX_INSTRUCTIONS];
+} Block;
+
+typedef struct {
+    Block* blocks;                          /* BLOCK_CACHE_SIZE blocks, hashed by memory */
+    Block* current;                         /* Block being walked, NULL if none */
+    uint8_t next;                           /* Index of its next instruction */
+    DecodedInstruction scratch;             /* Instructions that arent in a block */
+    const uint8_t* operand;                 /* Next operand byte of the running instruction */
+    uint32_t generation[0x100];             /* Bumped when code on a memory page changes */
+    uint8_t codeStart[0x100];               /* Range of each page that has blocks */
+    uint8_t codeEnd[0x100];
+} BlockCache;
+
+void initBlockCache(BlockCache* cache);
+/* Allocates the blocks, they are freed with freeBlockCache() */
+bool allocateBlockCache(BlockCache* cache);
+void freeBlockCache(BlockCache* cache);
+/* Starts walking the block at PC and returns its first instruction, or the instruction
+ * decoded into scratch if PC isnt somewhere blocks are kept */
+const DecodedInstruction* enterBlock(struct VM* vm);
+/* Returns the block starting at PC, decoding it if needed, or NULL if PC isnt 
+ * somewhere blocks are kept */
+Block* lookupBlock(struct VM* vm);
+/* Decodes the instruction at an address into scratch without using the cache */
+const DecodedInstruction* decodeInstruction(struct VM* vm, uint16_t address);
+/* Called for writes to pages that blocks were decoded from */
+void writeCodePage(struct VM* vm, uint16_t address);
+
+#endif
@@ -1,6 +1,12 @@
 #ifndef megagbc_cpu_h
 #define megagbc_cpu_h
 
+#include <stdint.h>
+
+/* Uncomment (or pass -DCPU_THREADED_DISPATCH) to dispatch opcodes through a table of label
+ * addresses with GCC's computed goto instead of the switch statement */
+// #define CPU_THREADED_DISPATCH
+
 struct VM;
 
 typedef enum {
@@ -31,6 +37,15 @@ typedef enum {
     INTERRUPT_COUNT
 } INTERRUPT;
 
+typedef enum {
+    /* The last operation that affected the flags, used to compute them lazily */
+    LAZY_FLAGS_NONE,                        /* F is up to date */
+    LAZY_FLAGS_ADD8,
+    LAZY_FLAGS_SUB8,
+    LAZY_FLAGS_ADD16,
+    LAZY_FLAGS_ZERO                         /* Only Z is set from the result */
+} LAZY_FLAGS_OP;
+
 /* Defining macros for 16 bit registers, only for readability purposes */
 #define R16_AF R8_A
 #define R16_BC R8_B
@@ -42,9 +57,15 @@ typedef enum {
 void resetGBC(struct VM* vm);
 /* Resets the registers in the GB */
 void resetGB(struct VM* vm);
-/* This function is invoked to run the CPU thread */
-void dispatch(struct VM* vm);
+/* This function is invoked to run the CPU thread, it runs the given number of 
+ * instructions or stops earlier if the emulator is stopped */
+void dispatch(struct VM* vm, unsigned int instructions);
+
+/* Returns the F register with all the pending lazy flags applied */
+uint8_t getFlagsRegister(struct VM* vm);
 
 /* Function to request an interrupt when necessary */
 void requestInterrupt(struct VM* vm, INTERRUPT interrupt);
+/* Must be called whenever IF or IE change */
+void updatePendingInterrupts(struct VM* vm);
 #endif
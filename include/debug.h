@@ -16,15 +16,25 @@
 // #define DEBUG_LOGGING
 // #define DEBUG_MEM_LOGGING
 #define DEBUG_PRINT_SERIAL_OUTPUT
-#define DEBUG_SUPPORT_SLOW_EMULATION
+
+/* Measures how much time goes to the PPU and to memory accesses for --bench, 
+ * reading the clock that often slows everything down by a lot */
+// #define DEBUG_PROFILE
 
 /* Stops running when encounters opcode 0x40, LD B, B */
 // #define DEBUG_LDBB_BREAKPOINT
 
-#ifdef DEBUG_REALTIME_PRINTING
-#define DEBUG_SUPPORT_SLOW_EMULATION
+#ifdef DEBUG_PROFILE
+/* Counts the time spent since the last switch towards the current section, and makes
+ * the given section current until PROFILE_END */
+#define PROFILE_BEGIN(vm, section) PROFILE_SECTION previousSection = profileSwitch(vm, section)
+#define PROFILE_END(vm) profileSwitch(vm, previousSection)
+#else
+#define PROFILE_BEGIN(vm, section)
+#define PROFILE_END(vm)
 #endif
 
+PROFILE_SECTION profileSwitch(VM* vm, PROFILE_SECTION section);
 void printInstruction(VM* vm);
 void printRegisters(VM* vm);
 void printCBInstruction(VM* vm, uint8_t byte);
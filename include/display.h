@@ -1,6 +1,20 @@
 #ifndef megagbc_display_h
 #define megagbc_display_h
-#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Uncomment (or pass -DPPU_FIFO_ONLY) to produce every scanline with the dot accurate 
+ * pixel FIFO instead of rendering unchanging scanlines in one pass */
+// #define PPU_FIFO_ONLY
+
+/* Uncomment (or pass -DPPU_NO_CATCH_UP) to run the PPU on every dot of mode 2 and of FIFO
+ * scanlines as the CPU gets there, instead of letting it fall behind until the CPU could 
+ * notice (see syncPPU) */
+// #define PPU_NO_CATCH_UP
+
+/* Uncomment (or pass -DCGB_COLOR_CORRECTION) to pass CGB colors through a lookup table which 
+ * mimics the CGB LCD instead of showing them as they are */
+// #define CGB_COLOR_CORRECTION
 
 #define DISPLAY_SCALING 4
 #define HEIGHT_PX 144
@@ -15,9 +29,19 @@
 /* 1 T-Cycle = 1 Dot in normal speed mode */
 /* Mode 0 and 3 dont have a fixed dot count */
 
+/* Packs an rgb888 color into the framebuffer's ARGB8888 format */
+#define PACK_ARGB8888(r, g, b) (0xFF000000 | ((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (uint32_t)(b))
+
 #define T_CYCLES_PER_MODE2 80
 #define T_CYCLES_PER_VBLANK 4560		// or MODE1
 
+#define MAX_SPRITES_PER_SCANLINE 10
+#define SCANLINE_TILE_COUNT ((WIDTH_PX / 8) + 1)  /* Tiles a scanline can touch when its not 
+                                                     aligned to a tile */
+#define VRAM_TILE_DATA_SIZE 0x1800              /* Tile data area at the start of each VRAM bank */
+#define TILE_COUNT (VRAM_TILE_DATA_SIZE / 16)
+#define SCANLINE_TIMING_CACHE_SIZE 64
+
 struct VM;
 
 typedef enum {
@@ -67,6 +91,32 @@ typedef struct {
 	uint8_t count;
 } FIFO;
 
+/* A tile decoded from its 2 bitplanes, each row holds the color IDs of its 8 pixels
+ * packed 2 bits each with the leftmost pixel in the lowest bits */
+typedef struct {
+    uint16_t rows[8];
+    uint16_t flippedRows[8];                    /* Horizontally flipped rows */
+    bool valid;                                 /* Cleared when the tile is written to */
+} DecodedTile;
+
+/* Everything the length of mode 3 depends on, the pixels themselves dont change it */
+typedef struct {
+    uint8_t fineScrollX;                        /* SCX & 7 */
+    uint8_t windowX;                            /* WX, or 0xFF if the window isnt on the line */
+    uint8_t spriteCount;                        /* 0 if objects are disabled */
+    uint8_t spriteX[MAX_SPRITES_PER_SCANLINE];
+    uint8_t spriteIndex[MAX_SPRITES_PER_SCANLINE];
+} ScanlineTimingKey;
+
+/* Mode 3 timing measured by the FIFO for a scanline, scanlines with the same key 
+ * take exactly as long so they can be rendered in one pass instead */
+typedef struct {
+    bool valid;
+    ScanlineTimingKey key;
+    uint16_t mode3Dots;                         /* Dots mode 3 lasted for */
+    uint16_t mode3Cycles;                       /* cyclesSinceLastMode at the end of mode 3 */
+} ScanlineTiming;
+
 void pushFIFO(FIFO* fifo, FIFO_Pixel pixel);
 FIFO_Pixel popFIFO(FIFO* fifo);
 FIFO_Pixel peekFIFO(FIFO* fifo, uint8_t index);
@@ -74,7 +124,28 @@ void insertFIFO(FIFO* fifo, FIFO_Pixel pixel, uint8_t index);
 void clearFIFO(FIFO* fifo);
 
 void syncDisplay(struct VM* vm, unsigned int cycles);
+/* Schedules the PPU event for the next dot at which the PPU does something the CPU 
+ * can see */
+void schedulePPU(struct VM* vm);
+/* Syncs the PPU upto the current clock and schedules it again */
+void handlePPUEvent(struct VM* vm);
+/* Brings the PPU upto the current clock if it fell behind, must be called before 
+ * anything outside the PPU reads or changes state it uses in the middle of a mode */
+void syncPPU(struct VM* vm);
+/* Marks the decoded tile at address (offset in a VRAM bank) as changed */
+void invalidateTile(struct VM* vm, uint8_t bank, uint16_t address);
+/* Keep the cached palette colors in sync, called after the CPU writes byte 'index' of 
+ * BG/OBJ color RAM, or one of BGP/OBP0/OBP1 on DMG */
+void updatePaletteColor(struct VM* vm, bool isSprite, uint8_t index);
+void updatePaletteDMG(struct VM* vm, uint16_t paletteReg);
+void updatePalettes(struct VM* vm);
+/* Must be called before the CPU writes to a register the PPU reads while drawing, 
+ * it syncs the PPU and makes the current scanline fall back to the FIFO */
+void prepareRegisterWritePPU(struct VM* vm);
 void enablePPU(struct VM* vm);
 void disablePPU(struct VM* vm);
+/* Returns the last completed (or in progress) frame as WIDTH_PX * HEIGHT_PX 
+ * ARGB8888 pixels, row by row */
+const uint32_t* getFramebuffer(struct VM* vm);
 
 #endif
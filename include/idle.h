@@ -0,0 +1,51 @@
+#ifndef megagbc_idle_h
+#define megagbc_idle_h
+#include <stdbool.h>
+#include <stdint.h>
+#include "../include/cpu.h"
+
+/* Forward Declare VM instead of including vm.h
+ * to avoid a circular include */
+
+struct VM;
+
+/* Loops longer than this (in bytes) are never looked at */
+#define IDLE_LOOP_MAX_SIZE 24
+
+/* Idle loop detection
+ *
+ * Besides HALT, lots of games wait for something by spinning on a short loop like
+ *
+ *     wait: ldh a, (LY)
+ *           cp 144
+ *           jr nz, wait
+ *
+ * or by polling a flag in WRAM that an interrupt handler sets. When a loop like this
+ * only reads memory and A/F, and comes back around to its start with every register
+ * the same as last time, every following iteration does exactly the same thing until
+ * something else changes what it reads. While the CPU is spinning the only things that
+ * can do that are scheduled events (and interrupts, which are requested by them), so
+ * the clock is moved forward by whole iterations up to the last one that finishes
+ * before the next event is due, and from there on the loop runs normally */
+
+typedef struct {
+    bool enabled;                       /* Kill switch, when false nothing is skipped */
+    uint16_t start;                     /* Loop being watched, from its start to the end */
+    uint16_t end;                       /* of the jump back to it */
+    bool idle;                          /* Whether the loop could be idle */
+    unsigned int length;                /* Instructions in 1 iteration */
+    uint8_t GPR[GP_COUNT];              /* Registers the last time the jump back was taken */
+    unsigned long lastInstructionCount; /* Instruction count and clock at that time */
+    unsigned long lastClock;
+    unsigned long lastDeadline;         /* Next event at that time */
+
+    unsigned long skips;                /* Times iterations were skipped */
+    unsigned long skippedCycles;        /* T-Cycles that were skipped */
+} IdleLoop;
+
+void initIdleLoop(IdleLoop* loop);
+/* Called whenever a jump backwards to start is taken from the instruction ending at end,
+ * the flags need to be resolved */
+void checkIdleLoop(struct VM* vm, uint16_t start, uint16_t end);
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef megagbc_jit_h
+#define megagbc_jit_h
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Forward Declare VM instead of including vm.h
+ * to avoid a circular include */
+
+struct VM;
+struct Block;
+
+/* Uncomment (or pass -DCPU_JIT) to compile hot blocks to x86-64 machine code, this
+ * only works on Linux x86-64 and needs the block cache */
+// #define CPU_JIT
+
+#if defined(CPU_JIT) && !(defined(__x86_64__) && defined(__linux__))
+#undef CPU_JIT
+#endif
+
+#define JIT_ARENA_SIZE (16 * 1024 * 1024)   /* Bytes of machine code before everything is
+                                               thrown away and compiled again */
+#define JIT_MAX_BLOCK_SIZE (16 * 1024)      /* Most machine code a single block can take */
+#define JIT_HOT_RUNS 8                      /* Times a block is interpreted before it is
+                                               compiled */
+
+/* Dynamic recompiler
+ *
+ * Blocks of the block cache (see block.h) that keep being run are compiled to x86-64
+ * code which does the same thing the interpreter would, one instruction after another.
+ * While a compiled block runs A, F, BC, DE, HL and SP live in host registers, and
+ * memory that is mapped into the memory pages is read and written directly
+ *
+ * Timing doesnt change, the clock is advanced at exactly the same points of every
+ * instruction as in the interpreter and events run right when they are due. The block
+ * only stops at the next instruction boundary after that, since events can request
+ * interrupts. Writes that go to the slow handler and can change what the CPU does next
+ * (IO registers, IE, MBC registers and code) stop it the same way, so interrupts are
+ * always handled on the same instruction as in the interpreter
+ *
+ * Compiled code belongs to its block, blocks are keyed by the memory they were decoded
+ * from so ROM bank switches never run the wrong code, and blocks thrown away because
+ * their code in RAM was written to take their compiled code with them
+ *
+ * EI, RETI, HALT, STOP and DAA arent compiled, a block stops right before them and the
+ * interpreter runs them. The interpreter is also used for everything when the JIT is
+ * off, and JIT_VERIFY runs every compiled block a second time on the interpreter and
+ * stops at the first block where they dont agree */
+
+typedef enum {
+    JIT_OFF,
+    JIT_ON,
+    JIT_VERIFY                              /* Check every block against the interpreter,
+                                               this is very slow */
+} JIT_MODE;
+
+/* What running a block changed, for JIT_VERIFY. It needs the VM so its in jit.c */
+typedef struct JitSnapshot JitSnapshot;
+
+typedef struct {
+    JIT_MODE mode;
+    uint8_t* arena;                         /* Executable memory for the compiled code */
+    size_t arenaUsed;
+    uint8_t flagTable[256];                 /* Z, H and C for every value of the host
+                                               flags loaded by LAHF */
+    bool stop;                              /* Set while a block runs when it has to stop
+                                               at the next instruction */
+    uint32_t executed;                      /* Instructions run by the last block */
+    int32_t jumpEnd;                        /* If it ended with a jump that could be the
+                                               end of an idle loop, the address after it,
+                                               -1 otherwise */
+    JitSnapshot* snapshot;                  /* For JIT_VERIFY */
+    bool savePages;                         /* Set while JIT_VERIFY runs a block, memory
+                                               pages are saved before they are written */
+
+    unsigned long compiledBlocks;           /* Blocks compiled */
+    unsigned long blocksRun;                /* Times compiled blocks were run */
+    unsigned long instructions;             /* Instructions run by compiled blocks */
+    unsigned long flushes;                  /* Times the arena filled up */
+} Jit;
+
+void initJit(Jit* jit);
+/* Unmaps the arena and frees the snapshots */
+void freeJit(Jit* jit);
+/* Compiles the block, returns false if it cant be compiled (it starts with an
+ * instruction that isnt compiled) or the arena couldnt be mapped */
+bool compileBlock(struct VM* vm, struct Block* block);
+/* Runs the compiled code of a block, the flags have to be resolved */
+void runBlockCode(struct VM* vm, struct Block* block);
+/* Switches between the modes, only when the VM isnt running */
+void setJitMode(struct VM* vm, JIT_MODE mode);
+
+/* Memory accesses of compiled blocks that dont go straight to a memory page, these
+ * are in cpu.c next to the interpreter's */
+uint8_t readAddrCompiled(struct VM* vm, uint16_t addr);
+void writeAddrCompiled(struct VM* vm, uint16_t addr, uint8_t byte);
+
+/* JIT_VERIFY, the snapshot is freed with freeJit()
+ *
+ * Only the CPU, the state of the hardware and the memory pages that get written are
+ * saved, the framebuffer and the decoded tiles are drawn and decoded again the same
+ * way when the block is run a second time */
+JitSnapshot* allocateJitSnapshot(struct VM* vm);
+/* Saves the VM before a block, pages written after this are saved before the write */
+void saveJitSnapshot(struct VM* vm, JitSnapshot* snapshot);
+/* Keeps what the compiled block did and puts the VM back to how it was before it */
+void loadJitSnapshot(struct VM* vm, JitSnapshot* snapshot);
+/* Compares the VM against what the compiled block did, and describes the first 
+ * difference if there is one */
+bool compareJitSnapshot(struct VM* vm, JitSnapshot* snapshot, char* difference, size_t size);
+/* Saves the page of an address before it is first written while savePages is set */
+void saveWrittenPage(struct VM* vm, uint16_t addr);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef megagbc_mbc_h
 #define megagbc_mbc_h
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -26,6 +27,9 @@ typedef enum {
     MBC_TYPE_7
 } MBC_TYPE;
 
+/* Returns false if the cartridge needs hardware the emulator doesnt have yet,
+ * mbc_allocate() would exit on those */
+bool mbc_isSupported(Cartridge* cartridge);
 void mbc_allocate(struct VM* vm);
 void mbc_free(struct VM* vm);
 void mbc_writeExternalRAM(struct VM* vm, uint16_t addr, uint8_t byte);
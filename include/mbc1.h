@@ -8,8 +8,8 @@ typedef struct {
      * MBC1 supports 4 8kib banks for RAM */
     uint8_t* ramBanks;
     
-    /* Note : Selected RAM/ROM banks are kept in their 
-     * associated memory locations in the VM Memory.
+    /* Note : Selected RAM/ROM banks are mapped into the VM's 
+     * memory pages, nothing is copied.
      * The cartridge structure located in VM contains 
      * the entire rom as a continuous array and the MBC maps
      * the correct bank from it */
@@ -0,0 +1,103 @@
+#ifndef megagbc_megagbc_h
+#define megagbc_megagbc_h
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* libmegagbc
+ *
+ * Embeds the emulator in another program. Every GBC is an independent emulator with
+ * its own VM and copy of the ROM, any number of them can exist in one process as
+ * long as each one is only used by one thread at a time
+ *
+ * Nothing here opens a window, reads the keyboard or sleeps unless a backend that
+ * does so is given to gbc_create_with_backend() */
+
+#define GBC_WIDTH 160
+#define GBC_HEIGHT 144
+/* T-Cycles per second on the real hardware */
+#define GBC_CLOCK_RATE 4194304
+
+/* Buttons for gbc_set_input(), a set bit means the button is held down */
+#define GBC_BUTTON_RIGHT    (1 << 0)
+#define GBC_BUTTON_LEFT     (1 << 1)
+#define GBC_BUTTON_UP       (1 << 2)
+#define GBC_BUTTON_DOWN     (1 << 3)
+#define GBC_BUTTON_A        (1 << 4)
+#define GBC_BUTTON_B        (1 << 5)
+#define GBC_BUTTON_SELECT   (1 << 6)
+#define GBC_BUTTON_START    (1 << 7)
+
+typedef struct GBC GBC;
+
+/* How instructions are run, see gbc_set_jit() */
+typedef enum {
+    GBC_JIT_OFF,                            /* Interpret everything */
+    GBC_JIT_ON,                             /* Compile blocks that are run often */
+    GBC_JIT_VERIFY                          /* Same, but run every compiled block on the 
+                                               interpreter as well and quit if they differ */
+} GBCJitMode;
+
+/* Counters for measuring how fast the emulator runs, see gbc_get_stats() */
+typedef struct {
+    unsigned long frames;                   /* Frames finished */
+    unsigned long instructions;             /* Instructions run */
+    unsigned long cycles;                   /* T-Cycles run */
+    unsigned long idleSkips;                /* Times an idle loop was skipped through */
+    unsigned long idleCycles;               /* T-Cycles of the above, included in cycles */
+    unsigned long compiledBlocks;           /* Blocks compiled to machine code */
+    unsigned long jitInstructions;          /* Instructions run by compiled blocks, included
+                                               in instructions */
+    bool profiled;                          /* Whether the times below were measured, 
+                                               they need a build with DEBUG_PROFILE */
+    double ppuSeconds;                      /* Time spent syncing the display */
+    double busSeconds;                      /* Time spent in memory accesses that arent 
+                                               plain reads / writes of memory */
+} GBCStats;
+struct Backend;
+
+/* Boots a copy of the ROM, returns NULL if it isnt a valid cartridge or it needs
+ * hardware the emulator doesnt support yet */
+GBC* gbc_create(const uint8_t* rom, size_t size);
+/* Same as gbc_create() but with a backend from backend.h, which is how the megagbc
+ * executable gets its window, input and frame pacing */
+GBC* gbc_create_with_backend(const uint8_t* rom, size_t size, const struct Backend* backend);
+void gbc_destroy(GBC* gbc);
+
+/* Runs until the current frame is finished */
+void gbc_run_frame(GBC* gbc);
+/* Runs for atleast the given number of T-Cycles, it only stops between instructions
+ * so it can run a few cycles more, returns the number of cycles that were run */
+unsigned long gbc_run_cycles(GBC* gbc, unsigned long cycles);
+
+/* Sets how fast the emulator runs compared to the real hardware, 0 means as fast as
+ * possible. This only matters with a backend that paces frames, without one it
+ * always runs as fast as possible */
+void gbc_set_speed(GBC* gbc, unsigned int multiplier);
+/* Sets which buttons are held down, a combination of GBC_BUTTON_* */
+void gbc_set_input(GBC* gbc, uint8_t buttons);
+/* The last drawn frame, GBC_WIDTH * GBC_HEIGHT pixels in ARGB8888. The pointer stays
+ * valid until the GBC is destroyed */
+const uint32_t* gbc_framebuffer(GBC* gbc);
+/* Number of frames finished since the GBC was created */
+unsigned long gbc_frame_count(GBC* gbc);
+/* Turns skipping through idle loops on or off, its on by default. Its only there to 
+ * rule it out when something looks wrong */
+void gbc_set_idle_skip(GBC* gbc, bool enabled);
+/* Sets how instructions are run, its GBC_JIT_ON by default in builds with CPU_JIT (see
+ * jit.h) and GBC_JIT_OFF otherwise. Returns false if the build has no JIT to turn on */
+bool gbc_set_jit(GBC* gbc, GBCJitMode mode);
+/* Fills in the counters since the GBC was created */
+void gbc_get_stats(GBC* gbc, GBCStats* stats);
+/* True once the backend has asked to quit, for example when the window was closed */
+bool gbc_should_quit(GBC* gbc);
+
+/* Calls loop with the GBC and data and returns once it has returned, the GBC should
+ * only be used from loop until then. The backend picks the thread it runs on, the SDL
+ * backend has to draw and read the window on the calling thread, so loop runs on 
+ * another one. Without a backend that needs this its just called. Returns false if 
+ * the backend couldnt run it */
+typedef void (*GBCLoop)(GBC* gbc, void* data);
+bool gbc_run_loop(GBC* gbc, GBCLoop loop, void* data);
+
+#endif
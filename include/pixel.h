@@ -0,0 +1,39 @@
+#ifndef megagbc_pixel_h
+#define megagbc_pixel_h
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Uncomment (or pass -DPIXEL_KERNELS_SCALAR) to always use the scalar pixel kernels
+ * instead of picking SSE2/AVX2 ones at runtime */
+// #define PIXEL_KERNELS_SCALAR
+
+/* Pixel kernels work on whole tile rows at a time. A decoded tile row holds the 2 bit
+ * color IDs of its 8 pixels, with the leftmost pixel in the lowest bits
+ *
+ * The best implementation the host CPU supports is chosen once by initPixelKernels(),
+ * calling it again doesnt change it */
+
+typedef struct {
+    const char* name;
+
+    /* Interleaves the two bitplanes of count tile rows (low byte first, like in VRAM)
+     * into decoded rows, along with their horizontally flipped versions */
+    void (*decodeTileRows)(const uint8_t* tileData, uint16_t* rows, uint16_t* flippedRows,
+                           int count);
+    /* Resolves the color IDs of count decoded rows through the 4 color palette picked
+     * for each row, and writes 8 ARGB8888 pixels per row into out */
+    void (*expandTileRows)(const uint16_t* rows, const uint8_t* paletteIndices,
+                           const uint32_t (*palettes)[4], uint32_t* out, int count);
+} PixelKernels;
+
+#define PIXEL_KERNELS_MAX 3
+
+extern PixelKernels pixelKernels;
+
+void initPixelKernels();
+/* Fills kernels with every implementation the host CPU can run, from the scalar one
+ * upto the fastest, and returns how many there are. Only tests and benchmarks need 
+ * this, the emulator just uses pixelKernels */
+int getSupportedPixelKernels(const PixelKernels** kernels);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef megagbc_scheduler_h
+#define megagbc_scheduler_h
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Forward Declare VM instead of including vm.h
+ * to avoid a circular include */
+
+struct VM;
+
+/* Hardware that needs to act at a certain clock cycle schedules an event for it,
+ * instead of being polled on every M-Cycle. The CPU only advances the clock and
+ * runs the events once their deadline has passed
+ *
+ * When multiple events are due on the same cycle they run in the order listed here */
+typedef enum {
+    EVENT_PPU,                          /* PPU mode switches, LY, STAT/VBlank and frame end */
+    EVENT_DMA,                          /* End of an OAM DMA */
+    EVENT_TIMER,                        /* TIMA overflow */
+    EVENT_YIELD,                        /* Return from the CPU loop, used to run for a 
+                                           number of cycles */
+
+    EVENT_COUNT
+} EVENT_TYPE;
+
+typedef struct {
+    unsigned long deadline;             /* Clock (T-Cycles) at which the event is due */
+    EVENT_TYPE type;
+} Event;
+
+typedef struct {
+    /* The scheduled events are kept in a binary min heap ordered by deadline,
+     * each event type can only be scheduled once */
+    Event heap[EVENT_COUNT];
+    int heapIndex[EVENT_COUNT];         /* Position of each event type in the heap, -1 if
+                                           it isnt scheduled */
+    int count;
+    unsigned long nextDeadline;         /* Deadline of the earliest event */
+} Scheduler;
+
+void initScheduler(Scheduler* scheduler);
+/* Schedules an event at the given clock, or moves it if it was already scheduled */
+void scheduleEvent(struct VM* vm, EVENT_TYPE type, unsigned long deadline);
+void cancelEvent(struct VM* vm, EVENT_TYPE type);
+bool isEventScheduled(struct VM* vm, EVENT_TYPE type);
+/* Runs all the events whose deadline has passed, the handlers must either schedule 
+ * their event again or cancel it */
+void runEvents(struct VM* vm);
+
+#endif
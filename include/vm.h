@@ -1,20 +1,33 @@
 #ifndef MGBC_VM_H
 #define MGBC_VM_H
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_render.h>
 #include <stdint.h>
 #include <unistd.h>
+#include "../include/backend.h"
 #include "../include/cartridge.h"
 #include "../include/mbc.h"
 #include "../include/cpu.h"
 #include "../include/display.h"
+#include "../include/scheduler.h"
+#include "../include/idle.h"
+#include "../include/block.h"
+#include "../include/jit.h"
 
 /* Utility macros */
 #define SET_BIT(byte, bit) byte |= 1 << bit
 #define GET_BIT(byte, bit) ((byte >> bit) & 1)
 #define CLEAR_BIT(byte, bit) byte &= ~(1 << bit)
 
-/* Cycles till the DIV timer is increment */
+/* Speed multiplier which doesnt wait for the real hardware at all */
+#define SPEED_UNCAPPED 0
+/* While running faster than 1x, frames are only presented this often (in microsec) */
+#define FAST_PRESENT_INTERVAL (1e6/DEFAULT_FRAMERATE)
+
+#define T_CYCLES_PER_DMA_SPRITE 16        /* OAM DMA copies a sprite (4 bytes) every 4 M-Cycles */
+#define DMA_SPRITE_COUNT        40
+#define HDMA_CHUNK_SIZE         16        /* CGB HDMA/GDMA copy 16 bytes at a time */
+#define T_CYCLES_PER_HDMA_CHUNK 32        /* and stop the CPU for 8 M-Cycles per chunk */
+
+/* Cycles till DIV is incremented, its the upper byte of the 16 bit system counter */
 #define T_CYCLES_PER_DIV      256
 
 typedef enum {
@@ -43,6 +56,24 @@ typedef enum {
     INTERRUPT_ENABLE = 0xFFFF                   /* register which stores if interrupts are enabled */
 } MEM_ADDR;
 
+/* The CPU sees memory through a table of 256 byte pages, each page points 
+ * directly to the memory backing it so most accesses are a single indexed load.
+ * A NULL pointer means the access has side effects or is blocked (IO, MBC registers, 
+ * locked VRAM/OAM, DMA) and has to go through the slow handler instead 
+ *
+ * Bank switching only changes which memory the pages point to */
+#define MEMORY_PAGE_SIZE    0x100
+#define MEMORY_PAGE_COUNT   0x100
+
+typedef struct {
+    uint8_t* memory;                            /* Memory currently banked into the page, 
+                                                   NULL if it is handled by the MBC */
+    uint8_t* read;                              /* Page for reads, NULL if handled */
+    uint8_t* write;                             /* Page for writes, NULL if handled */
+    bool hasCode;                               /* Blocks were decoded from the page, so 
+                                                   writes have to be checked, see block.h */
+} MEMORY_PAGE;
+
 typedef enum {
     EMU_DMG,                    /* Emulate gameboy */
     EMU_CGB                     /* Emulate gameboy color */
@@ -57,6 +88,30 @@ typedef enum {
 	JOYPAD_SELECT_NONE
 } JOYPAD_SELECT;
 
+/* Joypad buttons, the first 4 are bits 0-3 of the direction buffer and 
+ * the last 4 are bits 0-3 of the action buffer */
+
+typedef enum {
+    JOYPAD_BUTTON_RIGHT,
+    JOYPAD_BUTTON_LEFT,
+    JOYPAD_BUTTON_UP,
+    JOYPAD_BUTTON_DOWN,
+    JOYPAD_BUTTON_A,
+    JOYPAD_BUTTON_B,
+    JOYPAD_BUTTON_SELECT,
+    JOYPAD_BUTTON_START
+} JOYPAD_BUTTON;
+
+/* Parts of the emulator that time is measured for with DEBUG_PROFILE, 
+ * each one only counts the time not spent in the others */
+
+typedef enum {
+    PROFILE_CPU,                /* Everything else, mostly instruction dispatch */
+    PROFILE_PPU,                /* Syncing the display */
+    PROFILE_BUS,                /* Memory accesses that go through the handlers */
+    PROFILE_SECTION_COUNT
+} PROFILE_SECTION;
+
 /* IO Port Register Macros */
 #define R_P1_JOYP	0xFF00
 #define R_SB        0xFF01
@@ -79,6 +134,11 @@ typedef enum {
 #define R_WY        0xFF4A
 #define R_WX        0xFF4B
 #define R_VBK		0xFF4F
+#define R_HDMA1     0xFF51
+#define R_HDMA2     0xFF52
+#define R_HDMA3     0xFF53
+#define R_HDMA4     0xFF54
+#define R_HDMA5     0xFF55
 #define R_BCPS		0xFF68
 #define R_BCPD		0xFF69
 #define R_OCPS		0xFF6A
@@ -87,9 +147,24 @@ typedef enum {
 #define R_IE        INTERRUPT_ENABLE
 
 struct VM {
-    /* ---------------- SDL ----------------- */
-    SDL_Window* sdl_window;					/* The window */
-    SDL_Renderer* sdl_renderer;             /* Renderer */
+    /* ---------------- Host ---------------- */
+    const Backend* backend;                 /* Video, input and timing, see backend.h */
+    void* backendData;                      /* State owned by the backend */
+    unsigned long frameCount;               /* Frames finished since the emulator started */
+    bool stopAtFrameEnd;                    /* Stop running at the end of the current frame */
+    bool quit;                              /* The backend asked the emulator to quit */
+    unsigned int speed;                     /* Speed multiplier for the realtime clock, 
+                                               SPEED_UNCAPPED for no limit */
+    unsigned int fastForwardSpeed;          /* ^^^ used while fastForward is held */
+    bool fastForward;
+    unsigned long ticksAtLastPresent;       /* When the last frame was presented, frames
+                                               are dropped while running faster than 1x */
+    unsigned long instructionCount;         /* Instructions run since the emulator started */
+    PROFILE_SECTION profileSection;         /* What the emulator is doing right now */
+    unsigned long profileLastSwitch;        /* When it started doing that (in nanosec) */
+    unsigned long profileTime[PROFILE_SECTION_COUNT];
+                                            /* Time spent in each section (in nanosec), 
+                                               only measured with DEBUG_PROFILE */
 	unsigned long ticksAtStartup;			/* Stores the ticks at emulator startup (rom boot) */
 	unsigned long ticksAtLastRender;		/* Used to calculate how much time has passed 
 											   since last sdl frame render */
@@ -97,31 +172,56 @@ struct VM {
 	uint8_t joypadActionBuffer;				/* Stores joypad action button states */
 	JOYPAD_SELECT joypadSelectedMode;		
     /* -------------- Emulator ------------- */
+    Scheduler scheduler;                    /* Events for the hardware, see scheduler.h */
     Cartridge* cartridge;
     EMULATION_MODE emuMode;                 /* Which behaviour are we emulating, dmg, cgb, ect */
-    bool run;                               /* A flag that when set to false, quits the emulator */
+    bool run;                               /* A flag that when set to false, stops running
+                                               instructions after the current one */
     bool paused;
     bool IME;                               /* Interrupt Master Enable Flag */ 
-    unsigned long lastDIVSync;              /* Holds the clock's state when DIV timer was last synced
-                                             * this helps in getting the cycles elapsed */
-    unsigned long lastTIMASync;             /* Same but for the TIMA timer */
+    uint8_t pendingInterrupts;              /* IF & IE & 0x1F, the interrupts which are both
+                                               requested and enabled, kept upto date by
+                                               updatePendingInterrupts() */
+    unsigned long systemCounterOffset;      /* Added to the clock to get the system counter
+                                               DIV is the upper byte of, changed when DIV
+                                               is reset (see getSystemCounter) */
+    unsigned long lastTIMASync;             /* Holds the clock's state when TIMA was last synced,
+                                             * this helps in getting the increments since */
     unsigned long clock;                    /* Main clock of the whole emulator 
 											   Counts in T-Cycles */
 	bool scheduleHaltBug;				    /* If set to true,the CPU recreates the halt bug */
     bool doingDMA;
-    uint16_t mCyclesSinceDMA;               /* M-Cycles elapsed since DMA began */
+    unsigned long dmaStart;                 /* Clock at which the DMA began */
+    uint8_t dmaSpritesCopied;               /* Sprites already copied to OAM, the DMA is 
+                                               ahead of this until syncDMA is called */
     uint16_t dmaSource;                     /* DMA Source Address */
+    bool doingHDMA;                         /* A HBlank DMA is waiting for the next HBlank */
+    uint16_t hdmaSource;                    /* CGB HDMA/GDMA Source Address */
+    uint16_t hdmaDestination;               /* CGB HDMA/GDMA Destination Address, in VRAM */
+    uint8_t hdmaChunksLeft;                 /* 16 byte chunks left to copy */
+    unsigned long stalledCycles;            /* Cycles the CPU has been stopped for by HDMA,
+                                               the clock skips them once the events due
+                                               have run (see runEvents) */
     /* ---------------- CPU ---------------- */
     uint8_t GPR[GP_COUNT];
     uint16_t PC;                        /* Program Counter */
+    LAZY_FLAGS_OP lazyFlagsOp;          /* Last operation whose flags are not in F yet */
+    uint8_t lazyFlagsMask;              /* Flags in F that the operation decides */
+    uint16_t lazyFlagsA;                /* Operands of the operation */
+    uint16_t lazyFlagsB;
+    uint8_t lazyFlagsCarry;
     bool scheduleInterruptEnable;       /* If set to true, it enables interrupts at the
                                            dispatch of the next instruction */
 	bool haltMode;						/* If set to true, the CPU enters the halt 
 										   procedure */
+    IdleLoop idleLoop;                  /* Idle loop detection, see idle.h */
     /* ------------- Memory ---------------- */
     uint8_t MEM[0xFFFF + 1];
+    MEMORY_PAGE memoryPages[MEMORY_PAGE_COUNT];
+    BlockCache blockCache;              /* Decoded instructions, see block.h */
+    Jit jit;                            /* Compiled blocks, see jit.h */
 	uint8_t* wramBanks;         	    /* 7 Banks for WRAM when on CGB mode */
-	uint8_t* vramBank;			        /* Switchable VRAM Bank when on CGB mode */
+	uint8_t* vramBank;			        /* VRAM Bank 1 when on CGB mode, bank 0 is in MEM */
     void* memController;                /* Memory Bank Controller */
     MBC_TYPE memControllerType;
 	/* ---------------- PPU ---------------- */
@@ -132,7 +232,10 @@ struct VM {
                                                this is set by mode 3 at every scanline to 
                                                set the hblank wait cycle duration */
 	bool ppuEnabled;
+    unsigned long lastDisplaySync;          /* Clock at which the PPU was last synced */
 	bool skipFrame;							/* Skips a frame render */
+    uint32_t framebuffer[WIDTH_PX * HEIGHT_PX]; /* ARGB8888 pixels written by the PPU, uploaded
+                                               to the screen once per frame */
 	uint8_t currentFetcherTask;
     uint16_t fetcherTileAddress;            /* Address of the current tile the fetcher is on */
     uint8_t fetcherTileAttributes;          /* Attributes of the current tile the fetcher is on */
@@ -142,8 +245,7 @@ struct VM {
                                              * true coordinates of the tile row being rendered,
                                              * scrolling is applied to these values and then
                                              * they are used */
-    uint8_t fetcherTileRowLow;              /* Lower byte of the fetcher tile row data */
-    uint8_t fetcherTileRowHigh;             /* Upper .... */
+    uint16_t fetcherTileRow;                /* Decoded tile row the fetcher got, flipped if needed */
     bool firstTileInScanline;               /* Is true if the current tile the fetcher is on
                                                is the first tile in the current scanline */
     uint8_t windowYCounter;                 /* Internal window Y counter, it counts the current 
@@ -159,9 +261,10 @@ struct VM {
     uint8_t pixelsToDiscard;                /* Fixed offset of pixels to discard at start of a
                                              * scanline. This is decided by the lower 3 bits of 
                                              * SCX for BG tiles and when WX < 7 for window tiles */
-    uint8_t preservedFetcherTileLow;
-    uint8_t preservedFetcherTileHigh;
+    uint16_t preservedFetcherTileRow;
     uint8_t preservedFetcherTileAttributes;
+    DecodedTile decodedTiles[2][TILE_COUNT];    /* Tiles of both VRAM banks, decoded when the 
+                                               PPU first uses them */
     uint8_t* spriteData;                    /* Pointer to the data of the sprite being rendered rn */
     bool renderingSprites;
     uint8_t oamDataBuffer[50];              /* OAM Data is read and written to this area on every 
@@ -173,6 +276,16 @@ struct VM {
                                                scanline */
     uint8_t spriteSize;                     /* 0 = 8x8, 1 = 8x16, read every scanline */
     bool isLastSpriteOverlap;
+    ScanlineTiming scanlineTimings[SCANLINE_TIMING_CACHE_SIZE];
+    ScanlineTimingKey scanlineKey;          /* Timing key of the current scanline */
+    bool fastScanline;                      /* The current scanline was rendered in one pass,
+                                               mode 3 only waits for its duration */
+    bool fifoScanline;                      /* The current scanline has to go through the FIFO
+                                               and cant be measured, because a register was 
+                                               written during mode 3 */
+    unsigned int mode3Dots;                 /* Dots spent in mode 3 on the current scanline */
+    uint16_t fastScanlineDots;
+    uint16_t fastScanlineCycles;
     uint8_t lastSpriteOverlapPushIndex;     /* Index of the last overlapping sprite that was pushed fully */
     int lastSpriteOverlapX;                 /* X Coordinate of the last overlapping sprite that was pushed fully */
     uint8_t* bgColorRAM;                    /* 64 Byte long color ram which stores CGB palettes */
@@ -180,6 +293,9 @@ struct VM {
     uint8_t currentBackgroundCRAMIndex;     /* Current byte value in color ram which can be 
                                                addressed by BCPS */
     uint8_t currentSpriteCRAMIndex;         /* ^^^^ addressed by OCPS */
+    uint32_t paletteColors[2][8][4];        /* BG and OBJ palettes converted to the framebuffer
+                                               format, DMG uses BG palette 0 for BGP and
+                                               OBJ palettes 0-1 for OBP0/OBP1 */
     unsigned int cyclesSinceLastFrame;      /* Holds the cycles passed since last frame was drawn */
 	unsigned int cyclesSinceLastMode;
 	bool lockVRAM;							/* Locks CPU from accessing VRAM */
@@ -189,8 +305,13 @@ struct VM {
 
 typedef struct VM VM;
 
-/* Loads in the cartridge into the VM and starts the overall emulator */
-void startEmulator(Cartridge* cartridge);
+/* Loads in the cartridge into the VM and boots it on a backend, returns false if 
+ * the cartridge couldnt be booted or the backend couldnt be started, in which case 
+ * the VM has already been cleaned up */
+bool initEmulator(VM* vm, Cartridge* cartridge, const Backend* backend);
+/* Runs instructions until vm->run is cleared, either by the backend quitting,
+ * the end of a frame (if stopAtFrameEnd is set) or the yield event */
+void runEmulator(VM* vm);
 
 void pauseEmulator(VM* vm);
 void unpauseEmulator(VM* vm);
@@ -198,29 +319,78 @@ void unpauseEmulator(VM* vm);
 void stopEmulator(VM* vm);
 
 /* Increments the cycle count by 4 tcycles and syncs all hardware to act accordingly if necessary */
-void cyclesSync_4(VM* vm);
+static inline void cyclesSync_4(VM* vm) {
+    /* This function is called millions of times by the CPU
+     * in a second and therefore it needs to be optimised 
+     *
+     * So we dont update any hardware here, the hardware schedules events 
+     * for when it needs to act and we only run them once they are due */
+    vm->clock += 4;
+
+    if (vm->clock >= vm->scheduler.nextDeadline) runEvents(vm);
+}
+
+static inline unsigned int getEmulationSpeed(VM* vm) {
+    return vm->fastForward ? vm->fastForwardSpeed : vm->speed;
+}
 
 /* Joypad */
 
 /* Updates the register by writing correct values to the lower nibble */
 void updateJoypadRegBuffer(VM* vm, JOYPAD_SELECT mode);
+/* Presses or releases a button, this is how backends feed input */
+void setJoypadButton(VM* vm, JOYPAD_BUTTON button, bool pressed);
 
-/* SDL */
-int initSDL(VM* vm);
-void freeSDL(VM* vm);
-void handleSDLEvents(VM* vm);
-
-/* Sync timer */
+/* Sync timer, brings TIMA (and the DIV byte in MEM) upto the current clock */
 void syncTimer(VM* vm);
+/* The 16 bit counter which is incremented every T-Cycle, DIV is its upper byte 
+ * and TIMA is incremented on the falling edges of one of its bits */
+uint16_t getSystemCounter(VM* vm);
+/* Bit of the system counter TIMA follows for the frequency in TAC */
+uint16_t getTimerBit(uint8_t timerControl);
 void incrementTIMA(VM* vm);
+/* Schedules the timer event for the next TIMA overflow, this has to be called 
+ * whenever TIMA or TAC change */
+void scheduleTimer(VM* vm);
+void handleTimerEvent(VM* vm);
+
+/* Cancels itself and stops running, see runEmulator */
+void handleYieldEvent(VM* vm);
 
 /* DMA */
-void syncDMA(VM* vm);
+/* Copies the sprites the DMA has gotten to by the clock given, this must be called 
+ * before OAM is read during a DMA, upto the clock it is read at */
+void syncDMA(VM* vm, unsigned long clock);
+/* Clock at which the DMA copies the next sprite */
+unsigned long getNextDMACopy(VM* vm);
+/* Finishes the DMA */
+void handleDMAEvent(VM* vm);
 void startDMATransfer(VM* vm, uint8_t byte);
+/* CGB HDMA, a write to HDMA5 either copies everything at once (GDMA), starts copying 
+ * a chunk every HBlank or stops the HBlank DMA */
+void startHDMATransfer(VM* vm, uint8_t byte);
+/* Copies the next chunk of a HBlank DMA, the PPU calls this when it enters HBlank */
+void handleHDMAChunk(VM* vm);
+
+/* Memory pages */
+
+/* Points the pages covering the address range to memory, or to the MBC if it is NULL */
+void mapMemory(VM* vm, uint16_t startAddr, uint16_t endAddr, uint8_t* memory);
+/* Remaps the pages covering the address range according to the
+ * current DMA and PPU lock state, it must be called whenever those change */
+void updateMemoryPages(VM* vm, uint16_t startAddr, uint16_t endAddr);
+/* Reads the memory banked in at an address without any side effects or locks,
+ * this is also how the CPU fetches instructions */
+static inline uint8_t peekAddr(VM* vm, uint16_t addr) {
+    uint8_t* memory = vm->memoryPages[addr / MEMORY_PAGE_SIZE].memory;
+
+    if (memory == NULL) return vm->MEM[addr];
+    return memory[addr % MEMORY_PAGE_SIZE];
+}
 
 /* CGB Only, WRAM/VRAM bank switching */
-void switchCGB_WRAM(VM* vm, uint8_t oldBankNumber, uint8_t bankNumber);
-void switchCGB_VRAM(VM* vm, uint8_t oldBankNumber, uint8_t bankNumber);
+void switchCGB_WRAM(VM* vm, uint8_t bankNumber);
+void switchCGB_VRAM(VM* vm, uint8_t bankNumber);
 
 /* Utility */
 unsigned long clock_u();
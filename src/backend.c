@@ -0,0 +1,69 @@
+#include "../include/backend.h"
+#include "../include/vm.h"
+#include "../include/display.h"
+#include "../include/debug.h"
+
+/* Realtime clock */
+
+void startClockRealtime(VM* vm) {
+	vm->ticksAtStartup = clock_u();
+    vm->ticksAtLastRender = 0;
+}
+
+void waitForFrameRealtime(VM* vm) {
+	/* The emulator keeps its speed accurate by locking to the framerate
+	 * Whatever has to be done (cpu execution, audio, rendering a frame) in
+	 * the interval equivalent to 1 frame render on the gameboy is done in 1 frame
+	 * render on the emulator, the remaining time is waited for on the emulator to
+	 * sync with the time on the gameboy */
+	unsigned long ticksElapsed = (clock_u() - vm->ticksAtStartup) - vm->ticksAtLastRender;
+    unsigned int speed = getEmulationSpeed(vm);
+
+    if (speed == SPEED_UNCAPPED) {
+        /* Dont wait at all */
+        vm->ticksAtLastRender += ticksElapsed;
+        return;
+    }
+
+    /* Running N times faster means a frame only gets 1/N of the time */
+    double frameTime = (1e6/DEFAULT_FRAMERATE) / speed;
+
+	/* Ticks elapsed is the amount of time elapsed since last frame render (in microsec),
+	 * which is lesser than the amount of time it would have taken on the real gameboy
+	 * because the emulator goes very fast
+	 *
+	 * It can still be greater when the emulator is running faster than the host can keep
+	 * up with or after a pause, the difference would go negative then */
+	if (ticksElapsed < frameTime) {
+		usleep(frameTime - ticksElapsed);
+	}
+	vm->ticksAtLastRender = clock_u() - vm->ticksAtStartup;
+}
+
+/* Null backend */
+
+static bool initNull(VM* vm) {
+    vm->backendData = NULL;
+    return true;
+}
+
+static void freeNull(VM* vm) {}
+static void presentFrameNull(VM* vm) {}
+static void pollInputNull(VM* vm) {}
+
+static void startClockNull(VM* vm) {
+    /* Only kept for the elapsed time printed when stopping */
+	vm->ticksAtStartup = clock_u();
+}
+
+static void waitForFrameNull(VM* vm) {}
+
+const Backend nullBackend = {
+    .name = "null",
+    .init = initNull,
+    .free = freeNull,
+    .presentFrame = presentFrameNull,
+    .pollInput = pollInputNull,
+    .startClock = startClockNull,
+    .waitForFrame = waitForFrameNull
+};
@@ -0,0 +1,352 @@
+#include "../include/backend.h"
+#include "../include/vm.h"
+#include "../include/debug.h"
+#include "../include/display.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_pixels.h>
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_scancode.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_video.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* SDL only supports rendering and handling window events on the thread that made the
+ * window, so the main thread keeps doing that and the emulator runs on a thread of its
+ * own, started by runLoopSDL(). Uploading frames and waiting on vsync or the compositor
+ * never holds up the emulation that way, the emulation thread only paces itself
+ * (waitForFrameRealtime) and copies the finished frame out
+ *
+ * Frames are handed over through a triple buffer, at any time one buffer is being 
+ * written by the emulation thread, one is being shown by the main thread and the third
+ * holds the latest finished frame. Either side takes the latest one by swapping its own 
+ * buffer in with a single atomic exchange, so neither ever waits on the other. If the 
+ * main thread falls behind, the frames it didnt get to are replaced by newer ones 
+ * (dropped) and it always shows the newest one
+ *
+ * Input goes the other way, the main thread queues the events the emulator cares about
+ * and the emulation thread handles them the next time it polls for input */
+#define PRESENT_BUFFER_COUNT    3
+#define PRESENT_BUFFER_FRESH    4           /* Set along with the latest buffer until the 
+                                               main thread takes it */
+#define INPUT_QUEUE_SIZE        64
+#define EVENT_POLL_INTERVAL_MS  10          /* How long the main thread waits for a frame
+                                               before it checks for events again */
+
+typedef struct {
+    unsigned long count;
+    unsigned long total;                    /* In microseconds */
+    unsigned long worst;
+} FrameTimeStats;
+
+typedef struct {
+    SDL_Window* window;                     /* The window */
+    SDL_Renderer* renderer;                 /* Renderer, only used by the main thread */
+    SDL_Texture* texture;                   /* Streaming texture the framebuffer is uploaded to */
+
+    /* Emulation thread */
+    SDL_atomic_t emulating;                 /* Cleared once it is done */
+    void (*loop)(void* data);               /* What it runs, see runLoopSDL() */
+    void* loopData;
+
+    /* Frames */
+    SDL_sem* frameReady;                    /* Posted for every finished frame */
+    uint32_t buffers[PRESENT_BUFFER_COUNT][WIDTH_PX * HEIGHT_PX];
+    SDL_atomic_t latestBuffer;              /* Buffer with the latest finished frame, and 
+                                               PRESENT_BUFFER_FRESH if it wasnt shown yet */
+    int writeBuffer;                        /* Owned by the emulation thread */
+    int showBuffer;                         /* Owned by the main thread */
+
+    /* Input */
+    SDL_mutex* inputLock;                   /* Guards the queue */
+    SDL_Event inputs[INPUT_QUEUE_SIZE];     /* Ring buffer */
+    int firstInput;
+    int inputCount;
+    SDL_atomic_t pendingInputs;             /* inputCount, checked without the lock */
+    SDL_atomic_t speed;                     /* Speed as of the last input, for the title */
+    unsigned int titleSpeed;                /* Speed the title shows, owned by the main thread */
+
+    /* Frame time statistics, printed when the window is closed 
+     *
+     * The emulation thread keeps the time between frames and how much of it was spent 
+     * emulating rather than waiting for the next frame, the main thread keeps how long
+     * showing a frame took (the upload and present, including any vsync or compositor 
+     * wait) and how many frames were dropped */
+    FrameTimeStats emulationFrames;
+    FrameTimeStats emulationWork;
+    unsigned long ticksAtLastFrame;         /* 0 when the next frame shouldnt be counted */
+    FrameTimeStats presentedFrames;
+    SDL_atomic_t droppedFrames;
+} SDLBackendData;
+
+static void addFrameTime(FrameTimeStats* stats, unsigned long time) {
+    stats->count++;
+    stats->total += time;
+    if (time > stats->worst) stats->worst = time;
+}
+
+static void printFrameTimes(const char* name, FrameTimeStats* stats) {
+    if (stats->count == 0) return;
+
+    printf("%s : %lu frames, %.2f ms average, %.2f ms worst\n", name, stats->count,
+           stats->total / 1e3 / stats->count, stats->worst / 1e3);
+}
+
+static bool initSDL(VM* vm) {
+    SDLBackendData* sdl = (SDLBackendData*)calloc(1, sizeof(SDLBackendData));
+    if (sdl == NULL) return false;
+
+    vm->backendData = sdl;
+
+    SDL_Init(SDL_INIT_EVERYTHING);
+    sdl->window = SDL_CreateWindow("MegaGBC", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                   WIDTH_PX * DISPLAY_SCALING, HEIGHT_PX * DISPLAY_SCALING, SDL_WINDOW_SHOWN);
+
+    if (!sdl->window) return false;         /* Failed to create screen */
+
+    sdl->renderer = SDL_CreateRenderer(sdl->window, -1, SDL_RENDERER_PRESENTVSYNC);
+    if (!sdl->renderer) return false;
+
+    /* Frames are uploaded to this texture once per frame, the texture is then
+     * stretched over the whole window */
+    sdl->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STREAMING, WIDTH_PX, HEIGHT_PX);
+    if (!sdl->texture) return false;
+
+    /* Buffer 0 is written first, 1 is the latest (nothing yet) and 2 is shown */
+    sdl->writeBuffer = 0;
+    sdl->showBuffer = 2;
+    SDL_AtomicSet(&sdl->latestBuffer, 1);
+    sdl->titleSpeed = 1;
+
+    sdl->frameReady = SDL_CreateSemaphore(0);
+    sdl->inputLock = SDL_CreateMutex();
+    return sdl->frameReady && sdl->inputLock;
+}
+
+static void freeSDL(VM* vm) {
+    SDLBackendData* sdl = (SDLBackendData*)vm->backendData;
+    if (sdl == NULL) return;
+
+    printFrameTimes("Frame time (emulation thread)", &sdl->emulationFrames);
+    printFrameTimes("Emulation time (emulation thread)", &sdl->emulationWork);
+    printFrameTimes("Present time (main thread)", &sdl->presentedFrames);
+    if (sdl->presentedFrames.count > 0) {
+        printf("Dropped %d frames the main thread didnt get to\n", SDL_AtomicGet(&sdl->droppedFrames));
+    }
+
+    if (sdl->frameReady) SDL_DestroySemaphore(sdl->frameReady);
+    if (sdl->inputLock) SDL_DestroyMutex(sdl->inputLock);
+    if (sdl->texture) SDL_DestroyTexture(sdl->texture);
+    if (sdl->renderer) SDL_DestroyRenderer(sdl->renderer);
+    if (sdl->window) SDL_DestroyWindow(sdl->window);
+    SDL_Quit();
+
+    free(sdl);
+    vm->backendData = NULL;
+}
+
+static void presentFrameSDL(VM* vm) {
+    SDLBackendData* sdl = (SDLBackendData*)vm->backendData;
+
+    /* Copy the frame out and make it the latest one, the main thread shows it
+     * whenever it gets to it */
+    memcpy(sdl->buffers[sdl->writeBuffer], vm->framebuffer, sizeof(sdl->buffers[0]));
+
+    SDL_MemoryBarrierRelease();
+    int previous = SDL_AtomicSet(&sdl->latestBuffer, sdl->writeBuffer | PRESENT_BUFFER_FRESH);
+    SDL_MemoryBarrierAcquire();
+    if (previous & PRESENT_BUFFER_FRESH) SDL_AtomicAdd(&sdl->droppedFrames, 1);
+
+    sdl->writeBuffer = previous & ~PRESENT_BUFFER_FRESH;
+    SDL_SemPost(sdl->frameReady);
+}
+
+static void showLatestFrame(SDLBackendData* sdl) {
+    if (!(SDL_AtomicGet(&sdl->latestBuffer) & PRESENT_BUFFER_FRESH)) return;
+
+    /* Take the latest frame and leave the one just shown for the emulation thread,
+     * the barriers make sure the frame is fully written before its taken and read
+     * before its given back */
+    SDL_MemoryBarrierRelease();
+    sdl->showBuffer = SDL_AtomicSet(&sdl->latestBuffer, sdl->showBuffer) & ~PRESENT_BUFFER_FRESH;
+    SDL_MemoryBarrierAcquire();
+
+    unsigned long ticks = clock_u();
+    SDL_UpdateTexture(sdl->texture, NULL, sdl->buffers[sdl->showBuffer], WIDTH_PX * sizeof(uint32_t));
+    SDL_RenderCopy(sdl->renderer, sdl->texture, NULL, NULL);
+    SDL_RenderPresent(sdl->renderer);
+    addFrameTime(&sdl->presentedFrames, clock_u() - ticks);
+}
+
+static void waitForFrameSDL(VM* vm) {
+    SDLBackendData* sdl = (SDLBackendData*)vm->backendData;
+    unsigned long ticks = clock_u();
+
+    if (sdl->ticksAtLastFrame != 0) addFrameTime(&sdl->emulationWork, ticks - sdl->ticksAtLastFrame);
+
+    waitForFrameRealtime(vm);
+    ticks = clock_u();
+
+    if (sdl->ticksAtLastFrame != 0) addFrameTime(&sdl->emulationFrames, ticks - sdl->ticksAtLastFrame);
+    sdl->ticksAtLastFrame = ticks;
+}
+
+static bool getJoypadButton(SDL_Scancode scancode, JOYPAD_BUTTON* button) {
+    switch (scancode) {
+        case SDL_SCANCODE_UP:     *button = JOYPAD_BUTTON_UP; return true;
+        case SDL_SCANCODE_LEFT:   *button = JOYPAD_BUTTON_LEFT; return true;
+        case SDL_SCANCODE_DOWN:   *button = JOYPAD_BUTTON_DOWN; return true;
+        case SDL_SCANCODE_RIGHT:  *button = JOYPAD_BUTTON_RIGHT; return true;
+        case SDL_SCANCODE_Z:      *button = JOYPAD_BUTTON_B; return true;
+        case SDL_SCANCODE_X:      *button = JOYPAD_BUTTON_A; return true;
+        case SDL_SCANCODE_RETURN: *button = JOYPAD_BUTTON_START; return true;
+        case SDL_SCANCODE_TAB:    *button = JOYPAD_BUTTON_SELECT; return true;
+        default: return false;
+    }
+}
+
+static bool getSpeed(SDL_Scancode scancode, unsigned int* speed) {
+    switch (scancode) {
+        case SDL_SCANCODE_1: *speed = 1; return true;
+        case SDL_SCANCODE_2: *speed = 2; return true;
+        case SDL_SCANCODE_4: *speed = 4; return true;
+        case SDL_SCANCODE_8: *speed = 8; return true;
+        case SDL_SCANCODE_0: *speed = SPEED_UNCAPPED; return true;
+        default: return false;
+    }
+}
+
+static void updateWindowTitle(SDLBackendData* sdl) {
+    unsigned int speed = SDL_AtomicGet(&sdl->speed);
+    char title[32];
+
+    if (speed == sdl->titleSpeed) return;
+    sdl->titleSpeed = speed;
+
+    if (speed == 1) snprintf(title, sizeof(title), "MegaGBC");
+    else if (speed == SPEED_UNCAPPED) snprintf(title, sizeof(title), "MegaGBC (uncapped)");
+    else snprintf(title, sizeof(title), "MegaGBC (%ux)", speed);
+
+    SDL_SetWindowTitle(sdl->window, title);
+}
+
+static void queueEvents(SDLBackendData* sdl) {
+    /* We listen for events like keystrokes and window closing, only the ones the 
+     * emulation thread handles are queued */
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        bool key = (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && event.key.repeat == 0;
+        if (!key && event.type != SDL_QUIT) continue;
+
+        SDL_LockMutex(sdl->inputLock);
+        /* The emulation thread empties it every few hundred instructions, its only
+         * full if that thread is stuck */
+        if (sdl->inputCount < INPUT_QUEUE_SIZE) {
+            sdl->inputs[(sdl->firstInput + sdl->inputCount) % INPUT_QUEUE_SIZE] = event;
+            sdl->inputCount++;
+        }
+        SDL_AtomicSet(&sdl->pendingInputs, sdl->inputCount);
+        SDL_UnlockMutex(sdl->inputLock);
+    }
+}
+
+static void handleEvent(VM* vm, SDL_Event* event) {
+    SDLBackendData* sdl = (SDLBackendData*)vm->backendData;
+
+    if (event->type == SDL_QUIT) {
+        vm->quit = true;
+        vm->run = false;
+        return;
+    }
+
+    bool pressed = event->type == SDL_KEYDOWN;
+    JOYPAD_BUTTON button;
+    unsigned int speed;
+
+    if (getJoypadButton(event->key.keysym.scancode, &button)) {
+        setJoypadButton(vm, button, pressed);
+    } else if (event->key.keysym.scancode == SDL_SCANCODE_LSHIFT) {
+        /* Fast forward for as long as shift is held */
+        vm->fastForward = pressed;
+        SDL_AtomicSet(&sdl->speed, getEmulationSpeed(vm));
+    } else if (pressed && getSpeed(event->key.keysym.scancode, &speed)) {
+        vm->speed = speed;
+        SDL_AtomicSet(&sdl->speed, getEmulationSpeed(vm));
+    } else if (pressed && event->key.keysym.scancode == SDL_SCANCODE_SPACE) {
+        if (!vm->paused) pauseEmulator(vm);
+        else {
+            unpauseEmulator(vm);
+            /* The time spent paused isnt a slow frame */
+            sdl->ticksAtLastFrame = 0;
+        }
+    }
+}
+
+static void pollInputSDL(VM* vm) {
+    SDLBackendData* sdl = (SDLBackendData*)vm->backendData;
+
+    /* Taken one at a time, pausing keeps handling the ones after it from in here */
+    while (SDL_AtomicGet(&sdl->pendingInputs) != 0) {
+        SDL_LockMutex(sdl->inputLock);
+        SDL_Event event = sdl->inputs[sdl->firstInput];
+        sdl->firstInput = (sdl->firstInput + 1) % INPUT_QUEUE_SIZE;
+        sdl->inputCount--;
+        SDL_AtomicSet(&sdl->pendingInputs, sdl->inputCount);
+        SDL_UnlockMutex(sdl->inputLock);
+
+        handleEvent(vm, &event);
+    }
+}
+
+static int runEmulation(void* data) {
+    SDLBackendData* sdl = (SDLBackendData*)data;
+
+    sdl->loop(sdl->loopData);
+
+    SDL_AtomicSet(&sdl->emulating, 0);
+    SDL_SemPost(sdl->frameReady);
+    return 0;
+}
+
+static bool runLoopSDL(VM* vm, void (*loop)(void* data), void* data) {
+    SDLBackendData* sdl = (SDLBackendData*)vm->backendData;
+
+    sdl->loop = loop;
+    sdl->loopData = data;
+    SDL_AtomicSet(&sdl->speed, getEmulationSpeed(vm));
+    SDL_AtomicSet(&sdl->emulating, 1);
+
+    SDL_Thread* emulation = SDL_CreateThread(runEmulation, "emulation", sdl);
+    if (!emulation) {
+        log_warning(vm, "Could not start the emulation thread");
+        return false;
+    }
+
+    /* Woken up for every frame, the timeout is so events are still handled when no 
+     * frames come, like while paused */
+    while (SDL_AtomicGet(&sdl->emulating)) {
+        SDL_SemWaitTimeout(sdl->frameReady, EVENT_POLL_INTERVAL_MS);
+        queueEvents(sdl);
+        updateWindowTitle(sdl);
+        showLatestFrame(sdl);
+    }
+
+    SDL_WaitThread(emulation, NULL);
+    return true;
+}
+
+const Backend sdlBackend = {
+    .name = "sdl",
+    .init = initSDL,
+    .free = freeSDL,
+    .presentFrame = presentFrameSDL,
+    .pollInput = pollInputSDL,
+    .startClock = startClockRealtime,
+    .waitForFrame = waitForFrameSDL,
+    .runLoop = runLoopSDL
+};
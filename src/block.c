@@ -0,0 +1,193 @@
+#include "../include/block.h"
+#include "../include/vm.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Bytes taken by every opcode, CB prefixed instructions are always 2 */
+static const uint8_t instructionLengths[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,   /* 00 */
+    1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,   /* 10 */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,   /* 20 */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,   /* 30 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 40 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 50 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 60 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 70 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 80 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 90 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* A0 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* B0 */
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,   /* C0 */
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,   /* D0 */
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,   /* E0 */
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1    /* F0 */
+};
+
+#ifndef CPU_NO_BLOCK_CACHE
+static bool endsBlock(uint8_t opcode) {
+    /* Instructions after which the next one is never the one that follows in memory */
+    switch (opcode) {
+        case 0x10:                                  /* STOP */
+        case 0x18:                                  /* JR */
+        case 0x76:                                  /* HALT */
+        case 0xC3: case 0xE9:                       /* JP */
+        case 0xC9: case 0xD9:                       /* RET, RETI */
+        case 0xCD:                                  /* CALL */
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF:
+        case 0xE7: case 0xEF: case 0xF7: case 0xFF: /* RST */
+            return true;
+        default: return false;
+    }
+}
+
+static bool isCacheable(uint16_t address) {
+    /* ROM, WRAM and HRAM, everything else is decoded every time it runs */
+    return address <= ROM_NN_16KB_END ||
+           (address >= WRAM_N0_4KB && address <= WRAM_NN_4KB_END) ||
+           (address >= HRAM_N0 && address <= HRAM_N0_END);
+}
+#endif
+
+void initBlockCache(BlockCache* cache) {
+    cache->blocks = NULL;
+    cache->current = NULL;
+    cache->next = 0;
+    cache->operand = cache->scratch.bytes + 1;
+    memset(&cache->scratch, 0, sizeof(cache->scratch));
+    memset(cache->generation, 0, sizeof(cache->generation));
+    memset(cache->codeStart, 0xFF, sizeof(cache->codeStart));
+    memset(cache->codeEnd, 0, sizeof(cache->codeEnd));
+}
+
+bool allocateBlockCache(BlockCache* cache) {
+    cache->blocks = (Block*)malloc(sizeof(Block) * BLOCK_CACHE_SIZE);
+    if (cache->blocks == NULL) return false;
+
+    for (int i = 0; i < BLOCK_CACHE_SIZE; i++) cache->blocks[i].memory = NULL;
+    return true;
+}
+
+void freeBlockCache(BlockCache* cache) {
+    free(cache->blocks);
+    cache->blocks = NULL;
+    cache->current = NULL;
+}
+
+static void decodeInto(VM* vm, DecodedInstruction* instruction, uint16_t address) {
+    instruction->address = address;
+    instruction->bytes[0] = peekAddr(vm, address);
+    instruction->bytes[1] = peekAddr(vm, address + 1);
+    instruction->bytes[2] = peekAddr(vm, address + 2);
+    instruction->length = instructionLengths[instruction->bytes[0]];
+}
+
+const DecodedInstruction* decodeInstruction(VM* vm, uint16_t address) {
+    decodeInto(vm, &vm->blockCache.scratch, address);
+    return &vm->blockCache.scratch;
+}
+
+#ifndef CPU_NO_BLOCK_CACHE
+static void decodeBlock(VM* vm, Block* block, const uint8_t* memory, uint16_t start) {
+    BlockCache* cache = &vm->blockCache;
+    uint8_t page = start / MEMORY_PAGE_SIZE;
+    /* Blocks stay on their page, and HRAM blocks dont run into IE */
+    unsigned int limit = page == HRAM_N0 / MEMORY_PAGE_SIZE ? HRAM_N0_END + 1 
+                                                            : (page + 1) * MEMORY_PAGE_SIZE;
+    unsigned int address = start;
+
+    block->memory = memory;
+    block->start = start;
+    block->count = 0;
+    block->generation = cache->generation[page];
+#ifdef CPU_JIT
+    block->code = NULL;
+    block->runs = 0;
+    block->uncompilable = false;
+#endif
+
+    while (block->count < BLOCK_MAX_INSTRUCTIONS) {
+        DecodedInstruction* instruction = &block->instructions[block->count];
+
+        decodeInto(vm, instruction, address);
+        if (address + instruction->length > limit) break;
+
+        block->count++;
+        address += instruction->length;
+        if (endsBlock(instruction->bytes[0])) break;
+    }
+
+    if (block->count == 0 || page <= ROM_NN_16KB_END / MEMORY_PAGE_SIZE) return;
+
+    /* Writes to this part of the RAM page have to throw the block away */
+    uint8_t first = start % MEMORY_PAGE_SIZE;
+    uint8_t last = (address - 1) % MEMORY_PAGE_SIZE;
+
+    if (first < cache->codeStart[page]) cache->codeStart[page] = first;
+    if (last > cache->codeEnd[page]) cache->codeEnd[page] = last;
+
+    if (!vm->memoryPages[page].hasCode) {
+        vm->memoryPages[page].hasCode = true;
+        updateMemoryPages(vm, start, start);
+    }
+}
+#endif
+
+Block* lookupBlock(VM* vm) {
+#ifdef CPU_NO_BLOCK_CACHE
+    return NULL;
+#else
+    BlockCache* cache = &vm->blockCache;
+    uint16_t address = vm->PC;
+    const uint8_t* memory = vm->memoryPages[address / MEMORY_PAGE_SIZE].memory;
+
+    if (memory == NULL || !isCacheable(address)) return NULL;
+    memory += address % MEMORY_PAGE_SIZE;
+
+    uintptr_t key = (uintptr_t)memory;
+    Block* block = &cache->blocks[(key ^ (key >> 12)) & (BLOCK_CACHE_SIZE - 1)];
+
+    if (block->memory != memory || block->start != address || 
+            block->generation != cache->generation[address / MEMORY_PAGE_SIZE]) {
+        decodeBlock(vm, block, memory, address);
+    }
+
+    /* The instruction is cut off by the end of the page */
+    if (block->count == 0) return NULL;
+    return block;
+#endif
+}
+
+const DecodedInstruction* enterBlock(VM* vm) {
+    BlockCache* cache = &vm->blockCache;
+    Block* block = lookupBlock(vm);
+
+    if (block == NULL) {
+        cache->current = NULL;
+        return decodeInstruction(vm, vm->PC);
+    }
+
+    cache->current = block;
+    cache->next = 1;
+    return &block->instructions[0];
+}
+
+void writeCodePage(VM* vm, uint16_t address) {
+    BlockCache* cache = &vm->blockCache;
+    uint8_t page = address / MEMORY_PAGE_SIZE;
+    uint8_t offset = address % MEMORY_PAGE_SIZE;
+
+    if (offset < cache->codeStart[page] || offset > cache->codeEnd[page]) return;
+
+    /* Every block on the page is thrown away, and the page becomes writable again 
+     * until code is decoded from it */
+    cache->generation[page]++;
+    cache->codeStart[page] = 0xFF;
+    cache->codeEnd[page] = 0;
+
+    vm->memoryPages[page].hasCode = false;
+    updateMemoryPages(vm, address, address);
+
+    if (cache->current != NULL && cache->current->start / MEMORY_PAGE_SIZE == page) {
+        cache->current = NULL;
+    }
+}
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -46,10 +47,7 @@
 #define DEC_RR(vm, RR) set_reg16(vm, RR, (get_reg16(vm, RR) - 1)); cyclesSync_4(vm)
 
 /* Direct Jump */
-#define JUMP(vm, a16) vm->PC = a16; cyclesSync_4(vm)
 #define JUMP_RR(vm, RR) vm->PC = get_reg16(vm, RR)
-/* Relative Jump */
-#define JUMP_RL(vm, i8) vm->PC += (int8_t)i8; cyclesSync_4(vm)
 
 #define PUSH_R16(vm, RR) cyclesSync_4(vm); push16(vm, get_reg16(vm, RR))
 #define POP_R16(vm, RR) set_reg16(vm, RR, pop16(vm))
@@ -59,41 +57,27 @@
 #define CCF(vm) set_flag(vm, FLAG_C, get_flag(vm, FLAG_C) ^ 1); \
                 set_flag(vm, FLAG_N, 0);                        \
                 set_flag(vm, FLAG_H, 0)
-/* Flag utility macros */
-#define TEST_Z_FLAG(vm, r) set_flag(vm, FLAG_Z, r == 0 ? 1 : 0)
-/* We check if a carry over for the last 4 bits happened 
- * ref : https://www.reddit.com/r/EmuDev/comments/4ycoix/a_guide_to_the_gameboys_halfcarry_flag*/
-#define TEST_H_FLAG_ADD(vm, x, y) set_flag(vm, FLAG_H, \
-                                    (((uint32_t)x & 0xf) + ((uint32_t)y & 0xf) > 0xf) ? 1 : 0)
 
+/* Builds the bit of a flag in the F register */
+#define FLAG_BIT(flag, bit) ((bit) << ((flag) + 4))
 
-
-/* half carry counts when theres carry from bit 11-12 for most 16 bit instructions */
-
-#define TEST_H_FLAG_ADD16(vm, x, y) set_flag(vm, FLAG_H, \
-                                    (((uint32_t)x & 0xfff) + ((uint32_t)y & 0xfff) > 0xfff) ? 1 : 0 )
-
-#define TEST_H_FLAG_SUB(vm, x, y) set_flag(vm, FLAG_H, \
-                                    (((x & 0xf) - (y & 0xf) & 0x10) ? 1 : 0))
-/* Test for integer overloads and set carry flags */
-#define TEST_C_FLAG_ADD16(vm, x, y) set_flag(vm, FLAG_C, ((uint32_t)(x) + (uint32_t)(y)) > 0xFFFF ? 1 : 0)
-#define TEST_C_FLAG_ADD8(vm, x, y) set_flag(vm, FLAG_C, ((uint16_t)(x) + (uint16_t)(y)) > 0xFF ? 1 : 0)
-#define TEST_C_FLAG_SUB16(vm, x, y) set_flag(vm, FLAG_C, ((int)(x) - (int)(y)) < 0 ? 1 : 0)
-#define TEST_C_FLAG_SUB8(vm, x, y) set_flag(vm, FLAG_C, ((int)(x) - (int)(y)) < 0 ? 1 : 0)
-
-static uint8_t readAddr(VM* vm, uint16_t addr);
-static void writeAddr(VM* vm, uint16_t addr, uint8_t byte);
+static inline uint8_t readAddr(VM* vm, uint16_t addr);
+static inline void writeAddr(VM* vm, uint16_t addr, uint8_t byte);
 static inline void writeAddr_4C(VM* vm, uint16_t addr, uint8_t byte);
 static inline uint8_t readAddr_4C(VM* vm, uint16_t addr);
 
+/* Operands of the running instruction were already decoded when it was fetched,
+ * these take them in order while moving the PC along, see block.h */
+
 static inline uint8_t readByte(VM* vm) {
     /* Reads a byte and doesnt consume any cycles */
-    return vm->MEM[vm->PC++];
+    vm->PC++;
+    return *vm->blockCache.operand++;
 }
 
 static inline uint8_t readByte_4C(VM* vm) {
     /* Reads a byte and consumes 4 cycles */
-    uint8_t byte = vm->MEM[vm->PC++];
+    uint8_t byte = readByte(vm);
 
     cyclesSync_4(vm);
     return byte;
@@ -101,42 +85,175 @@ static inline uint8_t readByte_4C(VM* vm) {
 
 static inline uint16_t read2Bytes(VM* vm) {
     /* Reads 2 bytes and doesnt consume any cycles */
-    return (uint16_t)(vm->MEM[vm->PC++] | (vm->MEM[vm->PC++] << 8));
+    uint8_t low = readByte(vm);
+    uint8_t high = readByte(vm);
+
+    return (uint16_t)(low | (high << 8));
 }
 
 static uint16_t read2Bytes_8C(VM* vm) {
     /* Reads 2 bytes and consumes 8 cycles, 4 per byte */
-    uint8_t low = vm->MEM[vm->PC++]; 
+    uint8_t low = readByte(vm); 
     cyclesSync_4(vm);
 
-    uint8_t high = vm->MEM[vm->PC++];
+    uint8_t high = readByte(vm);
     cyclesSync_4(vm);
 
     return (uint16_t)(low | (high << 8));
 }
 
+/* Lazy flags
+ *
+ * Most instructions overwrite the flags set by the previous one before anything reads them,
+ * so instead of updating F, ALU instructions only record what operation they did and on 
+ * which operands. The flags it affects (lazyFlagsMask) are then built from that record 
+ * when F is actually read, by a conditional instruction, ADC/SBC, DAA, PUSH AF, 
+ * an interrupt or the debugger. Flags that are not in the mask are kept in GPR[R8_F] */
+
+static uint8_t computeLazyFlags(VM* vm) {
+    uint16_t a = vm->lazyFlagsA;
+    uint16_t b = vm->lazyFlagsB;
+    uint8_t carry = vm->lazyFlagsCarry;
+
+    switch (vm->lazyFlagsOp) {
+        case LAZY_FLAGS_ADD8: {
+            /* ADC adds the carry flag on top, a half carry/carry can happen on either 
+             * of the 2 additions so we add all 3 at once and test the sum
+             * ref : https://www.reddit.com/r/EmuDev/comments/4ycoix/a_guide_to_the_gameboys_halfcarry_flag*/
+            uint16_t result = a + b + carry;
+
+            return FLAG_BIT(FLAG_Z, (uint8_t)result == 0) |
+                   FLAG_BIT(FLAG_H, ((a & 0xF) + (b & 0xF) + carry) > 0xF) |
+                   FLAG_BIT(FLAG_C, result > 0xFF);
+        }
+        case LAZY_FLAGS_SUB8: {
+            /* Same as above but a borrow is checked for instead, SBC subtracts the carry too */
+            uint8_t result = a - b - carry;
+
+            return FLAG_BIT(FLAG_Z, result == 0) |
+                   FLAG_BIT(FLAG_N, 1) |
+                   FLAG_BIT(FLAG_H, (a & 0xF) < (b & 0xF) + carry) |
+                   FLAG_BIT(FLAG_C, a < b + carry);
+        }
+        case LAZY_FLAGS_ADD16:
+            /* half carry counts when theres carry from bit 11-12 for most 16 bit instructions */
+            return FLAG_BIT(FLAG_H, ((uint32_t)(a & 0xFFF) + (uint32_t)(b & 0xFFF)) > 0xFFF) |
+                   FLAG_BIT(FLAG_C, ((uint32_t)a + (uint32_t)b) > 0xFFFF);
+        case LAZY_FLAGS_ZERO:
+            /* Only Z depends on the result, which is kept in lazyFlagsA */
+            return FLAG_BIT(FLAG_Z, (uint8_t)a == 0);
+        default: return 0;
+    }
+}
+
+static inline void resolveFlags(VM* vm) {
+    /* Brings the F register up to date */
+    if (vm->lazyFlagsOp == LAZY_FLAGS_NONE) return;
+
+    vm->GPR[R8_F] = (vm->GPR[R8_F] & ~vm->lazyFlagsMask) | (computeLazyFlags(vm) & vm->lazyFlagsMask);
+    vm->lazyFlagsOp = LAZY_FLAGS_NONE;
+}
+
+static inline void setLazyFlags(VM* vm, LAZY_FLAGS_OP op, uint16_t a, uint16_t b, uint8_t carry,
+        uint8_t mask) {
+    /* Records an operation, flags outside the mask have to already be in F */
+    vm->lazyFlagsOp = op;
+    vm->lazyFlagsA = a;
+    vm->lazyFlagsB = b;
+    vm->lazyFlagsCarry = carry;
+    vm->lazyFlagsMask = mask;
+}
+
+static inline void setFlags(VM* vm, uint8_t flags) {
+    /* Overwrites all the flags with already known values */
+    vm->GPR[R8_F] = flags;
+    vm->lazyFlagsOp = LAZY_FLAGS_NONE;
+}
+
+/* The following are used by instructions to record their effect on the flags */
+
+static inline void setFlagsAdd8(VM* vm, uint8_t old, uint8_t toAdd, uint8_t carry) {
+    setLazyFlags(vm, LAZY_FLAGS_ADD8, old, toAdd, carry, 0xF0);
+}
+
+static inline void setFlagsSub8(VM* vm, uint8_t old, uint8_t toSub, uint8_t carry) {
+    setLazyFlags(vm, LAZY_FLAGS_SUB8, old, toSub, carry, 0xF0);
+}
+
+static inline void setFlagsZero(VM* vm, uint8_t result, uint8_t otherFlags) {
+    /* Z is tested on the result, N H and C are already known */
+    vm->GPR[R8_F] = otherFlags;
+    setLazyFlags(vm, LAZY_FLAGS_ZERO, result, 0, 0, FLAG_BIT(FLAG_Z, 1));
+}
+
+static inline void setFlagsInc8(VM* vm, uint8_t old) {
+    /* C is left unchanged */
+    resolveFlags(vm);
+    setLazyFlags(vm, LAZY_FLAGS_ADD8, old, 1, 0, 0xF0 & ~FLAG_BIT(FLAG_C, 1));
+}
+
+static inline void setFlagsDec8(VM* vm, uint8_t old) {
+    /* C is left unchanged */
+    resolveFlags(vm);
+    setLazyFlags(vm, LAZY_FLAGS_SUB8, old, 1, 0, 0xF0 & ~FLAG_BIT(FLAG_C, 1));
+}
+
+static inline void setFlagsBit(VM* vm, uint8_t bitValue) {
+    /* Z is set if the bit is 0, N = 0, H = 1 and C is left unchanged */
+    resolveFlags(vm);
+    vm->GPR[R8_F] = (vm->GPR[R8_F] & FLAG_BIT(FLAG_C, 1)) | FLAG_BIT(FLAG_H, 1);
+    setLazyFlags(vm, LAZY_FLAGS_ZERO, bitValue, 0, 0, FLAG_BIT(FLAG_Z, 1));
+}
+
+static inline void setFlagsAdd16(VM* vm, uint16_t old, uint16_t toAdd) {
+    /* Z is left unchanged, N = 0 */
+    resolveFlags(vm);
+    setLazyFlags(vm, LAZY_FLAGS_ADD16, old, toAdd, 0, 0xF0 & ~FLAG_BIT(FLAG_Z, 1));
+}
+
+static inline void setFlagsAddSP(VM* vm, uint8_t old, uint8_t toAdd) {
+    /* Adding a signed 8 bit integer to SP sets H and C like an 8 bit addition 
+     * on the low byte, Z and N are always 0 */
+    vm->GPR[R8_F] = 0;
+    setLazyFlags(vm, LAZY_FLAGS_ADD8, old, toAdd, 0, FLAG_BIT(FLAG_H, 1) | FLAG_BIT(FLAG_C, 1));
+}
+
 static inline void set_flag(VM* vm, FLAG flag, uint8_t bit) {
     /* Since the flags are enums and in order, their numeric value
      * can be used to decide which bit to modify
      * We set the flag's corresponding bit to 1 */
+    resolveFlags(vm);
     if (bit) vm->GPR[R8_F] |= 1 << (flag + 4);
     /* Otherwise 0 */
     else vm->GPR[R8_F] &= ~(1 << (flag + 4));
 }
 
 static inline uint8_t get_flag(VM* vm, FLAG flag) {
-    return (vm->GPR[R8_F] >> (flag + 4)) & 1;
+    if (vm->lazyFlagsOp == LAZY_FLAGS_NONE || !(vm->lazyFlagsMask & FLAG_BIT(flag, 1))) {
+        return (vm->GPR[R8_F] >> (flag + 4)) & 1;
+    }
+
+    return (computeLazyFlags(vm) >> (flag + 4)) & 1;
+}
+
+uint8_t getFlagsRegister(VM* vm) {
+    resolveFlags(vm);
+    return vm->GPR[R8_F];
 }
 
 /* Retrives the value of the 16 bit registers by combining the values
  * of its 8 bit registers */
 static inline uint16_t get_reg16(VM* vm, GP_REG RR) {
+    /* PUSH AF reads the flags */
+    if (RR == R16_AF) resolveFlags(vm);
     return ((vm->GPR[RR] << 8) | vm->GPR[RR + 1]);
 }
 
 /* Sets 16 bit register by modifying the individual 8 bit registers
  * it consists of */
 static inline uint16_t set_reg16(VM* vm, GP_REG RR, uint16_t v) {
+    /* POP AF overwrites all the flags */
+    if (RR == R16_AF) vm->lazyFlagsOp = LAZY_FLAGS_NONE;
     vm->GPR[RR] = v >> 8; 
     vm->GPR[RR + 1] = v & 0xFF;
 
@@ -157,7 +274,7 @@ void resetGBC(VM* vm) {
     vm->PC = 0x0100;
     set_reg16(vm, R16_SP, 0xFFFE);
     vm->GPR[R8_A] = 0x11;
-    vm->GPR[R8_F] = 0b10000000;
+    setFlags(vm, 0b10000000);
     vm->GPR[R8_B] = 0x00;
     vm->GPR[R8_C] = 0x00;
     vm->GPR[R8_D] = 0xFF;
@@ -201,7 +318,7 @@ void resetGB(VM* vm) {
     vm->PC = 0x0100;
     set_reg16(vm, R16_SP, 0xFFFE);
     vm->GPR[R8_A] = 0x01;
-    vm->GPR[R8_F] = 0xF0;
+    setFlags(vm, 0xF0);
     vm->GPR[R8_B] = 0x00;
     vm->GPR[R8_C] = 0x13;
     vm->GPR[R8_D] = 0x00;
@@ -245,10 +362,8 @@ static void load_rr_rri8(VM* vm, GP_REG RR1, GP_REG RR2) {
      * RR1 = RR2 + I8 */
     uint16_t old = get_reg16(vm, RR2); 
     int8_t toAdd = (int8_t)readByte_4C(vm);
-    uint16_t result = set_reg16(vm, RR1, old + toAdd);
+    set_reg16(vm, RR1, old + toAdd);
 
-    set_flag(vm, FLAG_Z, 0);
-    set_flag(vm, FLAG_N, 0);
 
     /* For some reason this 16 bit addition does not do normal 
      * 16 bit half carry setting, so we do the 8 bit test */
@@ -256,8 +371,7 @@ static void load_rr_rri8(VM* vm, GP_REG RR1, GP_REG RR2) {
 
     /* We passed unsigned version to flag tests to handle
      * flags because at the low level its basically the same thing */
-    TEST_H_FLAG_ADD(vm, old, (uint8_t)toAdd);
-    TEST_C_FLAG_ADD8(vm, old, (uint8_t)toAdd);
+    setFlagsAddSP(vm, old, (uint8_t)toAdd);
 	
 	/* Internal */
 	cyclesSync_4(vm);
@@ -269,17 +383,14 @@ static void incrementR8(VM* vm, GP_REG R) {
     uint8_t old = vm->GPR[R];
     vm->GPR[R]++;
 
-    TEST_Z_FLAG(vm, vm->GPR[R]);
-    TEST_H_FLAG_ADD(vm, old, 1);
-    set_flag(vm, FLAG_N, 0);
+    setFlagsInc8(vm, old);
 }
 
 static void decrementR8(VM* vm, GP_REG R) {
     /* Decrementing for 8 bit registers */
-    uint8_t old = vm->GPR[R]; uint8_t new = --vm->GPR[R];
-    TEST_Z_FLAG(vm, new);
-    set_flag(vm, FLAG_N, 1);
-    TEST_H_FLAG_SUB(vm, old, 1);
+    uint8_t old = vm->GPR[R];
+    vm->GPR[R]--;
+    setFlagsDec8(vm, old);
 }
 
 /* The folloing functions are used for all 8 bit rotation 
@@ -294,14 +405,8 @@ static void rotateLeftR8(VM* vm, GP_REG R, bool setZFlag) {
     toModify |= bit7;
 
     vm->GPR[R] = toModify;
-    if (setZFlag) {
-        TEST_Z_FLAG(vm, toModify);
-    } else {
-        set_flag(vm, FLAG_Z, 0);
-    }
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit7);  
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit7));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit7));
 }
 
 static void rotateLeftAR16(VM* vm, GP_REG R16, bool setZFlag) {
@@ -313,14 +418,8 @@ static void rotateLeftAR16(VM* vm, GP_REG R16, bool setZFlag) {
     toModify |= bit7;
 
     writeAddr_4C(vm, addr, toModify);
-    if (setZFlag) {
-        TEST_Z_FLAG(vm, toModify);
-    } else {
-        set_flag(vm, FLAG_Z, 0);
-    }
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit7);  
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit7));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit7));
 }
 
 static void rotateRightR8(VM* vm, GP_REG R, bool setZFlag) {
@@ -333,14 +432,8 @@ static void rotateRightR8(VM* vm, GP_REG R, bool setZFlag) {
 
     vm->GPR[R] = toModify;
 
-    if (setZFlag) {
-        TEST_Z_FLAG(vm, toModify);
-    } else {
-        set_flag(vm, FLAG_Z, 0);
-    }
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit1); 
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit1));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit1));
 }
 
 static void rotateRightAR16(VM* vm, GP_REG R16, bool setZFlag) {
@@ -353,12 +446,8 @@ static void rotateRightAR16(VM* vm, GP_REG R16, bool setZFlag) {
 
     writeAddr_4C(vm, addr, toModify);
 
-    if (setZFlag) TEST_Z_FLAG(vm, toModify);
-    else set_flag(vm, FLAG_Z, 0);
-
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit1); 
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit1));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit1));
 }
 
 static void rotateLeftCarryR8(VM* vm, GP_REG R8, bool setZFlag) {
@@ -373,12 +462,8 @@ static void rotateLeftCarryR8(VM* vm, GP_REG R8, bool setZFlag) {
 
     vm->GPR[R8] = toModify;
 
-    if (setZFlag) TEST_Z_FLAG(vm, toModify);
-    else set_flag(vm, FLAG_Z, 0);
-
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit7);
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit7));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit7));
 }
 
 static void rotateLeftCarryAR16(VM* vm, GP_REG R16, bool setZFlag) {
@@ -392,12 +477,8 @@ static void rotateLeftCarryAR16(VM* vm, GP_REG R16, bool setZFlag) {
 
     writeAddr_4C(vm, addr, toModify);
 
-    if (setZFlag) TEST_Z_FLAG(vm, toModify);
-    else set_flag(vm, FLAG_Z, 0);
-
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit7);
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit7));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit7));
 }
 
 static void rotateRightCarryR8(VM* vm, GP_REG R8, bool setZFlag) {
@@ -412,12 +493,8 @@ static void rotateRightCarryR8(VM* vm, GP_REG R8, bool setZFlag) {
 
     vm->GPR[R8] = toModify;
 
-    if (setZFlag) TEST_Z_FLAG(vm, toModify);
-    else set_flag(vm, FLAG_Z, 0);
-
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit0);
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit0));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit0));
 }
 
 static void rotateRightCarryAR16(VM* vm, GP_REG R16, bool setZFlag) {
@@ -431,12 +508,8 @@ static void rotateRightCarryAR16(VM* vm, GP_REG R16, bool setZFlag) {
 
     writeAddr_4C(vm, addr, toModify);
 
-    if (setZFlag) TEST_Z_FLAG(vm, toModify);
-    else set_flag(vm, FLAG_Z, 0);
-
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit0);
+    if (setZFlag) setFlagsZero(vm, toModify, FLAG_BIT(FLAG_C, bit0));
+    else setFlags(vm, FLAG_BIT(FLAG_C, bit0));
 }
 
 static void shiftLeftArithmeticR8(VM* vm, GP_REG R) {
@@ -446,10 +519,7 @@ static void shiftLeftArithmeticR8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit7);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_C, bit7));
 }
 
 static void shiftLeftArithmeticAR16(VM* vm, GP_REG R16) {
@@ -460,10 +530,7 @@ static void shiftLeftArithmeticAR16(VM* vm, GP_REG R16) {
 
     writeAddr_4C(vm, addr, result);
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit7);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_C, bit7));
 }
 
 static void shiftRightLogicalR8(VM* vm, GP_REG R) {
@@ -473,10 +540,7 @@ static void shiftRightLogicalR8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit1);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_C, bit1));
 }
 
 static void shiftRightLogicalAR16(VM* vm, GP_REG R16) {
@@ -487,10 +551,7 @@ static void shiftRightLogicalAR16(VM* vm, GP_REG R16) {
 
     writeAddr_4C(vm, addr, result);
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit1);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_C, bit1));
 }
 
 static void shiftRightArithmeticR8(VM* vm, GP_REG R) {
@@ -503,10 +564,7 @@ static void shiftRightArithmeticR8(VM* vm, GP_REG R) {
     result |= bit7 << 7;
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit0);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_C, bit0));
 }
 
 static void shiftRightArithmeticAR16(VM* vm, GP_REG R16) {
@@ -520,10 +578,7 @@ static void shiftRightArithmeticAR16(VM* vm, GP_REG R16) {
     result |= bit7 << 7;
     writeAddr_4C(vm, addr, result);
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_C, bit0);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_C, bit0));
 }
 
 static void swapR8(VM* vm, GP_REG R8) {
@@ -535,10 +590,7 @@ static void swapR8(VM* vm, GP_REG R8) {
 
      vm->GPR[R8] = newValue;
 
-     TEST_Z_FLAG(vm, newValue);
-     set_flag(vm, FLAG_H, 0);
-     set_flag(vm, FLAG_N, 0);
-     set_flag(vm, FLAG_C, 0);
+     setFlagsZero(vm, newValue, 0);
 }
 
 static void swapAR16(VM* vm, GP_REG R16) {
@@ -551,28 +603,21 @@ static void swapAR16(VM* vm, GP_REG R16) {
 
      writeAddr_4C(vm, addr, newValue);
 
-     TEST_Z_FLAG(vm, newValue);
-     set_flag(vm, FLAG_H, 0);
-     set_flag(vm, FLAG_N, 0);
-     set_flag(vm, FLAG_C, 0);
+     setFlagsZero(vm, newValue, 0);
 }
 
 static void testBitR8(VM* vm, GP_REG R8, uint8_t bit) {
     uint8_t value = vm->GPR[R8];
     uint8_t bitValue = (value >> bit) & 0x1;
 
-    TEST_Z_FLAG(vm, bitValue);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 1);
+    setFlagsBit(vm, bitValue);
 }
 
 static void testBitAR16(VM* vm, GP_REG R16, uint8_t bit) {
     uint8_t value = readAddr_4C(vm, get_reg16(vm, R16));
     uint8_t bitValue = (value >> bit) & 0x1;
 
-    TEST_Z_FLAG(vm, bitValue);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 1);
+    setFlagsBit(vm, bitValue);
 }
 
 static void setBitR8(VM* vm, GP_REG R8, uint8_t bit) {
@@ -616,11 +661,9 @@ static void resetBitAR16(VM* vm, GP_REG R16, uint8_t bit) {
 static void addR16(VM* vm, GP_REG RR1, GP_REG RR2) {
     uint16_t old = get_reg16(vm, RR1); 
     uint16_t toAdd = get_reg16(vm, RR2);
-    uint16_t result = set_reg16(vm, RR1, old + toAdd);
+    set_reg16(vm, RR1, old + toAdd);
 
-    set_flag(vm, FLAG_N, 0);
-    TEST_H_FLAG_ADD16(vm, old, toAdd);
-    TEST_C_FLAG_ADD16(vm, old, toAdd);
+    setFlagsAdd16(vm, old, toAdd);
 
     cyclesSync_4(vm);
 }
@@ -630,9 +673,7 @@ static void addR16(VM* vm, GP_REG RR1, GP_REG RR2) {
 static void addR16I8(VM* vm, GP_REG RR) {
     uint16_t old = get_reg16(vm, RR);
     int8_t toAdd = (int8_t)readByte_4C(vm);
-    uint16_t result = set_reg16_8C(vm, RR, old + toAdd);
-    set_flag(vm, FLAG_Z, 0);
-    set_flag(vm, FLAG_N, 0);
+    set_reg16_8C(vm, RR, old + toAdd);
 
     /* For some reason this 16 bit addition does not do normal 
      * 16 bit half carry setting, so we do the 8 bit test */
@@ -640,8 +681,7 @@ static void addR16I8(VM* vm, GP_REG RR) {
 
     /* We passed unsigned version to flag tests to handle
      * flags because at the low level its basically the same thing */
-    TEST_H_FLAG_ADD(vm, old, (uint8_t)toAdd);
-    TEST_C_FLAG_ADD8(vm, old, (uint8_t)toAdd);
+    setFlagsAddSP(vm, old, (uint8_t)toAdd);
 }
 
 static void addR8(VM* vm, GP_REG R1, GP_REG R2) {
@@ -651,10 +691,7 @@ static void addR8(VM* vm, GP_REG R1, GP_REG R2) {
 
     vm->GPR[R1] = result;
     
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    TEST_H_FLAG_ADD(vm, old, toAdd);
-    TEST_C_FLAG_ADD8(vm, old, toAdd);
+    setFlagsAdd8(vm, old, toAdd, 0);
 }
 
 static void addR8D8(VM* vm, GP_REG R) {
@@ -664,10 +701,7 @@ static void addR8D8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    TEST_H_FLAG_ADD(vm, old, data);
-    TEST_C_FLAG_ADD8(vm, old, data);
+    setFlagsAdd8(vm, old, data, 0);
 }
 
 static void addR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
@@ -677,38 +711,7 @@ static void addR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
 
     vm->GPR[R8] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    TEST_H_FLAG_ADD(vm, old, toAdd);
-    TEST_C_FLAG_ADD8(vm, old, toAdd);
-}
-
-static void test_adc_hcflags(VM* vm, uint8_t old, uint8_t toAdd, uint8_t result, uint8_t carry) {
-    /* ADC has a slightly different behaviour i.e it adds the
-     * carry flag to the result, the normal H & C flag tests 
-     * have edge cases if used with ADC, so we do a custom test here */
-
-    bool halfCarryOccurred = false;
-    bool carryOccured = false;
-
-    /* Half carry - It can occur either when:
-     * 1. The initial value is added to the value that has to be added 
-     * 2. The result of the above is added to the carry flag 
-     *
-     * We note if a half carry occured in both the cases */
-
-    if (((old & 0xF) + (toAdd & 0xF)) > 0xF) halfCarryOccurred = true;
-    if (((result & 0xF) + (carry & 0xF)) > 0xF) halfCarryOccurred = true;
-
-    /* Carry Flag - When theres an integer overflow for the 8 bit addition
-     * we set the carry flag, the overflow must also be calculated separately like
-     * we did for half carry */
-
-    if (((uint16_t)old + (uint16_t)toAdd) > 0xFF) carryOccured = true;
-    if (((uint16_t)result + (uint16_t)carry) > 0xFF) carryOccured = true;
-
-    set_flag(vm, FLAG_H, halfCarryOccurred);
-    set_flag(vm, FLAG_C, carryOccured);
+    setFlagsAdd8(vm, old, toAdd, 0);
 }
 
 static void adcR8(VM* vm, GP_REG R1, GP_REG R2) {
@@ -720,9 +723,7 @@ static void adcR8(VM* vm, GP_REG R1, GP_REG R2) {
 
     vm->GPR[R1] = finalResult;
 
-    TEST_Z_FLAG(vm, finalResult);
-    set_flag(vm, FLAG_N, 0);
-    test_adc_hcflags(vm, old, toAdd, result, carry);
+    setFlagsAdd8(vm, old, toAdd, carry);
 }
 
 static void adcR8D8(VM* vm, GP_REG R) {
@@ -734,9 +735,7 @@ static void adcR8D8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = finalResult;
 
-    TEST_Z_FLAG(vm, finalResult);
-    set_flag(vm, FLAG_N, 0);
-    test_adc_hcflags(vm, old, data, result, carry);
+    setFlagsAdd8(vm, old, data, carry);
 }
 
 static void adcR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
@@ -748,9 +747,7 @@ static void adcR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
 
     vm->GPR[R8] = finalResult;
 
-    TEST_Z_FLAG(vm, finalResult);
-    set_flag(vm, FLAG_N, 0);
-    test_adc_hcflags(vm, old, toAdd, result, carry);
+    setFlagsAdd8(vm, old, toAdd, carry);
 }
 
 static void subR8(VM* vm, GP_REG R1, GP_REG R2) {
@@ -760,10 +757,7 @@ static void subR8(VM* vm, GP_REG R1, GP_REG R2) {
 
     vm->GPR[R1] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 1);
-    TEST_H_FLAG_SUB(vm, old, toSub);
-    TEST_C_FLAG_SUB8(vm, old, toSub);
+    setFlagsSub8(vm, old, toSub, 0);
 }
 
 static void subR8D8(VM* vm, GP_REG R) {
@@ -773,10 +767,7 @@ static void subR8D8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 1);
-    TEST_H_FLAG_SUB(vm, old, data);
-    TEST_C_FLAG_SUB8(vm, old, data);
+    setFlagsSub8(vm, old, data, 0);
 }
 
 static void subR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
@@ -786,28 +777,7 @@ static void subR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
 
     vm->GPR[R8] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 1);
-    TEST_H_FLAG_SUB(vm, old, toSub);
-    TEST_C_FLAG_SUB8(vm, old, toSub);
-}
-
-static void test_sbc_hcflags(VM* vm, uint8_t old, uint8_t toSub, uint8_t result, uint8_t carry) {
-    /* SBC is also similar to ADC so we need a custom test here aswell */
-    bool halfCarryOccurred = false;
-    bool carryOccurred = false;
-    
-    uint8_t oldLow = old & 0xF;
-    uint8_t resultLow = result & 0xF;
-
-    if ((uint8_t)(oldLow - (toSub & 0xF)) > oldLow) halfCarryOccurred = true;
-    if ((uint8_t)(resultLow - carry) > resultLow) halfCarryOccurred = true;
-
-    if ((uint8_t)((uint16_t)old - (uint16_t)toSub) > old) carryOccurred = true;
-    if ((uint8_t)((uint16_t)result - carry) > result) carryOccurred = true;
-
-    set_flag(vm, FLAG_H, halfCarryOccurred);
-    set_flag(vm, FLAG_C, carryOccurred);
+    setFlagsSub8(vm, old, toSub, 0);
 }
 
 static void sbcR8(VM* vm, GP_REG R1, GP_REG R2) {
@@ -819,9 +789,7 @@ static void sbcR8(VM* vm, GP_REG R1, GP_REG R2) {
 
     vm->GPR[R1] = finalResult;
 
-    TEST_Z_FLAG(vm, finalResult);
-    set_flag(vm, FLAG_N, 1);
-    test_sbc_hcflags(vm, old, toSub, result, carry);
+    setFlagsSub8(vm, old, toSub, carry);
 }
 
 static void sbcR8D8(VM* vm, GP_REG R) {
@@ -833,9 +801,7 @@ static void sbcR8D8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = finalResult;
 
-    TEST_Z_FLAG(vm, finalResult);
-    set_flag(vm, FLAG_N, 1);
-    test_sbc_hcflags(vm, old, data, result, carry);
+    setFlagsSub8(vm, old, data, carry);
 }
 
 static void sbcR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
@@ -847,9 +813,7 @@ static void sbcR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
 
     vm->GPR[R8] = finalResult;
 
-    TEST_Z_FLAG(vm, finalResult);
-    set_flag(vm, FLAG_N, 1);
-    test_sbc_hcflags(vm, old, toSub, result, carry);
+    setFlagsSub8(vm, old, toSub, carry);
 }
 
 static void andR8(VM* vm, GP_REG R1, GP_REG R2) {
@@ -859,10 +823,7 @@ static void andR8(VM* vm, GP_REG R1, GP_REG R2) {
 
     vm->GPR[R1] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 1);
-    set_flag(vm, FLAG_C, 0);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_H, 1));
 }
 
 static void andR8D8(VM* vm, GP_REG R) {
@@ -872,10 +833,7 @@ static void andR8D8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 1);
-    set_flag(vm, FLAG_C, 0);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_H, 1));
 }
 
 static void andR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
@@ -885,10 +843,7 @@ static void andR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
 
     vm->GPR[R8] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 1);
-    set_flag(vm, FLAG_C, 0);
+    setFlagsZero(vm, result, FLAG_BIT(FLAG_H, 1));
 }
 
 static void xorR8(VM* vm, GP_REG R1, GP_REG R2) {
@@ -898,10 +853,7 @@ static void xorR8(VM* vm, GP_REG R1, GP_REG R2) {
 
     vm->GPR[R1] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_C, 0);
+    setFlagsZero(vm, result, 0);
 }
 
 static void xorR8D8(VM* vm, GP_REG R) {
@@ -911,10 +863,7 @@ static void xorR8D8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_C, 0);
+    setFlagsZero(vm, result, 0);
 }
 
 static void xorR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
@@ -924,10 +873,7 @@ static void xorR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
 
     vm->GPR[R8] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_C, 0);
+    setFlagsZero(vm, result, 0);
 }
 
 static void orR8(VM* vm, GP_REG R1, GP_REG R2) {
@@ -937,10 +883,7 @@ static void orR8(VM* vm, GP_REG R1, GP_REG R2) {
 
     vm->GPR[R1] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_C, 0);   
+    setFlagsZero(vm, result, 0);
 }
 
 static void orR8D8(VM* vm, GP_REG R) {
@@ -950,10 +893,7 @@ static void orR8D8(VM* vm, GP_REG R) {
 
     vm->GPR[R] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_C, 0);   
+    setFlagsZero(vm, result, 0);
 }
 
 static void orR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
@@ -963,44 +903,29 @@ static void orR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
 
     vm->GPR[R8] = result;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 0);
-    set_flag(vm, FLAG_H, 0);
-    set_flag(vm, FLAG_C, 0);
+    setFlagsZero(vm, result, 0);
 }
 
 static void compareR8(VM* vm, GP_REG R1, GP_REG R2) {
     /* Basically R1 - R2, but results are thrown away and R1 is unchanged */
     uint8_t old = vm->GPR[R1];
     uint8_t toSub = vm->GPR[R2];
-    uint8_t result = old - toSub;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 1);
-    TEST_H_FLAG_SUB(vm, old, toSub);
-    TEST_C_FLAG_SUB8(vm, old, toSub);
+    setFlagsSub8(vm, old, toSub, 0);
 }
 
 static void compareR8D8(VM* vm, GP_REG R) {
     uint8_t old = vm->GPR[R];
     uint8_t toSub = readByte_4C(vm);
-    uint8_t result = old - toSub;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 1);
-    TEST_H_FLAG_SUB(vm, old, toSub);
-    TEST_C_FLAG_SUB8(vm, old, toSub);
+    setFlagsSub8(vm, old, toSub, 0);
 }
 
 static void compareR8_AR16(VM* vm, GP_REG R8, GP_REG R16) {
     uint8_t old = vm->GPR[R8];
     uint8_t toSub = readAddr_4C(vm, get_reg16(vm, R16));
-    uint8_t result = old - toSub;
 
-    TEST_Z_FLAG(vm, result);
-    set_flag(vm, FLAG_N, 1);
-    TEST_H_FLAG_SUB(vm, old, toSub);
-    TEST_C_FLAG_SUB8(vm, old, toSub);       
+    setFlagsSub8(vm, old, toSub, 0);
 }
 
 /* The following functions are responsible for returning, calling & stack manipulation*/
@@ -1071,6 +996,15 @@ static void cpl(VM* vm) {
 
 /* Conditional Jumps (both relative and direct) */ 
 
+static inline void checkJumpBack(VM* vm, uint16_t end) {
+    /* A jump a short way back could be the end of an idle loop, end is the address 
+     * right after the jump instruction */
+    if (!vm->idleLoop.enabled || vm->PC >= end || end - vm->PC > IDLE_LOOP_MAX_SIZE) return;
+
+    resolveFlags(vm);
+    checkIdleLoop(vm, vm->PC, end);
+}
+
 #define CONDITION_NZ(vm) (get_flag(vm, FLAG_Z) != 1)
 #define CONDITION_NC(vm) (get_flag(vm, FLAG_C) != 1)
 #define CONDITION_Z(vm)  (get_flag(vm, FLAG_Z) == 1)
@@ -1082,17 +1016,22 @@ static void jumpCondition(VM* vm, bool isTrue) {
     if (isTrue) {
 	    /* Cycles sync after branch decision */
 		cyclesSync_4(vm);
+
+        uint16_t end = vm->PC;
 		vm->PC = address;
+        checkJumpBack(vm, end);
 	}
 }
 
 static void jumpRelativeCondition(VM* vm, bool isTrue) {
     int8_t jumpCount = (int8_t)readByte_4C(vm);
     if (isTrue) {
+        uint16_t end = vm->PC;
         vm->PC += jumpCount;
 
         /* Cycles sync after incrementing PC */
         cyclesSync_4(vm);
+        checkJumpBack(vm, end);
     }
 }
 
@@ -1125,7 +1064,7 @@ static void decimalAdjust(VM* vm) {
         }
     }
 
-    TEST_Z_FLAG(vm, value);
+    set_flag(vm, FLAG_Z, value == 0);
     set_flag(vm, FLAG_H, 0);
 
     vm->GPR[R8_A] = value;
@@ -1134,13 +1073,11 @@ static void decimalAdjust(VM* vm) {
      * 'https://github.com/guigzzz/GoGB/blob/master/backend/cpu_arithmetic.go#L349' */
 }
 
-/* This function is responsible for writing 1 byte to a memory address */
+/* Slow path for writes to pages that aren't mapped directly */
 
-static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
-#ifdef DEBUG_MEM_LOGGING
-    printf("Writing 0x%02x to address 0x%04x\n", byte, addr);
-#endif
+static void writeAddrHandler(VM* vm, uint16_t addr, uint8_t byte) {
     if (addr >= HRAM_N0 && addr <= HRAM_N0_END) {
+        if (vm->memoryPages[addr >> 8].hasCode) writeCodePage(vm, addr);
         vm->MEM[addr] = byte;
         return;
     }
@@ -1163,59 +1100,67 @@ static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
 #endif
         return;
     } else if (addr >= IO_REG && addr <= IO_REG_END) {
+        /* Registers the PPU reads while drawing a scanline */
+        if (addr == R_LCDC || addr == R_SCY || addr == R_SCX || addr == R_WX || 
+            addr == R_BGP || addr == R_OBP0 || addr == R_OBP1) {
+            prepareRegisterWritePPU(vm);
+        } else if (addr == R_WY) {
+            /* WY is only read at the start of mode 2, the PPU just has to be there */
+            syncPPU(vm);
+        }
+
         /* We perform some actions before writing in some 
          * cases */
         switch (addr) {
-            case R_TIMA : syncTimer(vm); break;
+            case R_TIMA : {
+                /* The overflow moves along with TIMA */
+                syncTimer(vm);
+                vm->MEM[R_TIMA] = byte;
+                scheduleTimer(vm);
+                return;
+            }
             case R_TMA  : syncTimer(vm); break;
             case R_TAC  : {
                 syncTimer(vm); 
                 
-                /* Writing to TAC sometimes glitches TIMA,
-                 * algorithm from 'https://gbdev.io/pandocs/Timer_Obscure_Behaviour.html' */
+                /* TIMA is incremented when (timer enable AND the timer bit of the system 
+                 * counter) goes from 1 to 0, changing TAC can do that aswell
+                 * 'https://gbdev.io/pandocs/Timer_Obscure_Behaviour.html' */
                 uint8_t oldTAC = vm->MEM[R_TAC];
 				/* Make sure unused bits are unchanged */
                 uint8_t newTAC = byte | 0xF8;
+                uint16_t counter = getSystemCounter(vm);
 
-                vm->MEM[R_TAC] = newTAC;
+                bool oldSignal = GET_BIT(oldTAC, 2) && (counter & getTimerBit(oldTAC));
+                bool newSignal = GET_BIT(newTAC, 2) && (counter & getTimerBit(newTAC));
 
-                int clocks_array[] = {1024, 16, 64, 256};
-                uint8_t old_clock = clocks_array[oldTAC & 3];
-                uint8_t new_clock = clocks_array[newTAC & 3];
-
-                uint8_t old_enable = (oldTAC >> 2) & 1;
-                uint8_t new_enable = (newTAC >> 2) & 1;
-                uint16_t sys_clock = vm->clock & 0xFFFF;
-
-                bool glitch = false;
-                if (old_enable != 0) {
-                    if (new_enable == 0) {
-                        glitch = (sys_clock & (old_clock / 2)) != 0;
-                    } else {
-                        glitch = ((sys_clock & (old_clock / 2)) != 0) && 
-                                 ((sys_clock & (new_clock / 2)) == 0);
-                    }
-                }
-                
-                if (glitch) {
+                if (oldSignal && !newSignal) {
                     incrementTIMA(vm);
                 }
+
+                vm->MEM[R_TAC] = newTAC;
+                scheduleTimer(vm);
                 return;
             }
             case R_DIV  : {
-                /* Write to DIV resets it */
+                /* Write to DIV resets the whole system counter */
                 syncTimer(vm);
 
-                if (vm->MEM[R_DIV] == 1 && ((vm->MEM[R_TAC] >> 2) & 1)) {
-                    /* If DIV = 1 and timer is enabled, theres a bug in which
-                     * the TIMA increases */
-                    vm->MEM[R_DIV] = 0;
+                if (GET_BIT(vm->MEM[R_TAC], 2) && 
+                    (getSystemCounter(vm) & getTimerBit(vm->MEM[R_TAC]))) {
+                    /* The timer bit falls to 0 with it, which increments TIMA */
                     incrementTIMA(vm); 
-                    return;
                 }
+
+                vm->systemCounterOffset = 0 - vm->clock;
                 vm->MEM[R_DIV] = 0;
+                scheduleTimer(vm);
                 return;
             }
+            case R_IF:
+                vm->MEM[R_IF] = byte;
+                updatePendingInterrupts(vm);
+                return;
             case R_SC:
 #ifdef DEBUG_PRINT_SERIAL_OUTPUT
                 if (byte == 0x81) {
@@ -1246,11 +1191,10 @@ static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
 			case R_SVBK: {
                 if (vm->emuMode != EMU_CGB) return;
 				/* In CGB Mode, switch WRAM banks */
-				uint8_t oldBankNumber = vm->MEM[R_SVBK] & 0b00000111;
 				uint8_t bankNumber = byte & 0b00000111;
 				
 				if (bankNumber == 0) bankNumber = 1;
-				switchCGB_WRAM(vm, oldBankNumber, bankNumber);
+				switchCGB_WRAM(vm, bankNumber);
 				/* Ignore bits 7-3 */
 				vm->MEM[R_SVBK] = byte | 0b11111000;
 				return;	
@@ -1260,14 +1204,35 @@ static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
 				/* In CGB Mode, switch VRAM banks 
 			     *
 			     * Only bit 0 matters */
-				uint8_t oldBankNumber = vm->MEM[R_VBK] & 1;
 				uint8_t bankNumber = byte & 1;
 				    
-				switchCGB_VRAM(vm, oldBankNumber, bankNumber);
+				switchCGB_VRAM(vm, bankNumber);
 				/* Ignore all bits other than bit 0 */
 				vm->MEM[R_VBK] = byte | ~1;
 				return;
 			}
+            /* HDMA1-4 are write only, the lower 4 bits of both addresses are ignored
+             * and the destination is always in VRAM */
+            case R_HDMA1:
+                if (vm->emuMode != EMU_CGB) return;
+                vm->hdmaSource = (byte << 8) | (vm->hdmaSource & 0x00FF);
+                return;
+            case R_HDMA2:
+                if (vm->emuMode != EMU_CGB) return;
+                vm->hdmaSource = (vm->hdmaSource & 0xFF00) | (byte & 0xF0);
+                return;
+            case R_HDMA3:
+                if (vm->emuMode != EMU_CGB) return;
+                vm->hdmaDestination = VRAM_N0_8KB | ((byte & 0x1F) << 8) | (vm->hdmaDestination & 0x00FF);
+                return;
+            case R_HDMA4:
+                if (vm->emuMode != EMU_CGB) return;
+                vm->hdmaDestination = (vm->hdmaDestination & 0xFF00) | (byte & 0xF0);
+                return;
+            case R_HDMA5:
+                if (vm->emuMode != EMU_CGB) return;
+                startHDMATransfer(vm, byte);
+                return;
 			case R_BCPD: {
                 if (vm->emuMode != EMU_CGB) return;
                 if (vm->lockPalettes) {
@@ -1288,6 +1253,7 @@ static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
                 
                 // printf("Writing %02x to color ram address %02x\n", byte, vm->currentCRAMIndex);
                 vm->bgColorRAM[vm->currentBackgroundCRAMIndex] = byte;
+                updatePaletteColor(vm, false, vm->currentBackgroundCRAMIndex);
                 if (GET_BIT(vm->MEM[R_BCPS], 7)) {
                     vm->currentBackgroundCRAMIndex++;
 
@@ -1326,6 +1292,7 @@ static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
                 
                 // printf("Writing %02x to color ram address %02x\n", byte, vm->currentCRAMIndex);
                 vm->spriteColorRAM[vm->currentSpriteCRAMIndex] = byte;
+                updatePaletteColor(vm, true, vm->currentSpriteCRAMIndex);
                 if (GET_BIT(vm->MEM[R_OCPS], 7)) {
                     vm->currentSpriteCRAMIndex++;
 
@@ -1346,12 +1313,16 @@ static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
             }
             case R_BGP: {
                 if (vm->emuMode != EMU_DMG) return;
-                break;
+                vm->MEM[addr] = byte;
+                updatePaletteDMG(vm, addr);
+                return;
             }
             case R_OBP0:
             case R_OBP1:
                 if (vm->emuMode != EMU_DMG) return;
-                break;
+                vm->MEM[addr] = byte;
+                updatePaletteDMG(vm, addr);
+                return;
 			case R_STAT:
 				/* Bit 7 in STAT is unused so it has to always be 1.
 				 * Bit 2-0 are read only, and are left unchanged */
@@ -1402,14 +1373,30 @@ static void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
         }
 
         // printf("vram allowed %02x %04x mode %d cy %d ly %d\n", byte, addr, vm->ppuMode, vm->cyclesSinceLastMode, vm->MEM[R_LY]);
+        
+        /* Tile data writes come through here so the decoded tile gets invalidated, 
+         * the bank is whichever one is mapped in right now */
+        uint8_t bank = vm->memoryPages[addr >> 8].memory == &vm->MEM[addr & 0xFF00] ? 0 : 1;
+        invalidateTile(vm, bank, addr - VRAM_N0_8KB);
 	} else if (addr >= OAM_N0_160B && addr <= OAM_N0_160B_END) {
 		/* Handle the case when OAM has been locked by PPU */
 		if (vm->lockOAM) return;
-	}
-    vm->MEM[addr] = byte; 
+	} else if (addr == R_IE) {
+        vm->MEM[R_IE] = byte;
+        updatePendingInterrupts(vm);
+        return;
+    }
+
+    /* WRAM pages with code on them come here too */
+    if (vm->memoryPages[addr >> 8].hasCode) writeCodePage(vm, addr);
+
+    /* Write to whichever bank is mapped in */
+    vm->memoryPages[addr >> 8].memory[addr & 0xFF] = byte; 
 }
 
-static uint8_t readAddr(VM* vm, uint16_t addr) {
+/* Slow path for reads from pages that aren't mapped directly */
+
+static uint8_t readAddrHandler(VM* vm, uint16_t addr) {
     if (addr >= HRAM_N0 && addr <= HRAM_N0_END) {
         return vm->MEM[addr];
     }
@@ -1425,7 +1412,7 @@ static uint8_t readAddr(VM* vm, uint16_t addr) {
 		 *
 		 * or modify the read values accordingly*/
         switch (addr) {
-            case R_DIV  :
+            case R_DIV  : return getSystemCounter(vm) / T_CYCLES_PER_DIV;
             case R_TIMA :
             case R_TMA  :
             case R_TAC  : syncTimer(vm); break;
@@ -1451,9 +1438,42 @@ static uint8_t readAddr(VM* vm, uint16_t addr) {
 		if (vm->lockOAM) return 0xFF;
 	}
 
-    return vm->MEM[addr];
+    return peekAddr(vm, addr);
+}
+
+/* These functions are responsible for reading / writing 1 byte from / to a memory address,
+ * they go through the memory pages and only fall back to the handlers when needed */
+
+static inline void writeAddr(VM* vm, uint16_t addr, uint8_t byte) {
+#ifdef DEBUG_MEM_LOGGING
+    printf("Writing 0x%02x to address 0x%04x\n", byte, addr);
+#endif
+#ifdef CPU_JIT
+    if (vm->jit.savePages) saveWrittenPage(vm, addr);
+#endif
+    uint8_t* page = vm->memoryPages[addr >> 8].write;
+
+    if (page != NULL) {
+        page[addr & 0xFF] = byte;
+        return;
+    }
+
+    PROFILE_BEGIN(vm, PROFILE_BUS);
+    writeAddrHandler(vm, addr, byte);
+    PROFILE_END(vm);
 }
 
+static inline uint8_t readAddr(VM* vm, uint16_t addr) {
+    uint8_t* page = vm->memoryPages[addr >> 8].read;
+
+    if (page != NULL) return page[addr & 0xFF];
+
+    PROFILE_BEGIN(vm, PROFILE_BUS);
+    uint8_t byte = readAddrHandler(vm, addr);
+    PROFILE_END(vm);
+
+    return byte;
+}
 
 static void writeAddr_4C(VM* vm, uint16_t addr, uint8_t byte) {
     writeAddr(vm, addr, byte);
@@ -1467,13 +1487,40 @@ static uint8_t readAddr_4C(VM* vm, uint16_t addr) {
     return byte;
 }
 
+#ifdef CPU_JIT
+uint8_t readAddrCompiled(VM* vm, uint16_t addr) {
+    return readAddr(vm, addr);
+}
+
+void writeAddrCompiled(VM* vm, uint16_t addr, uint8_t byte) {
+    /* Anything that can change what the CPU does next stops the compiled block at the
+     * end of the instruction, so the interpreter can take over, see jit.h */
+    uint32_t generation = vm->blockCache.generation[addr >> 8];
+
+    writeAddr(vm, addr, byte);
+
+    if (addr <= ROM_NN_16KB_END || (addr >= IO_REG && addr <= IO_REG_END) || addr == R_IE ||
+            vm->blockCache.generation[addr >> 8] != generation) {
+        vm->jit.stop = true;
+    }
+}
+#endif
+
 /* Interrupt handling and helper functions */
 
+void updatePendingInterrupts(VM* vm) {
+    vm->pendingInterrupts = vm->MEM[R_IF] & vm->MEM[R_IE] & 0x1F;
+}
+
 void requestInterrupt(VM* vm, INTERRUPT interrupt) {
     /* This is called by external hardware to request interrupts
      *
      * We set the corresponding bit */
     vm->MEM[R_IF] |= 1 << interrupt;
+    updatePendingInterrupts(vm);
+#ifdef CPU_JIT
+    vm->jit.stop = true;
+#endif
 }
 
 static void dispatchInterrupt(VM* vm, INTERRUPT interrupt) {
@@ -1482,6 +1529,7 @@ static void dispatchInterrupt(VM* vm, INTERRUPT interrupt) {
     
     /* Set the bit of this interrupt in the IF register to 0 */
     vm->MEM[R_IF] &= ~(1 << interrupt);
+    updatePendingInterrupts(vm);
     
     /* Now we pass control to the interrupt handler 
      *
@@ -1501,58 +1549,26 @@ static void dispatchInterrupt(VM* vm, INTERRUPT interrupt) {
     }
 }
 
-static void handleInterrupts(VM* vm) {
-    /* Main interrupt handler for the CPU */
-    
-	/* Checks for an interrupt that can be handled and returns 
-	 * it if found, otherwise returns -1 */
-
-    /* We read interrupt flags, which tell us which interrupts are requested
-     * if any */
-    uint8_t requestedInterrupts = vm->MEM[R_IF];
-    uint8_t enabledInterrups = vm->MEM[R_IE];
+static inline void handleInterrupts(VM* vm) {
+    /* Main interrupt handler for the CPU, this runs after every instruction so
+     * it only checks the cached IF & IE */
+    uint8_t pendingInterrupts = vm->pendingInterrupts;
+    if (pendingInterrupts == 0) return;
 
-	if (vm->IME) {
-		if ((enabledInterrups & requestedInterrupts & 0x1F) != 0) {
-			/* Exit halt mode */
-			vm->haltMode = false;
-			/* Atleast 1 interrupt has been requested and is enabled too
-			*
-			* Note : Upper 3 bits should always be 0, this is handled when normally
-			* writing to interrupt flag register and in normal hardware requests this is
-			* never encountered 
-			*
-			* We loop to find the interrupt requested with the highest priority thats enabled */
-	
-		    for (int i = 0; i < INTERRUPT_COUNT; i++) {
-			    /* 'i' corresponds to the individual interrupts ranging from bit 0 to 4 */
+    /* Atleast 1 interrupt has been requested and is enabled too, this exits halt mode 
+     * even when IME is false and it cant be handled */
+    vm->haltMode = false;
 
-				uint8_t requestBit = (requestedInterrupts >> i) & 0x1;
-				uint8_t enabledBit = (enabledInterrups >> i) & 0x1;
-
-				if (requestBit && enabledBit) {
-					/* 'i' is currently the interrupt at the highest priority thats enabled */
-					dispatchInterrupt(vm, i);
-					return;
-				}
-			}
-		}
-	} else {
-		/* Even though the interrupt cannot be handled because IME is false,
-		 * we still need to exit halt mode */
-		if ((enabledInterrups & requestedInterrupts & 0x1F) != 0) {
-			vm->haltMode = false;
-		}
-	}
+    if (vm->IME) {
+        /* The lowest bit is the interrupt with the highest priority */
+        dispatchInterrupt(vm, __builtin_ctz(pendingInterrupts));
+    }
 }
 
 static void halt(VM* vm) {
 	/* HALT Instruction procedure */
-	uint8_t IE = vm->MEM[R_IE];
-	uint8_t IF = vm->MEM[R_IF];
-
 	if (vm->IME) {
-		if ((IE & IF & 0x1F) == 0) {
+		if (vm->pendingInterrupts == 0) {
 			/* IME Enabled, No enabled interrupts requested */
 			vm->haltMode = true;	
 			return;
@@ -1563,7 +1579,7 @@ static void halt(VM* vm) {
 		return;
 	} else {
 
-		if ((IE & IF & 0x1F) == 0) {
+		if (vm->pendingInterrupts == 0) {
 			/* IME Disabled, No enabled interrupts requested 
 			 *
 			 * We wait till an interrupt is requested, then we dont jump to the 
@@ -1578,11 +1594,124 @@ static void halt(VM* vm) {
 	}
 }
 
-/* Main CPU instruction dispatchers */
+/* Main CPU instruction dispatchers
+ *
+ * Both dispatch strategies share the same opcode bodies below. Every opcode body is a
+ * TARGET and ends with NEXT(), which either breaks out of the switch or, with threaded
+ * dispatch, finishes the instruction and jumps straight to the handler of the next one
+ * through a table of label addresses. This replicates the indirect jump at the end of
+ * every handler so the branch predictor gets a separate history for each opcode. */
+
+#ifdef CPU_THREADED_DISPATCH
+#define TARGET(op) case op: op_##op:
+#define CB_TARGET(op) case op: cb_##op:
+#define NEXT() do {                                                     \
+        finishInstruction(vm);                                          \
+        if (--instructions == 0 || !vm->run) return;                    \
+        NEXT_COMPILED();                                                \
+        if (!fetchOpcode(vm, &byte)) goto endInstruction;               \
+        goto *opcodeTable[byte];                                        \
+    } while (0)
+#define PREFIX_DISPATCH() goto *prefixTable[byte]
+
+/* Builds 16 entries of a label table, for opcodes 0xh0 to 0xhF */
+#define TABLE_ROW(prefix, h) &&prefix##h##0, &&prefix##h##1, &&prefix##h##2, &&prefix##h##3, \
+                             &&prefix##h##4, &&prefix##h##5, &&prefix##h##6, &&prefix##h##7, \
+                             &&prefix##h##8, &&prefix##h##9, &&prefix##h##A, &&prefix##h##B, \
+                             &&prefix##h##C, &&prefix##h##D, &&prefix##h##E, &&prefix##h##F
+#define LABEL_TABLE(prefix) {                                                           \
+    TABLE_ROW(prefix, 0), TABLE_ROW(prefix, 1), TABLE_ROW(prefix, 2), TABLE_ROW(prefix, 3), \
+    TABLE_ROW(prefix, 4), TABLE_ROW(prefix, 5), TABLE_ROW(prefix, 6), TABLE_ROW(prefix, 7), \
+    TABLE_ROW(prefix, 8), TABLE_ROW(prefix, 9), TABLE_ROW(prefix, A), TABLE_ROW(prefix, B), \
+    TABLE_ROW(prefix, C), TABLE_ROW(prefix, D), TABLE_ROW(prefix, E), TABLE_ROW(prefix, F)  \
+}
+#else
+#define TARGET(op) case op:
+#define CB_TARGET(op) case op:
+#define NEXT() break
+#define PREFIX_DISPATCH() goto prefixed
+#endif
+
+static inline const DecodedInstruction* fetchInstruction(VM* vm) {
+    /* Carries on through the current block as long as the PC follows it */
+    BlockCache* cache = &vm->blockCache;
+    Block* block = cache->current;
+
+    if (block != NULL && cache->next < block->count && 
+            block->instructions[cache->next].address == vm->PC) {
+        return &block->instructions[cache->next++];
+    }
+
+    return enterBlock(vm);
+}
+
+static inline void skipHaltedCycles(VM* vm) {
+    /* While halted the CPU does nothing but wait for an interrupt, and the only things
+     * that can request one are scheduled events (PPU, timer) and the joypad, which is 
+     * only polled between calls to dispatch. So instead of ticking 1 M-Cycle at a time
+     * we jump straight to the M-Cycle on which the next event runs, it lands on exactly
+     * the same clock ticking would have, so nothing can tell the difference 
+     *
+     * Without any events (LCD and timer off) the only way out is the joypad, then we 
+     * keep ticking so the input still gets polled */
+    unsigned long deadline = vm->scheduler.nextDeadline;
+
+    if (deadline != ULONG_MAX && deadline > vm->clock + 4) {
+        vm->clock += (deadline - vm->clock - 1) & ~3UL;
+    }
+
+    cyclesSync_4(vm);
+}
+
+static inline bool fetchOpcode(VM* vm, uint8_t* byte) {
+    /* Does the work that comes before every instruction and reads its opcode,
+     * returns false if the CPU is halted and there is no instruction to run */
+#ifdef DEBUG_PRINT_REGISTERS
+    printRegisters(vm);
+#endif
+#ifdef DEBUG_REALTIME_PRINTING
+    printInstruction(vm);
+#endif
+
+    /* Enable interrupts if it was scheduled */
+    if (vm->scheduleInterruptEnable) {
+        vm->scheduleInterruptEnable = false;
+        vm->IME = true;
+    }
+
+    if (vm->haltMode) {
+        /* Skip dispatch and directly check for pending interrupts */
+
+        /* The CPU is in sleep mode while halt mode is true,
+         * but the device clock will not be affected and continue 
+         * ticking 
+         *
+         * Other syncs will also continue taking place */
+        skipHaltedCycles(vm);
+        return false;
+    } else if (vm->scheduleHaltBug) {
+        /* The PC isnt incremented, so the opcode is read again as the first operand */
+        const DecodedInstruction* instruction = decodeInstruction(vm, vm->PC);
+
+        *byte = instruction->bytes[0];
+        vm->blockCache.operand = instruction->bytes;
+        cyclesSync_4(vm);
+    } else {
+        /* Normal Read */
+        const DecodedInstruction* instruction = fetchInstruction(vm);
+
+        *byte = instruction->bytes[0];
+        vm->blockCache.operand = instruction->bytes + 1;
+        vm->PC++;
+        cyclesSync_4(vm);
+    }
 
-static void prefixCB(VM* vm) {
-    /* This function contains opcode interpretations for
-     * all the instruction prefixed by opcode CB */
+    vm->instructionCount++;
+    return true;
+}
+
+static inline uint8_t fetchPrefixedOpcode(VM* vm) {
+    /* Reads the second byte of instructions prefixed by opcode CB */
     uint8_t byte = readByte_4C(vm);
     
 #ifdef DEBUG_PRINT_REGISTERS
@@ -1590,617 +1719,711 @@ static void prefixCB(VM* vm) {
 #endif
 #ifdef DEBUG_REALTIME_PRINTING
     printCBInstruction(vm, byte);
+#endif
+    return byte;
+}
+
+static inline void finishInstruction(VM* vm) {
+    /* The timer doesnt need to be synced here, its overflow is a scheduled event */
+    /* We handle any interrupts that are requested */
+    handleInterrupts(vm);
+}
+
+/* Compiled blocks cant print every instruction, so debug printing always interprets */
+#if defined(CPU_JIT) && !defined(DEBUG_REALTIME_PRINTING) && !defined(DEBUG_PRINT_REGISTERS)
+#define CPU_RUN_COMPILED
+/* With threaded dispatch the next instruction has to go through runCompiled() as well */
+#define NEXT_COMPILED() if (vm->jit.mode != JIT_OFF) goto nextInstruction
+#else
+#define NEXT_COMPILED()
 #endif
 
-    switch (byte) {
-        case 0x00: rotateLeftR8(vm, R8_B, true); break;
-        case 0x01: rotateLeftR8(vm, R8_C, true); break;
-        case 0x02: rotateLeftR8(vm, R8_D, true); break;
-        case 0x03: rotateLeftR8(vm, R8_E, true); break;
-        case 0x04: rotateLeftR8(vm, R8_H, true); break;
-        case 0x05: rotateLeftR8(vm, R8_L, true); break;
-        case 0x06: rotateLeftAR16(vm, R16_HL, true); break;
-        case 0x07: rotateLeftR8(vm, R8_A, true); break;
-        case 0x08: rotateRightR8(vm, R8_B, true); break;
-        case 0x09: rotateRightR8(vm, R8_C, true); break;
-        case 0x0A: rotateRightR8(vm, R8_D, true); break;
-        case 0x0B: rotateRightR8(vm, R8_E, true); break;
-        case 0x0C: rotateRightR8(vm, R8_H, true); break;
-        case 0x0D: rotateRightR8(vm, R8_L, true); break;
-        case 0x0E: rotateRightAR16(vm, R16_HL, true); break;
-        case 0x0F: rotateRightR8(vm, R8_A, true); break;
-        case 0x10: rotateLeftCarryR8(vm, R8_B, true); break;
-        case 0x11: rotateLeftCarryR8(vm, R8_C, true); break;
-        case 0x12: rotateLeftCarryR8(vm, R8_D, true); break;
-        case 0x13: rotateLeftCarryR8(vm, R8_E, true); break;
-        case 0x14: rotateLeftCarryR8(vm, R8_H, true); break;
-        case 0x15: rotateLeftCarryR8(vm, R8_L, true); break;
-        case 0x16: rotateLeftCarryAR16(vm, R16_HL, true); break;
-        case 0x17: rotateLeftCarryR8(vm, R8_A, true); break;
-        case 0x18: rotateRightCarryR8(vm, R8_B, true); break;
-        case 0x19: rotateRightCarryR8(vm, R8_C, true); break;
-        case 0x1A: rotateRightCarryR8(vm, R8_D, true); break;
-        case 0x1B: rotateRightCarryR8(vm, R8_E, true); break;
-        case 0x1C: rotateRightCarryR8(vm, R8_H, true); break;
-        case 0x1D: rotateRightCarryR8(vm, R8_L, true); break;
-        case 0x1E: rotateRightCarryAR16(vm, R16_HL, true); break;
-        case 0x1F: rotateRightCarryR8(vm, R8_A, true); break;
-        case 0x20: shiftLeftArithmeticR8(vm, R8_B); break;
-        case 0x21: shiftLeftArithmeticR8(vm, R8_C); break;
-        case 0x22: shiftLeftArithmeticR8(vm, R8_D); break;
-        case 0x23: shiftLeftArithmeticR8(vm, R8_E); break;
-        case 0x24: shiftLeftArithmeticR8(vm, R8_H); break;
-        case 0x25: shiftLeftArithmeticR8(vm, R8_L); break;
-        case 0x26: shiftLeftArithmeticAR16(vm, R16_HL); break;
-        case 0x27: shiftLeftArithmeticR8(vm, R8_A); break;
-        case 0x28: shiftRightArithmeticR8(vm, R8_B); break;
-        case 0x29: shiftRightArithmeticR8(vm, R8_C); break;
-        case 0x2A: shiftRightArithmeticR8(vm, R8_D); break;
-        case 0x2B: shiftRightArithmeticR8(vm, R8_E); break;
-        case 0x2C: shiftRightArithmeticR8(vm, R8_H); break;
-        case 0x2D: shiftRightArithmeticR8(vm, R8_L); break;
-        case 0x2E: shiftRightArithmeticAR16(vm, R16_HL); break;
-        case 0x2F: shiftRightArithmeticR8(vm, R8_A); break;
-        case 0x30: swapR8(vm, R8_B); break;
-        case 0x31: swapR8(vm, R8_C); break;
-        case 0x32: swapR8(vm, R8_D); break;
-        case 0x33: swapR8(vm, R8_E); break;
-        case 0x34: swapR8(vm, R8_H); break;
-        case 0x35: swapR8(vm, R8_L); break;
-        case 0x36: swapAR16(vm, R16_HL); break;
-        case 0x37: swapR8(vm, R8_A); break;
-        case 0x38: shiftRightLogicalR8(vm, R8_B); break;
-        case 0x39: shiftRightLogicalR8(vm, R8_C); break;
-        case 0x3A: shiftRightLogicalR8(vm, R8_D); break;
-        case 0x3B: shiftRightLogicalR8(vm, R8_E); break;
-        case 0x3C: shiftRightLogicalR8(vm, R8_H); break;
-        case 0x3D: shiftRightLogicalR8(vm, R8_L); break;
-        case 0x3E: shiftRightLogicalAR16(vm, R16_HL); break;
-        case 0x3F: shiftRightLogicalR8(vm, R8_A); break;
-        case 0x40: testBitR8(vm, R8_B, 0); break;
-        case 0x41: testBitR8(vm, R8_C, 0); break;
-        case 0x42: testBitR8(vm, R8_D, 0); break;
-        case 0x43: testBitR8(vm, R8_E, 0); break;
-        case 0x44: testBitR8(vm, R8_H, 0); break;
-        case 0x45: testBitR8(vm, R8_L, 0); break;
-        case 0x46: testBitAR16(vm, R16_HL, 0); break;
-        case 0x47: testBitR8(vm, R8_A, 0); break;
-        case 0x48: testBitR8(vm, R8_B, 1); break;
-        case 0x49: testBitR8(vm, R8_C, 1); break;
-        case 0x4A: testBitR8(vm, R8_D, 1); break;
-        case 0x4B: testBitR8(vm, R8_E, 1); break;
-        case 0x4C: testBitR8(vm, R8_H, 1); break;
-        case 0x4D: testBitR8(vm, R8_L, 1); break;
-        case 0x4E: testBitAR16(vm, R16_HL, 1); break;
-        case 0x4F: testBitR8(vm, R8_A, 1); break;
-        case 0x50: testBitR8(vm, R8_B, 2); break;
-        case 0x51: testBitR8(vm, R8_C, 2); break;
-        case 0x52: testBitR8(vm, R8_D, 2); break;
-        case 0x53: testBitR8(vm, R8_E, 2); break;
-        case 0x54: testBitR8(vm, R8_H, 2); break;
-        case 0x55: testBitR8(vm, R8_L, 2); break;
-        case 0x56: testBitAR16(vm, R16_HL, 2); break;
-        case 0x57: testBitR8(vm, R8_A, 2); break;
-        case 0x58: testBitR8(vm, R8_B, 3); break;
-        case 0x59: testBitR8(vm, R8_C, 3); break;
-        case 0x5A: testBitR8(vm, R8_D, 3); break;
-        case 0x5B: testBitR8(vm, R8_E, 3); break;
-        case 0x5C: testBitR8(vm, R8_H, 3); break;
-        case 0x5D: testBitR8(vm, R8_L, 3); break;
-        case 0x5E: testBitAR16(vm, R16_HL, 3); break;
-        case 0x5F: testBitR8(vm, R8_A, 3); break;
-        case 0x60: testBitR8(vm, R8_B, 4); break;
-        case 0x61: testBitR8(vm, R8_C, 4); break;
-        case 0x62: testBitR8(vm, R8_D, 4); break;
-        case 0x63: testBitR8(vm, R8_E, 4); break;
-        case 0x64: testBitR8(vm, R8_H, 4); break;
-        case 0x65: testBitR8(vm, R8_L, 4); break;
-        case 0x66: testBitAR16(vm, R16_HL, 4); break;
-        case 0x67: testBitR8(vm, R8_A, 4); break;
-        case 0x68: testBitR8(vm, R8_B, 5); break;
-        case 0x69: testBitR8(vm, R8_C, 5); break;
-        case 0x6A: testBitR8(vm, R8_D, 5); break;
-        case 0x6B: testBitR8(vm, R8_E, 5); break;
-        case 0x6C: testBitR8(vm, R8_H, 5); break;
-        case 0x6D: testBitR8(vm, R8_L, 5); break;
-        case 0x6E: testBitAR16(vm, R16_HL, 5); break;
-        case 0x6F: testBitR8(vm, R8_A, 5); break;
-        case 0x70: testBitR8(vm, R8_B, 6); break;
-        case 0x71: testBitR8(vm, R8_C, 6); break;
-        case 0x72: testBitR8(vm, R8_D, 6); break;
-        case 0x73: testBitR8(vm, R8_E, 6); break;
-        case 0x74: testBitR8(vm, R8_H, 6); break;
-        case 0x75: testBitR8(vm, R8_L, 6); break;
-        case 0x76: testBitAR16(vm, R16_HL, 6); break;
-        case 0x77: testBitR8(vm, R8_A, 6); break;
-        case 0x78: testBitR8(vm, R8_B, 7); break;
-        case 0x79: testBitR8(vm, R8_C, 7); break;
-        case 0x7A: testBitR8(vm, R8_D, 7); break;
-        case 0x7B: testBitR8(vm, R8_E, 7); break;
-        case 0x7C: testBitR8(vm, R8_H, 7); break;
-        case 0x7D: testBitR8(vm, R8_L, 7); break;
-        case 0x7E: testBitAR16(vm, R16_HL, 7); break;
-        case 0x7F: testBitR8(vm, R8_A, 7); break;
-        case 0x80: resetBitR8(vm, R8_B, 0); break;
-        case 0x81: resetBitR8(vm, R8_C, 0); break;
-        case 0x82: resetBitR8(vm, R8_D, 0); break;
-        case 0x83: resetBitR8(vm, R8_E, 0); break;
-        case 0x84: resetBitR8(vm, R8_H, 0); break;
-        case 0x85: resetBitR8(vm, R8_L, 0); break;
-        case 0x86: resetBitAR16(vm, R16_HL, 0); break;
-        case 0x87: resetBitR8(vm, R8_A, 0); break;
-        case 0x88: resetBitR8(vm, R8_B, 1); break;
-        case 0x89: resetBitR8(vm, R8_C, 1); break;
-        case 0x8A: resetBitR8(vm, R8_D, 1); break;
-        case 0x8B: resetBitR8(vm, R8_E, 1); break;
-        case 0x8C: resetBitR8(vm, R8_H, 1); break;
-        case 0x8D: resetBitR8(vm, R8_L, 1); break;
-        case 0x8E: resetBitAR16(vm, R16_HL, 1); break;
-        case 0x8F: resetBitR8(vm, R8_A, 1); break;
-        case 0x90: resetBitR8(vm, R8_B, 2); break;
-        case 0x91: resetBitR8(vm, R8_C, 2); break;
-        case 0x92: resetBitR8(vm, R8_D, 2); break;
-        case 0x93: resetBitR8(vm, R8_E, 2); break;
-        case 0x94: resetBitR8(vm, R8_H, 2); break;
-        case 0x95: resetBitR8(vm, R8_L, 2); break;
-        case 0x96: resetBitAR16(vm, R16_HL, 2); break;
-        case 0x97: resetBitR8(vm, R8_A, 2); break;
-        case 0x98: resetBitR8(vm, R8_B, 3); break;
-        case 0x99: resetBitR8(vm, R8_C, 3); break;
-        case 0x9A: resetBitR8(vm, R8_D, 3); break;
-        case 0x9B: resetBitR8(vm, R8_E, 3); break;
-        case 0x9C: resetBitR8(vm, R8_H, 3); break;
-        case 0x9D: resetBitR8(vm, R8_L, 3); break;
-        case 0x9E: resetBitAR16(vm, R16_HL, 3); break;
-        case 0x9F: resetBitR8(vm, R8_A, 3); break;
-        case 0xA0: resetBitR8(vm, R8_B, 4); break;
-        case 0xA1: resetBitR8(vm, R8_C, 4); break;
-        case 0xA2: resetBitR8(vm, R8_D, 4); break;
-        case 0xA3: resetBitR8(vm, R8_E, 4); break;
-        case 0xA4: resetBitR8(vm, R8_H, 4); break;
-        case 0xA5: resetBitR8(vm, R8_L, 4); break;
-        case 0xA6: resetBitAR16(vm, R16_HL, 4); break;
-        case 0xA7: resetBitR8(vm, R8_A, 4); break;
-        case 0xA8: resetBitR8(vm, R8_B, 5); break;
-        case 0xA9: resetBitR8(vm, R8_C, 5); break;
-        case 0xAA: resetBitR8(vm, R8_D, 5); break;
-        case 0xAB: resetBitR8(vm, R8_E, 5); break;
-        case 0xAC: resetBitR8(vm, R8_H, 5); break;
-        case 0xAD: resetBitR8(vm, R8_L, 5); break;
-        case 0xAE: resetBitAR16(vm, R16_HL, 5); break;
-        case 0xAF: resetBitR8(vm, R8_A, 5); break;
-        case 0xB0: resetBitR8(vm, R8_B, 6); break;
-        case 0xB1: resetBitR8(vm, R8_C, 6); break;
-        case 0xB2: resetBitR8(vm, R8_D, 6); break;
-        case 0xB3: resetBitR8(vm, R8_E, 6); break;
-        case 0xB4: resetBitR8(vm, R8_H, 6); break;
-        case 0xB5: resetBitR8(vm, R8_L, 6); break;
-        case 0xB6: resetBitAR16(vm, R16_HL, 6); break;
-        case 0xB7: resetBitR8(vm, R8_A, 6); break;
-        case 0xB8: resetBitR8(vm, R8_B, 7); break;
-        case 0xB9: resetBitR8(vm, R8_C, 7); break;
-        case 0xBA: resetBitR8(vm, R8_D, 7); break;
-        case 0xBB: resetBitR8(vm, R8_E, 7); break;
-        case 0xBC: resetBitR8(vm, R8_H, 7); break;
-        case 0xBD: resetBitR8(vm, R8_L, 7); break;
-        case 0xBE: resetBitAR16(vm, R16_HL, 7); break;
-        case 0xBF: resetBitR8(vm, R8_A, 7); break;
-        case 0xC0: setBitR8(vm, R8_B, 0); break;
-        case 0xC1: setBitR8(vm, R8_C, 0); break;
-        case 0xC2: setBitR8(vm, R8_D, 0); break;
-        case 0xC3: setBitR8(vm, R8_E, 0); break;
-        case 0xC4: setBitR8(vm, R8_H, 0); break;
-        case 0xC5: setBitR8(vm, R8_L, 0); break;
-        case 0xC6: setBitAR16(vm, R16_HL, 0); break;
-        case 0xC7: setBitR8(vm, R8_A, 0); break;
-        case 0xC8: setBitR8(vm, R8_B, 1); break;
-        case 0xC9: setBitR8(vm, R8_C, 1); break;
-        case 0xCA: setBitR8(vm, R8_D, 1); break;
-        case 0xCB: setBitR8(vm, R8_E, 1); break;
-        case 0xCC: setBitR8(vm, R8_H, 1); break;
-        case 0xCD: setBitR8(vm, R8_L, 1); break;
-        case 0xCE: setBitAR16(vm, R16_HL, 1); break;
-        case 0xCF: setBitR8(vm, R8_A, 1); break;
-        case 0xD0: setBitR8(vm, R8_B, 2); break;
-        case 0xD1: setBitR8(vm, R8_C, 2); break;
-        case 0xD2: setBitR8(vm, R8_D, 2); break;
-        case 0xD3: setBitR8(vm, R8_E, 2); break;
-        case 0xD4: setBitR8(vm, R8_H, 2); break;
-        case 0xD5: setBitR8(vm, R8_L, 2); break;
-        case 0xD6: setBitAR16(vm, R16_HL, 2); break;
-        case 0xD7: setBitR8(vm, R8_A, 2); break;
-        case 0xD8: setBitR8(vm, R8_B, 3); break;
-        case 0xD9: setBitR8(vm, R8_C, 3); break;
-        case 0xDA: setBitR8(vm, R8_D, 3); break;
-        case 0xDB: setBitR8(vm, R8_E, 3); break;
-        case 0xDC: setBitR8(vm, R8_H, 3); break;
-        case 0xDD: setBitR8(vm, R8_L, 3); break;
-        case 0xDE: setBitAR16(vm, R16_HL, 3); break;
-        case 0xDF: setBitR8(vm, R8_A, 3); break;
-        case 0xE0: setBitR8(vm, R8_B, 4); break;
-        case 0xE1: setBitR8(vm, R8_C, 4); break;
-        case 0xE2: setBitR8(vm, R8_D, 4); break;
-        case 0xE3: setBitR8(vm, R8_E, 4); break;
-        case 0xE4: setBitR8(vm, R8_H, 4); break;
-        case 0xE5: setBitR8(vm, R8_L, 4); break;
-        case 0xE6: setBitAR16(vm, R16_HL, 4); break;
-        case 0xE7: setBitR8(vm, R8_A, 4); break;
-        case 0xE8: setBitR8(vm, R8_B, 5); break;
-        case 0xE9: setBitR8(vm, R8_C, 5); break;
-        case 0xEA: setBitR8(vm, R8_D, 5); break;
-        case 0xEB: setBitR8(vm, R8_E, 5); break;
-        case 0xEC: setBitR8(vm, R8_H, 5); break;
-        case 0xED: setBitR8(vm, R8_L, 5); break;
-        case 0xEE: setBitAR16(vm, R16_HL, 5); break;
-        case 0xEF: setBitR8(vm, R8_A, 5); break;
-        case 0xF0: setBitR8(vm, R8_B, 6); break;
-        case 0xF1: setBitR8(vm, R8_C, 6); break;
-        case 0xF2: setBitR8(vm, R8_D, 6); break;
-        case 0xF3: setBitR8(vm, R8_E, 6); break;
-        case 0xF4: setBitR8(vm, R8_H, 6); break;
-        case 0xF5: setBitR8(vm, R8_L, 6); break;
-        case 0xF6: setBitAR16(vm, R16_HL, 6); break;
-        case 0xF7: setBitR8(vm, R8_A, 6); break;
-        case 0xF8: setBitR8(vm, R8_B, 7); break;
-        case 0xF9: setBitR8(vm, R8_C, 7); break;
-        case 0xFA: setBitR8(vm, R8_D, 7); break;
-        case 0xFB: setBitR8(vm, R8_E, 7); break;
-        case 0xFC: setBitR8(vm, R8_H, 7); break;
-        case 0xFD: setBitR8(vm, R8_L, 7); break;
-        case 0xFE: setBitAR16(vm, R16_HL, 7); break;
-        case 0xFF: setBitR8(vm, R8_A, 7); break;
+#ifdef CPU_RUN_COMPILED
+static void runCompiledCode(VM* vm, Block* block) {
+    Jit* jit = &vm->jit;
+
+    resolveFlags(vm);
+    runBlockCode(vm, block);
+
+    /* When it stopped in the middle the interpreter walks the rest of the block, that
+     * way every place a block can stop doesnt turn into a block of its own */
+    if (jit->stop && jit->executed < block->count && 
+            block->instructions[jit->executed].address == vm->PC) {
+        vm->blockCache.current = block;
+        vm->blockCache.next = jit->executed;
+    } else {
+        vm->blockCache.current = NULL;
     }
+
+    jit->blocksRun++;
+    jit->instructions += jit->executed;
+
+    if (jit->jumpEnd >= 0) checkJumpBack(vm, jit->jumpEnd);
+    finishInstruction(vm);
 }
 
-/* Instruction Set : https://www.pastraiser.com/cpu/gameboy/gameboy_opcodes.html */
+static void verifyCompiledCode(VM* vm, Block* block) {
+    /* Runs the block, then goes back and runs the same instructions on the interpreter
+     * and checks both ended up in the same state */
+    Jit* jit = &vm->jit;
+    char difference[128];
 
-void dispatch(VM* vm) {
-#ifdef DEBUG_PRINT_REGISTERS
-        printRegisters(vm);
-#endif
-#ifdef DEBUG_REALTIME_PRINTING
-        printInstruction(vm);
+    if (jit->snapshot == NULL) jit->snapshot = allocateJitSnapshot(vm);
+
+    saveJitSnapshot(vm, jit->snapshot);
+    runCompiledCode(vm, block);
+
+    /* The counters are part of the VM, so they have to survive going back */
+    uint32_t executed = jit->executed;
+    unsigned long blocksRun = jit->blocksRun;
+    unsigned long instructions = jit->instructions;
+    unsigned long compiledBlocks = jit->compiledBlocks;
+
+    loadJitSnapshot(vm, jit->snapshot);
+    jit->mode = JIT_OFF;
+    dispatch(vm, executed);
+    jit->mode = JIT_VERIFY;
+    jit->savePages = false;
+
+    jit->executed = executed;
+    jit->blocksRun = blocksRun;
+    jit->instructions = instructions;
+    jit->compiledBlocks = compiledBlocks;
+
+    if (!compareJitSnapshot(vm, jit->snapshot, difference, sizeof(difference))) {
+        printf("JIT : Block at 0x%04x (%u instructions) doesnt match the interpreter, %s\n",
+               block->start, executed, difference);
+        log_fatal(vm, "Compiled code doesnt match the interpreter");
+    }
+}
+
+static bool runCompiled(VM* vm, unsigned int* instructions) {
+    /* Runs the compiled code of the block at PC, returns false if there isnt any and
+     * the interpreter has to run the next instruction */
+    BlockCache* cache = &vm->blockCache;
+    Block* block = cache->current;
+
+    if (vm->haltMode || vm->scheduleHaltBug || vm->scheduleInterruptEnable) return false;
+
+    /* Blocks are only entered at their start, while the interpreter is walking one it
+     * carries on. Past the first instruction of one that cant be compiled the rest of
+     * it might be */
+    if (block != NULL && cache->next < block->count &&
+            block->instructions[cache->next].address == vm->PC &&
+            !(cache->next == 1 && block->uncompilable)) {
+        return false;
+    }
+
+    block = lookupBlock(vm);
+    if (block == NULL) return false;
+
+    if (block->code == NULL) {
+        /* Interpreted while it isnt hot yet */
+        cache->current = block;
+        cache->next = 0;
+
+        if (block->uncompilable || ++block->runs < JIT_HOT_RUNS) return false;
+        if (!compileBlock(vm, block)) return false;
+    }
+
+    if (vm->jit.mode == JIT_VERIFY) verifyCompiledCode(vm, block);
+    else runCompiledCode(vm, block);
+
+    /* The dispatch loop counts the block as 1 instruction */
+    unsigned int executed = vm->jit.executed;
+    if (executed > 1) *instructions = *instructions > executed ? *instructions - (executed - 1) : 1;
+    return true;
+}
 #endif
-		uint8_t byte = 0; /* Will get set later */
 
-        /* Enable interrupts if it was scheduled */
-        if (vm->scheduleInterruptEnable) {
-            vm->scheduleInterruptEnable = false;
-            vm->IME = true;
-        }
+/* Instruction Set : https://www.pastraiser.com/cpu/gameboy/gameboy_opcodes.html */
 
-		if (vm->haltMode) {
-			/* Skip dispatch and directly check for pending interrupts */
+void dispatch(VM* vm, unsigned int instructions) {
+#ifdef CPU_THREADED_DISPATCH
+    static const void* opcodeTable[256] = LABEL_TABLE(op_0x);
+    static const void* prefixTable[256] = LABEL_TABLE(cb_0x);
+#endif
+    uint8_t byte = 0; /* Will get set later */
 
-			/* The CPU is in sleep mode while halt mode is true,
-			 * but the device clock will not be affected and continue 
-			 * ticking 
-			 *
-			 * Other syncs will also continue taking place */
-			cyclesSync_4(vm);
-			goto skipLabel;
-		} else if (vm->scheduleHaltBug) {
-			/* Revert the PC increment */
-
-			byte = readByte(vm);
-			vm->PC--;
-			cyclesSync_4(vm);
-		} else {
-			/* Normal Read */
-			byte = readByte_4C(vm);	
-		}
+    for (; instructions > 0 && vm->run; instructions--) {
+#ifdef CPU_RUN_COMPILED
+#ifdef CPU_THREADED_DISPATCH
+nextInstruction:
+#endif
+        if (vm->jit.mode != JIT_OFF && runCompiled(vm, &instructions)) continue;
+#endif
+        if (!fetchOpcode(vm, &byte)) goto endInstruction;
         
 		/* Do the dispatch */
         switch (byte) {
             // nop
-            case 0x00: break;
-            case 0x01: LOAD_RR_D16(vm, R16_BC); break;
-            case 0x02: LOAD_ARR_R(vm, R16_BC, R8_A); break;
-            case 0x03: INC_RR(vm, R16_BC); break;
-            case 0x04: incrementR8(vm, R8_B); break;
-            case 0x05: decrementR8(vm, R8_B); break;
-            case 0x06: LOAD_R_D8(vm, R8_B); break;
-            case 0x07: rotateLeftR8(vm, R8_A, false); break;
-            case 0x08: {
+            TARGET(0x00) NEXT();
+            TARGET(0x01) LOAD_RR_D16(vm, R16_BC); NEXT();
+            TARGET(0x02) LOAD_ARR_R(vm, R16_BC, R8_A); NEXT();
+            TARGET(0x03) INC_RR(vm, R16_BC); NEXT();
+            TARGET(0x04) incrementR8(vm, R8_B); NEXT();
+            TARGET(0x05) decrementR8(vm, R8_B); NEXT();
+            TARGET(0x06) LOAD_R_D8(vm, R8_B); NEXT();
+            TARGET(0x07) rotateLeftR8(vm, R8_A, false); NEXT();
+            TARGET(0x08) {
                 uint16_t a = read2Bytes_8C(vm);
                 uint16_t sp = get_reg16(vm, R16_SP);
                 /* Write high byte to high and low byte to low */
                 writeAddr_4C(vm, a+1, sp >> 8);
                 writeAddr_4C(vm, a, sp & 0xFF);
-                break;
+                NEXT();
             }
-            case 0x09: addR16(vm, R16_HL, R16_BC); break;
-            case 0x0A: LOAD_R_ARR(vm, R8_A, R16_BC); break;
-            case 0x0B: DEC_RR(vm, R16_BC); break;
-            case 0x0C: incrementR8(vm, R8_C); break;
-            case 0x0D: decrementR8(vm, R8_C); break;
-            case 0x0E: LOAD_R_D8(vm, R8_C); break;
-            case 0x0F: rotateRightR8(vm, R8_A, false); break;
+            TARGET(0x09) addR16(vm, R16_HL, R16_BC); NEXT();
+            TARGET(0x0A) LOAD_R_ARR(vm, R8_A, R16_BC); NEXT();
+            TARGET(0x0B) DEC_RR(vm, R16_BC); NEXT();
+            TARGET(0x0C) incrementR8(vm, R8_C); NEXT();
+            TARGET(0x0D) decrementR8(vm, R8_C); NEXT();
+            TARGET(0x0E) LOAD_R_D8(vm, R8_C); NEXT();
+            TARGET(0x0F) rotateRightR8(vm, R8_A, false); NEXT();
             /* OPCODE 10 TODO - STOP, it stops the CPU from running */
-            case 0x10: break;
-            case 0x11: LOAD_RR_D16(vm, R16_DE); break;
-            case 0x12: LOAD_ARR_R(vm, R16_DE, R8_A); break;
-            case 0x13: INC_RR(vm, R16_DE); break;
-            case 0x14: incrementR8(vm, R8_D); break;
-            case 0x15: decrementR8(vm, R8_D); break;
-            case 0x16: LOAD_R_D8(vm, R8_D); break;
-            case 0x17: rotateLeftCarryR8(vm, R8_A, false); break;
-            case 0x18: JUMP_RL(vm, readByte_4C(vm)); break;
-            case 0x19: addR16(vm, R16_HL, R16_DE); break;
-            case 0x1A: LOAD_R_ARR(vm, R8_A, R16_DE); break;
-            case 0x1B: DEC_RR(vm, R16_DE); break;
-            case 0x1C: incrementR8(vm, R8_E); break;
-            case 0x1D: decrementR8(vm, R8_E); break;
-            case 0x1E: LOAD_R_D8(vm, R8_E); break;
-            case 0x1F: rotateRightCarryR8(vm, R8_A, false); break;
-            case 0x20: jumpRelativeCondition(vm, CONDITION_NZ(vm)); break;
-            case 0x21: LOAD_RR_D16(vm, R16_HL); break;
-            case 0x22: LOAD_ARR_R(vm, R16_HL, R8_A); 
+            TARGET(0x10) NEXT();
+            TARGET(0x11) LOAD_RR_D16(vm, R16_DE); NEXT();
+            TARGET(0x12) LOAD_ARR_R(vm, R16_DE, R8_A); NEXT();
+            TARGET(0x13) INC_RR(vm, R16_DE); NEXT();
+            TARGET(0x14) incrementR8(vm, R8_D); NEXT();
+            TARGET(0x15) decrementR8(vm, R8_D); NEXT();
+            TARGET(0x16) LOAD_R_D8(vm, R8_D); NEXT();
+            TARGET(0x17) rotateLeftCarryR8(vm, R8_A, false); NEXT();
+            TARGET(0x18) jumpRelativeCondition(vm, true); NEXT();
+            TARGET(0x19) addR16(vm, R16_HL, R16_DE); NEXT();
+            TARGET(0x1A) LOAD_R_ARR(vm, R8_A, R16_DE); NEXT();
+            TARGET(0x1B) DEC_RR(vm, R16_DE); NEXT();
+            TARGET(0x1C) incrementR8(vm, R8_E); NEXT();
+            TARGET(0x1D) decrementR8(vm, R8_E); NEXT();
+            TARGET(0x1E) LOAD_R_D8(vm, R8_E); NEXT();
+            TARGET(0x1F) rotateRightCarryR8(vm, R8_A, false); NEXT();
+            TARGET(0x20) jumpRelativeCondition(vm, CONDITION_NZ(vm)); NEXT();
+            TARGET(0x21) LOAD_RR_D16(vm, R16_HL); NEXT();
+            TARGET(0x22) LOAD_ARR_R(vm, R16_HL, R8_A); 
                        set_reg16(vm, R16_HL, (get_reg16(vm, R16_HL) + 1));
-                       break;
-            case 0x23: INC_RR(vm, R16_HL); break;
-            case 0x24: incrementR8(vm, R8_H); break;
-            case 0x25: decrementR8(vm, R8_H); break;
-            case 0x26: LOAD_R_D8(vm, R8_H); break;
-            case 0x27: decimalAdjust(vm); break;
-            case 0x28: jumpRelativeCondition(vm, CONDITION_Z(vm)); break;
-            case 0x29: addR16(vm, R16_HL, R16_HL); break;
-            case 0x2A: LOAD_R_ARR(vm, R8_A, R16_HL);
+                       NEXT();
+            TARGET(0x23) INC_RR(vm, R16_HL); NEXT();
+            TARGET(0x24) incrementR8(vm, R8_H); NEXT();
+            TARGET(0x25) decrementR8(vm, R8_H); NEXT();
+            TARGET(0x26) LOAD_R_D8(vm, R8_H); NEXT();
+            TARGET(0x27) decimalAdjust(vm); NEXT();
+            TARGET(0x28) jumpRelativeCondition(vm, CONDITION_Z(vm)); NEXT();
+            TARGET(0x29) addR16(vm, R16_HL, R16_HL); NEXT();
+            TARGET(0x2A) LOAD_R_ARR(vm, R8_A, R16_HL);
                        set_reg16(vm, R16_HL, (get_reg16(vm, R16_HL) + 1)); 
-                       break;
-            case 0x2B: DEC_RR(vm, R16_HL); break;
-            case 0x2C: incrementR8(vm, R8_L); break;
-            case 0x2D: decrementR8(vm, R8_L); break;
-            case 0x2E: LOAD_R_D8(vm, R8_L); break;
-            case 0x2F: cpl(vm); break;
-            case 0x30: jumpRelativeCondition(vm, CONDITION_NC(vm)); break;
-            case 0x31: LOAD_RR_D16(vm, R16_SP); break;
-            case 0x32: LOAD_ARR_R(vm, R16_HL, R8_A); 
+                       NEXT();
+            TARGET(0x2B) DEC_RR(vm, R16_HL); NEXT();
+            TARGET(0x2C) incrementR8(vm, R8_L); NEXT();
+            TARGET(0x2D) decrementR8(vm, R8_L); NEXT();
+            TARGET(0x2E) LOAD_R_D8(vm, R8_L); NEXT();
+            TARGET(0x2F) cpl(vm); NEXT();
+            TARGET(0x30) jumpRelativeCondition(vm, CONDITION_NC(vm)); NEXT();
+            TARGET(0x31) LOAD_RR_D16(vm, R16_SP); NEXT();
+            TARGET(0x32) LOAD_ARR_R(vm, R16_HL, R8_A); 
                        set_reg16(vm, R16_HL, (get_reg16(vm, R16_HL) - 1));
-                       break;
-            case 0x33: INC_RR(vm, R16_SP); break;
-            case 0x34: {
+                       NEXT();
+            TARGET(0x33) INC_RR(vm, R16_SP); NEXT();
+            TARGET(0x34) {
                 /* Increment what is at the address in HL */
                 uint16_t address = get_reg16(vm, R16_HL);
                 uint8_t old = readAddr_4C(vm, address);
                 uint8_t new = old + 1; 
-                
-                TEST_Z_FLAG(vm, new);
-                TEST_H_FLAG_ADD(vm, old, 1);
-                set_flag(vm, FLAG_N, 0);
+            
+                setFlagsInc8(vm, old);
                 writeAddr_4C(vm, address, new);
-                break;
+                NEXT();
             }
-            case 0x35: {
+            TARGET(0x35) {
                 /* Decrement what is at the address in HL */
                 uint16_t address = get_reg16(vm, R16_HL);
                 uint8_t old = readAddr_4C(vm, address);
                 uint8_t new = old - 1; 
 
-                TEST_Z_FLAG(vm, new);
-                TEST_H_FLAG_SUB(vm, old, 1);
-                set_flag(vm, FLAG_N, 1);
+                setFlagsDec8(vm, old);
                 writeAddr_4C(vm, address, new);
-                break;
+                NEXT();
             }
-            case 0x36: LOAD_ARR_D8(vm, R16_HL); break;
-            case 0x37: {
+            TARGET(0x36) LOAD_ARR_D8(vm, R16_HL); NEXT();
+            TARGET(0x37) {
                 set_flag(vm, FLAG_C, 1);
                 set_flag(vm, FLAG_N, 0);
                 set_flag(vm, FLAG_H, 0);
-                break;
+                NEXT();
             }
-            case 0x38: jumpRelativeCondition(vm, CONDITION_C(vm)); break;
-            case 0x39: addR16(vm, R16_HL, R16_SP); break;
-            case 0x3A: {
+            TARGET(0x38) jumpRelativeCondition(vm, CONDITION_C(vm)); NEXT();
+            TARGET(0x39) addR16(vm, R16_HL, R16_SP); NEXT();
+            TARGET(0x3A) {
                 LOAD_R_ARR(vm, R8_A, R16_HL);
                 set_reg16(vm, R16_HL, (get_reg16(vm, R16_HL) - 1));
-                break;
+                NEXT();
             }
-            case 0x3B: DEC_RR(vm, R16_SP); break;
-            case 0x3C: incrementR8(vm, R8_A); break;
-            case 0x3D: decrementR8(vm, R8_A); break;
-            case 0x3E: LOAD_R_D8(vm, R8_A); break;
-            case 0x3F: CCF(vm); break;
-            case 0x40: LOAD_R_R(vm, R8_B, R8_B); 
+            TARGET(0x3B) DEC_RR(vm, R16_SP); NEXT();
+            TARGET(0x3C) incrementR8(vm, R8_A); NEXT();
+            TARGET(0x3D) decrementR8(vm, R8_A); NEXT();
+            TARGET(0x3E) LOAD_R_D8(vm, R8_A); NEXT();
+            TARGET(0x3F) CCF(vm); NEXT();
+            TARGET(0x40) LOAD_R_R(vm, R8_B, R8_B); 
 #ifdef DEBUG_LDBB_BREAKPOINT 
                        exit(0); 
-#endif                  
-                       break;
-            case 0x41: LOAD_R_R(vm, R8_B, R8_C); break;
-            case 0x42: LOAD_R_R(vm, R8_B, R8_D); break;
-            case 0x43: LOAD_R_R(vm, R8_B, R8_E); break;
-            case 0x44: LOAD_R_R(vm, R8_B, R8_H); break;
-            case 0x45: LOAD_R_R(vm, R8_B, R8_L); break;
-            case 0x46: LOAD_R_ARR(vm, R8_B, R16_HL); break;
-            case 0x47: LOAD_R_R(vm, R8_B, R8_A); break;
-            case 0x48: LOAD_R_R(vm, R8_C, R8_B); break;
-            case 0x49: LOAD_R_R(vm, R8_C, R8_C); break;
-            case 0x4A: LOAD_R_R(vm, R8_C, R8_D); break;
-            case 0x4B: LOAD_R_R(vm, R8_C, R8_E); break;
-            case 0x4C: LOAD_R_R(vm, R8_C, R8_H); break;
-            case 0x4D: LOAD_R_R(vm, R8_C, R8_L); break;
-            case 0x4E: LOAD_R_ARR(vm, R8_C, R16_HL); break;
-            case 0x4F: LOAD_R_R(vm, R8_C, R8_A); break;
-            case 0x50: LOAD_R_R(vm, R8_D, R8_B); break;
-            case 0x51: LOAD_R_R(vm, R8_D, R8_C); break;
-            case 0x52: LOAD_R_R(vm, R8_D, R8_D); break;
-            case 0x53: LOAD_R_R(vm, R8_D, R8_E); break;
-            case 0x54: LOAD_R_R(vm, R8_D, R8_H); break;
-            case 0x55: LOAD_R_R(vm, R8_D, R8_L); break;
-            case 0x56: LOAD_R_ARR(vm, R8_D, R16_HL); break;
-            case 0x57: LOAD_R_R(vm, R8_D, R8_A); break;
-            case 0x58: LOAD_R_R(vm, R8_E, R8_B); break;
-            case 0x59: LOAD_R_R(vm, R8_E, R8_C); break;
-            case 0x5A: LOAD_R_R(vm, R8_E, R8_D); break;
-            case 0x5B: LOAD_R_R(vm, R8_E, R8_E); break;
-            case 0x5C: LOAD_R_R(vm, R8_E, R8_H); break;
-            case 0x5D: LOAD_R_R(vm, R8_E, R8_L); break;
-            case 0x5E: LOAD_R_ARR(vm, R8_E, R16_HL); break;
-            case 0x5F: LOAD_R_R(vm, R8_E, R8_A); break;
-            case 0x60: LOAD_R_R(vm, R8_H, R8_B); break;
-            case 0x61: LOAD_R_R(vm, R8_H, R8_C); break;
-            case 0x62: LOAD_R_R(vm, R8_H, R8_D); break;
-            case 0x63: LOAD_R_R(vm, R8_H, R8_E); break;
-            case 0x64: LOAD_R_R(vm, R8_H, R8_H); break;
-            case 0x65: LOAD_R_R(vm, R8_H, R8_L); break;
-            case 0x66: LOAD_R_ARR(vm, R8_H, R16_HL); break;
-            case 0x67: LOAD_R_R(vm, R8_H, R8_A); break;
-            case 0x68: LOAD_R_R(vm, R8_L, R8_B); break;
-            case 0x69: LOAD_R_R(vm, R8_L, R8_C); break;
-            case 0x6A: LOAD_R_R(vm, R8_L, R8_D); break;
-            case 0x6B: LOAD_R_R(vm, R8_L, R8_E); break;
-            case 0x6C: LOAD_R_R(vm, R8_L, R8_H); break;
-            case 0x6D: LOAD_R_R(vm, R8_L, R8_L); break;
-            case 0x6E: LOAD_R_ARR(vm, R8_L, R16_HL); break;
-            case 0x6F: LOAD_R_R(vm, R8_L, R8_A); break;
-            case 0x70: LOAD_ARR_R(vm, R16_HL, R8_B); break;
-            case 0x71: LOAD_ARR_R(vm, R16_HL, R8_C); break;
-            case 0x72: LOAD_ARR_R(vm, R16_HL, R8_D); break;
-            case 0x73: LOAD_ARR_R(vm, R16_HL, R8_E); break;
-            case 0x74: LOAD_ARR_R(vm, R16_HL, R8_H); break;
-            case 0x75: LOAD_ARR_R(vm, R16_HL, R8_L); break; 
-            case 0x76: halt(vm); break;
-            case 0x77: LOAD_ARR_R(vm, R16_HL, R8_A); break;
-            case 0x78: LOAD_R_R(vm, R8_A, R8_B); break;
-            case 0x79: LOAD_R_R(vm, R8_A, R8_C); break;
-            case 0x7A: LOAD_R_R(vm, R8_A, R8_D); break;
-            case 0x7B: LOAD_R_R(vm, R8_A, R8_E); break;
-            case 0x7C: LOAD_R_R(vm, R8_A, R8_H); break;
-            case 0x7D: LOAD_R_R(vm, R8_A, R8_L); break;
-            case 0x7E: LOAD_R_ARR(vm, R8_A, R16_HL); break;
-            case 0x7F: LOAD_R_R(vm, R8_A, R8_A); break;
-            case 0x80: addR8(vm, R8_A, R8_B); break;
-            case 0x81: addR8(vm, R8_A, R8_C); break;
-            case 0x82: addR8(vm, R8_A, R8_D); break;
-            case 0x83: addR8(vm, R8_A, R8_E); break;
-            case 0x84: addR8(vm, R8_A, R8_H); break;
-            case 0x85: addR8(vm, R8_A, R8_L); break;
-            case 0x86: addR8_AR16(vm, R8_A, R16_HL); break;
-            case 0x87: addR8(vm, R8_A, R8_A); break;
-            case 0x88: adcR8(vm, R8_A, R8_B); break;
-            case 0x89: adcR8(vm, R8_A, R8_C); break;
-            case 0x8A: adcR8(vm, R8_A, R8_D); break;
-            case 0x8B: adcR8(vm, R8_A, R8_E); break;
-            case 0x8C: adcR8(vm, R8_A, R8_H); break;
-            case 0x8D: adcR8(vm, R8_A, R8_L); break;
-            case 0x8E: adcR8_AR16(vm, R8_A, R16_HL); break;
-            case 0x8F: adcR8(vm, R8_A, R8_A); break;
-            case 0x90: subR8(vm, R8_A, R8_B); break;
-            case 0x91: subR8(vm, R8_A, R8_C); break;
-            case 0x92: subR8(vm, R8_A, R8_D); break;
-            case 0x93: subR8(vm, R8_A, R8_E); break;
-            case 0x94: subR8(vm, R8_A, R8_H); break;
-            case 0x95: subR8(vm, R8_A, R8_L); break;
-            case 0x96: subR8_AR16(vm, R8_A, R16_HL); break;
-            case 0x97: subR8(vm, R8_A, R8_A); break;
-            case 0x98: sbcR8(vm, R8_A, R8_B); break;
-            case 0x99: sbcR8(vm, R8_A, R8_C); break;
-            case 0x9A: sbcR8(vm, R8_A, R8_D); break;
-            case 0x9B: sbcR8(vm, R8_A, R8_E); break;
-            case 0x9C: sbcR8(vm, R8_A, R8_H); break;
-            case 0x9D: sbcR8(vm, R8_A, R8_L); break;
-            case 0x9E: sbcR8_AR16(vm, R8_A, R16_HL); break;
-            case 0x9F: sbcR8(vm, R8_A, R8_A); break;
-            case 0xA0: andR8(vm, R8_A, R8_B); break;
-            case 0xA1: andR8(vm, R8_A, R8_C); break;
-            case 0xA2: andR8(vm, R8_A, R8_D); break;
-            case 0xA3: andR8(vm, R8_A, R8_E); break;
-            case 0xA4: andR8(vm, R8_A, R8_H); break;
-            case 0xA5: andR8(vm, R8_A, R8_L); break;
-            case 0xA6: andR8_AR16(vm, R8_A, R16_HL); break;
-            case 0xA7: andR8(vm, R8_A, R8_A); break;
-            case 0xA8: xorR8(vm, R8_A, R8_B); break;
-            case 0xA9: xorR8(vm, R8_A, R8_C); break;
-            case 0xAA: xorR8(vm, R8_A, R8_D); break;
-            case 0xAB: xorR8(vm, R8_A, R8_E); break;
-            case 0xAC: xorR8(vm, R8_A, R8_H); break;
-            case 0xAD: xorR8(vm, R8_A, R8_L); break;
-            case 0xAE: xorR8_AR16(vm, R8_A, R16_HL); break;
-            case 0xAF: xorR8(vm, R8_A, R8_A); break;
-            case 0xB0: orR8(vm, R8_A, R8_B); break;
-            case 0xB1: orR8(vm, R8_A, R8_C); break;
-            case 0xB2: orR8(vm, R8_A, R8_D); break;
-            case 0xB3: orR8(vm, R8_A, R8_E); break;
-            case 0xB4: orR8(vm, R8_A, R8_H); break;
-            case 0xB5: orR8(vm, R8_A, R8_L); break;
-            case 0xB6: orR8_AR16(vm, R8_A, R16_HL); break;
-            case 0xB7: orR8(vm, R8_A, R8_A); break;
-            case 0xB8: compareR8(vm, R8_A, R8_B); break;
-            case 0xB9: compareR8(vm, R8_A, R8_C); break;
-            case 0xBA: compareR8(vm, R8_A, R8_D); break;
-            case 0xBB: compareR8(vm, R8_A, R8_E); break;
-            case 0xBC: compareR8(vm, R8_A, R8_H); break;
-            case 0xBD: compareR8(vm, R8_A, R8_L); break;
-            case 0xBE: compareR8_AR16(vm, R8_A, R16_HL); break;
-            case 0xBF: compareR8(vm, R8_A, R8_A); break;
-            case 0xC0: retCondition(vm, CONDITION_NZ(vm)); break;
-            case 0xC1: POP_R16(vm, R16_BC); break;
-            case 0xC2: jumpCondition(vm, CONDITION_NZ(vm)); break;
-            case 0xC3: JUMP(vm, read2Bytes_8C(vm)); break;
-            case 0xC4: callCondition(vm, read2Bytes_8C(vm), CONDITION_NZ(vm)); break;
-            case 0xC5: PUSH_R16(vm, R16_BC); break;
-            case 0xC6: addR8D8(vm, R8_A); break;
-            case 0xC7: RST(vm, 0x00); break;
-            case 0xC8: retCondition(vm, CONDITION_Z(vm)); break;
-            case 0xC9: ret(vm); break;
-            case 0xCA: jumpCondition(vm, CONDITION_Z(vm)); break;
-            case 0xCB: prefixCB(vm); break;
-            case 0xCC: callCondition(vm, read2Bytes_8C(vm), CONDITION_Z(vm)); break;
-            case 0xCD: call(vm, read2Bytes_8C(vm)); break;
-            case 0xCE: adcR8D8(vm, R8_A); break;
-            case 0xCF: RST(vm, 0x08); break;
-            case 0xD0: retCondition(vm, CONDITION_NC(vm)); break;
-            case 0xD1: POP_R16(vm, R16_DE); break;
-            case 0xD2: jumpCondition(vm, CONDITION_NC(vm)); break;
-            case 0xD4: callCondition(vm, read2Bytes_8C(vm), CONDITION_NC(vm)); break;
-            case 0xD5: PUSH_R16(vm, R16_DE); break;
-            case 0xD6: subR8D8(vm, R8_A); break;
-            case 0xD7: RST(vm, 0x10); break;
-            case 0xD8: retCondition(vm, CONDITION_C(vm)); break;
-            case 0xD9: INTERRUPT_MASTER_ENABLE(vm); ret(vm); break;
-            case 0xDA: jumpCondition(vm, CONDITION_C(vm)); break;
-            case 0xDC: callCondition(vm, read2Bytes_8C(vm), CONDITION_C(vm)); break;
-            case 0xDE: sbcR8D8(vm, R8_A); break;
-            case 0xDF: RST(vm, 0x18); break;
-            case 0xE0: LOAD_D8PORT_R(vm, R8_A); break;
-            case 0xE1: POP_R16(vm, R16_HL); break;
-            case 0xE2: LOAD_RPORT_R(vm, R8_A, R8_C); break;
-            case 0xE5: PUSH_R16(vm, R16_HL); break;
-            case 0xE6: andR8D8(vm, R8_A); break;
-            case 0xE7: RST(vm, 0x20); break;
-            case 0xE8: addR16I8(vm, R16_SP); break;
-            case 0xE9: JUMP_RR(vm, R16_HL); break; 
-            case 0xEA: LOAD_MEM_R(vm, R8_A); break;
-            case 0xEE: xorR8D8(vm, R8_A); break;
-            case 0xEF: RST(vm, 0x28); break;
-            case 0xF0: LOAD_R_D8PORT(vm, R8_A); break;
-            case 0xF1: {
+#endif
+                       NEXT();
+            TARGET(0x41) LOAD_R_R(vm, R8_B, R8_C); NEXT();
+            TARGET(0x42) LOAD_R_R(vm, R8_B, R8_D); NEXT();
+            TARGET(0x43) LOAD_R_R(vm, R8_B, R8_E); NEXT();
+            TARGET(0x44) LOAD_R_R(vm, R8_B, R8_H); NEXT();
+            TARGET(0x45) LOAD_R_R(vm, R8_B, R8_L); NEXT();
+            TARGET(0x46) LOAD_R_ARR(vm, R8_B, R16_HL); NEXT();
+            TARGET(0x47) LOAD_R_R(vm, R8_B, R8_A); NEXT();
+            TARGET(0x48) LOAD_R_R(vm, R8_C, R8_B); NEXT();
+            TARGET(0x49) LOAD_R_R(vm, R8_C, R8_C); NEXT();
+            TARGET(0x4A) LOAD_R_R(vm, R8_C, R8_D); NEXT();
+            TARGET(0x4B) LOAD_R_R(vm, R8_C, R8_E); NEXT();
+            TARGET(0x4C) LOAD_R_R(vm, R8_C, R8_H); NEXT();
+            TARGET(0x4D) LOAD_R_R(vm, R8_C, R8_L); NEXT();
+            TARGET(0x4E) LOAD_R_ARR(vm, R8_C, R16_HL); NEXT();
+            TARGET(0x4F) LOAD_R_R(vm, R8_C, R8_A); NEXT();
+            TARGET(0x50) LOAD_R_R(vm, R8_D, R8_B); NEXT();
+            TARGET(0x51) LOAD_R_R(vm, R8_D, R8_C); NEXT();
+            TARGET(0x52) LOAD_R_R(vm, R8_D, R8_D); NEXT();
+            TARGET(0x53) LOAD_R_R(vm, R8_D, R8_E); NEXT();
+            TARGET(0x54) LOAD_R_R(vm, R8_D, R8_H); NEXT();
+            TARGET(0x55) LOAD_R_R(vm, R8_D, R8_L); NEXT();
+            TARGET(0x56) LOAD_R_ARR(vm, R8_D, R16_HL); NEXT();
+            TARGET(0x57) LOAD_R_R(vm, R8_D, R8_A); NEXT();
+            TARGET(0x58) LOAD_R_R(vm, R8_E, R8_B); NEXT();
+            TARGET(0x59) LOAD_R_R(vm, R8_E, R8_C); NEXT();
+            TARGET(0x5A) LOAD_R_R(vm, R8_E, R8_D); NEXT();
+            TARGET(0x5B) LOAD_R_R(vm, R8_E, R8_E); NEXT();
+            TARGET(0x5C) LOAD_R_R(vm, R8_E, R8_H); NEXT();
+            TARGET(0x5D) LOAD_R_R(vm, R8_E, R8_L); NEXT();
+            TARGET(0x5E) LOAD_R_ARR(vm, R8_E, R16_HL); NEXT();
+            TARGET(0x5F) LOAD_R_R(vm, R8_E, R8_A); NEXT();
+            TARGET(0x60) LOAD_R_R(vm, R8_H, R8_B); NEXT();
+            TARGET(0x61) LOAD_R_R(vm, R8_H, R8_C); NEXT();
+            TARGET(0x62) LOAD_R_R(vm, R8_H, R8_D); NEXT();
+            TARGET(0x63) LOAD_R_R(vm, R8_H, R8_E); NEXT();
+            TARGET(0x64) LOAD_R_R(vm, R8_H, R8_H); NEXT();
+            TARGET(0x65) LOAD_R_R(vm, R8_H, R8_L); NEXT();
+            TARGET(0x66) LOAD_R_ARR(vm, R8_H, R16_HL); NEXT();
+            TARGET(0x67) LOAD_R_R(vm, R8_H, R8_A); NEXT();
+            TARGET(0x68) LOAD_R_R(vm, R8_L, R8_B); NEXT();
+            TARGET(0x69) LOAD_R_R(vm, R8_L, R8_C); NEXT();
+            TARGET(0x6A) LOAD_R_R(vm, R8_L, R8_D); NEXT();
+            TARGET(0x6B) LOAD_R_R(vm, R8_L, R8_E); NEXT();
+            TARGET(0x6C) LOAD_R_R(vm, R8_L, R8_H); NEXT();
+            TARGET(0x6D) LOAD_R_R(vm, R8_L, R8_L); NEXT();
+            TARGET(0x6E) LOAD_R_ARR(vm, R8_L, R16_HL); NEXT();
+            TARGET(0x6F) LOAD_R_R(vm, R8_L, R8_A); NEXT();
+            TARGET(0x70) LOAD_ARR_R(vm, R16_HL, R8_B); NEXT();
+            TARGET(0x71) LOAD_ARR_R(vm, R16_HL, R8_C); NEXT();
+            TARGET(0x72) LOAD_ARR_R(vm, R16_HL, R8_D); NEXT();
+            TARGET(0x73) LOAD_ARR_R(vm, R16_HL, R8_E); NEXT();
+            TARGET(0x74) LOAD_ARR_R(vm, R16_HL, R8_H); NEXT();
+            TARGET(0x75) LOAD_ARR_R(vm, R16_HL, R8_L); NEXT(); 
+            TARGET(0x76) halt(vm); NEXT();
+            TARGET(0x77) LOAD_ARR_R(vm, R16_HL, R8_A); NEXT();
+            TARGET(0x78) LOAD_R_R(vm, R8_A, R8_B); NEXT();
+            TARGET(0x79) LOAD_R_R(vm, R8_A, R8_C); NEXT();
+            TARGET(0x7A) LOAD_R_R(vm, R8_A, R8_D); NEXT();
+            TARGET(0x7B) LOAD_R_R(vm, R8_A, R8_E); NEXT();
+            TARGET(0x7C) LOAD_R_R(vm, R8_A, R8_H); NEXT();
+            TARGET(0x7D) LOAD_R_R(vm, R8_A, R8_L); NEXT();
+            TARGET(0x7E) LOAD_R_ARR(vm, R8_A, R16_HL); NEXT();
+            TARGET(0x7F) LOAD_R_R(vm, R8_A, R8_A); NEXT();
+            TARGET(0x80) addR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0x81) addR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0x82) addR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0x83) addR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0x84) addR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0x85) addR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0x86) addR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0x87) addR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0x88) adcR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0x89) adcR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0x8A) adcR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0x8B) adcR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0x8C) adcR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0x8D) adcR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0x8E) adcR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0x8F) adcR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0x90) subR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0x91) subR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0x92) subR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0x93) subR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0x94) subR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0x95) subR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0x96) subR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0x97) subR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0x98) sbcR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0x99) sbcR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0x9A) sbcR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0x9B) sbcR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0x9C) sbcR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0x9D) sbcR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0x9E) sbcR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0x9F) sbcR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0xA0) andR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0xA1) andR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0xA2) andR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0xA3) andR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0xA4) andR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0xA5) andR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0xA6) andR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0xA7) andR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0xA8) xorR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0xA9) xorR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0xAA) xorR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0xAB) xorR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0xAC) xorR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0xAD) xorR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0xAE) xorR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0xAF) xorR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0xB0) orR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0xB1) orR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0xB2) orR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0xB3) orR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0xB4) orR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0xB5) orR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0xB6) orR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0xB7) orR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0xB8) compareR8(vm, R8_A, R8_B); NEXT();
+            TARGET(0xB9) compareR8(vm, R8_A, R8_C); NEXT();
+            TARGET(0xBA) compareR8(vm, R8_A, R8_D); NEXT();
+            TARGET(0xBB) compareR8(vm, R8_A, R8_E); NEXT();
+            TARGET(0xBC) compareR8(vm, R8_A, R8_H); NEXT();
+            TARGET(0xBD) compareR8(vm, R8_A, R8_L); NEXT();
+            TARGET(0xBE) compareR8_AR16(vm, R8_A, R16_HL); NEXT();
+            TARGET(0xBF) compareR8(vm, R8_A, R8_A); NEXT();
+            TARGET(0xC0) retCondition(vm, CONDITION_NZ(vm)); NEXT();
+            TARGET(0xC1) POP_R16(vm, R16_BC); NEXT();
+            TARGET(0xC2) jumpCondition(vm, CONDITION_NZ(vm)); NEXT();
+            TARGET(0xC3) jumpCondition(vm, true); NEXT();
+            TARGET(0xC4) callCondition(vm, read2Bytes_8C(vm), CONDITION_NZ(vm)); NEXT();
+            TARGET(0xC5) PUSH_R16(vm, R16_BC); NEXT();
+            TARGET(0xC6) addR8D8(vm, R8_A); NEXT();
+            TARGET(0xC7) RST(vm, 0x00); NEXT();
+            TARGET(0xC8) retCondition(vm, CONDITION_Z(vm)); NEXT();
+            TARGET(0xC9) ret(vm); NEXT();
+            TARGET(0xCA) jumpCondition(vm, CONDITION_Z(vm)); NEXT();
+            TARGET(0xCB) byte = fetchPrefixedOpcode(vm); PREFIX_DISPATCH();
+            TARGET(0xCC) callCondition(vm, read2Bytes_8C(vm), CONDITION_Z(vm)); NEXT();
+            TARGET(0xCD) call(vm, read2Bytes_8C(vm)); NEXT();
+            TARGET(0xCE) adcR8D8(vm, R8_A); NEXT();
+            TARGET(0xCF) RST(vm, 0x08); NEXT();
+            TARGET(0xD0) retCondition(vm, CONDITION_NC(vm)); NEXT();
+            TARGET(0xD1) POP_R16(vm, R16_DE); NEXT();
+            TARGET(0xD2) jumpCondition(vm, CONDITION_NC(vm)); NEXT();
+            TARGET(0xD4) callCondition(vm, read2Bytes_8C(vm), CONDITION_NC(vm)); NEXT();
+            TARGET(0xD5) PUSH_R16(vm, R16_DE); NEXT();
+            TARGET(0xD6) subR8D8(vm, R8_A); NEXT();
+            TARGET(0xD7) RST(vm, 0x10); NEXT();
+            TARGET(0xD8) retCondition(vm, CONDITION_C(vm)); NEXT();
+            TARGET(0xD9) INTERRUPT_MASTER_ENABLE(vm); ret(vm); NEXT();
+            TARGET(0xDA) jumpCondition(vm, CONDITION_C(vm)); NEXT();
+            TARGET(0xDC) callCondition(vm, read2Bytes_8C(vm), CONDITION_C(vm)); NEXT();
+            TARGET(0xDE) sbcR8D8(vm, R8_A); NEXT();
+            TARGET(0xDF) RST(vm, 0x18); NEXT();
+            TARGET(0xE0) LOAD_D8PORT_R(vm, R8_A); NEXT();
+            TARGET(0xE1) POP_R16(vm, R16_HL); NEXT();
+            TARGET(0xE2) LOAD_RPORT_R(vm, R8_A, R8_C); NEXT();
+            TARGET(0xE5) PUSH_R16(vm, R16_HL); NEXT();
+            TARGET(0xE6) andR8D8(vm, R8_A); NEXT();
+            TARGET(0xE7) RST(vm, 0x20); NEXT();
+            TARGET(0xE8) addR16I8(vm, R16_SP); NEXT();
+            TARGET(0xE9) JUMP_RR(vm, R16_HL); NEXT(); 
+            TARGET(0xEA) LOAD_MEM_R(vm, R8_A); NEXT();
+            TARGET(0xEE) xorR8D8(vm, R8_A); NEXT();
+            TARGET(0xEF) RST(vm, 0x28); NEXT();
+            TARGET(0xF0) LOAD_R_D8PORT(vm, R8_A); NEXT();
+            TARGET(0xF1) {
                 POP_R16(vm, R16_AF); 
-                
+            
                 /* Always clear the lower 4 bits, they need to always
                  * be 0, we failed a blargg test because of this lol */
                 vm->GPR[R8_F] &= 0xF0;
-                break;
+                NEXT();
             }
-            case 0xF2: LOAD_R_RPORT(vm, R8_A, R8_C); break;
-            case 0xF3: INTERRUPT_MASTER_DISABLE(vm); break;
-            case 0xF5: PUSH_R16(vm, R16_AF); break;
-            case 0xF6: orR8D8(vm, R8_A); break;
-            case 0xF7: RST(vm, 0x30); break;
-            case 0xF8: LOAD_RR_RRI8(vm, R16_HL, R16_SP); break;
-            case 0xF9: LOAD_RR_RR(vm, R16_SP, R16_HL); break;
-            case 0xFA: LOAD_R_MEM(vm, R8_A); break;
-            case 0xFB: INTERRUPT_MASTER_ENABLE(vm); break;
-            case 0xFE: compareR8D8(vm, R8_A); break;
-            case 0xFF: RST(vm, 0x38); break;
-    }
-
-skipLabel:
-    /* We sync the timer after every dispatch just before checking for interrupts */
-    syncTimer(vm);
-    /* We handle any interrupts that are requested */
-    handleInterrupts(vm);
-}
+            TARGET(0xF2) LOAD_R_RPORT(vm, R8_A, R8_C); NEXT();
+            TARGET(0xF3) INTERRUPT_MASTER_DISABLE(vm); NEXT();
+            TARGET(0xF5) PUSH_R16(vm, R16_AF); NEXT();
+            TARGET(0xF6) orR8D8(vm, R8_A); NEXT();
+            TARGET(0xF7) RST(vm, 0x30); NEXT();
+            TARGET(0xF8) LOAD_RR_RRI8(vm, R16_HL, R16_SP); NEXT();
+            TARGET(0xF9) LOAD_RR_RR(vm, R16_SP, R16_HL); NEXT();
+            TARGET(0xFA) LOAD_R_MEM(vm, R8_A); NEXT();
+            TARGET(0xFB) INTERRUPT_MASTER_ENABLE(vm); NEXT();
+            TARGET(0xFE) compareR8D8(vm, R8_A); NEXT();
+            TARGET(0xFF) RST(vm, 0x38); NEXT();
+            /* Unused opcodes, these lock up real hardware but we treat them as NOPs */
+            TARGET(0xD3) TARGET(0xDB) TARGET(0xDD) TARGET(0xE3) TARGET(0xE4) TARGET(0xEB)
+            TARGET(0xEC) TARGET(0xED) TARGET(0xF4) TARGET(0xFC) TARGET(0xFD) NEXT();
+        }
+        goto endInstruction;
 
+#ifndef CPU_THREADED_DISPATCH
+prefixed:
+#endif
+        /* Opcode interpretations for all the instructions prefixed by opcode CB */
+        switch (byte) {
+            CB_TARGET(0x00) rotateLeftR8(vm, R8_B, true); NEXT();
+            CB_TARGET(0x01) rotateLeftR8(vm, R8_C, true); NEXT();
+            CB_TARGET(0x02) rotateLeftR8(vm, R8_D, true); NEXT();
+            CB_TARGET(0x03) rotateLeftR8(vm, R8_E, true); NEXT();
+            CB_TARGET(0x04) rotateLeftR8(vm, R8_H, true); NEXT();
+            CB_TARGET(0x05) rotateLeftR8(vm, R8_L, true); NEXT();
+            CB_TARGET(0x06) rotateLeftAR16(vm, R16_HL, true); NEXT();
+            CB_TARGET(0x07) rotateLeftR8(vm, R8_A, true); NEXT();
+            CB_TARGET(0x08) rotateRightR8(vm, R8_B, true); NEXT();
+            CB_TARGET(0x09) rotateRightR8(vm, R8_C, true); NEXT();
+            CB_TARGET(0x0A) rotateRightR8(vm, R8_D, true); NEXT();
+            CB_TARGET(0x0B) rotateRightR8(vm, R8_E, true); NEXT();
+            CB_TARGET(0x0C) rotateRightR8(vm, R8_H, true); NEXT();
+            CB_TARGET(0x0D) rotateRightR8(vm, R8_L, true); NEXT();
+            CB_TARGET(0x0E) rotateRightAR16(vm, R16_HL, true); NEXT();
+            CB_TARGET(0x0F) rotateRightR8(vm, R8_A, true); NEXT();
+            CB_TARGET(0x10) rotateLeftCarryR8(vm, R8_B, true); NEXT();
+            CB_TARGET(0x11) rotateLeftCarryR8(vm, R8_C, true); NEXT();
+            CB_TARGET(0x12) rotateLeftCarryR8(vm, R8_D, true); NEXT();
+            CB_TARGET(0x13) rotateLeftCarryR8(vm, R8_E, true); NEXT();
+            CB_TARGET(0x14) rotateLeftCarryR8(vm, R8_H, true); NEXT();
+            CB_TARGET(0x15) rotateLeftCarryR8(vm, R8_L, true); NEXT();
+            CB_TARGET(0x16) rotateLeftCarryAR16(vm, R16_HL, true); NEXT();
+            CB_TARGET(0x17) rotateLeftCarryR8(vm, R8_A, true); NEXT();
+            CB_TARGET(0x18) rotateRightCarryR8(vm, R8_B, true); NEXT();
+            CB_TARGET(0x19) rotateRightCarryR8(vm, R8_C, true); NEXT();
+            CB_TARGET(0x1A) rotateRightCarryR8(vm, R8_D, true); NEXT();
+            CB_TARGET(0x1B) rotateRightCarryR8(vm, R8_E, true); NEXT();
+            CB_TARGET(0x1C) rotateRightCarryR8(vm, R8_H, true); NEXT();
+            CB_TARGET(0x1D) rotateRightCarryR8(vm, R8_L, true); NEXT();
+            CB_TARGET(0x1E) rotateRightCarryAR16(vm, R16_HL, true); NEXT();
+            CB_TARGET(0x1F) rotateRightCarryR8(vm, R8_A, true); NEXT();
+            CB_TARGET(0x20) shiftLeftArithmeticR8(vm, R8_B); NEXT();
+            CB_TARGET(0x21) shiftLeftArithmeticR8(vm, R8_C); NEXT();
+            CB_TARGET(0x22) shiftLeftArithmeticR8(vm, R8_D); NEXT();
+            CB_TARGET(0x23) shiftLeftArithmeticR8(vm, R8_E); NEXT();
+            CB_TARGET(0x24) shiftLeftArithmeticR8(vm, R8_H); NEXT();
+            CB_TARGET(0x25) shiftLeftArithmeticR8(vm, R8_L); NEXT();
+            CB_TARGET(0x26) shiftLeftArithmeticAR16(vm, R16_HL); NEXT();
+            CB_TARGET(0x27) shiftLeftArithmeticR8(vm, R8_A); NEXT();
+            CB_TARGET(0x28) shiftRightArithmeticR8(vm, R8_B); NEXT();
+            CB_TARGET(0x29) shiftRightArithmeticR8(vm, R8_C); NEXT();
+            CB_TARGET(0x2A) shiftRightArithmeticR8(vm, R8_D); NEXT();
+            CB_TARGET(0x2B) shiftRightArithmeticR8(vm, R8_E); NEXT();
+            CB_TARGET(0x2C) shiftRightArithmeticR8(vm, R8_H); NEXT();
+            CB_TARGET(0x2D) shiftRightArithmeticR8(vm, R8_L); NEXT();
+            CB_TARGET(0x2E) shiftRightArithmeticAR16(vm, R16_HL); NEXT();
+            CB_TARGET(0x2F) shiftRightArithmeticR8(vm, R8_A); NEXT();
+            CB_TARGET(0x30) swapR8(vm, R8_B); NEXT();
+            CB_TARGET(0x31) swapR8(vm, R8_C); NEXT();
+            CB_TARGET(0x32) swapR8(vm, R8_D); NEXT();
+            CB_TARGET(0x33) swapR8(vm, R8_E); NEXT();
+            CB_TARGET(0x34) swapR8(vm, R8_H); NEXT();
+            CB_TARGET(0x35) swapR8(vm, R8_L); NEXT();
+            CB_TARGET(0x36) swapAR16(vm, R16_HL); NEXT();
+            CB_TARGET(0x37) swapR8(vm, R8_A); NEXT();
+            CB_TARGET(0x38) shiftRightLogicalR8(vm, R8_B); NEXT();
+            CB_TARGET(0x39) shiftRightLogicalR8(vm, R8_C); NEXT();
+            CB_TARGET(0x3A) shiftRightLogicalR8(vm, R8_D); NEXT();
+            CB_TARGET(0x3B) shiftRightLogicalR8(vm, R8_E); NEXT();
+            CB_TARGET(0x3C) shiftRightLogicalR8(vm, R8_H); NEXT();
+            CB_TARGET(0x3D) shiftRightLogicalR8(vm, R8_L); NEXT();
+            CB_TARGET(0x3E) shiftRightLogicalAR16(vm, R16_HL); NEXT();
+            CB_TARGET(0x3F) shiftRightLogicalR8(vm, R8_A); NEXT();
+            CB_TARGET(0x40) testBitR8(vm, R8_B, 0); NEXT();
+            CB_TARGET(0x41) testBitR8(vm, R8_C, 0); NEXT();
+            CB_TARGET(0x42) testBitR8(vm, R8_D, 0); NEXT();
+            CB_TARGET(0x43) testBitR8(vm, R8_E, 0); NEXT();
+            CB_TARGET(0x44) testBitR8(vm, R8_H, 0); NEXT();
+            CB_TARGET(0x45) testBitR8(vm, R8_L, 0); NEXT();
+            CB_TARGET(0x46) testBitAR16(vm, R16_HL, 0); NEXT();
+            CB_TARGET(0x47) testBitR8(vm, R8_A, 0); NEXT();
+            CB_TARGET(0x48) testBitR8(vm, R8_B, 1); NEXT();
+            CB_TARGET(0x49) testBitR8(vm, R8_C, 1); NEXT();
+            CB_TARGET(0x4A) testBitR8(vm, R8_D, 1); NEXT();
+            CB_TARGET(0x4B) testBitR8(vm, R8_E, 1); NEXT();
+            CB_TARGET(0x4C) testBitR8(vm, R8_H, 1); NEXT();
+            CB_TARGET(0x4D) testBitR8(vm, R8_L, 1); NEXT();
+            CB_TARGET(0x4E) testBitAR16(vm, R16_HL, 1); NEXT();
+            CB_TARGET(0x4F) testBitR8(vm, R8_A, 1); NEXT();
+            CB_TARGET(0x50) testBitR8(vm, R8_B, 2); NEXT();
+            CB_TARGET(0x51) testBitR8(vm, R8_C, 2); NEXT();
+            CB_TARGET(0x52) testBitR8(vm, R8_D, 2); NEXT();
+            CB_TARGET(0x53) testBitR8(vm, R8_E, 2); NEXT();
+            CB_TARGET(0x54) testBitR8(vm, R8_H, 2); NEXT();
+            CB_TARGET(0x55) testBitR8(vm, R8_L, 2); NEXT();
+            CB_TARGET(0x56) testBitAR16(vm, R16_HL, 2); NEXT();
+            CB_TARGET(0x57) testBitR8(vm, R8_A, 2); NEXT();
+            CB_TARGET(0x58) testBitR8(vm, R8_B, 3); NEXT();
+            CB_TARGET(0x59) testBitR8(vm, R8_C, 3); NEXT();
+            CB_TARGET(0x5A) testBitR8(vm, R8_D, 3); NEXT();
+            CB_TARGET(0x5B) testBitR8(vm, R8_E, 3); NEXT();
+            CB_TARGET(0x5C) testBitR8(vm, R8_H, 3); NEXT();
+            CB_TARGET(0x5D) testBitR8(vm, R8_L, 3); NEXT();
+            CB_TARGET(0x5E) testBitAR16(vm, R16_HL, 3); NEXT();
+            CB_TARGET(0x5F) testBitR8(vm, R8_A, 3); NEXT();
+            CB_TARGET(0x60) testBitR8(vm, R8_B, 4); NEXT();
+            CB_TARGET(0x61) testBitR8(vm, R8_C, 4); NEXT();
+            CB_TARGET(0x62) testBitR8(vm, R8_D, 4); NEXT();
+            CB_TARGET(0x63) testBitR8(vm, R8_E, 4); NEXT();
+            CB_TARGET(0x64) testBitR8(vm, R8_H, 4); NEXT();
+            CB_TARGET(0x65) testBitR8(vm, R8_L, 4); NEXT();
+            CB_TARGET(0x66) testBitAR16(vm, R16_HL, 4); NEXT();
+            CB_TARGET(0x67) testBitR8(vm, R8_A, 4); NEXT();
+            CB_TARGET(0x68) testBitR8(vm, R8_B, 5); NEXT();
+            CB_TARGET(0x69) testBitR8(vm, R8_C, 5); NEXT();
+            CB_TARGET(0x6A) testBitR8(vm, R8_D, 5); NEXT();
+            CB_TARGET(0x6B) testBitR8(vm, R8_E, 5); NEXT();
+            CB_TARGET(0x6C) testBitR8(vm, R8_H, 5); NEXT();
+            CB_TARGET(0x6D) testBitR8(vm, R8_L, 5); NEXT();
+            CB_TARGET(0x6E) testBitAR16(vm, R16_HL, 5); NEXT();
+            CB_TARGET(0x6F) testBitR8(vm, R8_A, 5); NEXT();
+            CB_TARGET(0x70) testBitR8(vm, R8_B, 6); NEXT();
+            CB_TARGET(0x71) testBitR8(vm, R8_C, 6); NEXT();
+            CB_TARGET(0x72) testBitR8(vm, R8_D, 6); NEXT();
+            CB_TARGET(0x73) testBitR8(vm, R8_E, 6); NEXT();
+            CB_TARGET(0x74) testBitR8(vm, R8_H, 6); NEXT();
+            CB_TARGET(0x75) testBitR8(vm, R8_L, 6); NEXT();
+            CB_TARGET(0x76) testBitAR16(vm, R16_HL, 6); NEXT();
+            CB_TARGET(0x77) testBitR8(vm, R8_A, 6); NEXT();
+            CB_TARGET(0x78) testBitR8(vm, R8_B, 7); NEXT();
+            CB_TARGET(0x79) testBitR8(vm, R8_C, 7); NEXT();
+            CB_TARGET(0x7A) testBitR8(vm, R8_D, 7); NEXT();
+            CB_TARGET(0x7B) testBitR8(vm, R8_E, 7); NEXT();
+            CB_TARGET(0x7C) testBitR8(vm, R8_H, 7); NEXT();
+            CB_TARGET(0x7D) testBitR8(vm, R8_L, 7); NEXT();
+            CB_TARGET(0x7E) testBitAR16(vm, R16_HL, 7); NEXT();
+            CB_TARGET(0x7F) testBitR8(vm, R8_A, 7); NEXT();
+            CB_TARGET(0x80) resetBitR8(vm, R8_B, 0); NEXT();
+            CB_TARGET(0x81) resetBitR8(vm, R8_C, 0); NEXT();
+            CB_TARGET(0x82) resetBitR8(vm, R8_D, 0); NEXT();
+            CB_TARGET(0x83) resetBitR8(vm, R8_E, 0); NEXT();
+            CB_TARGET(0x84) resetBitR8(vm, R8_H, 0); NEXT();
+            CB_TARGET(0x85) resetBitR8(vm, R8_L, 0); NEXT();
+            CB_TARGET(0x86) resetBitAR16(vm, R16_HL, 0); NEXT();
+            CB_TARGET(0x87) resetBitR8(vm, R8_A, 0); NEXT();
+            CB_TARGET(0x88) resetBitR8(vm, R8_B, 1); NEXT();
+            CB_TARGET(0x89) resetBitR8(vm, R8_C, 1); NEXT();
+            CB_TARGET(0x8A) resetBitR8(vm, R8_D, 1); NEXT();
+            CB_TARGET(0x8B) resetBitR8(vm, R8_E, 1); NEXT();
+            CB_TARGET(0x8C) resetBitR8(vm, R8_H, 1); NEXT();
+            CB_TARGET(0x8D) resetBitR8(vm, R8_L, 1); NEXT();
+            CB_TARGET(0x8E) resetBitAR16(vm, R16_HL, 1); NEXT();
+            CB_TARGET(0x8F) resetBitR8(vm, R8_A, 1); NEXT();
+            CB_TARGET(0x90) resetBitR8(vm, R8_B, 2); NEXT();
+            CB_TARGET(0x91) resetBitR8(vm, R8_C, 2); NEXT();
+            CB_TARGET(0x92) resetBitR8(vm, R8_D, 2); NEXT();
+            CB_TARGET(0x93) resetBitR8(vm, R8_E, 2); NEXT();
+            CB_TARGET(0x94) resetBitR8(vm, R8_H, 2); NEXT();
+            CB_TARGET(0x95) resetBitR8(vm, R8_L, 2); NEXT();
+            CB_TARGET(0x96) resetBitAR16(vm, R16_HL, 2); NEXT();
+            CB_TARGET(0x97) resetBitR8(vm, R8_A, 2); NEXT();
+            CB_TARGET(0x98) resetBitR8(vm, R8_B, 3); NEXT();
+            CB_TARGET(0x99) resetBitR8(vm, R8_C, 3); NEXT();
+            CB_TARGET(0x9A) resetBitR8(vm, R8_D, 3); NEXT();
+            CB_TARGET(0x9B) resetBitR8(vm, R8_E, 3); NEXT();
+            CB_TARGET(0x9C) resetBitR8(vm, R8_H, 3); NEXT();
+            CB_TARGET(0x9D) resetBitR8(vm, R8_L, 3); NEXT();
+            CB_TARGET(0x9E) resetBitAR16(vm, R16_HL, 3); NEXT();
+            CB_TARGET(0x9F) resetBitR8(vm, R8_A, 3); NEXT();
+            CB_TARGET(0xA0) resetBitR8(vm, R8_B, 4); NEXT();
+            CB_TARGET(0xA1) resetBitR8(vm, R8_C, 4); NEXT();
+            CB_TARGET(0xA2) resetBitR8(vm, R8_D, 4); NEXT();
+            CB_TARGET(0xA3) resetBitR8(vm, R8_E, 4); NEXT();
+            CB_TARGET(0xA4) resetBitR8(vm, R8_H, 4); NEXT();
+            CB_TARGET(0xA5) resetBitR8(vm, R8_L, 4); NEXT();
+            CB_TARGET(0xA6) resetBitAR16(vm, R16_HL, 4); NEXT();
+            CB_TARGET(0xA7) resetBitR8(vm, R8_A, 4); NEXT();
+            CB_TARGET(0xA8) resetBitR8(vm, R8_B, 5); NEXT();
+            CB_TARGET(0xA9) resetBitR8(vm, R8_C, 5); NEXT();
+            CB_TARGET(0xAA) resetBitR8(vm, R8_D, 5); NEXT();
+            CB_TARGET(0xAB) resetBitR8(vm, R8_E, 5); NEXT();
+            CB_TARGET(0xAC) resetBitR8(vm, R8_H, 5); NEXT();
+            CB_TARGET(0xAD) resetBitR8(vm, R8_L, 5); NEXT();
+            CB_TARGET(0xAE) resetBitAR16(vm, R16_HL, 5); NEXT();
+            CB_TARGET(0xAF) resetBitR8(vm, R8_A, 5); NEXT();
+            CB_TARGET(0xB0) resetBitR8(vm, R8_B, 6); NEXT();
+            CB_TARGET(0xB1) resetBitR8(vm, R8_C, 6); NEXT();
+            CB_TARGET(0xB2) resetBitR8(vm, R8_D, 6); NEXT();
+            CB_TARGET(0xB3) resetBitR8(vm, R8_E, 6); NEXT();
+            CB_TARGET(0xB4) resetBitR8(vm, R8_H, 6); NEXT();
+            CB_TARGET(0xB5) resetBitR8(vm, R8_L, 6); NEXT();
+            CB_TARGET(0xB6) resetBitAR16(vm, R16_HL, 6); NEXT();
+            CB_TARGET(0xB7) resetBitR8(vm, R8_A, 6); NEXT();
+            CB_TARGET(0xB8) resetBitR8(vm, R8_B, 7); NEXT();
+            CB_TARGET(0xB9) resetBitR8(vm, R8_C, 7); NEXT();
+            CB_TARGET(0xBA) resetBitR8(vm, R8_D, 7); NEXT();
+            CB_TARGET(0xBB) resetBitR8(vm, R8_E, 7); NEXT();
+            CB_TARGET(0xBC) resetBitR8(vm, R8_H, 7); NEXT();
+            CB_TARGET(0xBD) resetBitR8(vm, R8_L, 7); NEXT();
+            CB_TARGET(0xBE) resetBitAR16(vm, R16_HL, 7); NEXT();
+            CB_TARGET(0xBF) resetBitR8(vm, R8_A, 7); NEXT();
+            CB_TARGET(0xC0) setBitR8(vm, R8_B, 0); NEXT();
+            CB_TARGET(0xC1) setBitR8(vm, R8_C, 0); NEXT();
+            CB_TARGET(0xC2) setBitR8(vm, R8_D, 0); NEXT();
+            CB_TARGET(0xC3) setBitR8(vm, R8_E, 0); NEXT();
+            CB_TARGET(0xC4) setBitR8(vm, R8_H, 0); NEXT();
+            CB_TARGET(0xC5) setBitR8(vm, R8_L, 0); NEXT();
+            CB_TARGET(0xC6) setBitAR16(vm, R16_HL, 0); NEXT();
+            CB_TARGET(0xC7) setBitR8(vm, R8_A, 0); NEXT();
+            CB_TARGET(0xC8) setBitR8(vm, R8_B, 1); NEXT();
+            CB_TARGET(0xC9) setBitR8(vm, R8_C, 1); NEXT();
+            CB_TARGET(0xCA) setBitR8(vm, R8_D, 1); NEXT();
+            CB_TARGET(0xCB) setBitR8(vm, R8_E, 1); NEXT();
+            CB_TARGET(0xCC) setBitR8(vm, R8_H, 1); NEXT();
+            CB_TARGET(0xCD) setBitR8(vm, R8_L, 1); NEXT();
+            CB_TARGET(0xCE) setBitAR16(vm, R16_HL, 1); NEXT();
+            CB_TARGET(0xCF) setBitR8(vm, R8_A, 1); NEXT();
+            CB_TARGET(0xD0) setBitR8(vm, R8_B, 2); NEXT();
+            CB_TARGET(0xD1) setBitR8(vm, R8_C, 2); NEXT();
+            CB_TARGET(0xD2) setBitR8(vm, R8_D, 2); NEXT();
+            CB_TARGET(0xD3) setBitR8(vm, R8_E, 2); NEXT();
+            CB_TARGET(0xD4) setBitR8(vm, R8_H, 2); NEXT();
+            CB_TARGET(0xD5) setBitR8(vm, R8_L, 2); NEXT();
+            CB_TARGET(0xD6) setBitAR16(vm, R16_HL, 2); NEXT();
+            CB_TARGET(0xD7) setBitR8(vm, R8_A, 2); NEXT();
+            CB_TARGET(0xD8) setBitR8(vm, R8_B, 3); NEXT();
+            CB_TARGET(0xD9) setBitR8(vm, R8_C, 3); NEXT();
+            CB_TARGET(0xDA) setBitR8(vm, R8_D, 3); NEXT();
+            CB_TARGET(0xDB) setBitR8(vm, R8_E, 3); NEXT();
+            CB_TARGET(0xDC) setBitR8(vm, R8_H, 3); NEXT();
+            CB_TARGET(0xDD) setBitR8(vm, R8_L, 3); NEXT();
+            CB_TARGET(0xDE) setBitAR16(vm, R16_HL, 3); NEXT();
+            CB_TARGET(0xDF) setBitR8(vm, R8_A, 3); NEXT();
+            CB_TARGET(0xE0) setBitR8(vm, R8_B, 4); NEXT();
+            CB_TARGET(0xE1) setBitR8(vm, R8_C, 4); NEXT();
+            CB_TARGET(0xE2) setBitR8(vm, R8_D, 4); NEXT();
+            CB_TARGET(0xE3) setBitR8(vm, R8_E, 4); NEXT();
+            CB_TARGET(0xE4) setBitR8(vm, R8_H, 4); NEXT();
+            CB_TARGET(0xE5) setBitR8(vm, R8_L, 4); NEXT();
+            CB_TARGET(0xE6) setBitAR16(vm, R16_HL, 4); NEXT();
+            CB_TARGET(0xE7) setBitR8(vm, R8_A, 4); NEXT();
+            CB_TARGET(0xE8) setBitR8(vm, R8_B, 5); NEXT();
+            CB_TARGET(0xE9) setBitR8(vm, R8_C, 5); NEXT();
+            CB_TARGET(0xEA) setBitR8(vm, R8_D, 5); NEXT();
+            CB_TARGET(0xEB) setBitR8(vm, R8_E, 5); NEXT();
+            CB_TARGET(0xEC) setBitR8(vm, R8_H, 5); NEXT();
+            CB_TARGET(0xED) setBitR8(vm, R8_L, 5); NEXT();
+            CB_TARGET(0xEE) setBitAR16(vm, R16_HL, 5); NEXT();
+            CB_TARGET(0xEF) setBitR8(vm, R8_A, 5); NEXT();
+            CB_TARGET(0xF0) setBitR8(vm, R8_B, 6); NEXT();
+            CB_TARGET(0xF1) setBitR8(vm, R8_C, 6); NEXT();
+            CB_TARGET(0xF2) setBitR8(vm, R8_D, 6); NEXT();
+            CB_TARGET(0xF3) setBitR8(vm, R8_E, 6); NEXT();
+            CB_TARGET(0xF4) setBitR8(vm, R8_H, 6); NEXT();
+            CB_TARGET(0xF5) setBitR8(vm, R8_L, 6); NEXT();
+            CB_TARGET(0xF6) setBitAR16(vm, R16_HL, 6); NEXT();
+            CB_TARGET(0xF7) setBitR8(vm, R8_A, 6); NEXT();
+            CB_TARGET(0xF8) setBitR8(vm, R8_B, 7); NEXT();
+            CB_TARGET(0xF9) setBitR8(vm, R8_C, 7); NEXT();
+            CB_TARGET(0xFA) setBitR8(vm, R8_D, 7); NEXT();
+            CB_TARGET(0xFB) setBitR8(vm, R8_E, 7); NEXT();
+            CB_TARGET(0xFC) setBitR8(vm, R8_H, 7); NEXT();
+            CB_TARGET(0xFD) setBitR8(vm, R8_L, 7); NEXT();
+            CB_TARGET(0xFE) setBitAR16(vm, R16_HL, 7); NEXT();
+            CB_TARGET(0xFF) setBitR8(vm, R8_A, 7); NEXT();
+        }
 
+endInstruction:
+        finishInstruction(vm);
+    }
+}
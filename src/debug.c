@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <time.h>
 #include "../include/debug.h"
 
 void log_fatal(VM* vm, const char* string) {
@@ -16,15 +17,28 @@ void log_warning(VM* vm, const char* string) {
     printf("\n");
 }
 
+PROFILE_SECTION profileSwitch(VM* vm, PROFILE_SECTION section) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    unsigned long now = t.tv_sec * 1000000000UL + t.tv_nsec;
+    PROFILE_SECTION previous = vm->profileSection;
+
+    vm->profileTime[previous] += now - vm->profileLastSwitch;
+    vm->profileLastSwitch = now;
+    vm->profileSection = section;
+    return previous;
+}
+
 static uint16_t read2Bytes(VM* vm) {
-    uint8_t b1 = vm->MEM[vm->PC + 1];
-    uint8_t b2 = vm->MEM[vm->PC + 2];
+    uint8_t b1 = peekAddr(vm, vm->PC + 1);
+    uint8_t b2 = peekAddr(vm, vm->PC + 2);
     uint16_t D16 = (b2 << 8) | b1;
     return D16;
 }
 
 static void printFlags(VM* vm) {
-    uint8_t flagState = vm->GPR[R8_F];
+    uint8_t flagState = getFlagsRegister(vm);
     
     printf("[Z%d", flagState >> 7);
     printf(" N%d", (flagState >> 6) & 1);
@@ -41,7 +55,7 @@ static void d16(VM* vm, char* ins) {
 }
 
 static void d8(VM* vm, char* ins) {
-    printf("%s (0x%02x)\n", ins, vm->MEM[vm->PC + 1]);
+    printf("%s (0x%02x)\n", ins, peekAddr(vm, vm->PC + 1));
 }
 
 static void a16(VM* vm, char* ins) {
@@ -49,7 +63,7 @@ static void a16(VM* vm, char* ins) {
 }
 
 static void r8(VM* vm, char* ins) {
-    printf("%s (%d)\n", ins, (int8_t)vm->MEM[vm->PC + 1]);
+    printf("%s (%d)\n", ins, (int8_t)peekAddr(vm, vm->PC + 1));
 }
 
 void printCBInstruction(VM* vm, uint8_t byte) {
@@ -67,6 +81,8 @@ void printCBInstruction(VM* vm, uint8_t byte) {
     printf("sig:%x]", (vm->MEM[R_P1_JOYP] & 0b00001111));
 #endif
 #ifdef DEBUG_PRINT_TIMERS
+    /* The timer is synced lazily, bring it upto date before printing */
+    syncTimer(vm);
 	printf("[%x|%x|%x|%x]", vm->MEM[R_DIV], vm->MEM[R_TIMA], vm->MEM[R_TMA], vm->MEM[R_TAC]);
 #endif
     printf(" %5s", "");
@@ -347,11 +363,13 @@ void printInstruction(VM* vm) {
     printf("sig:%x]", (vm->MEM[R_P1_JOYP] & 0b00001111));
 #endif
 #ifdef DEBUG_PRINT_TIMERS
+    /* The timer is synced lazily, bring it upto date before printing */
+    syncTimer(vm);
 	printf("[%x|%x|%x|%x]", vm->MEM[R_DIV], vm->MEM[R_TIMA], vm->MEM[R_TMA], vm->MEM[R_TAC]);
 #endif
     printf(" %5s", "");
   
-    switch (vm->MEM[vm->PC]) {
+    switch (peekAddr(vm, vm->PC)) {
         case 0x00: return simpleInstruction(vm, "NOP");
         case 0x01: return d16(vm, "LD BC, d16");
         case 0x02: return simpleInstruction(vm, "LD (BC), A");
@@ -1,42 +1,31 @@
 #include "../include/vm.h"
 #include "../include/display.h"
 #include "../include/debug.h"
-#include <SDL2/SDL_events.h>
-#include <SDL2/SDL_keycode.h>
-#include <SDL2/SDL_pixels.h>
-#include <SDL2/SDL_render.h>
-#include <SDL2/SDL_scancode.h>
-#include <SDL2/SDL_timer.h>
-#include <SDL2/SDL_video.h>
+#include "../include/pixel.h"
+#include <pthread.h>
 #include <stdbool.h>
-
-#include <SDL2/SDL.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
-static void lockToFramerate(VM* vm) {
-	/* The emulator keeps its speed accurate by locking to the framerate
-	 * Whatever has to be done (cpu execution, audio, rendering a frame) in 
-	 * the interval equivalent to 1 frame render on the gameboy is done in 1 frame
-	 * render on the emulator, the remaining time is waited for on the emulator to
-	 * sync with the time on the gameboy */
-	unsigned long ticksElapsed = (clock_u() - vm->ticksAtStartup) - vm->ticksAtLastRender;
-		
-	/* Ticks elapsed is the amount of time elapsed since last frame render (in microsec),
-	 * which is lesser than the amount of time it would have taken on the real gameboy
-	 * because the emulator goes very fast 
-	 *
-	 * In special cases where the emulator needs to be able to go slower than the 
-	 * gb itself (for debugging), we add a special check */
-
-#ifdef DEBUG_SUPPORT_SLOW_EMULATION
-	if (ticksElapsed < (1e6/DEFAULT_FRAMERATE)) {
-#endif
-		usleep((1e6/DEFAULT_FRAMERATE) - ticksElapsed);
-#ifdef DEBUG_SUPPORT_SLOW_EMULATION
-	}
-#endif
-	vm->ticksAtLastRender = clock_u() - vm->ticksAtStartup;
+static bool shouldPresentFrame(VM* vm) {
+    /* At 1x every frame is presented, any faster and presenting would cost more than 
+     * it shows, so frames are dropped to keep it at about the normal framerate */
+    if (getEmulationSpeed(vm) == 1) return true;
+
+    unsigned long ticks = clock_u();
+    if (ticks - vm->ticksAtLastPresent < FAST_PRESENT_INTERVAL) return false;
+
+    vm->ticksAtLastPresent = ticks;
+    return true;
+}
+
+static void finishFrame(VM* vm) {
+    /* Counts the frame and lets the backend keep the emulator at the right speed */
+    vm->frameCount++;
+    if (vm->stopAtFrameEnd) vm->run = false;
+
+    vm->backend->waitForFrame(vm);
 }
 
 static void updateSTAT(VM* vm, STAT_UPDATE_TYPE type) {
@@ -92,33 +81,45 @@ static void updateSTAT(VM* vm, STAT_UPDATE_TYPE type) {
 #undef SWITCH_MODE
 }
 
+static inline void lockMemory(VM* vm, bool oam, bool palettes, bool vram) {
+	/* The CPU accesses VRAM and OAM through the memory pages, so they are 
+	 * only remapped when their lock actually changes */
+	if (vm->lockOAM != oam) {
+		vm->lockOAM = oam;
+		updateMemoryPages(vm, OAM_N0_160B, OAM_N0_160B_END);
+	}
+
+	if (vm->lockVRAM != vram) {
+		vm->lockVRAM = vram;
+		updateMemoryPages(vm, VRAM_N0_8KB, VRAM_N0_8KB_END);
+	}
+
+	vm->lockPalettes = palettes;
+}
+
 static inline void switchModePPU(VM* vm, PPU_MODE mode) {
 	vm->ppuMode = mode;
 	vm->cyclesSinceLastMode = 0;
 
 	switch (mode) {
 		case PPU_MODE_2: 
-			vm->lockOAM = true;
-			vm->lockPalettes = false;
-			vm->lockVRAM = false;
+			lockMemory(vm, true, false, false);
 			updateSTAT(vm, STAT_UPDATE_SWITCH_MODE2);
 			break;
 		case PPU_MODE_3:
-			vm->lockOAM = true;
-			vm->lockPalettes = true;
-			vm->lockVRAM = true;
+			lockMemory(vm, true, true, true);
 			updateSTAT(vm, STAT_UPDATE_SWITCH_MODE3);
 			break;
 		case PPU_MODE_0:
-			vm->lockOAM = false;
-			vm->lockPalettes = false;
-			vm->lockVRAM = false;
+			lockMemory(vm, false, false, false);
 			updateSTAT(vm, STAT_UPDATE_SWITCH_MODE0);
+
+			/* HBlank DMA copies a chunk at the start of every HBlank, but not when
+			 * the LCD is turned off */
+			if (vm->doingHDMA && vm->ppuEnabled) handleHDMAChunk(vm);
 			break;
 		case PPU_MODE_1:
-			vm->lockOAM = false;
-			vm->lockPalettes = false;
-			vm->lockVRAM = false;
+			lockMemory(vm, false, false, false);
 			updateSTAT(vm, STAT_UPDATE_SWITCH_MODE1);
 			break;
 	}
@@ -146,12 +147,12 @@ static uint8_t* getCurrentFetcherTileData(VM* vm) {
     
     if (vm->emuMode == EMU_CGB) {
         uint8_t useVramBank1 = GET_BIT(vm->fetcherTileAttributes, 3);    
-        vramBank0Pointer = (vm->MEM[R_VBK] == 0xFF) ? vm->vramBank : &vm->MEM[VRAM_N0_8KB];
+        vramBank0Pointer = &vm->MEM[VRAM_N0_8KB];
     
         /* Select which pointer to use to fetch tile data */
         if (useVramBank1) {
             /* Tile data from vram bank 1 */
-            vramBankPointer = (vm->MEM[R_VBK] == 0xFF) ? &vm->MEM[VRAM_N0_8KB] : vm->vramBank;
+            vramBankPointer = vm->vramBank;
         } else {
             vramBankPointer = vramBank0Pointer;
         }
@@ -197,75 +198,174 @@ static uint8_t* getCurrentFetcherTileData(VM* vm) {
     return tileData;
 }
 
+/* Decoded Tiles 
+ *
+ * Tiles are decoded from their bitplanes once and reused until the CPU writes to them */
+
+static void decodeTile(DecodedTile* tile, uint8_t* tileData) {
+    pixelKernels.decodeTileRows(tileData, tile->rows, tile->flippedRows, 8);
+    tile->valid = true;
+}
+
+static inline uint16_t getDecodedTileRow(VM* vm, uint8_t* tileData, uint8_t row, bool flipped) {
+    /* Returns a row of the tile whose data starts at tileData in one of the VRAM banks,
+     * the row can go upto 15 for 8x16 sprites */
+    uint8_t* vramBankPointer = &vm->MEM[VRAM_N0_8KB];
+    uint8_t bank = 0;
+
+    if (tileData < vramBankPointer || tileData >= vramBankPointer + 0x2000) {
+        vramBankPointer = vm->vramBank;
+        bank = 1;
+    }
+
+    /* Address of the row in the bank */
+    uint16_t address = (tileData - vramBankPointer) + (row * 2);
+
+    if (address >= VRAM_TILE_DATA_SIZE) {
+        /* Flipped rows in the last tiles can reach into the tile maps */
+        uint16_t decodedRow, decodedFlippedRow;
+        pixelKernels.decodeTileRows(&tileData[2 * row], &decodedRow, &decodedFlippedRow, 1);
+        return flipped ? decodedFlippedRow : decodedRow;
+    }
+
+    uint16_t tileIndex = address / 16;
+    DecodedTile* tile = &vm->decodedTiles[bank][tileIndex];
+    if (!tile->valid) decodeTile(tile, vramBankPointer + (tileIndex * 16));
+
+    return flipped ? tile->flippedRows[(address / 2) % 8] : tile->rows[(address / 2) % 8];
+}
+
+void invalidateTile(VM* vm, uint8_t bank, uint16_t address) {
+    if (address >= VRAM_TILE_DATA_SIZE) return;
+    vm->decodedTiles[bank][address / 16].valid = false;
+}
+
+/* Palette cache
+ *
+ * Palettes only change when the game writes to them, so their colors are converted to 
+ * the framebuffer format right then and pixels just look them up */
+
 static inline uint8_t toRGB888(uint8_t rgb555) {
-    /* Input can be red, green or blue value of rgb 555 */
+    /* Input can be red, green or blue value of rgb 555 
+     * Source for conversion : https://stackoverflow.com/questions/4409763/how-to-convert-from-rgb555-to-rgb888-in-c*/
     return (rgb555 << 3) | (rgb555 >> 2);
 }
 
-static void getPixelColor_CGB(VM* vm, FIFO_Pixel pixel, uint8_t* r, uint8_t* g, uint8_t* b,
-        bool isSprite) {
+static inline uint32_t convertRGB555(uint16_t color) {
+    uint8_t r = color & 0b0000000000011111;
+    uint8_t g = (color & 0b0000001111100000) >> 5;
+    uint8_t b = (color & 0b0111110000000000) >> 10;
+
+#ifdef CGB_COLOR_CORRECTION
+    /* Mix the channels the way the CGB LCD does, it washes out the colors a bit 
+     * and darkens them */
+    unsigned int correctedR = (r * 26) + (g * 4) + (b * 2);
+    unsigned int correctedG = (g * 24) + (b * 8);
+    unsigned int correctedB = (r * 6) + (g * 4) + (b * 22);
+
+    if (correctedR > 960) correctedR = 960;
+    if (correctedG > 960) correctedG = 960;
+    if (correctedB > 960) correctedB = 960;
+
+    return PACK_ARGB8888(correctedR >> 2, correctedG >> 2, correctedB >> 2);
+#else
+    return PACK_ARGB8888(toRGB888(r), toRGB888(g), toRGB888(b));
+#endif
+}
 
-    uint8_t* colorRAM = isSprite ? vm->spriteColorRAM : vm->bgColorRAM;
-    uint8_t* palettePointer = &colorRAM[pixel.colorPalette * 8];
-    /* Color is stored as little endian rgb555 */
-    uint8_t colorLow = palettePointer[pixel.colorID * 2];
-    uint8_t colorHigh = palettePointer[(pixel.colorID * 2) + 1];
-    // printf("ci %d cl %02x ch %02x cp %02x x %03d y %03d\n", pixel.colorID, colorLow, colorHigh, pixel.colorPalette, pixel.screenX, pixel.screenY);
-    uint16_t color = (colorHigh << 8) + colorLow;
-    
-    /* We need to convert these values to rgb888 
-     * Source for conversion : https://stackoverflow.com/questions/4409763/how-to-convert-from-rgb555-to-rgb888-in-c*/
-    // printf("c%04x p%d\n", color, pixel.colorPalette);
+#ifdef CGB_COLOR_CORRECTION
+/* Every RGB555 color already corrected, its shared by all VMs and built on first use,
+ * pthread_once makes VMs on other threads wait until the whole table is there */
+static uint32_t colorCorrectionLUT[0x8000];
+static pthread_once_t colorCorrectionLUTOnce = PTHREAD_ONCE_INIT;
 
-    *r = toRGB888((color & 0b0000000000011111));
-    *g = toRGB888((color & 0b0000001111100000) >> 5);
-    *b = toRGB888((color & 0b0111110000000000) >> 10);
+static void buildColorCorrectionLUT() {
+    for (int i = 0; i < 0x8000; i++) colorCorrectionLUT[i] = convertRGB555(i);
+}
+#endif
 
-    /*
-    for (int i = 0; i < 64; i++) {
-        printf("%02x ", vm->colorRAM[i]);
-    }
+static inline uint32_t getHostColor(uint16_t color) {
+#ifdef CGB_COLOR_CORRECTION
+    pthread_once(&colorCorrectionLUTOnce, buildColorCorrectionLUT);
 
+    return colorCorrectionLUT[color & 0x7FFF];
+#else
+    return convertRGB555(color);
+#endif
+}
 
-    printf("\n");
-    */
+void updatePaletteColor(VM* vm, bool isSprite, uint8_t index) {
+    /* Converts the color containing byte 'index' of BG or OBJ color RAM */
+    uint8_t* colorRAM = isSprite ? vm->spriteColorRAM : vm->bgColorRAM;
+    uint8_t colorIndex = index / 2;
+    /* Color is stored as little endian rgb555 */
+    uint16_t color = (colorRAM[(colorIndex * 2) + 1] << 8) | colorRAM[colorIndex * 2];
+
+    vm->paletteColors[isSprite][colorIndex / 4][colorIndex % 4] = getHostColor(color);
 }
 
-static void getPixelColor_DMG(VM* vm, FIFO_Pixel pixel, uint8_t* r, uint8_t* g, uint8_t* b, 
-        bool isSprite) {
+void updatePaletteDMG(VM* vm, uint16_t paletteReg) {
+    /* White, Light Gray, Dark Gray and Black */
+    static const uint8_t shades[4] = { 0xFF, 0xAA, 0x55, 0x00 };
+    uint32_t* palette = paletteReg == R_BGP  ? vm->paletteColors[0][0] :
+                        paletteReg == R_OBP0 ? vm->paletteColors[1][0] : vm->paletteColors[1][1];
 
-    int paletteReg = R_BGP;
-    if (isSprite) paletteReg = pixel.colorPalette == 0 ? R_OBP0 : R_OBP1;
+    for (int colorID = 0; colorID < 4; colorID++) {
+        uint8_t shade = shades[(vm->MEM[paletteReg] >> (colorID * 2)) & 0b00000011];
+        palette[colorID] = PACK_ARGB8888(shade, shade, shade);
+    }
+}
 
-    uint8_t shadeId = (vm->MEM[paletteReg] >> (pixel.colorID * 2)) & 0b00000011;
-    uint8_t shade = 0x00;
+void updatePalettes(VM* vm) {
+    /* Rebuilds the whole cache, after the palettes were reset */
+    memset(vm->paletteColors, 0, sizeof(vm->paletteColors));
 
-    switch (shadeId) {
-        case 0: {
-            /* White */
-            shade = 0xFF;
-            break;
-        }
-        case 1: {
-            /* Light Gray */
-            shade = 0xAA;
-            break;
-        }
-        case 2: {
-            /* Dark Gray */
-            shade = 0x55;
-            break;
-        }
-        case 3: {
-            /* Black */
-            shade = 0x00;
-            break;
+    if (vm->emuMode == EMU_CGB) {
+        for (int i = 0; i < 64; i += 2) {
+            updatePaletteColor(vm, false, i);
+            updatePaletteColor(vm, true, i);
         }
+    } else if (vm->emuMode == EMU_DMG) {
+        updatePaletteDMG(vm, R_BGP);
+        updatePaletteDMG(vm, R_OBP0);
+        updatePaletteDMG(vm, R_OBP1);
+    }
+}
+
+static inline bool spriteHasPriority(VM* vm, FIFO_Pixel pixel, FIFO_Pixel spritePixel) {
+    /* Decides whether a sprite pixel is drawn over the BG/Window pixel below it */
+    if (spritePixel.colorID == 0) return false;
+
+    if (vm->emuMode == EMU_DMG) {
+        /* case 1. Pixel isnt transparent and it has a priority over BG/Window
+         * or case 2. BG color 0 will be overwritten, otherwise BG/Window have a 
+         * higher priority*/
+        return spritePixel.bgPriority == 0 || pixel.colorID == 0;
+    } else if (vm->emuMode == EMU_CGB) {
+        /* For CGB, we've got additional 2 priority flags to check */
+        if (!GET_BIT(vm->MEM[R_LCDC], 0)) {
+            /* Sprites will be displayed on top because master priority */
+            return true;
+        } 
+
+        /* Master priority is not used, instead we start by checking 
+         * BG Attributes priority. If its set, sprite only overlaps color 0 BG,
+         * it gets covered by anything else BG/Window
+         * If its not set, it uses OAM bit.
+         *
+         * If OAM bit is set, sprite overlaps BG/Window color 1-3
+         * If its not set, it overlaps all BG/Window unless sprite is color O*/
+        return (pixel.bgPriority == 1 && pixel.colorID == 0) ||
+               (pixel.bgPriority == 0 && (spritePixel.bgPriority == 0 || pixel.colorID == 0));
     }
 
-    *r = shade;
-    *g = shade;
-    *b = shade;
+    return false;
+}
+
+static inline void drawPixel(VM* vm, FIFO_Pixel pixel, bool isSprite) {
+    /* On DMG, colorPalette picks OBP0/OBP1 for sprites and is 0 (BGP) for BG/Window */
+    vm->framebuffer[(pixel.screenY * WIDTH_PX) + pixel.screenX] = 
+        vm->paletteColors[isSprite][pixel.colorPalette][pixel.colorID];
 }
 
 static void renderPixel(VM* vm) {
@@ -273,42 +373,14 @@ static void renderPixel(VM* vm) {
     if (vm->BackgroundFIFO.count == 0) return;
 
     FIFO_Pixel pixel = popFIFO(&vm->BackgroundFIFO);
-    uint8_t r, g, b = 0;
     bool isSprite = false;
 
     if (vm->OAMFIFO.count != 0) {
         FIFO_Pixel spritePixel = popFIFO(&vm->OAMFIFO); 
 
-        if (spritePixel.colorID != 0) {
-            if (vm->emuMode == EMU_DMG) {
-                if (spritePixel.bgPriority == 0 || pixel.colorID == 0) {
-                    /* case 1. Pixel isnt transparent and it has a priority over BG/Window
-                     * or case 2. BG color 0 will be overwritten, otherwise BG/Window have a 
-                     * higher priority*/
-                    pixel = spritePixel;
-                    isSprite = true;
-                }
-            } else if (vm->emuMode == EMU_CGB) {
-                /* For CGB, we've got additional 2 priority flags to check */
-                if (!GET_BIT(vm->MEM[R_LCDC], 0)) {
-                    /* Sprites will be displayed on top because master priority */
-                    pixel = spritePixel;
-                    isSprite = true;
-                } else {
-                    /* Master priority is not used, instead we start by checking 
-                     * BG Attributes priority. If its set, sprite only overlaps color 0 BG,
-                     * it gets covered by anything else BG/Window
-                     * If its not set, it uses OAM bit.
-                     *
-                     * If OAM bit is set, sprite overlaps BG/Window color 1-3
-                     * If its not set, sprite overlaps all BG/Window unless sprite is color O*/
-                    if ((pixel.bgPriority == 1 && pixel.colorID == 0) ||
-                        (pixel.bgPriority == 0 && (spritePixel.bgPriority == 0 || pixel.colorID == 0))) {
-                        pixel = spritePixel;
-                        isSprite = true;
-                    }
-                }
-            }
+        if (spriteHasPriority(vm, pixel, spritePixel)) {
+            pixel = spritePixel;
+            isSprite = true;
         }
     }
 
@@ -319,14 +391,7 @@ static void renderPixel(VM* vm) {
     }
     */
 
-    if (vm->emuMode == EMU_CGB) {
-        getPixelColor_CGB(vm, pixel, &r, &g, &b, isSprite);
-    } else if (vm->emuMode == EMU_DMG) {
-        getPixelColor_DMG(vm, pixel, &r, &g, &b, isSprite);
-    }
-
-    SDL_SetRenderDrawColor(vm->sdl_renderer, r, g, b, 255);
-    SDL_RenderDrawPoint(vm->sdl_renderer, pixel.screenX, pixel.screenY);
+    drawPixel(vm, pixel, isSprite);
 
     vm->nextRenderPixelX = pixel.screenX + 1;
     // printf("rendered pixel at x%d\n", pixel.screenX);
@@ -367,8 +432,7 @@ static uint8_t* getSprite(VM* vm) {
 }
 
 static void pushPixels(VM* vm) {
-    uint8_t tileDataLow = vm->fetcherTileRowLow;
-    uint8_t tileDataHigh = vm->fetcherTileRowHigh; 
+    uint16_t tileRow = vm->fetcherTileRow;
     bool switchedToWindowRender = false;
     bool switchedToSpriteRender = false;
     /* Push pixels to FIFO 
@@ -429,8 +493,7 @@ static void pushPixels(VM* vm) {
             vm->spriteData = sprite;
             /* Fetch data and attributes for the remaining bg/window tiles get preserved 
              * for later use */
-            vm->preservedFetcherTileLow = vm->fetcherTileRowLow;
-            vm->preservedFetcherTileHigh = vm->fetcherTileRowHigh;
+            vm->preservedFetcherTileRow = vm->fetcherTileRow;
             vm->preservedFetcherTileAttributes = vm->fetcherTileAttributes;
             break;
         }
@@ -488,23 +551,21 @@ static void pushPixels(VM* vm) {
         }
         // if (pixelsToDiscard > 0 && vm->fetcherX != 0 && !vm->renderingSprites && !vm->renderingWindow) printf("fuck x%d y%d %d\n", vm->nextPushPixelX - 1, vm->fetcherY, vm->pixelsToDiscard);
         FIFO_Pixel pixel;
-        /* Check for horizontal bit flip */
-        uint8_t index = GET_BIT(vm->fetcherTileAttributes, 5) ? i - 1 : 8 - i;
-        uint8_t higherBit = GET_BIT(tileDataHigh, index);
-        uint8_t lowerBit = GET_BIT(tileDataLow, index);   
+        /* The decoded row is already flipped if it has to be */
+        uint8_t colorID = (tileRow >> ((i - 1) * 2)) & 0b00000011;
         uint8_t bgPriority = 0; 
 
         /* Set color palette, color ID and other data  */
         if (vm->emuMode == EMU_CGB) {
             pixel.colorPalette = vm->fetcherTileAttributes & 0b00000111;
-            pixel.colorID = (higherBit << 1) | lowerBit;
+            pixel.colorID = colorID;
             bgPriority = GET_BIT(vm->fetcherTileAttributes, 7);
 
         } else if (vm->emuMode == EMU_DMG) {
             pixel.colorPalette = 0;
             /* On DMG, if background/window is disabled through lcdc, bgp color 0 is rendered */
             if (GET_BIT(vm->MEM[R_LCDC], 0)) {
-                pixel.colorID = (higherBit << 1) | lowerBit;
+                pixel.colorID = colorID;
             } else {
                 pixel.colorID = 0;
             }
@@ -542,8 +603,7 @@ static void pushSpritePixels(VM* vm) {
     /* When the sprite fetch is complete, this function is called to push the 
      * sprite pixels to the sprite fifo as well as push the BG/Window pixels 
      * which were remaining at the start of sprite rendering. */
-    uint8_t tileDataLow = vm->fetcherTileRowLow;
-    uint8_t tileDataHigh = vm->fetcherTileRowHigh;
+    uint16_t tileRow = vm->fetcherTileRow;
     uint8_t tileAttributes = vm->fetcherTileAttributes;
     int startX = vm->spriteData[1] - 8;
     uint8_t spriteOAMIndex = vm->spriteData[4];
@@ -575,16 +635,13 @@ static void pushSpritePixels(VM* vm) {
      * In case the sprite starts a bit off screen to the left, we discard the correct amount 
      * of pixels */
     for (int i = startX < 0 ? -startX + 1 : 1; i <= 8; i++) {
-        /* Check for horizontal bit flip */
-        uint8_t pixelIndex = GET_BIT(tileAttributes, 5) ? i - 1 : 8 - i;
         /* Make adjustments to the index in the fifo that is utilized when sprite is 
          * off screen to the left 
          *
          * Note : startX is a negative value so its subtracted */
         uint8_t fifoIndex = (i - 1) + (startX < 0 ? startX : 0);
-        uint8_t higherBit = GET_BIT(tileDataHigh, pixelIndex);
-        uint8_t lowerBit = GET_BIT(tileDataLow, pixelIndex);
-        uint8_t colorID = (higherBit << 1) | lowerBit;
+        /* The decoded row is already flipped if it has to be */
+        uint8_t colorID = (tileRow >> ((i - 1) * 2)) & 0b00000011;
         uint8_t bgPriority = GET_BIT(tileAttributes, 7);
         uint8_t colorPalette = 0;
 
@@ -647,12 +704,10 @@ static void pushSpritePixels(VM* vm) {
     vm->lastSpriteOverlapX = startX;
     /* Restore State */
     vm->fetcherTileAttributes = vm->preservedFetcherTileAttributes;
-    vm->fetcherTileRowHigh = vm->preservedFetcherTileHigh;
-    vm->fetcherTileRowLow = vm->preservedFetcherTileLow;
+    vm->fetcherTileRow = vm->preservedFetcherTileRow;
 
     vm->preservedFetcherTileAttributes = 0;
-    vm->preservedFetcherTileHigh = 0;
-    vm->preservedFetcherTileLow = 0;
+    vm->preservedFetcherTileRow = 0;
 
     vm->renderingSprites = false;
     /* Continue BG/Window pushing */
@@ -713,7 +768,7 @@ static void advanceFetcher(VM* vm) {
                     /* Handle tile attributes if on a CGB 
                      *
                      * This works for both BG and Window */
-                    vm->fetcherTileAttributes = vm->MEM[R_VBK] == 0xFF ? vm->MEM[VRAM_N0_8KB + vm->fetcherTileAddress] : vm->vramBank[vm->fetcherTileAddress];
+                    vm->fetcherTileAttributes = vm->vramBank[vm->fetcherTileAddress];
                 } else if (vm->emuMode == EMU_DMG) {
                     vm->fetcherTileAttributes = 0;
                 }
@@ -740,7 +795,7 @@ static void advanceFetcher(VM* vm) {
                     /* Handle tile attributes if on a CGB 
                     *
                     * This works for both BG and Window */
-                    vm->fetcherTileAttributes = vm->MEM[R_VBK] == 0xFF ? vm->MEM[VRAM_N0_8KB + vm->fetcherTileAddress] : vm->vramBank[vm->fetcherTileAddress];
+                    vm->fetcherTileAttributes = vm->vramBank[vm->fetcherTileAddress];
                 } else if (vm->emuMode == EMU_DMG) {
                     vm->fetcherTileAttributes = 0;
                 }
@@ -773,42 +828,16 @@ static void advanceFetcher(VM* vm) {
                 if (verticallyFlipped) currentRowInTile = (vm->spriteSize == 0 ? 7 : 15) - currentRowInTile; 
             }
 
-            vm->fetcherTileRowLow = tileData[2 * currentRowInTile];
+            /* Both bitplanes of the row come out of the decoded tile cache at once,
+             * already flipped horizontally if the attributes ask for it */
+            vm->fetcherTileRow = getDecodedTileRow(vm, tileData, currentRowInTile,
+                                                   GET_BIT(vm->fetcherTileAttributes, 5));
             vm->currentFetcherTask++;
 			break;
 		}
 		case FETCHER_GET_DATA_HIGH: {
-            /* Do the same as above but instead get the higher byte */
-            uint8_t* tileData = getCurrentFetcherTileData(vm); 
-            uint8_t currentRowInTile;
-
-            if (vm->renderingSprites) {
-                /* Sprites */
-                currentRowInTile = vm->spriteData[0]; 
-            } else if (vm->renderingWindow) {
-                /* WIndow tiles */
-                currentRowInTile = vm->windowYCounter % 8;
-            } else {
-                /* BG Tiles */
-                currentRowInTile = (vm->fetcherY + vm->MEM[R_SCY]) % 8; 
-            }
-
-            if (vm->renderingSprites || vm->emuMode == EMU_CGB) {
-                bool verticallyFlipped = GET_BIT(vm->fetcherTileAttributes, 6);
-                if (verticallyFlipped) currentRowInTile = (vm->spriteSize == 0 ? 7 : 15) - currentRowInTile;
-            }
-            
-            vm->fetcherTileRowHigh = tileData[(2 * currentRowInTile) + 1];
-            
-            /*         
-            if (currentRowInTile == 7) {
-                printf("tile data for x%d\n", vm->fetcherX * 8);
-                for (int i = 0; i < 16; i++) {
-                    printf("%02x ", tileData[i]);
-                }
-                printf("\n");
-            }
-            */
+            /* The higher byte was already decoded along with the lower byte, 
+             * this step only takes up the time */
             if (vm->firstTileInScanline) {
                 vm->currentFetcherTask = 0;
                 vm->firstTileInScanline = false;
@@ -911,6 +940,319 @@ static void advanceMode2(VM* vm) {
     }
 }
 
+/* Fast Scanlines 
+ *
+ * The FIFO is accurate down to the dot but most scanlines never change while they are 
+ * being drawn, those get rendered in one pass at the start of mode 3. Mode 3 still has 
+ * to last exactly as long as it would have with the FIFO, so its length is measured the
+ * first time the FIFO draws a scanline with a certain timing key and reused afterwards */
+
+static void getScanlineTimingKey(VM* vm, ScanlineTimingKey* key) {
+    /* Clear it completely so keys can be compared as a whole */
+    memset(key, 0, sizeof(ScanlineTimingKey));
+
+    key->fineScrollX = vm->MEM[R_SCX] & 0b00000111;
+    key->windowX = 0xFF;
+
+    if (GET_BIT(vm->MEM[R_LCDC], 5) && vm->lyWasWY && vm->MEM[R_WX] <= 166) {
+        key->windowX = vm->MEM[R_WX];
+    }
+
+    if (GET_BIT(vm->MEM[R_LCDC], 1)) {
+        key->spriteCount = vm->spritesInScanline;
+
+        for (int i = 0; i < vm->spritesInScanline; i++) {
+            key->spriteX[i] = vm->oamDataBuffer[(i * 5) + 1];
+            key->spriteIndex[i] = vm->oamDataBuffer[(i * 5) + 4];
+        }
+    }
+}
+
+static inline ScanlineTiming* getScanlineTiming(VM* vm, ScanlineTimingKey* key) {
+    unsigned int hash = key->fineScrollX * 31 + key->windowX;
+
+    for (int i = 0; i < key->spriteCount; i++) {
+        hash = hash * 31 + key->spriteX[i];
+    }
+
+    return &vm->scanlineTimings[hash % SCANLINE_TIMING_CACHE_SIZE];
+}
+
+static void getTileRows(VM* vm, uint16_t tileMapRowAddress, uint8_t firstColumn, uint8_t row,
+        int count, uint16_t* rows, uint8_t* attributes) {
+    /* Does the same as the fetcher for count BG/Window tiles along a row of the tile map, 
+     * starting at firstColumn and wrapping around the map */
+    uint8_t* vramBank0Pointer = &vm->MEM[VRAM_N0_8KB];
+
+    for (int i = 0; i < count; i++) {
+        uint16_t tileMapAddress = tileMapRowAddress + ((firstColumn + i) % 32);
+        uint8_t* vramBankPointer = vramBank0Pointer;
+        uint8_t tileAttributes = 0;
+        uint8_t tileRow = row;
+
+        if (vm->emuMode == EMU_CGB) {
+            tileAttributes = vm->vramBank[tileMapAddress];
+            if (GET_BIT(tileAttributes, 3)) vramBankPointer = vm->vramBank;
+
+            if (GET_BIT(tileAttributes, 6)) tileRow = (vm->spriteSize == 0 ? 7 : 15) - tileRow;
+        }
+
+        uint8_t tileIndex = vramBank0Pointer[tileMapAddress];
+        uint8_t* tileData;
+
+        if (GET_BIT(vm->MEM[R_LCDC], 4)) {
+            /* $8000 method */
+            tileData = vramBankPointer + (tileIndex * 16);
+        } else if (tileIndex < 128) {
+            /* $8800 method */
+            tileData = vramBankPointer + 0x1000 + (tileIndex * 16);
+        } else {
+            tileData = vramBankPointer + 0x800 + ((tileIndex - 128) * 16);
+        }
+
+        attributes[i] = tileAttributes;
+        rows[i] = getDecodedTileRow(vm, tileData, tileRow, GET_BIT(tileAttributes, 5));
+    }
+}
+
+static void getScanlineSprites(VM* vm, FIFO_Pixel* spritePixels) {
+    /* Mixes the sprites of the scanline the same way the OAM FIFO does, sprites are 
+     * pushed in the order the fetcher finds them and only the pixels which havent been 
+     * drawn yet (still in the FIFO) take part in the comparisons */
+    for (int i = 0; i < WIDTH_PX; i++) {
+        spritePixels[i].colorID = 0;
+    }
+
+    if (!GET_BIT(vm->MEM[R_LCDC], 1)) return;
+
+    /* Sort the visible sprites by the X at which the fetcher reaches them,
+     * sprites with the same X keep their OAM order */
+    uint8_t* sprites[MAX_SPRITES_PER_SCANLINE];
+    int count = 0;
+
+    for (int i = 0; i < vm->spritesInScanline; i++) {
+        uint8_t* sprite = &vm->oamDataBuffer[i * 5];
+        if (sprite[1] == 0 || sprite[1] >= 168) continue;
+
+        int pushX = sprite[1] < 8 ? 0 : sprite[1] - 8;
+        int j = count++;
+
+        while (j > 0 && (sprites[j - 1][1] < 8 ? 0 : sprites[j - 1][1] - 8) > pushX) {
+            sprites[j] = sprites[j - 1];
+            j--;
+        }
+        sprites[j] = sprite;
+    }
+
+    int fifoEndX = 0;                       /* Screen X after the last pixel in the OAM FIFO */
+    uint8_t lastPushIndex = vm->lastSpriteOverlapPushIndex;
+
+    for (int s = 0; s < count; s++) {
+        uint8_t* sprite = sprites[s];
+        int startX = sprite[1] - 8;
+        int pushX = startX < 0 ? 0 : startX;
+        uint8_t spriteOAMIndex = sprite[4];
+        uint8_t tileAttributes = sprite[3];
+
+        int fifoCount = fifoEndX > pushX ? fifoEndX - pushX : 0;
+        bool partiallyOverlaps = fifoCount > 0 && fifoCount < 8;
+
+        /* The FIFO gets filled up with transparent pixels */
+        for (int i = 0; i < 8 && fifoCount != 8; i++) {
+            if (pushX + i == WIDTH_PX) break;
+            if (startX < 0 && fifoCount >= 8 + startX) break;
+            fifoCount++;
+        }
+        fifoEndX = pushX + fifoCount;
+
+        /* Fetch the sprite tile row */
+        uint8_t tileIndex = sprite[2];
+        uint8_t row = sprite[0];
+        uint8_t* vramBankPointer = &vm->MEM[VRAM_N0_8KB];
+
+        if (vm->spriteSize == 1) tileIndex &= 0xFE;
+        if (GET_BIT(tileAttributes, 6)) row = (vm->spriteSize == 0 ? 7 : 15) - row;
+        if (vm->emuMode == EMU_CGB && GET_BIT(tileAttributes, 3)) vramBankPointer = vm->vramBank;
+
+        uint8_t* tileData = vramBankPointer + (tileIndex * 16);
+        uint16_t tileRow = getDecodedTileRow(vm, tileData, row, GET_BIT(tileAttributes, 5));
+
+        for (int i = startX < 0 ? -startX + 1 : 1; i <= 8; i++) {
+            int x = pushX + (i - 1) + (startX < 0 ? startX : 0);
+            if (x >= WIDTH_PX) break;
+
+            FIFO_Pixel pixel;
+
+            pixel.colorID = (tileRow >> ((i - 1) * 2)) & 0b00000011;
+            pixel.bgPriority = GET_BIT(tileAttributes, 7);
+            pixel.colorPalette = vm->emuMode == EMU_DMG ? GET_BIT(tileAttributes, 4) : 
+                                                          tileAttributes & 0b00000111;
+            pixel.screenX = x;
+            pixel.screenY = vm->fetcherY;
+
+            if (pixel.colorID == 0) continue;
+
+            if (spritePixels[x].colorID == 0) {
+                spritePixels[x] = pixel;
+            } else if (spriteOAMIndex < lastPushIndex) {
+                /* Both are opaque, see pushSpritePixels */
+                if (vm->emuMode == EMU_CGB || !partiallyOverlaps) spritePixels[x] = pixel;
+            }
+        }
+
+        lastPushIndex = spriteOAMIndex;
+    }
+}
+
+static void renderScanlineFast(VM* vm) {
+    /* Renders the whole scanline in one pass with the registers as they are now, the 
+     * BG/Window is expanded a tile row at a time and then the sprites are drawn over it */
+    FIFO_Pixel spritePixels[WIDTH_PX];
+    getScanlineSprites(vm, spritePixels);
+
+    uint8_t lcdc = vm->MEM[R_LCDC];
+    uint8_t scx = vm->MEM[R_SCX];
+    uint8_t bgY = (uint16_t)(vm->fetcherY + vm->MEM[R_SCY]) & 0xFF;
+    uint16_t bgTileMap = GET_BIT(lcdc, 3) ? 0x1C00 : 0x1800;
+    uint16_t windowTileMap = GET_BIT(lcdc, 6) ? 0x1C00 : 0x1800;
+    int windowStartX = WIDTH_PX;
+
+    if (vm->scanlineKey.windowX != 0xFF) {
+        windowStartX = vm->MEM[R_WX] < 7 ? 0 : vm->MEM[R_WX] - 7;
+    }
+
+    /* The BG tiles are followed by the window tiles, both of them start on a tile 
+     * boundary so the first few pixels of each can be left out */
+    uint16_t rows[SCANLINE_TILE_COUNT * 2];
+    uint8_t attributes[SCANLINE_TILE_COUNT * 2];
+    uint8_t paletteIndices[SCANLINE_TILE_COUNT * 2];
+    uint32_t line[SCANLINE_TILE_COUNT * 2 * 8];
+
+    int bgOffset = scx % 8;
+    int bgTiles = windowStartX == 0 ? 0 : (bgOffset + windowStartX + 7) / 8;
+    int windowOffset = 0;
+    int windowTiles = 0;
+
+    getTileRows(vm, bgTileMap + (bgY / 8) * 32, scx / 8, bgY % 8, bgTiles, rows, attributes);
+
+    if (windowStartX < WIDTH_PX) {
+        /* Window columns start at WX - 7 */
+        int windowX = windowStartX - (vm->MEM[R_WX] - 7);
+        windowOffset = windowX % 8;
+        windowTiles = (windowOffset + (WIDTH_PX - windowStartX) + 7) / 8;
+
+        getTileRows(vm, windowTileMap + (vm->windowYCounter / 8) * 32, windowX / 8, 
+                    vm->windowYCounter % 8, windowTiles, &rows[bgTiles], &attributes[bgTiles]);
+    }
+
+    int tileCount = bgTiles + windowTiles;
+
+    for (int i = 0; i < tileCount; i++) {
+        /* On DMG, if background/window is disabled through lcdc, bgp color 0 is rendered */
+        if (vm->emuMode == EMU_DMG && !GET_BIT(lcdc, 0)) rows[i] = 0;
+        paletteIndices[i] = attributes[i] & 0b00000111;
+    }
+
+    pixelKernels.expandTileRows(rows, paletteIndices, (const uint32_t (*)[4])vm->paletteColors[0], 
+                                line, tileCount);
+
+    uint32_t* scanline = &vm->framebuffer[vm->fetcherY * WIDTH_PX];
+    memcpy(scanline, &line[bgOffset], windowStartX * sizeof(uint32_t));
+    memcpy(&scanline[windowStartX], &line[(bgTiles * 8) + windowOffset], 
+           (WIDTH_PX - windowStartX) * sizeof(uint32_t));
+
+    for (int x = 0; x < WIDTH_PX; x++) {
+        if (spritePixels[x].colorID == 0) continue;
+
+        /* Find the BG/Window pixel below the sprite pixel */
+        int linePosition = x < windowStartX ? x + bgOffset : 
+                                              (bgTiles * 8) + windowOffset + (x - windowStartX);
+        FIFO_Pixel pixel;
+
+        pixel.colorID = (rows[linePosition / 8] >> ((linePosition % 8) * 2)) & 0b00000011;
+        pixel.bgPriority = GET_BIT(attributes[linePosition / 8], 7);
+
+        if (spriteHasPriority(vm, pixel, spritePixels[x])) {
+            scanline[x] = vm->paletteColors[1][spritePixels[x].colorPalette][spritePixels[x].colorID];
+        }
+    }
+}
+
+static bool startFastScanline(VM* vm) {
+    /* Called on the first dot of mode 3, returns true if the scanline was rendered 
+     * in one pass */
+#ifdef PPU_FIFO_ONLY
+    return false;
+#endif
+    /* The FIFO has to start from its usual state for the timing to be the same */
+    if (vm->fifoScanline || vm->isLastSpriteOverlap || vm->doOptionalPush) {
+        vm->fifoScanline = true;
+        return false;
+    }
+
+    getScanlineTimingKey(vm, &vm->scanlineKey);
+    ScanlineTiming* timing = getScanlineTiming(vm, &vm->scanlineKey);
+
+    if (!timing->valid || memcmp(&timing->key, &vm->scanlineKey, sizeof(ScanlineTimingKey)) != 0) {
+        /* Not measured yet, the FIFO draws it and measures it */
+        return false;
+    }
+
+    renderScanlineFast(vm);
+
+    vm->fastScanline = true;
+    vm->fastScanlineDots = timing->mode3Dots;
+    vm->fastScanlineCycles = timing->mode3Cycles;
+    return true;
+}
+
+static void advancePPU(VM* vm);
+
+static void leaveFastScanline(VM* vm) {
+    /* A register is about to change in the middle of a scanline that was rendered in 
+     * one pass, so the FIFO reruns it upto the current dot. The registers still hold 
+     * the values the scanline was rendered with since this is the first write */
+    unsigned int dots = vm->cyclesSinceLastMode;
+
+    vm->fastScanline = false;
+    vm->fifoScanline = true;
+    vm->cyclesSinceLastMode = 0;
+    vm->mode3Dots = 0;
+
+    for (unsigned int i = 0; i < dots; i++) {
+        advancePPU(vm);
+    }
+}
+
+static void finishMode3(VM* vm) {
+    if (vm->renderingWindow || (vm->fastScanline && vm->scanlineKey.windowX != 0xFF)) {
+        /* If we were rendering the window in this line, 
+         * increment the window line counter 
+         *
+         * This means if window gets disabled between scanlines,
+         * the window line counter is still preserved */
+        vm->renderingWindow = false;
+        vm->windowYCounter++;
+    }
+
+    vm->currentFetcherTask = 0;
+    vm->fetcherX = 0;
+    vm->nextPushPixelX = 0;
+    vm->renderingSprites = false;
+    vm->spritesInScanline = 0;
+    vm->spriteData = NULL;
+    vm->preservedFetcherTileRow = 0;
+    vm->preservedFetcherTileAttributes = 0;
+    vm->fastScanline = false;
+    vm->fifoScanline = false;
+    vm->mode3Dots = 0;
+    /* tile pixel row over */ 
+    vm->nextRenderPixelX = 0;
+    vm->hblankDuration = T_CYCLES_PER_SCANLINE - T_CYCLES_PER_MODE2 - vm->cyclesSinceLastMode; 
+
+    switchModePPU(vm, PPU_MODE_0); 
+}
+
 static void advancePPU(VM* vm) {
 	/* We use a state machine to handle different PPU modes */
 	vm->cyclesSinceLastMode++;
@@ -949,6 +1291,17 @@ static void advancePPU(VM* vm) {
 
 			break;
 		case PPU_MODE_3:
+            if (vm->fastScanline) {
+                /* The scanline is already rendered, wait for mode 3 to end */
+                if (vm->cyclesSinceLastMode == vm->fastScanlineDots) {
+                    vm->cyclesSinceLastMode = vm->fastScanlineCycles;
+                    finishMode3(vm);
+                }
+                break;
+            }
+
+            vm->mode3Dots++;
+
             if (vm->pauseDotClock > 0) {
                 vm->pauseDotClock--;
                 break;
@@ -970,6 +1323,8 @@ static void advancePPU(VM* vm) {
                 vm->pixelsToDiscard = vm->MEM[R_SCX] & 0b00000111;
                 vm->pauseDotClock = 0;
 
+                if (startFastScanline(vm)) break;
+
                 if (remainderPixels != 0) {
                     vm->pauseDotClock = remainderPixels - 1;
                     break;
@@ -988,30 +1343,17 @@ static void advancePPU(VM* vm) {
              * to finish which is 6 dots behind). At the end of the 6th dot itself, it resets back 
              * to its initial state for the next scanline */
 			if (vm->nextRenderPixelX == 160) {
-                if (vm->renderingWindow) {
-                    /* If we were rendering the window in this line, 
-                     * increment the window line counter 
-                     *
-                     * This means if window gets disabled between scanlines,
-                     * the window line counter is still preserved */
-                    vm->renderingWindow = false;
-                    vm->windowYCounter++;
+                if (!vm->fifoScanline) {
+                    /* Remember how long this scanline took */
+                    ScanlineTiming* timing = getScanlineTiming(vm, &vm->scanlineKey);
+
+                    timing->valid = true;
+                    timing->key = vm->scanlineKey;
+                    timing->mode3Dots = vm->mode3Dots;
+                    timing->mode3Cycles = vm->cyclesSinceLastMode;
                 }
 
-                vm->currentFetcherTask = 0;
-                vm->fetcherX = 0;
-                vm->nextPushPixelX = 0;
-                vm->renderingSprites = false;
-                vm->spritesInScanline = 0;
-                vm->spriteData = NULL;
-                vm->preservedFetcherTileLow = 0;
-                vm->preservedFetcherTileHigh = 0;
-                vm->preservedFetcherTileAttributes = 0;
-                /* tile pixel row over */ 
-                vm->nextRenderPixelX = 0;
-                vm->hblankDuration = T_CYCLES_PER_SCANLINE - T_CYCLES_PER_MODE2 - vm->cyclesSinceLastMode; 
-
-				switchModePPU(vm, PPU_MODE_0); 
+                finishMode3(vm);
             }
 
 			break;
@@ -1075,6 +1417,22 @@ static void advancePPU(VM* vm) {
 
 /* PPU Enable & Disable */
 
+void prepareRegisterWritePPU(VM* vm) {
+    if (!vm->ppuEnabled) return;
+
+    /* Bring the PPU upto the cycle of the write */
+    handlePPUEvent(vm);
+    if (vm->ppuMode != PPU_MODE_3 || vm->cyclesSinceLastMode == 0) return;
+
+    /* The write lands in the middle of the scanline */
+    if (vm->fastScanline) {
+        leaveFastScanline(vm);
+        schedulePPU(vm);
+    }
+
+    vm->fifoScanline = true;
+}
+
 void enablePPU(VM* vm) {
     if (vm->ppuEnabled) return;
 	vm->ppuEnabled = true;
@@ -1085,10 +1443,22 @@ void enablePPU(VM* vm) {
 
     /* Reset frame counter so the whole emulator is again aligned with the PPU frames */
     vm->cyclesSinceLastFrame = 0;
+
+    vm->fastScanline = false;
+    vm->fifoScanline = false;
+    vm->mode3Dots = 0;
+
+    vm->lastDisplaySync = vm->clock;
+    schedulePPU(vm);
 }
 
 void disablePPU(VM* vm) {
     if (!vm->ppuEnabled) return;
+
+    /* Finish the dots that are due before turning it off */
+    handlePPUEvent(vm);
+    cancelEvent(vm, EVENT_PPU);
+
 	if (vm->ppuMode != PPU_MODE_1) {
 		/* This is dangerous for any game/rom to do on real hardware
 		 * as it can damage hardware */
@@ -1100,6 +1470,14 @@ void disablePPU(VM* vm) {
 
 	/* Set STAT mode to 0 */
 	switchModePPU(vm, PPU_MODE_0);
+
+    /* Frames keep ending while its off, see syncDisplay */
+    vm->lastDisplaySync = vm->clock;
+    schedulePPU(vm);
+}
+
+const uint32_t* getFramebuffer(VM* vm) {
+    return vm->framebuffer;
 }
 
 /* -------------------- */
@@ -1173,24 +1551,169 @@ void insertFIFO(FIFO* fifo, FIFO_Pixel pixel, uint8_t index) {
     else fifo->contents[fifo->nextPopIndex + index] = pixel;
 }
 
+static inline unsigned int getIdleDotsPPU(VM* vm) {
+    /* Returns the number of upcoming dots in which the PPU does nothing but count,
+     * these can be skipped over at once
+     *
+     * Mode 2 and 3 do work on every dot (OAM scan, fetcher and FIFO), 
+     * mode 0 and 1 only act on a few known dots, and so does mode 3 when the 
+     * scanline was rendered in one pass */
+#ifdef DEBUG_PRINT_PPU
+    /* Every dot gets printed */
+    return 0;
+#endif
+    unsigned int cycle = vm->cyclesSinceLastMode;
+    unsigned int nextActionCycle;
+
+    switch (vm->ppuMode) {
+        case PPU_MODE_0: 
+            /* LY increment and end of scanline */
+            nextActionCycle = vm->hblankDuration - 6;
+            if (cycle >= nextActionCycle) nextActionCycle = vm->hblankDuration;
+            break;
+        case PPU_MODE_1: {
+            /* LY increment on every line, LY reset and LY=LYC check on line 153 and end of vblank */
+            unsigned int cycleAtLYReset = T_CYCLES_PER_VBLANK - T_CYCLES_PER_SCANLINE + 4;
+            unsigned int cycleAtLYCInterrupt = T_CYCLES_PER_VBLANK - T_CYCLES_PER_SCANLINE + 12;
+            
+            nextActionCycle = (cycle / T_CYCLES_PER_SCANLINE) * T_CYCLES_PER_SCANLINE + 
+                              T_CYCLES_PER_SCANLINE - 6;
+            if (cycle >= nextActionCycle) nextActionCycle += T_CYCLES_PER_SCANLINE;
+
+            if (cycle < cycleAtLYReset && cycleAtLYReset < nextActionCycle) {
+                nextActionCycle = cycleAtLYReset;
+            } else if (cycle < cycleAtLYCInterrupt && cycleAtLYCInterrupt < nextActionCycle) {
+                nextActionCycle = cycleAtLYCInterrupt;
+            } else if (nextActionCycle > T_CYCLES_PER_VBLANK) {
+                nextActionCycle = T_CYCLES_PER_VBLANK;
+            }
+            break;
+        }
+        case PPU_MODE_3:
+            /* Only when the scanline is already rendered */
+            if (!vm->fastScanline) return 0;
+            nextActionCycle = vm->fastScanlineDots;
+            break;
+        default: return 0;
+    }
+
+    if (cycle >= nextActionCycle) return 0;
+    unsigned int idleDots = nextActionCycle - cycle - 1;
+
+    /* The end of a frame also has to be run */
+    unsigned int idleFrameDots = T_CYCLES_PER_FRAME - vm->cyclesSinceLastFrame - 1;
+    if (vm->cyclesSinceLastFrame >= T_CYCLES_PER_FRAME) idleFrameDots = 0;
+
+    return idleDots < idleFrameDots ? idleDots : idleFrameDots;
+}
+
+static unsigned int getUnseenDotsPPU(VM* vm) {
+    /* Returns the number of upcoming dots which the PPU can run later than the CPU gets 
+     * to them, without the CPU being able to tell
+     *
+     * Mode switches, LY changes and interrupts are seen by the CPU so the PPU has to 
+     * run them right on time. What mode 2 and FIFO mode 3 do on the dots in between 
+     * only shows once they end, so the PPU is left behind for those and catches up at
+     * the end of the mode. Until then everything that could change what it does on those 
+     * dots (writes to the registers it reads and the end of an OAM DMA) has to syncPPU()
+     * first, the CPU cant touch OAM and VRAM while they are locked during these modes 
+     * anyway, and sprites copied by a DMA in between are copied when the PPU gets 
+     * to them */
+#if !defined(PPU_NO_CATCH_UP) && !defined(DEBUG_PRINT_PPU)
+    unsigned int cycle = vm->cyclesSinceLastMode;
+    unsigned int unseenDots = 0;
+
+    switch (vm->ppuMode) {
+        case PPU_MODE_2:
+            /* OAM scan and the WY check, upto the switch to mode 3 */
+            if (cycle < T_CYCLES_PER_MODE2) unseenDots = T_CYCLES_PER_MODE2 - cycle - 1;
+            break;
+        case PPU_MODE_3:
+            /* At most 1 pixel is rendered per dot, so mode 3 cant end before all the
+             * pixels left in the scanline could have been */
+            if (!vm->fastScanline && vm->nextRenderPixelX < WIDTH_PX) {
+                unseenDots = WIDTH_PX - vm->nextRenderPixelX - 1;
+            }
+            break;
+        default: break;
+    }
+
+    if (unseenDots > 0) {
+        /* The end of a frame also has to be run */
+        unsigned int unseenFrameDots = T_CYCLES_PER_FRAME - vm->cyclesSinceLastFrame - 1;
+        if (vm->cyclesSinceLastFrame >= T_CYCLES_PER_FRAME) unseenFrameDots = 0;
+
+        return unseenDots < unseenFrameDots ? unseenDots : unseenFrameDots;
+    }
+#endif
+    return getIdleDotsPPU(vm);
+}
+
+void schedulePPU(VM* vm) {
+    if (!vm->ppuEnabled) {
+        /* Nothing happens until the end of the frame */
+        scheduleEvent(vm, EVENT_PPU, vm->lastDisplaySync + T_CYCLES_PER_FRAME - vm->cyclesSinceLastFrame);
+        return;
+    }
+    scheduleEvent(vm, EVENT_PPU, vm->lastDisplaySync + getUnseenDotsPPU(vm) + 1);
+}
+
+void handlePPUEvent(VM* vm) {
+    PROFILE_BEGIN(vm, PROFILE_PPU);
+
+    /* While a DMA runs the OAM scan has to see the sprites it copied before each dot,
+     * so the PPU is run upto every sprite that gets copied in between */
+    while (vm->doingDMA && vm->dmaSpritesCopied < DMA_SPRITE_COUNT) {
+        unsigned long nextCopy = getNextDMACopy(vm);
+        if (nextCopy > vm->clock) break;
+
+        syncDisplay(vm, nextCopy - vm->lastDisplaySync);
+        vm->lastDisplaySync = nextCopy;
+        syncDMA(vm, nextCopy);
+    }
+
+    syncDisplay(vm, vm->clock - vm->lastDisplaySync);
+    PROFILE_END(vm);
+    vm->lastDisplaySync = vm->clock;
+    schedulePPU(vm);
+}
+
+void syncPPU(VM* vm) {
+    if (vm->ppuEnabled && vm->lastDisplaySync != vm->clock) handlePPUEvent(vm);
+}
+
 void syncDisplay(VM* vm, unsigned int cycles) {
     /* We sync the display by running the PPU for the correct number of 
 	 * dots (1 dot = 1 tcycle in normal speed) */
 	if (!vm->ppuEnabled) {
-        /* Keep locking to framerate even if PPU is off */
-        for (unsigned int i = 0; i < cycles; i++) {
-            vm->cyclesSinceLastFrame = 0;
+        /* Nothing is drawn while the LCD is off, but frames still end at the same 
+         * rate so the backend keeps pacing the emulator and frame counts stay right,
+         * the PPU event lands on every frame end so this is usually atmost one */
+        unsigned long frameCycles = vm->cyclesSinceLastFrame + cycles;
+        unsigned long frames = frameCycles / T_CYCLES_PER_FRAME;
 
-            if (vm->cyclesSinceLastFrame == T_CYCLES_PER_FRAME) {
-                vm->cyclesSinceLastFrame = 0;
-		        lockToFramerate(vm);
-            }
-        }
+        vm->cyclesSinceLastFrame = frameCycles % T_CYCLES_PER_FRAME;
+        while (frames-- > 0) finishFrame(vm);
 
 		return;
 	}
 
-	for (unsigned int i = 0; i < cycles; i++) {
+	while (cycles > 0) {
+        if (vm->ppuMode != PPU_MODE_2) {
+            /* Skip over the dots in which nothing happens */
+            unsigned int idleDots = getIdleDotsPPU(vm);
+
+            if (idleDots > 0) {
+                if (idleDots > cycles) idleDots = cycles;
+
+                vm->cyclesSinceLastMode += idleDots;
+                vm->cyclesSinceLastFrame += idleDots;
+                cycles -= idleDots;
+                continue;
+            }
+        }
+
+        cycles--;
 		vm->cyclesSinceLastFrame++;
 #ifdef DEBUG_PRINT_PPU
         printf("[m%d|ly%03d|fcy%05d|mcy%04d|fifoc%d|lastX%03d|type %s]\n", vm->ppuMode, vm->MEM[R_LY], vm->cyclesSinceLastFrame, vm->cyclesSinceLastMode, vm->BackgroundFIFO.count, vm->nextRenderPixelX, vm->renderingWindow ? "win" : "bg");
@@ -1204,10 +1727,10 @@ void syncDisplay(VM* vm, unsigned int cycles) {
 
 			if (vm->skipFrame) {
 				vm->skipFrame = false;
-			} else {
-				SDL_RenderPresent(vm->sdl_renderer);
+			} else if (shouldPresentFrame(vm)) {
+				vm->backend->presentFrame(vm);
 			}
-			lockToFramerate(vm);
+			finishFrame(vm);
 		} 
 	}
 }
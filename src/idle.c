@@ -0,0 +1,178 @@
+#include "../include/idle.h"
+#include "../include/vm.h"
+#include <limits.h>
+#include <string.h>
+
+/* Where an instruction in the loop reads memory from */
+typedef enum {
+    READ_NONE,
+    READ_BC,
+    READ_DE,
+    READ_HL,
+    READ_PORT_C,                        /* 0xFF00 + C */
+    READ_PORT_D8,                       /* 0xFF00 + immediate byte */
+    READ_D16                            /* Immediate address */
+} READ_KIND;
+
+static bool isVolatileAddress(uint16_t addr) {
+    /* These change with the clock without any event being scheduled for it */
+    return addr == R_DIV || addr == R_TIMA;
+}
+
+static bool checkRead(VM* vm, READ_KIND kind, uint16_t addr) {
+    /* Returns false if the read could see a different value without an event */
+    switch (kind) {
+        case READ_BC:       addr = (vm->GPR[R8_B] << 8) | vm->GPR[R8_C]; break;
+        case READ_DE:       addr = (vm->GPR[R8_D] << 8) | vm->GPR[R8_E]; break;
+        case READ_HL:       addr = (vm->GPR[R8_H] << 8) | vm->GPR[R8_L]; break;
+        case READ_PORT_C:   addr = 0xFF00 + vm->GPR[R8_C]; break;
+        case READ_PORT_D8:  addr = 0xFF00 + (addr & 0xFF); break;
+        case READ_D16:      break;
+        default: return true;
+    }
+
+    return !isVolatileAddress(addr);
+}
+
+static bool isAllowedPrefixed(uint8_t byte) {
+    /* BIT on anything, other operations only on A */
+    return (byte >= 0x40 && byte <= 0x7F) || (byte & 7) == 7;
+}
+
+static bool analyzeIdleLoop(VM* vm, uint16_t start, uint16_t end, unsigned int* length) {
+    /* Goes through the loop once, in a straight line from start to end, and returns
+     * whether every instruction in it is one that could be part of an idle loop 
+     *
+     * That means it doesnt write to memory or touch the stack, only changes A and F
+     * (so the addresses it reads from stay the same), doesnt read DIV or TIMA, and 
+     * any jump in the middle leaves the loop. Every iteration then runs exactly these
+     * instructions */
+    uint16_t addr = start;
+    *length = 0;
+
+    while (addr < end) {
+        uint8_t byte = peekAddr(vm, addr);
+        uint16_t operand = peekAddr(vm, addr + 1) | (peekAddr(vm, addr + 2) << 8);
+        uint8_t size = 1;
+        READ_KIND read = READ_NONE;
+        bool isJump = false;
+        uint16_t target = 0;
+
+        switch (byte) {
+            case 0x00: case 0x07: case 0x0F: case 0x17: case 0x1F:
+            case 0x27: case 0x2F: case 0x37: case 0x3C: case 0x3D: case 0x3F:
+            case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7F:
+                break;
+            case 0x0A: read = READ_BC; break;
+            case 0x1A: read = READ_DE; break;
+            case 0x7E: read = READ_HL; break;
+            case 0xF2: read = READ_PORT_C; break;
+            case 0x3E: case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+            case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+                size = 2;
+                break;
+            case 0xF0: read = READ_PORT_D8; size = 2; break;
+            case 0xFA: read = READ_D16; size = 3; break;
+            case 0xCB: {
+                uint8_t prefixed = operand & 0xFF;
+                if (!isAllowedPrefixed(prefixed)) return false;
+                if ((prefixed & 7) == 6) read = READ_HL;
+                size = 2;
+                break;
+            }
+            case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+                size = 2;
+                isJump = true;
+                target = addr + 2 + (int8_t)(operand & 0xFF);
+                break;
+            case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA:
+                size = 3;
+                isJump = true;
+                target = operand;
+                break;
+            default:
+                /* ALU operations on A, with registers or (HL) */
+                if (byte >= 0x80 && byte <= 0xBF) {
+                    if ((byte & 7) == 6) read = READ_HL;
+                    break;
+                }
+                return false;
+        }
+
+        if (!checkRead(vm, read, operand)) return false;
+
+        addr += size;
+        (*length)++;
+
+        if (isJump) {
+            bool last = addr == end;
+
+            /* The jump at the end is the one that came back to start, anything else
+             * has to leave the loop, and unconditional ones can only be at the end */
+            if (last) return target == start;
+            if (byte == 0x18 || byte == 0xC3) return false;
+            if (target >= start && target < end) return false;
+        }
+    }
+
+    /* The jump back wasnt where we expected it */
+    return false;
+}
+
+void initIdleLoop(IdleLoop* loop) {
+    loop->enabled = true;
+    loop->start = 0;
+    loop->end = 0;
+    loop->idle = false;
+    loop->length = 0;
+    memset(loop->GPR, 0, sizeof(loop->GPR));
+    loop->lastInstructionCount = 0;
+    loop->lastClock = 0;
+    loop->lastDeadline = 0;
+    loop->skips = 0;
+    loop->skippedCycles = 0;
+}
+
+static void skipIdleIterations(VM* vm) {
+    IdleLoop* loop = &vm->idleLoop;
+    unsigned long deadline = vm->scheduler.nextDeadline;
+    unsigned long cycles = vm->clock - loop->lastClock;
+
+    /* Without any events only the joypad can end the loop */
+    if (deadline == ULONG_MAX || deadline <= vm->clock || cycles == 0) return;
+
+    /* The events run as soon as the clock reaches their deadline, so every skipped
+     * iteration has to end before it */
+    unsigned long iterations = (deadline - vm->clock - 1) / cycles;
+    if (iterations == 0) return;
+
+    vm->clock += iterations * cycles;
+    vm->instructionCount += iterations * loop->length;
+
+    loop->skips++;
+    loop->skippedCycles += iterations * cycles;
+}
+
+void checkIdleLoop(VM* vm, uint16_t start, uint16_t end) {
+    IdleLoop* loop = &vm->idleLoop;
+    bool sameLoop = loop->start == start && loop->end == end;
+
+    if (sameLoop && loop->idle && vm->clock < loop->lastDeadline &&
+            vm->instructionCount - loop->lastInstructionCount == loop->length) {
+        /* Went through the whole loop once since the last time, without an interrupt, 
+         * leaving it, or any event changing what it read. If the registers didnt 
+         * change either, its spinning */
+        if (memcmp(loop->GPR, vm->GPR, GP_COUNT) == 0) skipIdleIterations(vm);
+    } else if (!sameLoop || loop->idle) {
+        /* A new loop, or the code could have changed since it was last looked at.
+         * Loops which cant be idle are not looked at again until another loop runs */
+        loop->start = start;
+        loop->end = end;
+        loop->idle = analyzeIdleLoop(vm, start, end, &loop->length);
+    }
+
+    memcpy(loop->GPR, vm->GPR, GP_COUNT);
+    loop->lastInstructionCount = vm->instructionCount;
+    loop->lastClock = vm->clock;
+    loop->lastDeadline = vm->scheduler.nextDeadline;
+}
@@ -0,0 +1,1393 @@
+#include "../include/jit.h"
+#include "../include/vm.h"
+#include "../include/debug.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef CPU_JIT
+#include <sys/mman.h>
+#endif
+
+void initJit(Jit* jit) {
+#ifdef CPU_JIT
+    jit->mode = JIT_ON;
+#else
+    jit->mode = JIT_OFF;
+#endif
+    jit->arena = NULL;
+    jit->arenaUsed = 0;
+    jit->stop = false;
+    jit->executed = 0;
+    jit->jumpEnd = -1;
+    jit->snapshot = NULL;
+    jit->savePages = false;
+    jit->compiledBlocks = 0;
+    jit->blocksRun = 0;
+    jit->instructions = 0;
+    jit->flushes = 0;
+
+    /* LAHF loads SF ZF - AF - PF - CF into AH, Z H and C are the same bits on the SM83
+     * as on x86 for additions and subtractions, N is added by the instruction */
+    for (int flags = 0; flags < 256; flags++) {
+        jit->flagTable[flags] = ((flags & 0x40) ? 0x80 : 0) |
+                                ((flags & 0x10) ? 0x20 : 0) |
+                                ((flags & 0x01) ? 0x10 : 0);
+    }
+}
+
+/* A memory page that was written while JIT_VERIFY ran a block */
+typedef struct {
+    uint8_t* memory;                        /* Where it is, whichever bank it was in */
+    uint16_t address;                       /* Address of the page when it was saved */
+    uint8_t before[MEMORY_PAGE_SIZE];       /* Before the block */
+    uint8_t after[MEMORY_PAGE_SIZE];        /* After the compiled block */
+} JitPage;
+
+struct JitSnapshot {
+    VM* vm;                                 /* The VM before the block, without the
+                                               arrays skipped by copyState() */
+    JitPage* pages;
+    size_t pageCount;
+    size_t pageCapacity;
+    uint8_t colorRAM[2][128];               /* CGB palettes before and after the
+                                               compiled block */
+
+    /* The CPU after the compiled block */
+    uint8_t GPR[GP_COUNT];
+    uint16_t PC;
+    unsigned long clock;
+    unsigned long instructionCount;
+    bool IME;
+    bool haltMode;
+};
+
+static void freeJitSnapshot(JitSnapshot* snapshot) {
+    if (snapshot == NULL) return;
+
+    free(snapshot->vm);
+    free(snapshot->pages);
+    free(snapshot);
+}
+
+void freeJit(Jit* jit) {
+#ifdef CPU_JIT
+    if (jit->arena != NULL) munmap(jit->arena, JIT_ARENA_SIZE);
+#endif
+    jit->arena = NULL;
+
+    freeJitSnapshot(jit->snapshot);
+    jit->snapshot = NULL;
+}
+
+#ifdef CPU_JIT
+
+/* x86-64 code emission
+ *
+ * Only the handful of instruction forms the compiler needs are encoded here, always
+ * with 32 bit displacements and immediates to keep it simple. Bytes are only ever
+ * moved through AL, CL and DL so no byte register ever needs a REX prefix to reach */
+
+typedef enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+} HOST_REG;
+
+/* AH in the r/m field of a byte instruction without a REX prefix */
+#define HOST_AH RSP
+
+/* Where the VM and the SM83 registers are kept while a block runs, every pair is
+ * kept as a single 16 bit value */
+#define HOST_VM RBX
+#define HOST_A  R12
+#define HOST_F  R13
+#define HOST_BC R14
+#define HOST_DE R15
+#define HOST_HL RBP
+#define HOST_SP R11                         /* Isnt callee saved, see emitCall() */
+
+/* Stack slots below the saved registers */
+#define SLOT_SP     0                       /* SP while calling into C */
+#define SLOT_TEMP   8                       /* Values that have to live across a sync */
+#define SLOT_WRITE  16                      /* Address and byte of a write while its page is saved */
+#define FRAME_SIZE  24                      /* Keeps the stack 16 byte aligned for calls */
+
+typedef enum { ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP } HOST_ALU;
+typedef enum { SHIFT_ROL, SHIFT_ROR, SHIFT_SHL = 4, SHIFT_SHR = 5 } HOST_SHIFT;
+typedef enum { CONDITION_B = 2, CONDITION_Z = 4, CONDITION_NZ = 5 } HOST_CONDITION;
+
+#define VM_OFFSET(field) ((int32_t)offsetof(VM, field))
+#define GPR_OFFSET(reg) (VM_OFFSET(GPR) + (reg))
+#define PAGE_OFFSET(field) (VM_OFFSET(memoryPages) + (int32_t)offsetof(MEMORY_PAGE, field))
+
+typedef void (*CompiledCode)(VM* vm);
+
+typedef struct {
+    uint8_t* code;
+    size_t size;
+    bool overflow;                          /* Ran past JIT_MAX_BLOCK_SIZE */
+    size_t epilogue;                        /* Where the shared exit code is */
+    bool savePages;                         /* Writes save their page first, for JIT_VERIFY */
+} Emitter;
+
+static void emit8(Emitter* e, uint8_t byte) {
+    if (e->size >= JIT_MAX_BLOCK_SIZE) {
+        e->overflow = true;
+        return;
+    }
+    e->code[e->size++] = byte;
+}
+
+static void emit32(Emitter* e, uint32_t value) {
+    for (int i = 0; i < 4; i++) emit8(e, value >> (i * 8));
+}
+
+static void emit64(Emitter* e, uint64_t value) {
+    for (int i = 0; i < 8; i++) emit8(e, value >> (i * 8));
+}
+
+static void emitOpcode(Emitter* e, bool wide, int reg, int index, int base, uint16_t opcode) {
+    uint8_t rex = 0x40 | (wide << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+
+    if (rex != 0x40) emit8(e, rex);
+    if (opcode > 0xFF) emit8(e, opcode >> 8);
+    emit8(e, opcode & 0xFF);
+}
+
+static void emitRR(Emitter* e, uint16_t opcode, bool wide, int reg, int rm) {
+    /* Instruction with a register in the r/m field */
+    emitOpcode(e, wide, reg, 0, rm, opcode);
+    emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emitRM(Emitter* e, uint16_t opcode, bool wide, int reg, int base, int index, int32_t disp) {
+    /* Instruction with [base + index + disp] in the r/m field, index is -1 for none */
+    emitOpcode(e, wide, reg, index < 0 ? 0 : index, base, opcode);
+
+    if (index < 0 && (base & 7) != RSP) {
+        emit8(e, 0x80 | ((reg & 7) << 3) | (base & 7));
+    } else {
+        emit8(e, 0x84 | ((reg & 7) << 3));
+        emit8(e, (((index < 0 ? RSP : index) & 7) << 3) | (base & 7));
+    }
+    emit32(e, disp);
+}
+
+static void emitMov(Emitter* e, int dst, int src) {
+    emitRR(e, 0x8B, false, dst, src);
+}
+
+static void emitMovImm(Emitter* e, int dst, uint32_t value) {
+    emitOpcode(e, false, 0, 0, dst, 0xB8 + (dst & 7));
+    emit32(e, value);
+}
+
+static void emitAlu(Emitter* e, HOST_ALU op, int dst, int src) {
+    emitRR(e, op * 8 + 1, false, src, dst);
+}
+
+static void emitAlu8(Emitter* e, HOST_ALU op, int dst, int src) {
+    emitRR(e, op * 8, false, src, dst);
+}
+
+static void emitAluImm(Emitter* e, HOST_ALU op, int dst, uint32_t value) {
+    emitRR(e, 0x81, false, op, dst);
+    emit32(e, value);
+}
+
+static void emitShift(Emitter* e, HOST_SHIFT op, int dst, uint8_t count) {
+    emitRR(e, 0xC1, false, op, dst);
+    emit8(e, count);
+}
+
+static void emitShift8(Emitter* e, HOST_SHIFT op, int dst, uint8_t count) {
+    emitRR(e, 0xC0, false, op, dst);
+    emit8(e, count);
+}
+
+static void emitMovzx8(Emitter* e, int dst, int src) {
+    emitRR(e, 0x0FB6, false, dst, src);
+}
+
+static void emitTestImm(Emitter* e, int reg, uint32_t value) {
+    emitRR(e, 0xF7, false, 0, reg);
+    emit32(e, value);
+}
+
+static void emitSetZ(Emitter* e, int dst) {
+    emitRR(e, 0x0F94, false, 0, dst);
+}
+
+static void emitLahf(Emitter* e) {
+    emit8(e, 0x9F);
+}
+
+static size_t emitJumpForward(Emitter* e, int condition) {
+    /* Jump with a target that isnt known yet, condition is -1 for an unconditional
+     * one, returns what to give to patchJump() */
+    if (condition < 0) {
+        emit8(e, 0xE9);
+    } else {
+        emit8(e, 0x0F);
+        emit8(e, 0x80 | condition);
+    }
+    emit32(e, 0);
+    return e->size;
+}
+
+static void patchJump(Emitter* e, size_t jump) {
+    /* Points the jump at the current position */
+    if (e->overflow) return;
+
+    int32_t distance = (int32_t)(e->size - jump);
+    memcpy(&e->code[jump - 4], &distance, sizeof(distance));
+}
+
+static void emitCall(Emitter* e, const void* function) {
+    /* Calls into C with the VM as the first argument, everything but the SM83
+     * registers is clobbered */
+    emitRM(e, 0x89, false, HOST_SP, RSP, -1, SLOT_SP);
+    emitRR(e, 0x8B, true, RDI, HOST_VM);
+    emitOpcode(e, true, 0, 0, RAX, 0xB8);
+    emit64(e, (uint64_t)(uintptr_t)function);
+    emitRR(e, 0xFF, false, 2, RAX);
+    emitRM(e, 0x8B, false, HOST_SP, RSP, -1, SLOT_SP);
+}
+
+/* Cycles and memory */
+
+static void emitSync(Emitter* e) {
+    /* cyclesSync_4(), the block has to stop after this instruction if any events ran */
+    emitRM(e, 0x83, true, 0, HOST_VM, -1, VM_OFFSET(clock));
+    emit8(e, 4);
+    emitRM(e, 0x8B, true, RAX, HOST_VM, -1, VM_OFFSET(clock));
+    emitRM(e, 0x3B, true, RAX, HOST_VM, -1, VM_OFFSET(scheduler.nextDeadline));
+    size_t notDue = emitJumpForward(e, CONDITION_B);
+
+    emitCall(e, runEvents);
+    emitRM(e, 0xC6, false, 0, HOST_VM, -1, VM_OFFSET(jit.stop));
+    emit8(e, 1);
+    patchJump(e, notDue);
+}
+
+static void emitPageLookup(Emitter* e, int32_t pageOffset) {
+    /* Loads the read or write pointer of the memory page of the address in ESI into RAX */
+    emitMov(e, RAX, RSI);
+    emitShift(e, SHIFT_SHR, RAX, 8);
+    emitRR(e, 0x69, false, RAX, RAX);
+    emit32(e, sizeof(MEMORY_PAGE));
+    emitRM(e, 0x8B, true, RAX, HOST_VM, RAX, pageOffset);
+    emitRR(e, 0x85, true, RAX, RAX);
+}
+
+static void emitRead(Emitter* e) {
+    /* readAddr(), the address is in ESI and the byte is read into EAX */
+    emitPageLookup(e, PAGE_OFFSET(read));
+    size_t handled = emitJumpForward(e, CONDITION_Z);
+
+    emitMov(e, RCX, RSI);
+    emitAluImm(e, ALU_AND, RCX, 0xFF);
+    emitRM(e, 0x0FB6, false, RAX, RAX, RCX, 0);
+    size_t done = emitJumpForward(e, -1);
+
+    patchJump(e, handled);
+    emitCall(e, readAddrCompiled);
+    emitMovzx8(e, RAX, RAX);
+    patchJump(e, done);
+}
+
+static void emitWrite(Emitter* e) {
+    /* writeAddr(), the address is in ESI and the byte in DL */
+    if (e->savePages) {
+        emitRM(e, 0x89, false, RSI, RSP, -1, SLOT_WRITE);
+        emitRM(e, 0x89, false, RDX, RSP, -1, SLOT_WRITE + 4);
+        emitCall(e, saveWrittenPage);
+        emitRM(e, 0x8B, false, RSI, RSP, -1, SLOT_WRITE);
+        emitRM(e, 0x8B, false, RDX, RSP, -1, SLOT_WRITE + 4);
+    }
+
+    emitPageLookup(e, PAGE_OFFSET(write));
+    size_t handled = emitJumpForward(e, CONDITION_Z);
+
+    emitMov(e, RCX, RSI);
+    emitAluImm(e, ALU_AND, RCX, 0xFF);
+    emitRM(e, 0x88, false, RDX, RAX, RCX, 0);
+    size_t done = emitJumpForward(e, -1);
+
+    patchJump(e, handled);
+    emitCall(e, writeAddrCompiled);
+    patchJump(e, done);
+}
+
+static void emitReadAt(Emitter* e, uint16_t address) {
+    emitMovImm(e, RSI, address);
+    emitRead(e);
+}
+
+static void emitWriteAt(Emitter* e, uint16_t address, int value) {
+    emitMov(e, RDX, value);
+    emitMovImm(e, RSI, address);
+    emitWrite(e);
+}
+
+static void emitSaveTemp(Emitter* e, int reg) {
+    emitRM(e, 0x89, false, reg, RSP, -1, SLOT_TEMP);
+}
+
+static void emitLoadTemp(Emitter* e, int reg) {
+    emitRM(e, 0x8B, false, reg, RSP, -1, SLOT_TEMP);
+}
+
+/* SM83 registers */
+
+static int pairRegister(GP_REG pair) {
+    switch (pair) {
+        case R16_BC: return HOST_BC;
+        case R16_DE: return HOST_DE;
+        case R16_HL: return HOST_HL;
+        default: return HOST_SP;
+    }
+}
+
+/* Registers in the order they are encoded in opcodes, (HL) is handled separately */
+static const GP_REG operandRegisters[8] = { R8_B, R8_C, R8_D, R8_E, R8_H, R8_L, R8_F, R8_A };
+/* Register pairs in the order they are encoded in opcodes */
+static const GP_REG operandPairs[4] = { R16_BC, R16_DE, R16_HL, R16_SP };
+
+static void emitGetR8(Emitter* e, int dst, GP_REG reg) {
+    if (reg == R8_A) {
+        emitMov(e, dst, HOST_A);
+        return;
+    }
+
+    emitMov(e, dst, pairRegister(reg & ~1));
+    if ((reg & 1) == 0) emitShift(e, SHIFT_SHR, dst, 8);
+    else emitAluImm(e, ALU_AND, dst, 0xFF);
+}
+
+static void emitSetR8(Emitter* e, GP_REG reg, int src) {
+    /* Only the low byte of src is used, src is clobbered */
+    if (reg == R8_A) {
+        emitMovzx8(e, HOST_A, src);
+        return;
+    }
+
+    int pair = pairRegister(reg & ~1);
+
+    emitMovzx8(e, src, src);
+    if ((reg & 1) == 0) {
+        emitShift(e, SHIFT_SHL, src, 8);
+        emitAluImm(e, ALU_AND, pair, 0xFF);
+    } else {
+        emitAluImm(e, ALU_AND, pair, 0xFF00);
+    }
+    emitAlu(e, ALU_OR, pair, src);
+}
+
+static void emitAddPair(Emitter* e, int pair, int32_t value) {
+    emitAluImm(e, ALU_ADD, pair, (uint32_t)value);
+    emitAluImm(e, ALU_AND, pair, 0xFFFF);
+}
+
+static void emitFlagsFromHost(Emitter* e, int dst) {
+    /* Z, H and C of the last x86 addition or subtraction into dst */
+    emitLahf(e);
+    emitMovzx8(e, RDX, HOST_AH);
+    emitRM(e, 0x0FB6, false, dst, HOST_VM, RDX, VM_OFFSET(jit.flagTable));
+}
+
+static void emitArithmetic(Emitter* e, int op) {
+    /* ADD ADC SUB SBC AND XOR OR CP with A, the operand is in CL */
+    static const HOST_ALU hostOps[8] = { ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBB,
+                                         ALU_AND, ALU_XOR, ALU_OR, ALU_CMP };
+
+    if (op >= 4 && op <= 6) {
+        /* Only Z depends on the result, H is set by AND */
+        emitAlu(e, ALU_XOR, HOST_F, HOST_F);
+        emitAlu(e, hostOps[op], HOST_A, RCX);
+        emitSetZ(e, HOST_F);
+        emitShift(e, SHIFT_SHL, HOST_F, 7);
+        if (op == 4) emitAluImm(e, ALU_OR, HOST_F, 0x20);
+        return;
+    }
+
+    emitMov(e, RAX, HOST_A);
+    /* ADC and SBC take the carry into the host's */
+    if (op == 1 || op == 3) {
+        emitRR(e, 0x0FBA, false, 4, HOST_F);
+        emit8(e, 4);
+    }
+    emitAlu8(e, hostOps[op], RAX, RCX);
+    emitFlagsFromHost(e, HOST_F);
+    if (op != 7) emitMovzx8(e, HOST_A, RAX);
+    if (op >= 2) emitAluImm(e, ALU_OR, HOST_F, 0x40);
+}
+
+static void emitIncDec(Emitter* e, bool decrement) {
+    /* INC / DEC of AL, C is left unchanged */
+    emitRR(e, 0xFE, false, decrement, RAX);
+    emitFlagsFromHost(e, RCX);
+    emitAluImm(e, ALU_AND, RCX, 0xA0);
+    emitAluImm(e, ALU_AND, HOST_F, 0x10);
+    emitAlu(e, ALU_OR, HOST_F, RCX);
+    if (decrement) emitAluImm(e, ALU_OR, HOST_F, 0x40);
+}
+
+static void emitShiftOp(Emitter* e, int op) {
+    /* RLC RRC RL RR SLA SRA SWAP SRL of EAX, the bit shifted out is left in EDX */
+    switch (op) {
+        case 6:
+            emitShift8(e, SHIFT_ROL, RAX, 4);
+            emitAlu(e, ALU_XOR, RDX, RDX);
+            return;
+        case 0: case 2: case 4:
+            emitMov(e, RDX, RAX);
+            emitShift(e, SHIFT_SHR, RDX, 7);
+            break;
+        default:
+            emitMov(e, RDX, RAX);
+            emitAluImm(e, ALU_AND, RDX, 1);
+            break;
+    }
+
+    switch (op) {
+        case 0: emitShift8(e, SHIFT_ROL, RAX, 1); break;
+        case 1: emitShift8(e, SHIFT_ROR, RAX, 1); break;
+        case 2:
+            emitMov(e, RCX, HOST_F);
+            emitShift(e, SHIFT_SHR, RCX, 4);
+            emitAluImm(e, ALU_AND, RCX, 1);
+            emitAlu(e, ALU_ADD, RAX, RAX);
+            emitAlu(e, ALU_OR, RAX, RCX);
+            emitAluImm(e, ALU_AND, RAX, 0xFF);
+            break;
+        case 3:
+            emitMov(e, RCX, HOST_F);
+            emitAluImm(e, ALU_AND, RCX, 0x10);
+            emitShift(e, SHIFT_SHL, RCX, 3);
+            emitShift(e, SHIFT_SHR, RAX, 1);
+            emitAlu(e, ALU_OR, RAX, RCX);
+            break;
+        case 4:
+            emitAlu(e, ALU_ADD, RAX, RAX);
+            emitAluImm(e, ALU_AND, RAX, 0xFF);
+            break;
+        case 5:
+            emitMov(e, RCX, RAX);
+            emitAluImm(e, ALU_AND, RCX, 0x80);
+            emitShift(e, SHIFT_SHR, RAX, 1);
+            emitAlu(e, ALU_OR, RAX, RCX);
+            break;
+        case 7: emitShift(e, SHIFT_SHR, RAX, 1); break;
+    }
+}
+
+static void emitPrefixed(Emitter* e, uint8_t opcode) {
+    /* CB prefixed operation on EAX, BIT leaves it unchanged */
+    int bit = (opcode >> 3) & 7;
+
+    switch (opcode >> 6) {
+        case 0:
+            emitShiftOp(e, opcode >> 3);
+            emitAlu(e, ALU_XOR, HOST_F, HOST_F);
+            emitRR(e, 0x85, false, RAX, RAX);
+            emitSetZ(e, HOST_F);
+            emitShift(e, SHIFT_SHL, HOST_F, 7);
+            emitShift(e, SHIFT_SHL, RDX, 4);
+            emitAlu(e, ALU_OR, HOST_F, RDX);
+            break;
+        case 1:
+            /* Z is set if the bit is 0, H = 1 and C is left unchanged */
+            emitAluImm(e, ALU_AND, HOST_F, 0x10);
+            emitAluImm(e, ALU_OR, HOST_F, 0x20);
+            emitMov(e, RCX, RAX);
+            if (bit != 0) emitShift(e, SHIFT_SHR, RCX, bit);
+            emitAluImm(e, ALU_AND, RCX, 1);
+            emitAluImm(e, ALU_XOR, RCX, 1);
+            emitShift(e, SHIFT_SHL, RCX, 7);
+            emitAlu(e, ALU_OR, HOST_F, RCX);
+            break;
+        case 2: emitAluImm(e, ALU_AND, RAX, ~(1 << bit) & 0xFF); break;
+        case 3: emitAluImm(e, ALU_OR, RAX, 1 << bit); break;
+    }
+}
+
+static void emitPushSaved(Emitter* e) {
+    /* Writes the high byte in EDI and the low byte in the temp slot below SP and moves 
+     * it down */
+    emitMov(e, RSI, HOST_SP);
+    emitAddPair(e, RSI, -1);
+    emitMov(e, RDX, RDI);
+    emitWrite(e);
+    emitSync(e);
+
+    emitMov(e, RSI, HOST_SP);
+    emitAddPair(e, RSI, -2);
+    emitLoadTemp(e, RDX);
+    emitWrite(e);
+    emitSync(e);
+
+    emitAddPair(e, HOST_SP, -2);
+}
+
+static void emitPushImm(Emitter* e, uint16_t value) {
+    emitMovImm(e, RDI, value >> 8);
+    emitMovImm(e, RAX, value & 0xFF);
+    emitSaveTemp(e, RAX);
+    emitPushSaved(e);
+}
+
+static void emitPop(Emitter* e) {
+    /* Reads 2 bytes from SP and moves it up, the value is left in EAX */
+    emitMov(e, RSI, HOST_SP);
+    emitRead(e);
+    emitSaveTemp(e, RAX);
+    emitSync(e);
+
+    emitMov(e, RSI, HOST_SP);
+    emitAddPair(e, RSI, 1);
+    emitRead(e);
+    emitShift(e, SHIFT_SHL, RAX, 8);
+    emitLoadTemp(e, RCX);
+    emitAlu(e, ALU_OR, RAX, RCX);
+    emitSaveTemp(e, RAX);
+    emitSync(e);
+
+    emitAddPair(e, HOST_SP, 2);
+    emitLoadTemp(e, RAX);
+}
+
+static void emitSplitPair(Emitter* e, int pair) {
+    /* High byte into EDI and low byte into the temp slot, for pushing a pair */
+    emitMov(e, RDI, pair);
+    emitAluImm(e, ALU_AND, RDI, 0xFF);
+    emitSaveTemp(e, RDI);
+    emitMov(e, RDI, pair);
+    emitShift(e, SHIFT_SHR, RDI, 8);
+}
+
+/* Exits */
+
+static void emitExit(Emitter* e, int pcRegister, uint16_t pc, unsigned int executed, int32_t jumpEnd) {
+    /* Leaves the block with the PC in a register, or the constant if it is -1 */
+    if (pcRegister < 0) emitMovImm(e, RAX, pc);
+    else if (pcRegister != RAX) emitMov(e, RAX, pcRegister);
+    emitMovImm(e, RCX, executed);
+    emitMovImm(e, RDX, (uint32_t)jumpEnd);
+
+    emit8(e, 0xE9);
+    emit32(e, (uint32_t)(int32_t)(e->epilogue - (e->size + 4)));
+}
+
+static void emitEpilogue(Emitter* e) {
+    /* Stores everything back into the VM and returns, the PC is in AX, the number of
+     * instructions run in ECX and the jump end in EDX */
+    static const int pairs[4] = { HOST_BC, HOST_DE, HOST_HL, HOST_SP };
+
+    e->epilogue = e->size;
+
+    emit8(e, 0x66);
+    emitRM(e, 0x89, false, RAX, HOST_VM, -1, VM_OFFSET(PC));
+    emitRM(e, 0x89, false, RCX, HOST_VM, -1, VM_OFFSET(jit.executed));
+    emitRM(e, 0x89, false, RDX, HOST_VM, -1, VM_OFFSET(jit.jumpEnd));
+    emitRM(e, 0x01, true, RCX, HOST_VM, -1, VM_OFFSET(instructionCount));
+    emitRM(e, 0x88, false, HOST_A, HOST_VM, -1, GPR_OFFSET(R8_A));
+    emitRM(e, 0x88, false, HOST_F, HOST_VM, -1, GPR_OFFSET(R8_F));
+
+    /* The pairs are stored high byte first */
+    for (int i = 0; i < 4; i++) {
+        emitMov(e, RAX, pairs[i]);
+        emit8(e, 0x66);
+        emitShift(e, SHIFT_ROL, RAX, 8);
+        emit8(e, 0x66);
+        emitRM(e, 0x89, false, RAX, HOST_VM, -1, GPR_OFFSET(R8_B + i * 2));
+    }
+
+    emitRR(e, 0x83, true, 0, RSP);
+    emit8(e, FRAME_SIZE);
+    emitOpcode(e, false, 0, 0, R15, 0x58 + (R15 & 7));
+    emitOpcode(e, false, 0, 0, R14, 0x58 + (R14 & 7));
+    emitOpcode(e, false, 0, 0, R13, 0x58 + (R13 & 7));
+    emitOpcode(e, false, 0, 0, R12, 0x58 + (R12 & 7));
+    emit8(e, 0x58 + RBP);
+    emit8(e, 0x58 + RBX);
+    emit8(e, 0xC3);
+}
+
+static void emitPrologue(Emitter* e) {
+    static const int pairs[4] = { HOST_BC, HOST_DE, HOST_HL, HOST_SP };
+
+    emit8(e, 0x50 + RBX);
+    emit8(e, 0x50 + RBP);
+    emitOpcode(e, false, 0, 0, R12, 0x50 + (R12 & 7));
+    emitOpcode(e, false, 0, 0, R13, 0x50 + (R13 & 7));
+    emitOpcode(e, false, 0, 0, R14, 0x50 + (R14 & 7));
+    emitOpcode(e, false, 0, 0, R15, 0x50 + (R15 & 7));
+    emitRR(e, 0x83, true, 5, RSP);
+    emit8(e, FRAME_SIZE);
+
+    emitRR(e, 0x8B, true, HOST_VM, RDI);
+    emitRM(e, 0xC6, false, 0, HOST_VM, -1, VM_OFFSET(jit.stop));
+    emit8(e, 0);
+    emitRM(e, 0x0FB6, false, HOST_A, HOST_VM, -1, GPR_OFFSET(R8_A));
+    emitRM(e, 0x0FB6, false, HOST_F, HOST_VM, -1, GPR_OFFSET(R8_F));
+
+    for (int i = 0; i < 4; i++) {
+        emitRM(e, 0x0FB7, false, pairs[i], HOST_VM, -1, GPR_OFFSET(R8_B + i * 2));
+        emit8(e, 0x66);
+        emitShift(e, SHIFT_ROL, pairs[i], 8);
+    }
+}
+
+/* Instructions */
+
+static bool isCompiled(uint8_t opcode) {
+    switch (opcode) {
+        case 0x27:                                  /* DAA */
+        case 0x10:                                  /* STOP */
+        case 0x76:                                  /* HALT */
+        case 0xD9:                                  /* RETI */
+        case 0xFB:                                  /* EI */
+            return false;
+#ifdef DEBUG_LDBB_BREAKPOINT
+        case 0x40: return false;
+#endif
+        default: return true;
+    }
+}
+
+static size_t emitCondition(Emitter* e, uint8_t opcode) {
+    /* Tests the condition of a conditional jump, call or return and returns a jump
+     * for when it isnt met, to be patched */
+    static const uint8_t flags[4] = { 0x80, 0x80, 0x10, 0x10 };
+    int condition = (opcode >> 3) & 3;
+
+    emitTestImm(e, HOST_F, flags[condition]);
+    /* NZ and NC skip when the flag is set, Z and C when it isnt */
+    return emitJumpForward(e, (condition & 1) ? CONDITION_Z : CONDITION_NZ);
+}
+
+static bool compileInstruction(Emitter* e, const DecodedInstruction* instruction, unsigned int index) {
+    /* Compiles the instruction, returns true if the block always exits at its end */
+    uint8_t opcode = instruction->bytes[0];
+    uint8_t d8 = instruction->bytes[1];
+    uint16_t d16 = instruction->bytes[1] | (instruction->bytes[2] << 8);
+    uint16_t next = instruction->address + instruction->length;
+    unsigned int executed = index + 1;
+
+    /* The fetch */
+    emitSync(e);
+
+    if (opcode >= 0x40 && opcode < 0x80) {
+        /* LD r, r' / LD r, (HL) / LD (HL), r */
+        int dst = (opcode >> 3) & 7;
+        int src = opcode & 7;
+
+        if (src == 6) {
+            emitMov(e, RSI, HOST_HL);
+            emitRead(e);
+            emitSetR8(e, operandRegisters[dst], RAX);
+            emitSync(e);
+        } else if (dst == 6) {
+            emitGetR8(e, RDX, operandRegisters[src]);
+            emitMov(e, RSI, HOST_HL);
+            emitWrite(e);
+            emitSync(e);
+        } else if (dst != src) {
+            emitGetR8(e, RAX, operandRegisters[src]);
+            emitSetR8(e, operandRegisters[dst], RAX);
+        }
+        return false;
+    }
+
+    if (opcode >= 0x80 && opcode < 0xC0) {
+        /* ALU with a register or (HL) */
+        int src = opcode & 7;
+
+        if (src == 6) {
+            emitMov(e, RSI, HOST_HL);
+            emitRead(e);
+            emitMov(e, RCX, RAX);
+            emitArithmetic(e, (opcode >> 3) & 7);
+            emitSync(e);
+        } else {
+            emitGetR8(e, RCX, operandRegisters[src]);
+            emitArithmetic(e, (opcode >> 3) & 7);
+        }
+        return false;
+    }
+
+    if (opcode < 0x40 && (opcode & 7) >= 4 && (opcode & 7) <= 6) {
+        /* INC r / DEC r / LD r, d8 and their (HL) versions */
+        int dst = (opcode >> 3) & 7;
+        bool isLoad = (opcode & 7) == 6;
+
+        if (dst != 6) {
+            if (isLoad) {
+                emitMovImm(e, RAX, d8);
+                emitSetR8(e, operandRegisters[dst], RAX);
+                emitSync(e);
+            } else {
+                emitGetR8(e, RAX, operandRegisters[dst]);
+                emitIncDec(e, opcode & 1);
+                emitSetR8(e, operandRegisters[dst], RAX);
+            }
+        } else if (isLoad) {
+            emitSync(e);
+            emitMovImm(e, RDX, d8);
+            emitMov(e, RSI, HOST_HL);
+            emitWrite(e);
+            emitSync(e);
+        } else {
+            emitMov(e, RSI, HOST_HL);
+            emitRead(e);
+            emitIncDec(e, opcode & 1);
+            emitSaveTemp(e, RAX);
+            emitSync(e);
+            emitLoadTemp(e, RDX);
+            emitMov(e, RSI, HOST_HL);
+            emitWrite(e);
+            emitSync(e);
+        }
+        return false;
+    }
+
+    if (opcode < 0x40 && (opcode & 0xF) == 0x01) {
+        /* LD rr, d16 */
+        emitMovImm(e, pairRegister(operandPairs[opcode >> 4]), d16);
+        emitSync(e);
+        emitSync(e);
+        return false;
+    }
+
+    if (opcode < 0x40 && ((opcode & 0xF) == 0x03 || (opcode & 0xF) == 0x0B)) {
+        /* INC rr / DEC rr */
+        emitAddPair(e, pairRegister(operandPairs[opcode >> 4]), (opcode & 8) ? -1 : 1);
+        emitSync(e);
+        return false;
+    }
+
+    if (opcode < 0x40 && (opcode & 0xF) == 0x09) {
+        /* ADD HL, rr, Z is left unchanged, H and C come from bits 11 and 15 */
+        int src = pairRegister(operandPairs[opcode >> 4]);
+
+        emitMov(e, RAX, HOST_HL);
+        emitAluImm(e, ALU_AND, RAX, 0xFFF);
+        emitMov(e, RCX, src);
+        emitAluImm(e, ALU_AND, RCX, 0xFFF);
+        emitAlu(e, ALU_ADD, RAX, RCX);
+        emitAluImm(e, ALU_AND, RAX, 0x1000);
+        emitShift(e, SHIFT_SHR, RAX, 7);
+
+        emitMov(e, RCX, HOST_HL);
+        emitAlu(e, ALU_ADD, RCX, src);
+        emitMov(e, RDX, RCX);
+        emitShift(e, SHIFT_SHR, RDX, 12);
+        emitAluImm(e, ALU_AND, RDX, 0x10);
+        emitAluImm(e, ALU_AND, RCX, 0xFFFF);
+        emitMov(e, HOST_HL, RCX);
+
+        emitAluImm(e, ALU_AND, HOST_F, 0x80);
+        emitAlu(e, ALU_OR, HOST_F, RAX);
+        emitAlu(e, ALU_OR, HOST_F, RDX);
+        emitSync(e);
+        return false;
+    }
+
+    if (opcode < 0x40 && ((opcode & 0xF) == 0x02 || (opcode & 0xF) == 0x0A)) {
+        /* LD (BC), A / LD (DE), A / LD (HL+), A / LD (HL-), A and the loads into A */
+        int pair = pairRegister(opcode < 0x20 ? operandPairs[opcode >> 4] : R16_HL);
+
+        emitMov(e, RSI, pair);
+        if (opcode & 8) {
+            emitRead(e);
+            emitSetR8(e, R8_A, RAX);
+        } else {
+            emitMov(e, RDX, HOST_A);
+            emitWrite(e);
+        }
+        if (opcode >= 0x20) emitAddPair(e, HOST_HL, opcode < 0x30 ? 1 : -1);
+        emitSync(e);
+        return false;
+    }
+
+    if (opcode >= 0xC0 && (opcode & 0xF) == 0x05) {
+        /* PUSH rr */
+        emitSync(e);
+        if (opcode == 0xF5) {
+            emitMov(e, RDI, HOST_F);
+            emitSaveTemp(e, RDI);
+            emitMov(e, RDI, HOST_A);
+        } else {
+            emitSplitPair(e, pairRegister(operandPairs[(opcode >> 4) & 3]));
+        }
+        emitPushSaved(e);
+        return false;
+    }
+
+    if (opcode >= 0xC0 && (opcode & 0xF) == 0x01) {
+        /* POP rr */
+        emitPop(e);
+        if (opcode == 0xF1) {
+            emitMov(e, HOST_F, RAX);
+            emitAluImm(e, ALU_AND, HOST_F, 0xF0);
+            emitShift(e, SHIFT_SHR, RAX, 8);
+            emitMov(e, HOST_A, RAX);
+        } else {
+            emitMov(e, pairRegister(operandPairs[(opcode >> 4) & 3]), RAX);
+        }
+        return false;
+    }
+
+    if (opcode >= 0xC0 && (opcode & 7) == 7) {
+        /* RST */
+        emitSync(e);
+        emitPushImm(e, next);
+        emitExit(e, -1, opcode & 0x38, executed, -1);
+        return true;
+    }
+
+    switch (opcode) {
+        case 0x00:                                  /* NOP */
+        case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB:
+        case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+            return false;
+
+        case 0x07: case 0x0F: case 0x17: case 0x1F:
+            /* RLCA RRCA RLA RRA, like their CB versions but Z is always 0 */
+            emitMov(e, RAX, HOST_A);
+            emitShiftOp(e, opcode >> 3);
+            emitMov(e, HOST_A, RAX);
+            emitMov(e, HOST_F, RDX);
+            emitShift(e, SHIFT_SHL, HOST_F, 4);
+            return false;
+
+        case 0x08:                                  /* LD (a16), SP */
+            emitSync(e);
+            emitSync(e);
+            emitMov(e, RDX, HOST_SP);
+            emitShift(e, SHIFT_SHR, RDX, 8);
+            emitMovImm(e, RSI, (uint16_t)(d16 + 1));
+            emitWrite(e);
+            emitSync(e);
+            emitMov(e, RDX, HOST_SP);
+            emitMovImm(e, RSI, d16);
+            emitWrite(e);
+            emitSync(e);
+            return false;
+
+        case 0x18:                                  /* JR */
+            emitSync(e);
+            emitSync(e);
+            emitExit(e, -1, next + (int8_t)d8, executed, next);
+            return true;
+
+        case 0x20: case 0x28: case 0x30: case 0x38: {
+            emitSync(e);
+            size_t notTaken = emitCondition(e, opcode);
+            emitSync(e);
+            emitExit(e, -1, next + (int8_t)d8, executed, next);
+            patchJump(e, notTaken);
+            return false;
+        }
+
+        case 0x2F:                                  /* CPL */
+            emitAluImm(e, ALU_XOR, HOST_A, 0xFF);
+            emitAluImm(e, ALU_OR, HOST_F, 0x60);
+            return false;
+
+        case 0x37:                                  /* SCF */
+            emitAluImm(e, ALU_AND, HOST_F, 0x80);
+            emitAluImm(e, ALU_OR, HOST_F, 0x10);
+            return false;
+
+        case 0x3F:                                  /* CCF */
+            emitAluImm(e, ALU_AND, HOST_F, 0x90);
+            emitAluImm(e, ALU_XOR, HOST_F, 0x10);
+            return false;
+
+        case 0xC3:                                  /* JP */
+            emitSync(e);
+            emitSync(e);
+            emitSync(e);
+            emitExit(e, -1, d16, executed, next);
+            return true;
+
+        case 0xC2: case 0xCA: case 0xD2: case 0xDA: {
+            emitSync(e);
+            emitSync(e);
+            size_t notTaken = emitCondition(e, opcode);
+            emitSync(e);
+            emitExit(e, -1, d16, executed, next);
+            patchJump(e, notTaken);
+            return false;
+        }
+
+        case 0xE9:                                  /* JP HL */
+            emitExit(e, HOST_HL, 0, executed, -1);
+            return true;
+
+        case 0xCD:                                  /* CALL */
+            emitSync(e);
+            emitSync(e);
+            emitSync(e);
+            emitPushImm(e, next);
+            emitExit(e, -1, d16, executed, -1);
+            return true;
+
+        case 0xC4: case 0xCC: case 0xD4: case 0xDC: {
+            emitSync(e);
+            emitSync(e);
+            size_t notTaken = emitCondition(e, opcode);
+            emitSync(e);
+            emitPushImm(e, next);
+            emitExit(e, -1, d16, executed, -1);
+            patchJump(e, notTaken);
+            return false;
+        }
+
+        case 0xC9:                                  /* RET */
+            emitPop(e);
+            emitSaveTemp(e, RAX);
+            emitSync(e);
+            emitLoadTemp(e, RAX);
+            emitExit(e, RAX, 0, executed, -1);
+            return true;
+
+        case 0xC0: case 0xC8: case 0xD0: case 0xD8: {
+            emitSync(e);
+            size_t notTaken = emitCondition(e, opcode);
+            emitPop(e);
+            emitSaveTemp(e, RAX);
+            emitSync(e);
+            emitLoadTemp(e, RAX);
+            emitExit(e, RAX, 0, executed, -1);
+            patchJump(e, notTaken);
+            return false;
+        }
+
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+        case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+            /* ALU with d8 */
+            emitMovImm(e, RCX, d8);
+            emitArithmetic(e, (opcode >> 3) & 7);
+            emitSync(e);
+            return false;
+
+        case 0xCB: {
+            uint8_t prefixed = d8;
+            int src = prefixed & 7;
+
+            emitSync(e);
+            if (src != 6) {
+                emitGetR8(e, RAX, operandRegisters[src]);
+                emitPrefixed(e, prefixed);
+                if ((prefixed >> 6) != 1) emitSetR8(e, operandRegisters[src], RAX);
+                return false;
+            }
+
+            emitMov(e, RSI, HOST_HL);
+            emitRead(e);
+            emitPrefixed(e, prefixed);
+            emitSaveTemp(e, RAX);
+            emitSync(e);
+            if ((prefixed >> 6) != 1) {
+                emitLoadTemp(e, RDX);
+                emitMov(e, RSI, HOST_HL);
+                emitWrite(e);
+                emitSync(e);
+            }
+            return false;
+        }
+
+        case 0xE0:                                  /* LDH (a8), A */
+            emitSync(e);
+            emitWriteAt(e, 0xFF00 + d8, HOST_A);
+            emitSync(e);
+            return false;
+
+        case 0xF0:                                  /* LDH A, (a8) */
+            emitSync(e);
+            emitReadAt(e, 0xFF00 + d8);
+            emitSetR8(e, R8_A, RAX);
+            emitSync(e);
+            return false;
+
+        case 0xE2:                                  /* LD (C), A */
+            emitGetR8(e, RSI, R8_C);
+            emitAluImm(e, ALU_ADD, RSI, 0xFF00);
+            emitMov(e, RDX, HOST_A);
+            emitWrite(e);
+            emitSync(e);
+            return false;
+
+        case 0xF2:                                  /* LD A, (C) */
+            emitGetR8(e, RSI, R8_C);
+            emitAluImm(e, ALU_ADD, RSI, 0xFF00);
+            emitRead(e);
+            emitSetR8(e, R8_A, RAX);
+            emitSync(e);
+            return false;
+
+        case 0xEA:                                  /* LD (a16), A */
+            emitSync(e);
+            emitSync(e);
+            emitWriteAt(e, d16, HOST_A);
+            emitSync(e);
+            return false;
+
+        case 0xFA:                                  /* LD A, (a16) */
+            emitSync(e);
+            emitSync(e);
+            emitReadAt(e, d16);
+            emitSetR8(e, R8_A, RAX);
+            emitSync(e);
+            return false;
+
+        case 0xE8:                                  /* ADD SP, e8 */
+        case 0xF8: {                                /* LD HL, SP + e8 */
+            /* H and C come from an 8 bit addition on the low byte, Z and N are 0 */
+            int dst = opcode == 0xE8 ? HOST_SP : HOST_HL;
+
+            emitSync(e);
+            emitMov(e, RAX, HOST_SP);
+            emitMovImm(e, RCX, d8);
+            emitAlu8(e, ALU_ADD, RAX, RCX);
+            emitFlagsFromHost(e, HOST_F);
+            emitAluImm(e, ALU_AND, HOST_F, 0x30);
+            if (dst != HOST_SP) emitMov(e, dst, HOST_SP);
+            emitAddPair(e, dst, (int8_t)d8);
+            emitSync(e);
+            if (opcode == 0xE8) emitSync(e);
+            return false;
+        }
+
+        case 0xF3:                                  /* DI */
+            emitRM(e, 0xC6, false, 0, HOST_VM, -1, VM_OFFSET(IME));
+            emit8(e, 0);
+            return false;
+
+        case 0xF9:                                  /* LD SP, HL */
+            emitMov(e, HOST_SP, HOST_HL);
+            emitSync(e);
+            return false;
+    }
+
+    /* Every opcode that isCompiled() is handled above */
+    return false;
+}
+
+static bool mapArena(VM* vm) {
+    Jit* jit = &vm->jit;
+
+    jit->arena = (uint8_t*)mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->arena == MAP_FAILED) {
+        jit->arena = NULL;
+        return false;
+    }
+
+    jit->arenaUsed = 0;
+    return true;
+}
+
+static void flushArena(VM* vm) {
+    /* Throws away all the compiled code, it is compiled again once it is run enough */
+    Block* blocks = vm->blockCache.blocks;
+
+    for (int i = 0; i < BLOCK_CACHE_SIZE; i++) {
+        if (blocks[i].memory == NULL) continue;
+
+        blocks[i].code = NULL;
+        blocks[i].runs = 0;
+    }
+
+    vm->jit.arenaUsed = 0;
+    vm->jit.flushes++;
+}
+
+bool compileBlock(VM* vm, Block* block) {
+    Jit* jit = &vm->jit;
+
+    if (!isCompiled(block->instructions[0].bytes[0])) {
+        block->uncompilable = true;
+        return false;
+    }
+
+    if (jit->arena == NULL && !mapArena(vm)) {
+        log_warning(vm, "Could not map memory for the JIT, using the interpreter");
+        jit->mode = JIT_OFF;
+        return false;
+    }
+
+    if (jit->arenaUsed + JIT_MAX_BLOCK_SIZE > JIT_ARENA_SIZE) flushArena(vm);
+
+    /* The arena is only writable while compiling, a block never takes more than
+     * JIT_MAX_BLOCK_SIZE so only those pages have to be opened up */
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)(jit->arena + jit->arenaUsed) & ~(uintptr_t)(pageSize - 1);
+    uintptr_t end = (uintptr_t)(jit->arena + jit->arenaUsed + JIT_MAX_BLOCK_SIZE);
+    end = (end + pageSize - 1) & ~(uintptr_t)(pageSize - 1);
+    if (end > (uintptr_t)(jit->arena + JIT_ARENA_SIZE)) end = (uintptr_t)(jit->arena + JIT_ARENA_SIZE);
+
+    if (mprotect((void*)start, end - start, PROT_READ | PROT_WRITE) != 0) {
+        log_warning(vm, "Could not write to the JIT arena, using the interpreter");
+        jit->mode = JIT_OFF;
+        return false;
+    }
+
+    Emitter emitter = { jit->arena + jit->arenaUsed, 0, false, 0, jit->mode == JIT_VERIFY };
+    Emitter* e = &emitter;
+    unsigned int index = 0;
+    bool exited = false;
+
+    emitEpilogue(e);
+    size_t entry = e->size;
+    emitPrologue(e);
+
+    for (; index < block->count && !exited; index++) {
+        const DecodedInstruction* instruction = &block->instructions[index];
+
+        if (!isCompiled(instruction->bytes[0])) break;
+
+        if (index > 0) {
+            /* Stop here if something happened during the last instruction that needs
+             * the interpreter to handle interrupts */
+            emitRM(e, 0x80, false, 7, HOST_VM, -1, VM_OFFSET(jit.stop));
+            emit8(e, 0);
+            size_t carryOn = emitJumpForward(e, CONDITION_Z);
+            emitExit(e, -1, instruction->address, index, -1);
+            patchJump(e, carryOn);
+        }
+
+        exited = compileInstruction(e, instruction, index);
+    }
+
+    if (!exited) {
+        /* Fell through to the instruction after the last compiled one */
+        const DecodedInstruction* last = &block->instructions[index - 1];
+        emitExit(e, -1, last->address + last->length, index, -1);
+    }
+
+    mprotect((void*)start, end - start, PROT_READ | PROT_EXEC);
+
+    if (e->overflow) {
+        block->uncompilable = true;
+        return false;
+    }
+
+    block->code = jit->arena + jit->arenaUsed + entry;
+    jit->arenaUsed += (e->size + 15) & ~(size_t)15;
+    jit->compiledBlocks++;
+    return true;
+}
+
+void runBlockCode(VM* vm, Block* block) {
+    ((CompiledCode)block->code)(vm);
+}
+
+void setJitMode(VM* vm, JIT_MODE mode) {
+    /* Blocks compiled for JIT_VERIFY save the pages they write and the others dont,
+     * so everything is compiled again when going in or out of it */
+    if ((mode == JIT_VERIFY) != (vm->jit.mode == JIT_VERIFY)) flushArena(vm);
+
+    vm->jit.mode = mode;
+}
+
+#else
+
+bool compileBlock(VM* vm, struct Block* block) {
+    return false;
+}
+
+void runBlockCode(VM* vm, struct Block* block) {}
+
+void setJitMode(VM* vm, JIT_MODE mode) {}
+
+#endif
+
+/* JIT_VERIFY */
+
+JitSnapshot* allocateJitSnapshot(VM* vm) {
+    JitSnapshot* snapshot = (JitSnapshot*)calloc(1, sizeof(JitSnapshot));
+    if (snapshot == NULL) log_fatal(vm, "Allocation Failed");
+
+    snapshot->vm = (VM*)malloc(sizeof(VM));
+    if (snapshot->vm == NULL) log_fatal(vm, "Allocation Failed");
+    return snapshot;
+}
+
+static void copyState(VM* to, const VM* from) {
+    /* Everything but the memory, the framebuffer and the decoded tiles, which are
+     * most of the VM. Memory is saved a page at a time when it is written, the other
+     * two are drawn and decoded again when the block runs a second time */
+#define COPY_RANGE(start, end) \
+    memcpy((uint8_t*)to + (start), (const uint8_t*)from + (start), (end) - (start))
+
+    COPY_RANGE(0, offsetof(VM, MEM));
+    COPY_RANGE(offsetof(VM, MEM) + sizeof(from->MEM), offsetof(VM, framebuffer));
+    COPY_RANGE(offsetof(VM, framebuffer) + sizeof(from->framebuffer), offsetof(VM, decodedTiles));
+    COPY_RANGE(offsetof(VM, decodedTiles) + sizeof(from->decodedTiles), sizeof(VM));
+#undef COPY_RANGE
+}
+
+static void savePage(VM* vm, JitSnapshot* snapshot, uint8_t* memory, uint16_t addr) {
+    /* A block only writes a few pages, so they are just searched */
+    for (size_t i = 0; i < snapshot->pageCount; i++) {
+        if (snapshot->pages[i].memory == memory) return;
+    }
+
+    if (snapshot->pageCount == snapshot->pageCapacity) {
+        snapshot->pageCapacity = snapshot->pageCapacity == 0 ? 16 : snapshot->pageCapacity * 2;
+        snapshot->pages = (JitPage*)realloc(snapshot->pages, snapshot->pageCapacity * sizeof(JitPage));
+        if (snapshot->pages == NULL) log_fatal(vm, "Allocation Failed");
+    }
+
+    /* A page first written while the interpreter runs the block again wasnt written by
+     * the compiled block, so it is the same after it too */
+    JitPage* page = &snapshot->pages[snapshot->pageCount++];
+    page->memory = memory;
+    page->address = addr & 0xFF00;
+    memcpy(page->before, memory, MEMORY_PAGE_SIZE);
+    memcpy(page->after, memory, MEMORY_PAGE_SIZE);
+}
+
+void saveWrittenPage(VM* vm, uint16_t addr) {
+    /* Writes to ROM are MBC commands, and pages without memory ignore writes */
+    uint8_t* memory = vm->memoryPages[addr / MEMORY_PAGE_SIZE].memory;
+
+    if (!vm->jit.savePages || addr <= ROM_NN_16KB_END || memory == NULL) return;
+    savePage(vm, vm->jit.snapshot, memory, addr);
+}
+
+void saveJitSnapshot(VM* vm, JitSnapshot* snapshot) {
+    copyState(snapshot->vm, vm);
+    snapshot->pageCount = 0;
+
+    /* The hardware writes OAM and the IO registers without going through the pages,
+     * anything else it writes (HDMA) is saved by saveWrittenPage() */
+    savePage(vm, snapshot, &vm->MEM[OAM_N0_160B], OAM_N0_160B);
+    savePage(vm, snapshot, &vm->MEM[IO_REG], IO_REG);
+
+    if (vm->emuMode == EMU_CGB) {
+        memcpy(snapshot->colorRAM[0], vm->bgColorRAM, 64);
+        memcpy(snapshot->colorRAM[0] + 64, vm->spriteColorRAM, 64);
+    }
+
+    vm->jit.savePages = true;
+}
+
+static void invalidatePageTiles(VM* vm, JitPage* page) {
+    /* The PPU could have decoded tiles from what the compiled block wrote */
+    uint8_t* banks[2] = { &vm->MEM[VRAM_N0_8KB], vm->vramBank };
+
+    for (int bank = 0; bank < 2; bank++) {
+        if (banks[bank] == NULL || page->memory < banks[bank] ||
+                page->memory >= banks[bank] + VRAM_TILE_DATA_SIZE) {
+            continue;
+        }
+
+        for (int offset = 0; offset < MEMORY_PAGE_SIZE; offset += 16) {
+            invalidateTile(vm, bank, (page->memory - banks[bank]) + offset);
+        }
+    }
+}
+
+void loadJitSnapshot(VM* vm, JitSnapshot* snapshot) {
+    /* Keeps what the compiled block did */
+    memcpy(snapshot->GPR, vm->GPR, GP_COUNT);
+    snapshot->PC = vm->PC;
+    snapshot->clock = vm->clock;
+    snapshot->instructionCount = vm->instructionCount;
+    snapshot->IME = vm->IME;
+    snapshot->haltMode = vm->haltMode;
+
+    for (size_t i = 0; i < snapshot->pageCount; i++) {
+        memcpy(snapshot->pages[i].after, snapshot->pages[i].memory, MEMORY_PAGE_SIZE);
+    }
+
+    /* Then goes back to before it, the pages written from here on are saved too */
+    copyState(vm, snapshot->vm);
+
+    for (size_t i = 0; i < snapshot->pageCount; i++) {
+        memcpy(snapshot->pages[i].memory, snapshot->pages[i].before, MEMORY_PAGE_SIZE);
+        invalidatePageTiles(vm, &snapshot->pages[i]);
+    }
+
+    if (vm->emuMode == EMU_CGB) {
+        memcpy(snapshot->colorRAM[1], vm->bgColorRAM, 64);
+        memcpy(snapshot->colorRAM[1] + 64, vm->spriteColorRAM, 64);
+        memcpy(vm->bgColorRAM, snapshot->colorRAM[0], 64);
+        memcpy(vm->spriteColorRAM, snapshot->colorRAM[0] + 64, 64);
+    }
+
+    vm->jit.savePages = true;
+}
+
+static bool compareBytes(const uint8_t* a, const uint8_t* b, size_t size, const char* name,
+                         char* difference, size_t differenceSize) {
+    for (size_t i = 0; i < size; i++) {
+        if (a[i] != b[i]) {
+            snprintf(difference, differenceSize, "%s[0x%zx] is 0x%02x, the interpreter has 0x%02x",
+                     name, i, a[i], b[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool compareJitSnapshot(VM* vm, JitSnapshot* snapshot, char* difference, size_t size) {
+    /* The snapshot has what the compiled block did and the VM what the interpreter did */
+    static const char* registerNames[GP_COUNT] = { "A", "F", "B", "C", "D", "E", "H", "L", "SP high", "SP low" };
+    uint8_t interpreterF = getFlagsRegister(vm);
+
+    for (int i = 0; i < GP_COUNT; i++) {
+        uint8_t value = i == R8_F ? interpreterF : vm->GPR[i];
+
+        if (snapshot->GPR[i] != value) {
+            snprintf(difference, size, "%s is 0x%02x, the interpreter has 0x%02x", registerNames[i],
+                     snapshot->GPR[i], value);
+            return false;
+        }
+    }
+
+    if (snapshot->PC != vm->PC) {
+        snprintf(difference, size, "PC is 0x%04x, the interpreter has 0x%04x", snapshot->PC, vm->PC);
+        return false;
+    }
+    if (snapshot->clock != vm->clock) {
+        snprintf(difference, size, "clock is %lu, the interpreter has %lu", snapshot->clock, vm->clock);
+        return false;
+    }
+    if (snapshot->instructionCount != vm->instructionCount) {
+        snprintf(difference, size, "instruction count is %lu, the interpreter has %lu",
+                 snapshot->instructionCount, vm->instructionCount);
+        return false;
+    }
+    if (snapshot->IME != vm->IME || snapshot->haltMode != vm->haltMode) {
+        snprintf(difference, size, "IME/HALT are %d/%d, the interpreter has %d/%d",
+                 snapshot->IME, snapshot->haltMode, vm->IME, vm->haltMode);
+        return false;
+    }
+
+    /* Both of them wrote to the same pages if they agree, a page only one of them wrote
+     * is still different from what the other left there */
+    for (size_t i = 0; i < snapshot->pageCount; i++) {
+        JitPage* page = &snapshot->pages[i];
+
+        for (int offset = 0; offset < MEMORY_PAGE_SIZE; offset++) {
+            if (page->after[offset] != page->memory[offset]) {
+                snprintf(difference, size, "0x%04x is 0x%02x, the interpreter has 0x%02x",
+                         page->address + offset, page->after[offset], page->memory[offset]);
+                return false;
+            }
+        }
+    }
+
+    if (vm->emuMode == EMU_CGB) {
+        return compareBytes(snapshot->colorRAM[1], vm->bgColorRAM, 64, "BG color RAM", difference, size) &&
+               compareBytes(snapshot->colorRAM[1] + 64, vm->spriteColorRAM, 64, "OBJ color RAM", difference, size);
+    }
+
+    return true;
+}
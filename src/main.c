@@ -1,16 +1,244 @@
-#include "../include/vm.h"
-#include "../include/cartridge.h"
+#include "../include/megagbc.h"
+#include "../include/backend.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+/* The megagbc executable, a frontend to libmegagbc which runs a single ROM
+ * on the SDL backend, or without any window at all */
+
+/* A line of an input script, the buttons are held from the start of the frame
+ * until the next line */
+typedef struct {
+    unsigned long frame;
+    uint8_t buttons;
+} ScriptedInput;
+
+typedef struct {
+    ScriptedInput* inputs;
+    unsigned long count;
+    unsigned long next;                     /* The next one to be applied */
+} InputScript;
+
+/* What runFrames() needs, it runs on whichever thread the backend picks */
+typedef struct {
+    InputScript* script;
+    unsigned long frameLimit;               /* 0 for no limit */
+} FrameLoop;
+
+static void printUsage() {
+    printf("Usage : megagbc [options] <rom>\n");
+    printf("  --headless     Run without a window, input or frame pacing\n");
+    printf("  --frames N     Quit after N frames\n");
+    printf("  --speed N      Run N times faster than the real hardware, 0 for uncapped\n");
+    printf("  --bench N      Run N frames headless as fast as possible and print the\n");
+    printf("                 results as JSON\n");
+    printf("  --no-idle-skip Run idle loops instead of skipping through them\n");
+    printf("  --no-jit       Interpret everything, in builds with CPU_JIT\n");
+    printf("  --jit-verify   Check every compiled block against the interpreter, in\n");
+    printf("                 builds with CPU_JIT\n");
+    printf("  --input FILE   Press buttons from an input script, every line is a frame\n");
+    printf("                 number and the buttons held from then on, e.g. '120 a+start'\n");
+}
+
+static bool parseButton(const char* name, uint8_t* button) {
+    static const char* names[] = { "right", "left", "up", "down", "a", "b", "select", "start" };
+
+    for (int i = 0; i < 8; i++) {
+        if (strcasecmp(name, names[i]) == 0) {
+            *button = 1 << i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool loadInputScript(InputScript* script, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+
+    unsigned long capacity = 0;
+    unsigned long line = 0;
+    char buffer[256];
+
+    script->inputs = NULL;
+    script->count = 0;
+    script->next = 0;
+
+    while (fgets(buffer, sizeof(buffer), file)) {
+        line++;
+
+        /* Blank lines and comments */
+        char* start = buffer + strspn(buffer, " \t\r\n");
+        if (*start == '\0' || *start == '#') continue;
+
+        char* end;
+        unsigned long frame = strtoul(start, &end, 10);
+        uint8_t buttons = 0;
+
+        if (end == start || (script->count > 0 && frame < script->inputs[script->count - 1].frame)) {
+            printf("Error : %s:%lu, expected a frame number no lower than the last one\n", path, line);
+            fclose(file);
+            return false;
+        }
+
+        for (char* name = strtok(end, " \t\r\n+,"); name != NULL; name = strtok(NULL, " \t\r\n+,")) {
+            uint8_t button;
+
+            if (strcasecmp(name, "none") == 0) continue;
+            if (!parseButton(name, &button)) {
+                printf("Error : %s:%lu, unknown button %s\n", path, line, name);
+                fclose(file);
+                return false;
+            }
+            buttons |= button;
+        }
+
+        if (script->count == capacity) {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            script->inputs = (ScriptedInput*)realloc(script->inputs, capacity * sizeof(ScriptedInput));
+        }
+
+        script->inputs[script->count].frame = frame;
+        script->inputs[script->count].buttons = buttons;
+        script->count++;
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void applyInputScript(InputScript* script, GBC* gbc) {
+    unsigned long frame = gbc_frame_count(gbc);
+
+    while (script->next < script->count && script->inputs[script->next].frame <= frame) {
+        gbc_set_input(gbc, script->inputs[script->next].buttons);
+        script->next++;
+    }
+}
+
+static void runFrames(GBC* gbc, void* data) {
+    FrameLoop* frameLoop = (FrameLoop*)data;
+
+    /* The backend presents every frame and paces them, we only keep going until
+     * it asks to quit */
+    while (!gbc_should_quit(gbc)) {
+        if (frameLoop->frameLimit != 0 && gbc_frame_count(gbc) >= frameLoop->frameLimit) break;
+
+        applyInputScript(frameLoop->script, gbc);
+        gbc_run_frame(gbc);
+    }
+}
+
+static double getSeconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void printJSONString(const char* string) {
+    putchar('"');
+    for (; *string; string++) {
+        if (*string == '"' || *string == '\\') printf("\\%c", *string);
+        else if ((unsigned char)*string < 0x20) printf("\\u%04x", *string);
+        else putchar(*string);
+    }
+    putchar('"');
+}
+
+static void printBenchmark(const char* filePath, GBCStats* start, GBCStats* end, double seconds) {
+    unsigned long frames = end->frames - start->frames;
+    unsigned long instructions = end->instructions - start->instructions;
+    unsigned long cycles = end->cycles - start->cycles;
+    unsigned long idleCycles = end->idleCycles - start->idleCycles;
+
+    printf("{\"rom\": ");
+    printJSONString(filePath);
+    printf(", \"frames\": %lu, \"instructions\": %lu, \"cycles\": %lu, \"seconds\": %.6f, ",
+           frames, instructions, cycles, seconds);
+    printf("\"fps\": %.2f, \"realtime\": %.3f, \"instructionsPerSecond\": %.0f, \"mCyclesPerSecond\": %.0f, ",
+           frames / seconds, (double)cycles / GBC_CLOCK_RATE / seconds,
+           instructions / seconds, cycles / 4 / seconds);
+    printf("\"idleSkips\": %lu, \"idleCycles\": %lu, \"idleRealtime\": %.3f, ",
+           end->idleSkips - start->idleSkips, idleCycles, (double)idleCycles / GBC_CLOCK_RATE);
+    printf("\"compiledBlocks\": %lu, \"jitInstructions\": %lu, ",
+           end->compiledBlocks - start->compiledBlocks, end->jitInstructions - start->jitInstructions);
+
+    if (end->profiled) {
+        double ppu = end->ppuSeconds - start->ppuSeconds;
+        double bus = end->busSeconds - start->busSeconds;
+
+        printf("\"breakdown\": {\"cpuSeconds\": %.6f, \"ppuSeconds\": %.6f, \"busSeconds\": %.6f}}\n",
+               seconds - ppu - bus, ppu, bus);
+    } else {
+        /* Measuring it needs a build with DEBUG_PROFILE */
+        printf("\"breakdown\": null}\n");
+    }
+}
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
+    char* filePath = NULL;
+    char* inputPath = NULL;
+    const Backend* backend = &sdlBackend;
+    unsigned long frameLimit = 0;
+    unsigned int speed = 1;
+    bool bench = false;
+    bool idleSkip = true;
+    GBCJitMode jitMode = GBC_JIT_ON;
+    const char* jitOption = NULL;                   /* The option that set jitMode */
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            backend = &nullBackend;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameLimit = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench = true;
+            backend = &nullBackend;
+            frameLimit = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--no-idle-skip") == 0) {
+            idleSkip = false;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            jitMode = GBC_JIT_OFF;
+            jitOption = argv[i];
+        } else if (strcmp(argv[i], "--jit-verify") == 0) {
+            jitMode = GBC_JIT_VERIFY;
+            jitOption = argv[i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            inputPath = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            printf("Error : Unknown option %s\n", argv[i]);
+            printUsage();
+            exit(1);
+        } else {
+            filePath = argv[i];
+        }
+    }
+
+    if (filePath == NULL) {
         printf("Error : Please give an input file\n");
+        printUsage();
         exit(1);
     }
 
-    char* filePath = argv[1];
+    if (bench && frameLimit == 0) {
+        printf("Error : --bench needs atleast 1 frame\n");
+        exit(1);
+    }
+
+    InputScript script = { NULL, 0, 0 };
+
+    if (inputPath != NULL && !loadInputScript(&script, inputPath)) {
+        printf("Error : Couldn't load input script\n");
+        exit(2);
+    }
+
     FILE* file = fopen(filePath, "r");
     
     if (file == NULL) {
@@ -28,10 +256,39 @@ int main(int argc, char* argv[]) {
 	
     fclose(file);
     
-    Cartridge c;
-    bool result = initCartridge(&c, allocation, size);
+    GBC* gbc = gbc_create_with_backend(allocation, size, backend);
+    free(allocation);
     
-    if (!result) exit(3);
+    if (gbc == NULL) exit(3);
+
+    gbc_set_speed(gbc, speed);
+    gbc_set_idle_skip(gbc, idleSkip);
+
+    if (jitOption != NULL && !gbc_set_jit(gbc, jitMode)) {
+        printf("Error : %s needs a build with CPU_JIT\n", jitOption);
+        gbc_destroy(gbc);
+        exit(1);
+    }
+
+    GBCStats startStats;
+    gbc_get_stats(gbc, &startStats);
+    double startSeconds = getSeconds();
+
+    FrameLoop frameLoop = { .script = &script, .frameLimit = frameLimit };
+    if (!gbc_run_loop(gbc, runFrames, &frameLoop)) {
+        free(script.inputs);
+        gbc_destroy(gbc);
+        exit(1);
+    }
+
+    if (bench) {
+        double seconds = getSeconds() - startSeconds;
+        GBCStats endStats;
+        gbc_get_stats(gbc, &endStats);
+
+        printBenchmark(filePath, &startStats, &endStats, seconds);
+    }
 
-    startEmulator(&c);
+    free(script.inputs);
+    gbc_destroy(gbc);
 }
@@ -14,7 +14,7 @@ void switchROMBank(VM* vm, int bankNumber) {
     uint8_t* allocated = vm->cartridge->allocated;
     uint8_t* bank = &allocated[bankNumber * 0x4000];    /* Size of each bank is 16 KiB */
 
-    memcpy(&vm->MEM[ROM_NN_16KB], bank, 0x4000);             /* Write the contents of the bank */
+    mapMemory(vm, ROM_NN_16KB, ROM_NN_16KB_END, bank);      /* Point the bus to the bank */
 
 #ifdef DEBUG_LOGGING
     printf("MBC : Switched ROM Bank to 0x%x\n", bankNumber);
@@ -26,7 +26,31 @@ void switchROMBank(VM* vm, int bankNumber) {
  * cases */
 
 void switchRestrictedROMBank(VM* vm, int bankNumber) {
-    memcpy(&vm->MEM[ROM_N0_16KB], vm->cartridge->allocated, 0x4000);   
+    /* The bank comes from the secondary bank register, which can select banks past
+     * the end of smaller ROMs, those wrap around like on the cartridge */
+    int bankCount = 2 << vm->cartridge->romSize;
+    uint8_t* bank = &vm->cartridge->allocated[(bankNumber & (bankCount - 1)) * 0x4000];
+
+    mapMemory(vm, ROM_N0_16KB, ROM_N0_16KB_END, bank);
+}
+
+bool mbc_isSupported(Cartridge* cartridge) {
+    /* Has to agree with mbc_allocate(), which treats anything else as fatal */
+    switch (cartridge->cType) {
+        case CARTRIDGE_NONE:
+        case CARTRIDGE_MBC1:
+        case CARTRIDGE_MBC2:
+        case CARTRIDGE_MBC2_BATTERY: return true;
+        case CARTRIDGE_MBC1_RAM:
+        case CARTRIDGE_MBC1_RAM_BATTERY:
+            if (cartridge->extRamSize <= EXT_RAM_32KB) return true;
+
+            printf("Error : External banks not supported with MBC1\n");
+            return false;
+        default:
+            printf("Error : MBC/External Hardware Not Supported\n");
+            return false;
+    }
 }
 
 void mbc_allocate(VM* vm) {
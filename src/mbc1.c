@@ -2,10 +2,33 @@
 #include "../include/mbc.h"
 #include "../include/mbc1.h"
 
-static inline void mbc1_switchRAMBank(VM* vm, MBC_1* mbc, int bankNumber) {
-    /* Each bank is 8KB = 0x2000
-     * Checks arent done by this function */
-    memcpy(&vm->MEM[RAM_NN_8KB], &mbc->ramBanks[bankNumber], 0x2000);
+static void mbc1_mapRAM(VM* vm, MBC_1* mbc) {
+    /* Banks the selected RAM bank into the external RAM area, each bank is 8KB = 0x2000
+     *
+     * When there is no RAM or it is disabled, accesses go through 
+     * mbc1_writeExternalRAM/mbc1_readExternalRAM instead */
+    if (mbc->ramBanks == NULL || !mbc->ramEnabled) {
+        mapMemory(vm, RAM_NN_8KB, RAM_NN_8KB_END, NULL);
+        return;
+    }
+
+    /* In ROM mode, only bank 0 of ram can be used, and only 32KB of RAM is 
+     * big enough to be switchable */
+    uint8_t bankNumber = 0;
+    
+    if (mbc->bankMode == BANK_MODE_RAM && vm->cartridge->extRamSize == EXT_RAM_32KB) {
+        bankNumber = mbc->secondaryBankNumber;
+    }
+
+    mapMemory(vm, RAM_NN_8KB, RAM_NN_8KB_END, &mbc->ramBanks[bankNumber * 0x2000]);
+}
+
+static void mbc1_mapRestrictedROM(VM* vm, MBC_1* mbc) {
+    /* MBC1 Remaps the 0x0000-0x3fff area too in RAM banking mode for 1MB+ ROMs
+     * depending on the value of the the secondary banking register */
+    if (vm->cartridge->romSize >= ROM_1MB) {
+        switchRestrictedROMBank(vm, mbc->secondaryBankNumber * 0x20);
+    }
 }
 
 static void mbc1_switchROMBankingMode(VM* vm, MBC_1* mbc) {
@@ -13,13 +36,7 @@ static void mbc1_switchROMBankingMode(VM* vm, MBC_1* mbc) {
     
     /* RAM banking is disabled and bank 0 of RAM is locked to 
      * the external RAM address */
-    if (mbc->ramBanks != NULL) {
-        if (vm->cartridge->extRamSize >= EXT_RAM_8KB) {
-            /* Atleast 1 bank of external ram exists, 
-            * switch to the first one */
-            mbc1_switchRAMBank(vm, mbc, 0);
-        }
-    }
+    mbc1_mapRAM(vm, mbc);
 
     /* Reset the first rom bank to 0 */
     switchRestrictedROMBank(vm, 0);
@@ -28,22 +45,10 @@ static void mbc1_switchROMBankingMode(VM* vm, MBC_1* mbc) {
 static void mbc1_switchRAMBankingMode(VM* vm, MBC_1* mbc) {
     mbc->bankMode = BANK_MODE_RAM;
 
-    if (vm->cartridge->extRamSize == EXT_RAM_32KB) {
-        /* If this cartridge has external ram which is big enough to be switchable, 
-         * we can switch the bank to the one in the secondary bank cartridge only if the 
-         * ram is enabled for use */
-
-        if (mbc->ramEnabled) {
-            mbc1_switchRAMBank(vm, mbc, mbc->secondaryBankNumber);
-        }
-    }
-
-    /* MBC1 Remaps the 0x0000-0x3fff area too in this mode for 1MB+ ROMs
-     * depending on the value of the the secondary banking register */
-    
-    if (vm->cartridge->romSize >= ROM_1MB) {
-        switchRestrictedROMBank(vm, mbc->secondaryBankNumber * 0x20);
-    }
+    /* If this cartridge has external ram which is big enough to be switchable, 
+     * the bank in the secondary bank register gets mapped */
+    mbc1_mapRAM(vm, mbc);
+    mbc1_mapRestrictedROM(vm, mbc);
 }
 
 void mbc1_allocate(VM* vm, bool externalRam) {
@@ -158,6 +163,8 @@ void mbc1_interceptROMWrite(VM* vm, uint16_t addr, uint8_t byte) {
         if ((byte & 0xF) == 0xA) mbc->ramEnabled = true;
         else mbc->ramEnabled = false;
 
+        mbc1_mapRAM(vm, mbc);
+
 #ifdef DEBUG_LOGGING
         printf("MBC : %s RAM\n", mbc->ramEnabled ? "Enabled" : "Disabled");
 #endif
@@ -202,6 +209,8 @@ void mbc1_interceptROMWrite(VM* vm, uint16_t addr, uint8_t byte) {
          * In ram mode (mode 1), this register is used to switch between the 4 ram banks  */
 
         uint8_t upperBankNumber = byte & 0b00000011;
+        mbc->secondaryBankNumber = upperBankNumber;
+
         if (mbc->bankMode == BANK_MODE_ROM) {
             /*
             * Check if the rom is even big enough to require 
@@ -226,10 +235,10 @@ void mbc1_interceptROMWrite(VM* vm, uint16_t addr, uint8_t byte) {
         
             switchROMBank(vm, fullBankNumber);
         } else if (mbc->bankMode == BANK_MODE_RAM) {
-            /* We have some RAM Banks to switch */
-            if (vm->cartridge->extRamSize == EXT_RAM_32KB) {
-                mbc1_switchRAMBank(vm, mbc, upperBankNumber);
-            }
+            /* We may have some RAM Banks to switch, and 0x0000-0x3fff follows the
+             * register too */
+            mbc1_mapRAM(vm, mbc);
+            mbc1_mapRestrictedROM(vm, mbc);
         }
 
     } else if (addr >= 0x6000 && addr <= 0x7fff) {
@@ -2,6 +2,15 @@
 #include "../include/mbc2.h"
 #include "../include/debug.h"
 
+static void mbc2_mapRAM(VM* vm, MBC_2* mbc) {
+    /* The 512 bytes of built in RAM are echoed through the whole external RAM area,
+     * so every 512 byte block gets mapped to it. When RAM is disabled, accesses go through
+     * mbc2_writeBuiltInRAM/mbc2_readBuiltInRAM instead */
+    for (int addr = RAM_NN_8KB; addr < RAM_NN_8KB_END; addr += 0x200) {
+        mapMemory(vm, addr, addr + 0x1FF, mbc->ramEnabled ? mbc->builtInRAM : NULL);
+    }
+}
+
 void mbc2_allocate(VM* vm) {
     MBC_2* mbc = (MBC_2*)malloc(sizeof(MBC_2));
     mbc->ramEnabled = false;
@@ -59,6 +68,7 @@ void mbc2_interceptROMWrite(VM *vm, uint16_t addr, uint8_t byte) {
              * Anything Else = Disable */
 
             mbc->ramEnabled = byte == 0x0A;
+            mbc2_mapRAM(vm, mbc);
 
 #ifdef DEBUG_LOGGING
             printf("MBC : RAM %s\n", mbc->ramEnabled ? "Enabled" : "Disabled");
@@ -0,0 +1,171 @@
+#include "../include/megagbc.h"
+#include "../include/backend.h"
+#include "../include/cartridge.h"
+#include "../include/debug.h"
+#include "../include/scheduler.h"
+#include "../include/vm.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct GBC {
+    VM vm;
+    Cartridge cartridge;                    /* Owns the copy of the ROM */
+};
+
+GBC* gbc_create(const uint8_t* rom, size_t size) {
+    return gbc_create_with_backend(rom, size, &nullBackend);
+}
+
+GBC* gbc_create_with_backend(const uint8_t* rom, size_t size, const Backend* backend) {
+    if (rom == NULL) return NULL;
+
+    GBC* gbc = (GBC*)malloc(sizeof(GBC));
+    uint8_t* allocation = (uint8_t*)malloc(size);
+
+    if (gbc == NULL || allocation == NULL) {
+        free(gbc);
+        free(allocation);
+        return NULL;
+    }
+
+    /* The cartridge keeps the ROM, so the caller is free to get rid of theirs */
+    memcpy(allocation, rom, size);
+
+    if (!initCartridge(&gbc->cartridge, allocation, size)) {
+        free(allocation);
+        free(gbc);
+        return NULL;
+    }
+
+    /* Checked before anything is set up, so the library never exits the process */
+    if (!mbc_isSupported(&gbc->cartridge)) {
+        freeCartridge(&gbc->cartridge);
+        free(gbc);
+        return NULL;
+    }
+
+    if (!initEmulator(&gbc->vm, &gbc->cartridge, backend)) {
+        freeCartridge(&gbc->cartridge);
+        free(gbc);
+        return NULL;
+    }
+
+    return gbc;
+}
+
+void gbc_destroy(GBC* gbc) {
+    if (gbc == NULL) return;
+
+    stopEmulator(&gbc->vm);
+    freeCartridge(&gbc->cartridge);
+    free(gbc);
+}
+
+void gbc_run_frame(GBC* gbc) {
+    VM* vm = &gbc->vm;
+
+    vm->stopAtFrameEnd = true;
+    vm->run = !vm->quit;
+    runEmulator(vm);
+    vm->stopAtFrameEnd = false;
+}
+
+unsigned long gbc_run_cycles(GBC* gbc, unsigned long cycles) {
+    VM* vm = &gbc->vm;
+    unsigned long start = vm->clock;
+
+    if (cycles == 0) return 0;
+
+    scheduleEvent(vm, EVENT_YIELD, start + cycles);
+    vm->run = !vm->quit;
+    runEmulator(vm);
+    /* In case something else stopped it first */
+    cancelEvent(vm, EVENT_YIELD);
+    /* Leave the PPU at the same cycle, in case the framebuffer is looked at */
+    syncPPU(vm);
+
+    return vm->clock - start;
+}
+
+void gbc_set_speed(GBC* gbc, unsigned int multiplier) {
+    gbc->vm.speed = multiplier;
+}
+
+void gbc_set_input(GBC* gbc, uint8_t buttons) {
+    for (int button = JOYPAD_BUTTON_RIGHT; button <= JOYPAD_BUTTON_START; button++) {
+        setJoypadButton(&gbc->vm, button, GET_BIT(buttons, button));
+    }
+}
+
+const uint32_t* gbc_framebuffer(GBC* gbc) {
+    return getFramebuffer(&gbc->vm);
+}
+
+unsigned long gbc_frame_count(GBC* gbc) {
+    return gbc->vm.frameCount;
+}
+
+void gbc_set_idle_skip(GBC* gbc, bool enabled) {
+    gbc->vm.idleLoop.enabled = enabled;
+}
+
+bool gbc_set_jit(GBC* gbc, GBCJitMode mode) {
+#ifdef CPU_JIT
+    switch (mode) {
+        case GBC_JIT_OFF: setJitMode(&gbc->vm, JIT_OFF); break;
+        case GBC_JIT_ON: setJitMode(&gbc->vm, JIT_ON); break;
+        case GBC_JIT_VERIFY: setJitMode(&gbc->vm, JIT_VERIFY); break;
+    }
+    return true;
+#else
+    return mode == GBC_JIT_OFF;
+#endif
+}
+
+void gbc_get_stats(GBC* gbc, GBCStats* stats) {
+    VM* vm = &gbc->vm;
+
+    stats->frames = vm->frameCount;
+    stats->instructions = vm->instructionCount;
+    stats->cycles = vm->clock;
+    stats->idleSkips = vm->idleLoop.skips;
+    stats->idleCycles = vm->idleLoop.skippedCycles;
+    stats->compiledBlocks = vm->jit.compiledBlocks;
+    stats->jitInstructions = vm->jit.instructions;
+#ifdef DEBUG_PROFILE
+    stats->profiled = true;
+#else
+    stats->profiled = false;
+#endif
+    stats->ppuSeconds = vm->profileTime[PROFILE_PPU] / 1e9;
+    stats->busSeconds = vm->profileTime[PROFILE_BUS] / 1e9;
+}
+
+bool gbc_should_quit(GBC* gbc) {
+    return gbc->vm.quit;
+}
+
+/* What gbc_run_loop() hands the backend, which only knows about the VM */
+typedef struct {
+    GBC* gbc;
+    GBCLoop loop;
+    void* data;
+} LoopCall;
+
+static void callLoop(void* data) {
+    LoopCall* call = (LoopCall*)data;
+    call->loop(call->gbc, call->data);
+}
+
+bool gbc_run_loop(GBC* gbc, GBCLoop loop, void* data) {
+    const Backend* backend = gbc->vm.backend;
+
+    if (backend->runLoop == NULL) {
+        loop(gbc, data);
+        return true;
+    }
+
+    LoopCall call = { .gbc = gbc, .loop = loop, .data = data };
+    return backend->runLoop(&gbc->vm, callLoop, &call);
+}
@@ -0,0 +1,232 @@
+#include "../include/pixel.h"
+#include <pthread.h>
+
+#if !defined(PIXEL_KERNELS_SCALAR) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/* Scalar kernels, these are used when the CPU has nothing better */
+
+static inline uint16_t reverseBitsInBytes(uint16_t x) {
+    x = ((x >> 1) & 0x5555) | ((x & 0x5555) << 1);
+    x = ((x >> 2) & 0x3333) | ((x & 0x3333) << 2);
+    x = ((x >> 4) & 0x0F0F) | ((x & 0x0F0F) << 4);
+    return x;
+}
+
+static inline uint16_t interleaveBytes(uint16_t x) {
+    /* Bit N of the low byte moves to bit 2N and bit N of the high byte to bit 2N + 1,
+     * which turns the two bitplanes into color IDs (Hacker's Delight, outer perfect shuffle) */
+    uint16_t t;
+    t = (x ^ (x >> 4)) & 0x00F0; x = x ^ t ^ (t << 4);
+    t = (x ^ (x >> 2)) & 0x0C0C; x = x ^ t ^ (t << 2);
+    t = (x ^ (x >> 1)) & 0x2222; x = x ^ t ^ (t << 1);
+    return x;
+}
+
+static void decodeTileRows_scalar(const uint8_t* tileData, uint16_t* rows, uint16_t* flippedRows,
+                                  int count) {
+    for (int i = 0; i < count; i++) {
+        uint16_t planes = tileData[2 * i] | (tileData[(2 * i) + 1] << 8);
+
+        /* Bit 0 holds the rightmost pixel, so its the flipped row which comes out as is */
+        flippedRows[i] = interleaveBytes(planes);
+        rows[i] = interleaveBytes(reverseBitsInBytes(planes));
+    }
+}
+
+static void expandTileRows_scalar(const uint16_t* rows, const uint8_t* paletteIndices,
+                                  const uint32_t (*palettes)[4], uint32_t* out, int count) {
+    for (int i = 0; i < count; i++) {
+        const uint32_t* palette = palettes[paletteIndices[i]];
+        uint16_t row = rows[i];
+
+        for (int x = 0; x < 8; x++) {
+            out[(i * 8) + x] = palette[(row >> (x * 2)) & 0b00000011];
+        }
+    }
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+/* SSE2 kernels, 8 rows are decoded at once with a 16 bit lane for each row, and the pixels
+ * of a row are picked out of the palette with compare masks */
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static inline SSE2_TARGET __m128i reverseBitsInBytes_sse2(__m128i x) {
+    const __m128i m1 = _mm_set1_epi16(0x5555);
+    const __m128i m2 = _mm_set1_epi16(0x3333);
+    const __m128i m4 = _mm_set1_epi16(0x0F0F);
+
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), m1), _mm_slli_epi16(_mm_and_si128(x, m1), 1));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), m2), _mm_slli_epi16(_mm_and_si128(x, m2), 2));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), m4), _mm_slli_epi16(_mm_and_si128(x, m4), 4));
+    return x;
+}
+
+static inline SSE2_TARGET __m128i interleaveBytes_sse2(__m128i x) {
+    __m128i t;
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi16(x, 4)), _mm_set1_epi16(0x00F0));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi16(t, 4)));
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi16(x, 2)), _mm_set1_epi16(0x0C0C));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi16(t, 2)));
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi16(x, 1)), _mm_set1_epi16(0x2222));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi16(t, 1)));
+    return x;
+}
+
+static SSE2_TARGET void decodeTileRows_sse2(const uint8_t* tileData, uint16_t* rows,
+                                            uint16_t* flippedRows, int count) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        /* Each 16 bit lane ends up with the low bitplane in its low byte */
+        __m128i planes = _mm_loadu_si128((const __m128i*)&tileData[2 * i]);
+
+        _mm_storeu_si128((__m128i*)&flippedRows[i], interleaveBytes_sse2(planes));
+        _mm_storeu_si128((__m128i*)&rows[i], interleaveBytes_sse2(reverseBitsInBytes_sse2(planes)));
+    }
+
+    decodeTileRows_scalar(&tileData[2 * i], &rows[i], &flippedRows[i], count - i);
+}
+
+static inline SSE2_TARGET __m128i selectColors_sse2(__m128i c0, __m128i c1, __m128i c2, __m128i c3,
+                                                    __m128i is1, __m128i is2, __m128i is3) {
+    /* The masks never overlap, so every color can be xored in on top of color 0 */
+    __m128i color = c0;
+    color = _mm_xor_si128(color, _mm_and_si128(_mm_xor_si128(c0, c1), is1));
+    color = _mm_xor_si128(color, _mm_and_si128(_mm_xor_si128(c0, c2), is2));
+    color = _mm_xor_si128(color, _mm_and_si128(_mm_xor_si128(c0, c3), is3));
+    return color;
+}
+
+static SSE2_TARGET void expandTileRows_sse2(const uint16_t* rows, const uint8_t* paletteIndices,
+                                            const uint32_t (*palettes)[4], uint32_t* out, int count) {
+    /* Lane N of these picks out the color ID of pixel N */
+    const __m128i idMask = _mm_setr_epi16(3 << 0, 3 << 2, 3 << 4, 3 << 6,
+                                          3 << 8, 3 << 10, 3 << 12, (int16_t)(3 << 14));
+    const __m128i id1 = _mm_setr_epi16(1 << 0, 1 << 2, 1 << 4, 1 << 6,
+                                       1 << 8, 1 << 10, 1 << 12, 1 << 14);
+    const __m128i id2 = _mm_slli_epi16(id1, 1);
+
+    for (int i = 0; i < count; i++) {
+        const uint32_t* palette = palettes[paletteIndices[i]];
+        __m128i ids = _mm_and_si128(_mm_set1_epi16(rows[i]), idMask);
+        __m128i is1 = _mm_cmpeq_epi16(ids, id1);
+        __m128i is2 = _mm_cmpeq_epi16(ids, id2);
+        __m128i is3 = _mm_cmpeq_epi16(ids, idMask);
+
+        __m128i c0 = _mm_set1_epi32(palette[0]);
+        __m128i c1 = _mm_set1_epi32(palette[1]);
+        __m128i c2 = _mm_set1_epi32(palette[2]);
+        __m128i c3 = _mm_set1_epi32(palette[3]);
+
+        /* Widen the 16 bit masks to 32 bits, pixels 0-3 and then 4-7 */
+        __m128i left = selectColors_sse2(c0, c1, c2, c3, _mm_unpacklo_epi16(is1, is1),
+                                         _mm_unpacklo_epi16(is2, is2), _mm_unpacklo_epi16(is3, is3));
+        __m128i right = selectColors_sse2(c0, c1, c2, c3, _mm_unpackhi_epi16(is1, is1),
+                                          _mm_unpackhi_epi16(is2, is2), _mm_unpackhi_epi16(is3, is3));
+
+        _mm_storeu_si128((__m128i*)&out[i * 8], left);
+        _mm_storeu_si128((__m128i*)&out[(i * 8) + 4], right);
+    }
+}
+
+/* AVX2 kernels, 16 rows are decoded at once and a row of pixels is a single permute
+ * of its palette */
+
+static AVX2_TARGET void decodeTileRows_avx2(const uint8_t* tileData, uint16_t* rows,
+                                            uint16_t* flippedRows, int count) {
+    const __m256i m1 = _mm256_set1_epi16(0x5555);
+    const __m256i m2 = _mm256_set1_epi16(0x3333);
+    const __m256i m4 = _mm256_set1_epi16(0x0F0F);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i planes = _mm256_loadu_si256((const __m256i*)&tileData[2 * i]);
+        __m256i x, t;
+
+        /* Same as the SSE2 version, first interleave as is for the flipped rows */
+        x = planes;
+        t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi16(x, 4)), _mm256_set1_epi16(0x00F0));
+        x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi16(t, 4)));
+        t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi16(x, 2)), _mm256_set1_epi16(0x0C0C));
+        x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi16(t, 2)));
+        t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi16(x, 1)), _mm256_set1_epi16(0x2222));
+        x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi16(t, 1)));
+        _mm256_storeu_si256((__m256i*)&flippedRows[i], x);
+
+        /* Then reverse the bitplanes for the normal rows */
+        x = planes;
+        x = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 1), m1), _mm256_slli_epi16(_mm256_and_si256(x, m1), 1));
+        x = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 2), m2), _mm256_slli_epi16(_mm256_and_si256(x, m2), 2));
+        x = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 4), m4), _mm256_slli_epi16(_mm256_and_si256(x, m4), 4));
+        t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi16(x, 4)), _mm256_set1_epi16(0x00F0));
+        x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi16(t, 4)));
+        t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi16(x, 2)), _mm256_set1_epi16(0x0C0C));
+        x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi16(t, 2)));
+        t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi16(x, 1)), _mm256_set1_epi16(0x2222));
+        x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi16(t, 1)));
+        _mm256_storeu_si256((__m256i*)&rows[i], x);
+    }
+
+    /* A single tile is only 8 rows */
+    decodeTileRows_sse2(&tileData[2 * i], &rows[i], &flippedRows[i], count - i);
+}
+
+static AVX2_TARGET void expandTileRows_avx2(const uint16_t* rows, const uint8_t* paletteIndices,
+                                            const uint32_t (*palettes)[4], uint32_t* out, int count) {
+    const __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m256i idMask = _mm256_set1_epi32(0b00000011);
+
+    for (int i = 0; i < count; i++) {
+        /* The palette sits in both halves, only the lower 4 lanes of it get picked */
+        __m256i palette = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i*)palettes[paletteIndices[i]]));
+        __m256i ids = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(rows[i]), shifts), idMask);
+
+        _mm256_storeu_si256((__m256i*)&out[i * 8], _mm256_permutevar8x32_epi32(palette, ids));
+    }
+}
+
+#endif
+
+static const PixelKernels scalarKernels = { "scalar", decodeTileRows_scalar, expandTileRows_scalar };
+#ifdef PIXEL_KERNELS_X86
+static const PixelKernels sse2Kernels = { "sse2", decodeTileRows_sse2, expandTileRows_sse2 };
+static const PixelKernels avx2Kernels = { "avx2", decodeTileRows_avx2, expandTileRows_avx2 };
+#endif
+
+PixelKernels pixelKernels = { "scalar", decodeTileRows_scalar, expandTileRows_scalar };
+static pthread_once_t pixelKernelsOnce = PTHREAD_ONCE_INIT;
+
+int getSupportedPixelKernels(const PixelKernels** kernels) {
+    int count = 0;
+    kernels[count++] = &scalarKernels;
+
+#ifdef PIXEL_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2")) kernels[count++] = &sse2Kernels;
+    if (__builtin_cpu_supports("avx2")) kernels[count++] = &avx2Kernels;
+#endif
+    return count;
+}
+
+static void selectPixelKernels() {
+    /* The last one supported is the fastest */
+    const PixelKernels* kernels[PIXEL_KERNELS_MAX];
+    int count = getSupportedPixelKernels(kernels);
+
+    pixelKernels = *kernels[count - 1];
+}
+
+void initPixelKernels() {
+    /* Every VM renders through the same kernels, they are only picked by the first
+     * one so VMs being created dont change them under VMs running on other threads */
+    pthread_once(&pixelKernelsOnce, selectPixelKernels);
+}
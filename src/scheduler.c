@@ -0,0 +1,133 @@
+#include "../include/scheduler.h"
+#include "../include/vm.h"
+#include "../include/display.h"
+#include <limits.h>
+
+static inline bool eventBefore(Event* a, Event* b) {
+    /* Events due on the same cycle run in the order of their type */
+    if (a->deadline != b->deadline) return a->deadline < b->deadline;
+    return a->type < b->type;
+}
+
+static inline void swapEvents(Scheduler* scheduler, int i, int j) {
+    Event temp = scheduler->heap[i];
+    scheduler->heap[i] = scheduler->heap[j];
+    scheduler->heap[j] = temp;
+
+    scheduler->heapIndex[scheduler->heap[i].type] = i;
+    scheduler->heapIndex[scheduler->heap[j].type] = j;
+}
+
+static void siftUp(Scheduler* scheduler, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!eventBefore(&scheduler->heap[i], &scheduler->heap[parent])) break;
+
+        swapEvents(scheduler, i, parent);
+        i = parent;
+    }
+}
+
+static void siftDown(Scheduler* scheduler, int i) {
+    while (true) {
+        int left = i * 2 + 1;
+        int right = left + 1;
+        int smallest = i;
+
+        if (left < scheduler->count &&
+                eventBefore(&scheduler->heap[left], &scheduler->heap[smallest])) smallest = left;
+        if (right < scheduler->count &&
+                eventBefore(&scheduler->heap[right], &scheduler->heap[smallest])) smallest = right;
+        if (smallest == i) break;
+
+        swapEvents(scheduler, i, smallest);
+        i = smallest;
+    }
+}
+
+static inline void updateNextDeadline(Scheduler* scheduler) {
+    scheduler->nextDeadline = scheduler->count > 0 ? scheduler->heap[0].deadline : ULONG_MAX;
+}
+
+void initScheduler(Scheduler* scheduler) {
+    scheduler->count = 0;
+
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        scheduler->heapIndex[i] = -1;
+    }
+
+    updateNextDeadline(scheduler);
+}
+
+void scheduleEvent(VM* vm, EVENT_TYPE type, unsigned long deadline) {
+    Scheduler* scheduler = &vm->scheduler;
+    int i = scheduler->heapIndex[type];
+
+    if (i == -1) {
+        /* Insert it at the end */
+        i = scheduler->count++;
+        scheduler->heap[i].type = type;
+        scheduler->heap[i].deadline = deadline;
+        scheduler->heapIndex[type] = i;
+        siftUp(scheduler, i);
+    } else if (deadline < scheduler->heap[i].deadline) {
+        scheduler->heap[i].deadline = deadline;
+        siftUp(scheduler, i);
+    } else {
+        /* Most of the time an event reschedules itself for later while its at the top */
+        scheduler->heap[i].deadline = deadline;
+        siftDown(scheduler, i);
+    }
+
+    updateNextDeadline(scheduler);
+}
+
+void cancelEvent(VM* vm, EVENT_TYPE type) {
+    Scheduler* scheduler = &vm->scheduler;
+    int i = scheduler->heapIndex[type];
+
+    if (i == -1) return;
+
+    /* Move the last event in its place */
+    int last = --scheduler->count;
+    scheduler->heapIndex[type] = -1;
+
+    if (i != last) {
+        EVENT_TYPE moved = scheduler->heap[last].type;
+
+        scheduler->heap[i] = scheduler->heap[last];
+        scheduler->heapIndex[moved] = i;
+        siftUp(scheduler, i);
+        siftDown(scheduler, scheduler->heapIndex[moved]);
+    }
+
+    updateNextDeadline(scheduler);
+}
+
+bool isEventScheduled(VM* vm, EVENT_TYPE type) {
+    return vm->scheduler.heapIndex[type] != -1;
+}
+
+void runEvents(VM* vm) {
+    Scheduler* scheduler = &vm->scheduler;
+
+    while (true) {
+        while (scheduler->count > 0 && scheduler->heap[0].deadline <= vm->clock) {
+            /* The handler either schedules the event again or cancels it */
+            switch (scheduler->heap[0].type) {
+                case EVENT_PPU: handlePPUEvent(vm); break;
+                case EVENT_DMA: handleDMAEvent(vm); break;
+                case EVENT_TIMER: handleTimerEvent(vm); break;
+                case EVENT_YIELD: handleYieldEvent(vm); break;
+                default: break;
+            }
+        }
+
+        /* HDMA stopped the CPU, the rest of the hardware keeps going for that long
+         * which can make more events due */
+        if (vm->stalledCycles == 0) break;
+
+        vm->clock += vm->stalledCycles;
+        vm->stalledCycles = 0;
+    }
+}
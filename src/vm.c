@@ -4,16 +4,12 @@
 #include "../include/debug.h"
 #include "../include/display.h"
 #include "../include/mbc.h"
+#include "../include/pixel.h"
 
-#include <SDL2/SDL_events.h>
-#include <SDL2/SDL_pixels.h>
-#include <SDL2/SDL_render.h>
-#include <SDL2/SDL_scancode.h>
-#include <SDL2/SDL_timer.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <time.h>
 #include <string.h>
-#include <SDL2/SDL.h>
 #include <sys/time.h>
 
 static void initVM(VM* vm) {
@@ -25,15 +21,30 @@ static void initVM(VM* vm) {
     vm->paused = false;
 
     vm->scheduleInterruptEnable = false;
+    vm->pendingInterrupts = 0;
 	vm->haltMode = false;
 	vm->scheduleHaltBug = false;
+    vm->lazyFlagsOp = LAZY_FLAGS_NONE;
 
     vm->clock = 0;
+    initScheduler(&vm->scheduler);
     vm->lastTIMASync = 0;
-    vm->lastDIVSync = 0;
-
-    vm->sdl_window = NULL;
-    vm->sdl_renderer = NULL;
+    vm->systemCounterOffset = 0;
+
+    vm->backend = &nullBackend;
+    vm->backendData = NULL;
+    vm->frameCount = 0;
+    vm->stopAtFrameEnd = false;
+    vm->quit = false;
+    vm->speed = 1;
+    vm->fastForwardSpeed = SPEED_UNCAPPED;
+    vm->fastForward = false;
+    vm->ticksAtLastPresent = 0;
+    vm->instructionCount = 0;
+    initIdleLoop(&vm->idleLoop);
+    vm->profileSection = PROFILE_CPU;
+    vm->profileLastSwitch = 0;
+    memset(vm->profileTime, 0, sizeof(vm->profileTime));
 	vm->ticksAtLastRender = 0;
 	vm->ticksAtStartup = 0;	
  
@@ -48,8 +59,7 @@ static void initVM(VM* vm) {
     vm->fetcherTileAttributes = 0;
     vm->fetcherX = 0;
     vm->fetcherY = 0;
-    vm->fetcherTileRowLow = 0;
-    vm->fetcherTileRowHigh = 0;
+    vm->fetcherTileRow = 0;
     vm->nextRenderPixelX = 0;
     vm->nextPushPixelX = 0;
     vm->pauseDotClock = 0;
@@ -61,17 +71,52 @@ static void initVM(VM* vm) {
     vm->renderingWindow = false;
     vm->renderingSprites = false;
     vm->spriteData = NULL;
-    vm->preservedFetcherTileLow = 0;
-    vm->preservedFetcherTileHigh = 0;
+    vm->preservedFetcherTileRow = 0;
     vm->preservedFetcherTileAttributes = 0;
+
+    for (int i = 0; i < TILE_COUNT; i++) {
+        vm->decodedTiles[0][i].valid = false;
+        vm->decodedTiles[1][i].valid = false;
+    }
+    initPixelKernels();
     vm->spriteSize = 0;
     vm->isLastSpriteOverlap = false;
+    vm->fastScanline = false;
+    vm->fifoScanline = false;
+    vm->mode3Dots = 0;
+    vm->fastScanlineDots = 0;
+    vm->fastScanlineCycles = 0;
+    
+    for (int i = 0; i < SCANLINE_TIMING_CACHE_SIZE; i++) {
+        vm->scanlineTimings[i].valid = false;
+    }
+
     vm->lastSpriteOverlapPushIndex = 0;
     vm->lastSpriteOverlapX = 0;
     vm->doingDMA = false;
-    vm->mCyclesSinceDMA = 0;
+    vm->dmaStart = 0;
+    vm->dmaSpritesCopied = 0;
     vm->dmaSource = 0;
+    vm->doingHDMA = false;
+    vm->hdmaSource = 0;
+    vm->hdmaDestination = VRAM_N0_8KB;
+    vm->hdmaChunksLeft = 0;
+    vm->stalledCycles = 0;
+    vm->lockVRAM = false;
+    vm->lockOAM = false;
+    vm->lockPalettes = false;
+
+    initBlockCache(&vm->blockCache);
+    initJit(&vm->jit);
+    for (int i = 0; i < MEMORY_PAGE_COUNT; i++) vm->memoryPages[i].hasCode = false;
+
+    /* Everything starts out mapped to MEM, external RAM is handled by the MBC */
+    mapMemory(vm, 0x0000, 0xFFFF, vm->MEM);
+    mapMemory(vm, RAM_NN_8KB, RAM_NN_8KB_END, NULL);
     
+    /* Start with a white screen */
+    for (int i = 0; i < WIDTH_PX * HEIGHT_PX; i++) vm->framebuffer[i] = PACK_ARGB8888(0xFF, 0xFF, 0xFF);
+
     /* Initialise OAM Buffer */
     memset(&vm->oamDataBuffer, 0xFF, 50);
     vm->spritesInScanline = 0;
@@ -134,8 +179,8 @@ static void initVMCartridge(VM* vm, Cartridge* cartridge) {
 	    * Because the default value of SVBK is 0xFF, which means bank 7 is selected 
 	    * by default 
 	    * Same goes for VBK, bank 1 will be selected by default*/
-	    switchCGB_WRAM(vm, 1, 7);
-	    switchCGB_VRAM(vm, 0, 1);
+	    switchCGB_WRAM(vm, 7);
+	    switchCGB_VRAM(vm, 1);
     } else if (vm->emuMode == EMU_DMG) {
         /* When the PPU first starts up, it takes 4 cycles less on the first frame,
 	     * it also doesnt lock OAM */
@@ -151,9 +196,22 @@ static void initVMCartridge(VM* vm, Cartridge* cartridge) {
 
         resetGB(vm);
     }
+
+    updateMemoryPages(vm, 0x0000, 0xFFFF);
+    updatePalettes(vm);
+    updatePendingInterrupts(vm);
+
+    /* The system counter starts where the boot ROM leaves DIV */
+    vm->systemCounterOffset = ((unsigned long)vm->MEM[R_DIV] * T_CYCLES_PER_DIV) - vm->clock;
+    vm->lastTIMASync = vm->clock;
+
+    /* Start scheduling the hardware */
+    vm->lastDisplaySync = vm->clock;
+    schedulePPU(vm);
+    scheduleTimer(vm);
 }
 
-static void bootROM(VM* vm) {
+static bool bootROM(VM* vm) {
     /* This is only a temporary boot rom function,
      * the original boot rom will be in binary and will
      * be mapped over correctly when the cpu is complete
@@ -173,7 +231,8 @@ static void bootROM(VM* vm) {
     bool logoVerified = memcmp(&vm->cartridge->logoChecksum, &logo, 0x18) == 0;
     
     if (!logoVerified) {
-        log_fatal(vm, "Logo Verification Failed");
+        log_warning(vm, "Logo Verification Failed");
+        return false;
     }
         
     int checksum = 0;
@@ -182,13 +241,15 @@ static void bootROM(VM* vm) {
     }
 
     if ((checksum & 0xFF) != vm->cartridge->headerChecksum) {
-        log_fatal(vm, "Header Checksum Doesn't Match, it is possibly corrupted");
+        log_warning(vm, "Header Checksum Doesn't Match, it is possibly corrupted");
+        return false;
     }
 #endif 
 
     /* Map the cartridge rom to the GBC rom space 
      * occupying bank 0 and 1, a total of 32 KB*/
-    memcpy(&vm->MEM[ROM_N0_16KB], vm->cartridge->allocated, 0x8000);
+    mapMemory(vm, ROM_N0_16KB, ROM_NN_16KB_END, vm->cartridge->allocated);
+    return true;
 }
 
 /* Utility */
@@ -214,111 +275,172 @@ void incrementTIMA(VM* vm) {
     }
 }
 
-/* CGB Specific WRAM & VRAM banking */
+/* Memory pages */
+
+static void mapMemoryPage(VM* vm, uint8_t page) {
+    uint16_t addr = page * MEMORY_PAGE_SIZE;
+    MEMORY_PAGE* entry = &vm->memoryPages[page];
+    uint8_t* direct = entry->memory;
+
+    entry->read = NULL;
+    entry->write = NULL;
+
+    /* During DMA, the cpu can only access HRAM, which is on the IO page */
+    if (vm->doingDMA || direct == NULL) return;
+
+    if (addr <= ROM_NN_16KB_END) {
+        /* Writes to ROM are MBC commands */
+        entry->read = direct;
+    } else if (addr <= VRAM_N0_8KB_END) {
+        if (!vm->lockVRAM) {
+            entry->read = direct;
+
+            /* Writes to tile data have to invalidate the decoded tiles */
+            if (addr >= VRAM_N0_8KB + VRAM_TILE_DATA_SIZE) entry->write = direct;
+        }
+    } else if (addr <= RAM_NN_8KB_END) {
+        /* External RAM is only banked in when the MBC has it enabled */
+        entry->read = direct;
+        entry->write = direct;
+    } else if (addr <= WRAM_NN_4KB_END) {
+        entry->read = direct;
+
+        /* Writes to pages with code on them have to throw away its blocks */
+        if (!entry->hasCode) entry->write = direct;
+    } else if (addr <= ECHO_N0_8KB_END) {
+        /* Echo RAM is read only */
+        entry->read = direct;
+    } else if (addr <= UNUSABLE_N0_END) {
+        /* OAM shares its page with the unusable area which ignores writes */
+        if (!vm->lockOAM) entry->read = direct;
+    }
+
+    /* IO registers share the last page with HRAM, it is always handled */
+}
+
+void mapMemory(VM* vm, uint16_t startAddr, uint16_t endAddr, uint8_t* memory) {
+    for (int page = startAddr / MEMORY_PAGE_SIZE; page <= endAddr / MEMORY_PAGE_SIZE; page++) {
+        uint8_t* pageMemory = NULL;
+        if (memory != NULL) pageMemory = memory + (page * MEMORY_PAGE_SIZE - startAddr);
+
+        vm->memoryPages[page].memory = pageMemory;
+        mapMemoryPage(vm, page);
+    }
+
+    /* The block being walked could have been on one of the pages */
+    vm->blockCache.current = NULL;
+}
+
+void updateMemoryPages(VM* vm, uint16_t startAddr, uint16_t endAddr) {
+    for (int page = startAddr / MEMORY_PAGE_SIZE; page <= endAddr / MEMORY_PAGE_SIZE; page++) {
+        mapMemoryPage(vm, page);
+    }
+}
 
-void switchCGB_WRAM(VM* vm, uint8_t oldBankNumber, uint8_t bankNumber) {
-	/* Switch WRAM bank (0xD000-0xDFFF) from oldBankNumber to bankNumber */
+/* CGB Specific WRAM & VRAM banking */
 
-	/* Copy contents of the old bank number to its respective bank buffer */
-	/* We do oldBankNumber - 1 because bank 0 is not stored in this buffer,
+void switchCGB_WRAM(VM* vm, uint8_t bankNumber) {
+	/* Switch WRAM bank (0xD000-0xDFFF) to bankNumber 
+	 *
+	 * We do bankNumber - 1 because bank 0 is not stored in this buffer,
 	 * the first ram number that gets stored here is 1 */
-	memcpy(&vm->wramBanks[0x1000 * (oldBankNumber - 1)], &vm->MEM[WRAM_NN_4KB], 0x1000);
+	mapMemory(vm, WRAM_NN_4KB, WRAM_NN_4KB_END, &vm->wramBanks[0x1000 * (bankNumber - 1)]);
+}
 
-	/* If old bank buffer is the same as the one to be switched to, copying 
-	 * the buffer to the address will cause a previous version of the ram to be loaded
-	 * so we put this check in place */
+void switchCGB_VRAM(VM* vm, uint8_t bankNumber) {
+	/* Bank 0 always stays in MEM so the PPU can read both banks directly */
+	uint8_t* bank = bankNumber == 0 ? &vm->MEM[VRAM_N0_8KB] : vm->vramBank;
 
-	if (oldBankNumber != bankNumber) {	
-		memcpy(&vm->MEM[WRAM_NN_4KB], &vm->wramBanks[0x1000 * (bankNumber - 1)], 0x1000);
-	}
+	mapMemory(vm, VRAM_N0_8KB, VRAM_N0_8KB_END, bank);
 }
 
-void switchCGB_VRAM(VM* vm, uint8_t oldBankNumber, uint8_t bankNumber) {
-	/* There are only 2 VRAM banks in total so we can basically just swap them */
-	if (oldBankNumber != bankNumber) {
-		/* Swap */
-		for (int i = 0; i < 0x2000; i++) {
-			uint8_t b1 = vm->MEM[VRAM_N0_8KB + i];
-			uint8_t b2 = vm->vramBank[i];
-
-			vm->MEM[VRAM_N0_8KB + i] = b2;
-			vm->vramBank[i] = b1;
-		}
-	}
+/* Cycle table contains number of cycles per TIMA increment for its corresponding freq */
+static const unsigned int timerCycleTable[] = {
+    1024,		// 4096 Hz
+    16,			// 262144 Hz
+    64,			// 65536 Hz
+    256			// 16384 Hz
+};
+
+uint16_t getSystemCounter(VM* vm) {
+    return (uint16_t)(vm->clock + vm->systemCounterOffset);
+}
+
+uint16_t getTimerBit(uint8_t timerControl) {
+    /* TIMA increments when this bit goes from 1 to 0, which happens once every period */
+    return timerCycleTable[timerControl & 0b00000011] / 2;
 }
 
 void syncTimer(VM* vm) {
-    /* This function should be called after every instruction dispatch at minimum
-     * it fully syncs the timer despite the length of the interval
+    /* This function fully syncs the timer despite the length of the interval
      *
-     * This is mainly an optimisation because display needs to always be updated
-     * and is therefore called after every cycle but it isnt the case for timer
-     * It only needs to be updated tzo request interrupts or provide 
-     * correct values when registers are queried / modified 
+     * The timer doesnt need to be updated every cycle
+     * It only needs to be updated to request interrupts (on TIMA overflow, which is
+     * a scheduled event) or provide correct values when registers are queried / modified 
      *
-     * Sometimes the timers should have had been incremented a few cycles 
-     * earlier, in that case we calculate the extra cycles and reduce the 
-     * lastSync value to match the older cycle and maintain the frequency
+     * Like on the real hardware, DIV and TIMA are both driven by the system counter,
+     * which is just the clock plus an offset (that changes when DIV is reset). So DIV
+     * is its upper byte, and TIMA was incremented once for every falling edge of the
+     * timer bit since the last sync, which is the number of times the counter went 
+     * past a multiple of the period
      *
-     * Because we have 2 timers with different frequencies, 
-     * we need 2 different variables to keep the values 
-	 *
-	 * lastDIVSync and lastTIMASync store the cycle at which
-	 * the last successful sync happened
+     * The counter here isnt cut to 16 bits, the period always divides 0x10000 so
+     * the edges are at the same places anyway 
 	 * */
 	
-	unsigned int cycles = vm->clock;
-    unsigned int cyclesElapsedDIV = cycles - vm->lastDIVSync;
-    
+    unsigned long counter = vm->clock + vm->systemCounterOffset;
+    unsigned long lastCounter = vm->lastTIMASync + vm->systemCounterOffset;
+
+    vm->MEM[R_DIV] = (uint8_t)(counter / T_CYCLES_PER_DIV);
+    vm->lastTIMASync = vm->clock;
 
-    /* Sync DIV */
-    if (cyclesElapsedDIV >= T_CYCLES_PER_DIV) {
-        /* 'Rewind' the last timer sync in case the timer should have been 
-         * incremented on an earlier cycle */
-        vm->lastDIVSync = cycles - (cyclesElapsedDIV - T_CYCLES_PER_DIV);
-        vm->MEM[R_DIV]++;
+    uint8_t timerControl = vm->MEM[R_TAC];
+    if (!GET_BIT(timerControl, 2)) return;
+
+    unsigned long period = timerCycleTable[timerControl & 0b00000011];
+    unsigned long increments = (counter / period) - (lastCounter / period);
+
+    /* The timer event is due on every overflow, so this is never more than 
+     * a full round of TIMA */
+    for (unsigned long i = 0; i < increments; i++) {
+        incrementTIMA(vm);
     }
+}
 
-    /* Sync TIMA */
-    unsigned int cyclesElapsedTIMA = cycles - vm->lastTIMASync;
-    uint8_t timerControl    =  vm->MEM[R_TAC];
-    uint8_t timerEnabled    =  (timerControl >> 2) & 1;
-    uint8_t timerFrequency  =  timerControl & 0b00000011;
-
-    if (timerEnabled) {
-		/* Cycle table contains number of cycles per increment for its corresponding freq */
-        int cycleTable[] = {
-			1024,		// 4096 Hz
-			16,			// 262144 Hz
-			64,			// 65536 Hz
-			256			// 16384 Hz
-		};
-        unsigned int cyc = cycleTable[timerFrequency];
-		
-        if (cyclesElapsedTIMA >= cyc) {
-			/* The least amount of cycles per increment for the timer 
-			 * is 16 cycles, which means it has to be often incremented more than
-			 * once per instruction 
-			 *
-			 * This is a good reason to sync it every cycle update but 
-			 * it still isnt as significant because the only times it really matters is
-			 * when the instructions read its value, we always sync the timer just before
-			 * the read so it gets covered. Interrupt timing also isnt a problem because 
-			 * interrupts are only checked once per instruction dispatch, and the timer
-			 * is synced right before that happens */
-			int rem = cyclesElapsedTIMA % cyc;
-			int increments = (int)(cyclesElapsedTIMA / cyc);
-
-            vm->lastTIMASync = cycles - rem;
-
-			for (int i = 0; i < increments; i++) {
-				incrementTIMA(vm);
-			}
-        }
+void scheduleTimer(VM* vm) {
+    /* The only time the timer needs to act on its own is when TIMA overflows
+     * and requests an interrupt, so that is when the event is scheduled */
+    uint8_t timerControl = vm->MEM[R_TAC];
+
+    if (!GET_BIT(timerControl, 2)) {
+        cancelEvent(vm, EVENT_TIMER);
+        return;
     }
+
+    /* TIMA overflows on the (0x100 - TIMA)th falling edge after the last sync */
+    unsigned long period = timerCycleTable[timerControl & 0b00000011];
+    unsigned long counter = vm->lastTIMASync + vm->systemCounterOffset;
+    unsigned long overflowCounter = ((counter / period) + (0x100 - vm->MEM[R_TIMA])) * period;
+
+    scheduleEvent(vm, EVENT_TIMER, overflowCounter - vm->systemCounterOffset);
+}
+
+void handleTimerEvent(VM* vm) {
+    syncTimer(vm);
+    scheduleTimer(vm);
 }
 
-/* DMA Transfers */
+/* DMA Transfers 
+ *
+ * DMA Transfers take 160 machine cycles to complete = 640 T-Cycles, and copy one 
+ * sprite (4 bytes) every 4 M-Cycles, as there are 40 OAM entries
+ *
+ * It has to look like its done sequentially sprite by sprite as it is possible to do 
+ * dma transfers during mode 2, which can cause the values to be read by the ppu in real
+ * time. But the CPU can only access HRAM until its done so nothing else can see OAM (or 
+ * change the source), which means the sprites dont have to be copied on time. They are 
+ * copied by syncDMA() when the PPU is synced (see handlePPUEvent), and the rest at the 
+ * end of the DMA, which is the only time it needs an event */
 void startDMATransfer(VM* vm, uint8_t byte) {
     if (byte > 0xDF) {
 #ifdef DEBUG_LOGGING
@@ -331,183 +453,162 @@ void startDMATransfer(VM* vm, uint8_t byte) {
 
     vm->dmaSource = address;
     vm->doingDMA = true;
-    vm->mCyclesSinceDMA = 0;
+    vm->dmaStart = vm->clock;
+    vm->dmaSpritesCopied = 0;
+    updateMemoryPages(vm, 0x0000, 0xFFFF);
+    scheduleEvent(vm, EVENT_DMA, vm->clock + T_CYCLES_PER_DMA_SPRITE * DMA_SPRITE_COUNT);
 }
 
-void syncDMA(VM* vm) {
-    /* DMA Transfers take 160 machine cycles to complete = 640 T-Cycles
-     *
-     * It needs to be done sequentially sprite by sprite as it is possible to do dma 
-     * transfers during mode 2, which can cause the values to be read by the ppu in real time 
-     *
-     * Calling this function once does 4 tcycles or 1 mcycle of syncing */
+void syncDMA(VM* vm, unsigned long clock) {
+    if (!vm->doingDMA || clock < vm->dmaStart) return;
 
-    vm->mCyclesSinceDMA++;
+    /* The first sprite is copied after 4 M-Cycles */
+    unsigned long spritesDue = (clock - vm->dmaStart) / T_CYCLES_PER_DMA_SPRITE;
+    if (spritesDue > DMA_SPRITE_COUNT) spritesDue = DMA_SPRITE_COUNT;
 
-    if (vm->mCyclesSinceDMA % 4 == 0) {
-        /* it takes 4 M-Cycles to load 1 sprite, as there are 40 OAM entries and 160 M-Cycles 
-         * in total */
-        
-        uint8_t currentSpriteIndex = (vm->mCyclesSinceDMA / 4) - 1;
-        uint8_t addressLow = currentSpriteIndex * 4;
-        memcpy(&vm->MEM[OAM_N0_160B + addressLow], &vm->MEM[vm->dmaSource + addressLow], 4);
+    while (vm->dmaSpritesCopied < spritesDue) {
+        uint8_t addressLow = vm->dmaSpritesCopied * 4;
+
+        for (int i = 0; i < 4; i++) {
+            vm->MEM[OAM_N0_160B + addressLow + i] = peekAddr(vm, vm->dmaSource + addressLow + i);
+        }
+        vm->dmaSpritesCopied++;
     }
+}
 
-    if (vm->mCyclesSinceDMA == 160) {
-        vm->dmaSource = 0;
-        vm->mCyclesSinceDMA = 0;
-        vm->doingDMA = false;
+unsigned long getNextDMACopy(VM* vm) {
+    return vm->dmaStart + (vm->dmaSpritesCopied + 1) * T_CYCLES_PER_DMA_SPRITE;
+}
+
+/* CGB HDMA Transfers
+ *
+ * HDMA copies from ROM, external RAM or WRAM to whichever VRAM bank is selected, 16 bytes
+ * at a time. A general purpose DMA (GDMA) copies everything as soon as HDMA5 is written, 
+ * a HBlank DMA copies one chunk every time the PPU enters HBlank. The CPU is stopped while
+ * a chunk is copied, nothing else can run in the meantime so each chunk is just a memcpy 
+ * between the memory banked into the pages, and the time it took is added to the clock 
+ * afterwards (see runEvents) */
+static void copyHDMAChunk(VM* vm) {
+    uint16_t source = vm->hdmaSource;
+
+    /* The DMA cant read VRAM or anything from E000 on, those sources read $FF */
+    bool openBus = (source >= VRAM_N0_8KB && source <= VRAM_N0_8KB_END) || source >= ECHO_N0_8KB;
+
+    /* Chunks are 16 byte aligned, so they never cross a page */
+    uint8_t* sourcePage = vm->memoryPages[source / MEMORY_PAGE_SIZE].memory;
+    uint8_t* destinationPage = vm->memoryPages[vm->hdmaDestination / MEMORY_PAGE_SIZE].memory;
+    uint8_t* destination = &destinationPage[vm->hdmaDestination % MEMORY_PAGE_SIZE];
+
+    /* A general purpose DMA started in mode 3 cant get into VRAM either, the chunk is
+     * lost but the transfer still moves on. HBlank chunks are always copied in mode 0 */
+    if (!vm->lockVRAM) {
+#ifdef CPU_JIT
+        if (vm->jit.savePages) saveWrittenPage(vm, vm->hdmaDestination);
+#endif
+        if (openBus) {
+            memset(destination, 0xFF, HDMA_CHUNK_SIZE);
+        } else if (sourcePage != NULL) {
+            memcpy(destination, &sourcePage[source % MEMORY_PAGE_SIZE], HDMA_CHUNK_SIZE);
+        } else {
+            /* External RAM is handled by the MBC */
+            for (int i = 0; i < HDMA_CHUNK_SIZE; i++) destination[i] = mbc_readExternalRAM(vm, source + i);
+        }
+
+        /* The chunk is exactly one tile */
+        uint8_t bank = destinationPage == &vm->MEM[vm->hdmaDestination & 0xFF00] ? 0 : 1;
+        invalidateTile(vm, bank, vm->hdmaDestination - VRAM_N0_8KB);
+        if (vm->memoryPages[vm->hdmaDestination / MEMORY_PAGE_SIZE].hasCode) {
+            writeCodePage(vm, vm->hdmaDestination);
+        }
     }
+
+    vm->hdmaSource += HDMA_CHUNK_SIZE;
+    vm->hdmaDestination = VRAM_N0_8KB | ((vm->hdmaDestination + HDMA_CHUNK_SIZE) & 0x1FF0);
+    vm->hdmaChunksLeft--;
 }
 
-/* ------------------ */ 
+void startHDMATransfer(VM* vm, uint8_t byte) {
+    if (vm->doingHDMA && !GET_BIT(byte, 7)) {
+        /* Stops the HBlank DMA, HDMA5 still shows how much was left */
+        vm->doingHDMA = false;
+        vm->MEM[R_HDMA5] = 0x80 | (vm->hdmaChunksLeft - 1);
+        return;
+    }
 
-static void run(VM* vm) {
-	/* We do input polling every 1000 cpu ticks */
-	vm->ticksAtStartup = clock_u();
+    vm->hdmaChunksLeft = (byte & 0x7F) + 1;
 
-    while (vm->run) {
-		/* Handle Events */
-        handleSDLEvents(vm);
+    if (GET_BIT(byte, 7)) {
+        /* HBlank DMA, bit 7 stays clear while its active */
+        vm->doingHDMA = true;
+        vm->MEM[R_HDMA5] = byte & 0x7F;
 
-		for (int i = 0; (i < 500) && vm->run; i++) {
-			/* Run the next CPU instruction */
-			dispatch(vm);
-		}
+        /* If its started during HBlank the first chunk is copied right away */
+        syncPPU(vm);
+        if (vm->ppuEnabled && vm->ppuMode == PPU_MODE_0) {
+            handleHDMAChunk(vm);
+            runEvents(vm);
+        }
+        return;
     }
-}
 
-void cyclesSync_4(VM* vm) {
-    /* This function is called millions of times by the CPU
-     * in a second and therefore it needs to be optimised 
-     *
-     * So we dont update all hardware but only the ones that need to
-     * always be upto date like the display 
-	 *
-	 */
-    vm->clock += 4;
-	
-    syncDisplay(vm, 4);
+    /* General purpose DMA, the CPU is stopped until all of it is copied */
+    unsigned long stall = vm->hdmaChunksLeft * T_CYCLES_PER_HDMA_CHUNK;
+
+    /* The PPU lags behind the CPU, it has to be here before VRAM changes under it */
+    syncPPU(vm);
+    while (vm->hdmaChunksLeft > 0) copyHDMAChunk(vm);
+    vm->MEM[R_HDMA5] = 0xFF;
 
-    if (vm->doingDMA) syncDMA(vm);
+    vm->stalledCycles += stall;
+    runEvents(vm);
 }
 
-/* SDL */
+void handleHDMAChunk(VM* vm) {
+    if (!vm->doingHDMA) return;
+
+    copyHDMAChunk(vm);
+    /* A halted CPU isnt doing anything to be stopped from */
+    if (!vm->haltMode) vm->stalledCycles += T_CYCLES_PER_HDMA_CHUNK;
+
+    if (vm->hdmaChunksLeft == 0) {
+        vm->doingHDMA = false;
+        vm->MEM[R_HDMA5] = 0xFF;
+    } else {
+        vm->MEM[R_HDMA5] = vm->hdmaChunksLeft - 1;
+    }
+}
 
-int initSDL(VM* vm) {
-    SDL_Init(SDL_INIT_EVERYTHING);
-    SDL_CreateWindowAndRenderer(WIDTH_PX * DISPLAY_SCALING, HEIGHT_PX * DISPLAY_SCALING, SDL_WINDOW_SHOWN,
-                                &vm->sdl_window, &vm->sdl_renderer);
+void handleDMAEvent(VM* vm) {
+    /* The last sprite lands now, the PPU has to be here first so the dots before 
+     * dont see it */
+    syncPPU(vm);
+    syncDMA(vm, vm->clock);
 
-    if (!vm->sdl_window) return 1;          /* Failed to create screen */
+    vm->dmaSource = 0;
+    vm->dmaSpritesCopied = 0;
+    vm->doingDMA = false;
+    updateMemoryPages(vm, 0x0000, 0xFFFF);
+    cancelEvent(vm, EVENT_DMA);
+}
 
-    SDL_SetWindowTitle(vm->sdl_window, "MegaGBC");
-	SDL_RenderSetScale(vm->sdl_renderer, DISPLAY_SCALING, DISPLAY_SCALING);
-    return 0;
+void handleYieldEvent(VM* vm) {
+    cancelEvent(vm, EVENT_YIELD);
+    vm->run = false;
 }
 
-void handleSDLEvents(VM *vm) {
-    /* We listen for events like keystrokes and window closing */
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-        if (event.type == SDL_KEYDOWN && event.key.repeat == 0) {
-			/* We reset the corresponding bit for every scancode 
-			 * in the buffer for keydown and set for keyup */
-			switch (event.key.keysym.scancode) {
-				case SDL_SCANCODE_UP:
-					/* Joypad Up */
-					vm->joypadDirectionBuffer &= ~(1 << 2);
-					break;
-				case SDL_SCANCODE_LEFT:
-					/* Joypad Left */
-					vm->joypadDirectionBuffer &= ~(1 << 1);
-					break;
-				case SDL_SCANCODE_DOWN:
-					/* Joypad Down */
-					vm->joypadDirectionBuffer &= ~(1 << 3);
-					break;
-				case SDL_SCANCODE_RIGHT:
-					/* Joypad Right */
-					vm->joypadDirectionBuffer &= ~(1 << 0);
-					break;
-				case SDL_SCANCODE_Z:
-					/* B */
-					vm->joypadActionBuffer &= ~(1 << 1);
-					break;
-				case SDL_SCANCODE_X:
-					/* A */
-					vm->joypadActionBuffer &= ~(1 << 0);
-					break;
-				case SDL_SCANCODE_RETURN:
-					/* Start */
-					vm->joypadActionBuffer &= ~(1 << 3);
-					break;
-				case SDL_SCANCODE_TAB:
-					/* Select */
-					vm->joypadActionBuffer &= ~(1 << 2);
-					break;
-                case SDL_SCANCODE_SPACE:
-                    if (!vm->paused) pauseEmulator(vm);
-                    else unpauseEmulator(vm);
-                    break;
-				default: return;
-			}
-
-			updateJoypadRegBuffer(vm, vm->joypadSelectedMode);
-
-			if (vm->joypadSelectedMode != JOYPAD_SELECT_NONE) {
-				/* Request joypad interrupt if atleast 1 of the modes are selected */
-				requestInterrupt(vm, INTERRUPT_JOYPAD);
-			}
-		} else if (event.type == SDL_KEYUP && event.key.repeat == 0) {
-			switch (event.key.keysym.scancode) {
-				case SDL_SCANCODE_UP:
-					/* Joypad Up */
-					vm->joypadDirectionBuffer |= 1 << 2;
-					break;
-				case SDL_SCANCODE_LEFT:
-					/* Joypad Left */
-					vm->joypadDirectionBuffer |= 1 << 1;
-					break;
-				case SDL_SCANCODE_DOWN:
-					/* Joypad Down */
-					vm->joypadDirectionBuffer |= 1 << 3;
-					break;
-				case SDL_SCANCODE_RIGHT:
-					/* Joypad Right */
-					vm->joypadDirectionBuffer |= 1 << 0;
-					break;
-				case SDL_SCANCODE_Z:
-					/* B */
-					vm->joypadActionBuffer |= 1 << 1;
-					break;
-				case SDL_SCANCODE_X:
-					/* A */
-					vm->joypadActionBuffer |= 1 << 0;
-					break;
-				case SDL_SCANCODE_RETURN:
-					/* Start */
-					vm->joypadActionBuffer |= 1 << 3;
-					break;
-				case SDL_SCANCODE_TAB:
-					/* Select */
-					vm->joypadActionBuffer |= 1 << 2;
-					break;
-				default: return;			 
-			}
-			updateJoypadRegBuffer(vm, vm->joypadSelectedMode);
-
-		} else if (event.type == SDL_QUIT) {
-            vm->run = false;
-        }
+/* ------------------ */ 
+
+void runEmulator(VM* vm) {
+	/* We do input polling every 500 cpu instructions */
+    while (vm->run) {
+		/* Handle Events */
+        vm->backend->pollInput(vm);
+
+		/* Run the next 500 CPU instructions */
+		dispatch(vm, 500);
     }
 }
 
-void freeSDL(VM* vm) {
-    SDL_DestroyRenderer(vm->sdl_renderer);
-    SDL_DestroyWindow(vm->sdl_window);
-    SDL_Quit();
-}
 /* ---------------------------------------- */
 
 /* Joypad */
@@ -539,41 +640,67 @@ void updateJoypadRegBuffer(VM* vm, JOYPAD_SELECT mode) {
 	}
 }
 
+void setJoypadButton(VM* vm, JOYPAD_BUTTON button, bool pressed) {
+    uint8_t* buffer = button < JOYPAD_BUTTON_A ? &vm->joypadDirectionBuffer : &vm->joypadActionBuffer;
+    uint8_t bit = button % 4;
+    bool wasPressed = !GET_BIT(*buffer, bit);
+
+    if (pressed == wasPressed) return;
+
+    /* We reset the corresponding bit in the buffer when its pressed 
+     * and set it when its released */
+    if (pressed) CLEAR_BIT(*buffer, bit);
+    else SET_BIT(*buffer, bit);
+
+    updateJoypadRegBuffer(vm, vm->joypadSelectedMode);
+
+    if (pressed && vm->joypadSelectedMode != JOYPAD_SELECT_NONE) {
+        /* Request joypad interrupt if atleast 1 of the modes are selected */
+        requestInterrupt(vm, INTERRUPT_JOYPAD);
+    }
+}
+
 /* ---------------------------------------- */ 
 
-void startEmulator(Cartridge* cartridge) {
-    VM vm;
-    initVM(&vm);
-    initVMCartridge(&vm, cartridge);
-    /* Start up SDL */
-    int status = initSDL(&vm);
-    if (status != 0) {
-        /* An error occurred and SDL wasnt started
-         *
-         * This is fatal as our emulator cannot run without it
-         * and we immediately quit */
-        log_fatal(&vm, "Error Starting SDL2");
-        return;
+bool initEmulator(VM* vm, Cartridge* cartridge, const Backend* backend) {
+    initVM(vm);
+    initVMCartridge(vm, cartridge);
+
+    if (!allocateBlockCache(&vm->blockCache)) {
+        log_warning(vm, "Could not allocate the block cache");
+        stopEmulator(vm);
+        return false;
+    }
+
+    /* Start up the backend */
+    vm->backend = backend;
+    if (!backend->init(vm)) {
+        /* An error occurred and the backend wasnt started,
+         * our emulator cannot run without it */
+        log_warning(vm, "Error Starting the backend");
+        stopEmulator(vm);
+        return false;
     } 
 
 #ifdef DEBUG_PRINT_CARTRIDGE_INFO
     printCartridge(cartridge); 
 #endif
 #ifdef DEBUG_LOGGING
-    printf("Emulation mode: %s\n", vm.emuMode == EMU_CGB ? "Gameboy Color" : vm.emuMode == EMU_DMG ? "Gameboy" : "");
+    printf("Emulation mode: %s\n", vm->emuMode == EMU_CGB ? "Gameboy Color" : vm->emuMode == EMU_DMG ? "Gameboy" : "");
     printf("Booting into ROM\n");
 #endif
-    bootROM(&vm);
+    if (!bootROM(vm)) {
+        stopEmulator(vm);
+        return false;
+    }
 #ifdef DEBUG_LOGGING
     printf("Setting up Memory Bank Controller\n");
 #endif
-    mbc_allocate(&vm);
+    mbc_allocate(vm);
  
     /* We are now ready to run */
-    vm.run = true;
-	 
-    run(&vm);
-    stopEmulator(&vm);
+    vm->backend->startClock(vm);
+    return true;
 }
 
 void pauseEmulator(VM* vm) {
@@ -581,9 +708,9 @@ void pauseEmulator(VM* vm) {
     vm->paused = true;
 
     while (true) {
-        handleSDLEvents(vm);
+        vm->backend->pollInput(vm);
 
-        if (!vm->paused) break;
+        if (!vm->paused || vm->quit) break;
     }
 }
 
@@ -601,11 +728,14 @@ void stopEmulator(VM* vm) {
     printf("Cleaning allocations\n");
 #endif
 
-    /* Free up all SDL allocations and stop it */
-    freeSDL(vm);
+    /* Free up all backend allocations and stop it */
+    vm->backend->free(vm);
     /* Free up MBC allocations */
     mbc_free(vm);
     
+    freeJit(&vm->jit);
+    freeBlockCache(&vm->blockCache);
+
     if (vm->emuMode == EMU_CGB) {
         /* Free memory allocated specifically for CGB */
         free(vm->vramBank);